@@ -0,0 +1,81 @@
+#define DOCTEST_CONFIG_IMPLEMENT
+#include "external/doctest/doctest.h"
+
+#define ANKERL_NANOBENCH_IMPLEMENT
+#include <nanobench.h>
+
+#include <atomic>
+using std::atomic;
+#include <cstdlib>
+using std::free;
+using std::malloc;
+#include <cstring>
+using std::strncmp;
+#include <new>
+using std::bad_alloc;
+
+// The tests and benchmarks are written immediately after the code they test,
+// so they are compiled in to the tests and benchmarks executables, and left out
+// of libmu and the mu executable.
+//
+// The benchmarks are the test cases named "... performance". The benchmarks
+// executable runs only them, without the sanitizers the tests executable uses,
+// and the tests executable runs everything else. Either one accepts the usual
+// doctest options, such as --test-case=<filters>.
+
+// Filters on the command line are combined with the default one, so the
+// benchmarks executable only adds it when there are none.
+static bool HasTestCaseFilter(int argc, char** argv) {
+  for (auto i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--test-case=", 12) == 0 ||
+        strncmp(argv[i], "-tc=", 4) == 0)
+      return true;
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  doctest::Context context;
+
+  context.setOption("no-intro", true);
+  context.setOption("no-version", true);
+#if defined(MU_BENCHMARKS)
+  if (!HasTestCaseFilter(argc, argv))
+    context.addFilter("test-case", "*performance");
+#else
+  context.addFilter("test-case-exclude", "*performance");
+#endif
+
+  context.applyCommandLine(argc, argv);
+
+  return context.run();
+}
+
+// This exposes the current test name inside a TEST_CASE.
+// It is really helpful for benchmarking, as we can name the test case and
+// benchmark the same string, and only write it once. See
+// https://github.com/doctest/doctest/issues/345 for this suggestion.
+// It must be in this file because DOCTEST_CONFIG_IMPLEMENT is here.
+const char* GetCurrentTestName() {
+  return doctest::detail::g_cs->currentTest->m_name;
+}
+
+static atomic<size_t> numberOfAllocations = 0;
+
+size_t GetNumberOfAllocations() { return numberOfAllocations; }
+
+#if !defined(__SANITIZE_ADDRESS__)
+void* operator new(size_t size) {
+  numberOfAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto memory = malloc(size == 0 ? 1 : size))
+    return memory;
+  throw bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+#endif
@@ -1,99 +1,533 @@
-#define DOCTEST_CONFIG_IMPLEMENT
-#include "external/doctest/doctest.h"
+#include <algorithm>
+using std::find;
+using std::min;
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+using std::fclose;
+using std::fflush;
+using std::fopen;
+using std::remove;
+#include <cstdlib>
+using std::getenv;
+using std::strtoul;
+#include <cstring>
+using std::strcmp;
+using std::strlen;
+using std::strncmp;
+#include <exception>
+using std::exception;
+#include <filesystem>
+using std::filesystem::path;
+#include <fstream>
+using std::ifstream;
+#include <memory>
+using std::make_unique;
+using std::unique_ptr;
+#include <string>
+using std::getline;
+using std::string;
+#include <vector>
+using std::vector;
 
-#define ANKERL_NANOBENCH_IMPLEMENT
-#include <nanobench.h>
+#include <signal.h>
 
 #include <fmt/core.h>
+using fmt::format;
 using fmt::print;
 
+#include "mu/Assembler.hpp"
 #include "mu/Bytecode.hpp"
+#include "mu/CompileCache.hpp"
 #include "mu/InstructionProcessor.hpp"
 #include "mu/Loader.hpp"
 #include "mu/Mutext/Parser.hpp"
+#include "mu/Optimizer.hpp"
+#include "mu/ReadOnlyMemoryMappedFile.hpp"
+#include "mu/Server.hpp"
+#include "mu/StreamingExecutor.hpp"
+#include "mu/VerifiedProgram.hpp"
+#include "mu/WorkStealingPool.hpp"
 
 // This is temporary until we have a ret opcode.
 #include "mu/Log.hpp"
 #include "mu/ValueStack.hpp"
 
+// The options that apply to each file.
+struct Options {
+  Engine engine = Engine::Verified;
+  bool optimize = false;
+  bool stream = false;
+
+  // Files are parsed every time when there is no cache.
+  CompileCache* cache = nullptr;
+};
+
+// Files execute on the threads of a pool, so the output of each one is kept
+// until all of them are done, then printed in order.
+struct ProgramResult {
+  int exitCode;
+  string output;
+};
+
 int PrintHelp();
-int RunTests(int argc, char* argv[]);
-int ProcessMutextFile(const char* muFilePath);
-int ProcessBytecodeFile(const char* muFilePath);
+int ProcessFiles(const vector<string>& filePaths, Options options,
+                 size_t numberOfThreads);
+ProgramResult ProcessFile(const string& filePath, Options options);
+ProgramResult ProcessMutextFile(const char* muFilePath, Options options);
+ProgramResult ProcessBytecodeFile(const char* muFilePath, Options options);
+ProgramResult ProcessMutextStream(const char* mutextFilePath, Options options);
+int Execute(span<Instruction> instructions, Options options, string& output,
+            const ProgramAnalysis* analysis);
+int VerifyAndProcess(span<Instruction> instructions, Engine engine,
+                     string& output, const ProgramAnalysis* analysis);
+bool TryReadManifest(const char* manifestPath, vector<string>& filePaths);
+string GetDefaultCacheDirectory();
+int Serve(const char* socketPath, Engine engine, size_t numberOfThreads);
+int Convert(bool assemble, BytecodeFormat bytecodeFormat, bool optimize,
+            const char* inputPath, const char* outputPath);
 
 bool AreEqual(const char* left, const char* right);
 bool StartsWith(const char* haystack, const char* needle);
 bool IsMutextFile(const char* filePath);
 
 int main(int argc, char** argv) {
-  InitializeInstructions();
-  if (argc != 2 || AreEqual(argv[1], "--help")) {
+  if (argc < 2 || AreEqual(argv[1], "--help"))
     return PrintHelp();
-  } else if (AreEqual(argv[1], "--test") ||
-             AreEqual(argv[1], "--list-test-cases") ||
-             StartsWith(argv[1], "--test-case")) {
-    return RunTests(argc, argv);
-  } else if (IsMutextFile(argv[1])) {
-    return ProcessMutextFile(argv[1]);
-  } else {
-    return ProcessBytecodeFile(argv[1]);
+
+  if (AreEqual(argv[1], "assemble") || AreEqual(argv[1], "disassemble")) {
+    auto assemble = AreEqual(argv[1], "assemble");
+    auto bytecodeFormat = BytecodeFormat::Plain;
+    auto optimize = false;
+    auto argumentIndex = 2;
+    for (; assemble && argumentIndex < argc - 2; ++argumentIndex) {
+      if (AreEqual(argv[argumentIndex], "--optimize") && !optimize)
+        optimize = true;
+      else if (AreEqual(argv[argumentIndex], "--compress") &&
+               bytecodeFormat == BytecodeFormat::Plain)
+        bytecodeFormat = BytecodeFormat::Compressed;
+      else if (AreEqual(argv[argumentIndex], "--analyze") &&
+               bytecodeFormat == BytecodeFormat::Plain)
+        bytecodeFormat = BytecodeFormat::Analyzed;
+      else
+        break;
+    }
+    if (argc - argumentIndex != 2) {
+      print("Error: {} needs an input path and an output path.\n", argv[1]);
+      return 1;
+    }
+    return Convert(assemble, bytecodeFormat, optimize, argv[argc - 2],
+                   argv[argc - 1]);
   }
+
+  Options options;
+  auto serve = false;
+  size_t numberOfThreads = 0;
+  auto cacheDirectory = GetDefaultCacheDirectory();
+  auto cacheSize = DefaultCompileCacheSize;
+  vector<string> filePaths;
+  auto argumentIndex = 1;
+  for (; argumentIndex < argc && StartsWith(argv[argumentIndex], "--");
+       argumentIndex++) {
+    if (StartsWith(argv[argumentIndex], "--engine=")) {
+      auto engineName = argv[argumentIndex] + strlen("--engine=");
+      if (!TryGetEngine(engineName, options.engine)) {
+        print("Error: Unknown engine '{}'.\n", engineName);
+        return 1;
+      }
+    } else if (AreEqual(argv[argumentIndex], "--optimize")) {
+      options.optimize = true;
+    } else if (AreEqual(argv[argumentIndex], "--stream")) {
+      options.stream = true;
+    } else if (StartsWith(argv[argumentIndex], "--threads=")) {
+      auto count = argv[argumentIndex] + strlen("--threads=");
+      auto end = count;
+      numberOfThreads = strtoul(count, &end, 10);
+      if (*count == '\0' || *end != '\0' || numberOfThreads == 0) {
+        print("Error: Invalid thread count '{}'.\n", count);
+        return 1;
+      }
+    } else if (StartsWith(argv[argumentIndex], "--cache=")) {
+      cacheDirectory = argv[argumentIndex] + strlen("--cache=");
+    } else if (StartsWith(argv[argumentIndex], "--cache-size=")) {
+      auto megabytes = argv[argumentIndex] + strlen("--cache-size=");
+      auto end = megabytes;
+      errno = 0;
+      auto value = strtoul(megabytes, &end, 10);
+      // A size too big to count in bytes is as invalid as one that is not a
+      // number, rather than wrapping around to a small one.
+      if (*megabytes == '\0' || *end != '\0' || errno == ERANGE ||
+          value > SIZE_MAX / (1024 * 1024)) {
+        print("Error: Invalid cache size '{}'.\n", megabytes);
+        return 1;
+      }
+      cacheSize = value * 1024 * 1024;
+    } else if (AreEqual(argv[argumentIndex], "--no-cache")) {
+      cacheDirectory.clear();
+    } else if (AreEqual(argv[argumentIndex], "--serve")) {
+      serve = true;
+    } else if (StartsWith(argv[argumentIndex], "--manifest=")) {
+      auto manifestPath = argv[argumentIndex] + strlen("--manifest=");
+      if (!TryReadManifest(manifestPath, filePaths)) {
+        print("Error: The manifest '{}' cannot be read.\n", manifestPath);
+        return 1;
+      }
+    } else {
+      print("Error: Unknown option '{}'.\n", argv[argumentIndex]);
+      return 1;
+    }
+  }
+
+  if (serve) {
+    if (argumentIndex != argc - 1) {
+      print("Error: --serve needs one socket path.\n");
+      return 1;
+    }
+    return Serve(argv[argumentIndex], options.engine, numberOfThreads);
+  }
+
+  for (; argumentIndex < argc; argumentIndex++)
+    filePaths.push_back(argv[argumentIndex]);
+
+  if (options.optimize &&
+      (options.stream || find(filePaths.begin(), filePaths.end(), "-") !=
+                             filePaths.end())) {
+    print("Error: Streamed \u03BCtext cannot be optimized.\n");
+    return 1;
+  }
+
+  if (filePaths.empty())
+    return PrintHelp();
+
+  unique_ptr<CompileCache> cache;
+  if (!cacheDirectory.empty()) {
+    cache = make_unique<CompileCache>(cacheDirectory, cacheSize);
+    options.cache = cache.get();
+  }
+  return ProcessFiles(filePaths, options, numberOfThreads);
 }
 
 int PrintHelp() {
   print("===========================================================\n");
   print("Welcome to the \u03BC VM!\n");
   print("\n");
-  print("Usage: mu <options | file.mu | file.mut>\n");
-  print("  - file.mu is a binary \u03BC bytecode file.\n");
-  print("  - file.mut is a text \u03BCtext file.\n");
+  print("Usage: mu [--engine=<name>] [--optimize] [--threads=<count>]\n");
+  print("          <options | files | --manifest=<file>>\n");
+  print("       mu [--engine=<name>] [--threads=<count>] --serve <socket>\n");
+  print("       mu assemble [--optimize] [--compress | --analyze]\n");
+  print("           <file.mut> <file.mu>\n");
+  print("       mu disassemble <file.mu> <file.mut>\n");
+  print("  - Each file is a binary \u03BC bytecode file (file.mu) or a text\n");
+  print("    \u03BCtext file (file.mut). The file - reads \u03BCtext from\n");
+  print("    stdin.\n");
+  print("  - assemble converts \u03BCtext to \u03BC bytecode, and\n");
+  print("    disassemble converts it back. Either path can be - for stdin\n");
+  print("    or stdout. Both stream, so programs of any size use little\n");
+  print("    memory. --compress writes bytecode in compressed blocks, which\n");
+  print("    are decompressed as they are executed. --analyze verifies the\n");
+  print("    program and writes what the verifier found with it, so it is\n");
+  print("    only checked when it is loaded. --optimize optimizes the\n");
+  print("    program before it is written, which reads all of it into\n");
+  print("    memory first.\n");
   print("\n");
   print("Options:\n");
   print("  --help - Display this message.\n");
-  print("  --test - Run \u03BC's tests (if provided, file.mu is ignored).\n");
+  print("  --engine=<name> - Execute with the named engine:\n");
+  print("      verified - Verify first, then skip runtime checks (the\n");
+  print("          default).\n");
+  print("      threaded - Direct-threaded dispatch.\n");
+  print("      loop - One registry lookup per instruction.\n");
+  print("      tailcall - Each handler tail calls the next one.\n");
+  print("      jit - Compile to native code first (x86-64 only).\n");
+  print("      register - Translate to register instructions first.\n");
+  print("      decoded - Decode to handlers that specialize themselves.\n");
+  print("      tiered - Decode first, then compile a program that\n");
+  print("          executes often (x86-64 only).\n");
+  print("  --optimize - Optimize the program before executing it, and\n");
+  print("      report how many instructions were removed.\n");
+  print("  --stream - Execute each \u03BCtext file while it is parsed, a\n");
+  print("      batch of instructions at a time, so it is never all in\n");
+  print("      memory. Programs from stdin are always streamed.\n");
+  print("  --threads=<count> - Execute files on this many threads (the\n");
+  print("      default is one for each core).\n");
+  print("  --cache=<directory> - Keep the bytecode for each \u03BCtext file\n");
+  print("      in this directory, so a file that has not changed is loaded\n");
+  print("      instead of parsed. The default is $XDG_CACHE_HOME/mu or\n");
+  print("      ~/.cache/mu.\n");
+  print("  --cache-size=<megabytes> - Remove the least recently used\n");
+  print("      programs when the cache is bigger than this (the default is\n");
+  print("      1024).\n");
+  print("  --no-cache - Parse every \u03BCtext file.\n");
+  print("  --manifest=<file> - Execute the files listed in the manifest,\n");
+  print("      one per line, relative to the manifest. Blank lines and\n");
+  print("      lines that start with # are skipped.\n");
+  print("  --serve <socket> - Listen on the Unix domain socket and execute\n");
+  print("      each program that is sent to it, until interrupted. See\n");
+  print("      mu/Server.hpp for the protocol.\n");
+  print("\n");
+  print("Files execute in parallel, and their output is reported in the\n");
+  print("order they were given.\n");
+  print("\n");
+  print("Every program is verified before it executes, whichever engine\n");
+  print("executes it.\n");
   print("\n");
   print("Note that file.mu should be a \u03BC bytecode file to execute.\n");
+  print("The tests and benchmarks are in the mu_tests and mu_benchmarks\n");
+  print("executables.\n");
   print("===========================================================\n");
 
   return 0;
 }
 
-int RunTests(int argc, char* argv[]) {
-  doctest::Context context;
+int ProcessFiles(const vector<string>& filePaths, Options options,
+                 size_t numberOfThreads) {
+  vector<ProgramResult> results(filePaths.size());
+  if (filePaths.size() == 1) {
+    results[0] = ProcessFile(filePaths[0], options);
+  } else {
+    if (numberOfThreads == 0)
+      numberOfThreads = WorkStealingPool().GetNumberOfThreads();
+    WorkStealingPool pool(min(numberOfThreads, filePaths.size()));
+    pool.Run(filePaths.size(), [&](size_t i) {
+      results[i] = ProcessFile(filePaths[i], options);
+    });
+  }
+
+  auto exitCode = 0;
+  for (size_t i = 0; i < filePaths.size(); i++) {
+    if (filePaths.size() > 1)
+      print("{}:\n", filePaths[i]);
+    print("{}", results[i].output);
+    if (results[i].exitCode != 0)
+      exitCode = results[i].exitCode;
+  }
+  return exitCode;
+}
+
+ProgramResult ProcessFile(const string& filePath, Options options) {
+  ClearValueStack();
+  try {
+    if (filePath == "-" || (options.stream && IsMutextFile(filePath.c_str())))
+      return ProcessMutextStream(filePath.c_str(), options);
+    if (IsMutextFile(filePath.c_str()))
+      return ProcessMutextFile(filePath.c_str(), options);
+    return ProcessBytecodeFile(filePath.c_str(), options);
+  } catch (const exception& e) {
+    return {1, format("Error: {}\n", e.what())};
+  }
+}
+
+ProgramResult ProcessMutextFile(const char* muFilePath, Options options) {
+  ReadOnlyMemoryMappedFile file(muFilePath);
+  string_view mutext((const char*)file.GetBuffer(), file.GetSize());
+
+  // A program that is in the compile cache is loaded instead of parsed.
+  unique_ptr<Loader> cached;
+  uint64_t key = 0;
+  if (options.cache != nullptr && !mutext.empty()) {
+    key = CompileCache::GetKey({file.GetBuffer(), file.GetSize()});
+    cached = options.cache->Find(key);
+  }
+
+  vector<Instruction> parsed;
+  span<Instruction> instructions;
+  if (cached != nullptr) {
+    instructions = cached->GetInstructions();
+  } else {
+    parsed = ParseMutext(mutext);
+    if (options.cache != nullptr && !parsed.empty())
+      options.cache->Store(key, parsed);
+    instructions = parsed;
+  }
+
+  string output;
+  if (Execute(instructions, options, output, nullptr) != 0)
+    return {1, output};
+  // This is temporary until we have a ret opcode.
+  if (StackSize() > 0)
+    output += FormatLogMessage(format("Top value: {}", Pop()));
+  return {0, output};
+}
 
-  context.setOption("no-intro", true);
-  context.setOption("no-version", true);
-  context.setOption("exit", true);
+ProgramResult ProcessBytecodeFile(const char* muFilePath, Options options) {
+  Loader loader(muFilePath);
+  if (loader.GetNumberOfInstructions() == 0)
+    return {1, format("Error: {}\n", loader.GetErrorMessage())};
 
-  context.applyCommandLine(argc, argv);
+  // A compressed file is optimized once it is decompressed.
+  if (loader.IsCompressed() && options.optimize) {
+    vector<Instruction> instructions;
+    if (!loader.ReadInstructions(instructions))
+      return {1, format("Error: {}\n", loader.GetErrorMessage())};
+    string output;
+    auto exitCode = Execute(instructions, options, output, nullptr);
+    return {exitCode, output};
+  }
 
-  int res = context.run();
+  // A file that is bigger than memory, or compressed, is executed a window at
+  // a time.
+  if (loader.IsWindowed()) {
+    if (options.optimize)
+      return {1, format("Error: The file '{}' is too big to optimize.\n",
+                        muFilePath)};
+    StreamingExecutor executor(options.engine);
+    if (!executor.Execute(loader))
+      return {1, format("Error: {}\n", executor.GetErrorMessage())};
+    return {0, ""};
+  }
 
-  if (context.shouldExit())
-    return res;
-  return 1;
+  string output;
+  auto exitCode =
+      Execute(loader.GetInstructions(), options, output, loader.GetAnalysis());
+  return {exitCode, output};
 }
 
-int ProcessMutextFile(const char* muFilePath) {
-  auto instructions = ParseMutextFile(muFilePath);
-  Process(instructions);
+ProgramResult ProcessMutextStream(const char* mutextFilePath, Options options) {
+  auto readStdin = AreEqual(mutextFilePath, "-");
+  auto mutext = readStdin ? stdin : fopen(mutextFilePath, "rb");
+  if (mutext == nullptr)
+    return {1, format("Error: The \u03BCtext file '{}' cannot be read.\n",
+                      mutextFilePath)};
+
+  StreamingExecutor executor(options.engine);
+  auto executed = executor.Execute(mutext);
+  if (!readStdin)
+    fclose(mutext);
+  if (!executed)
+    return {1, format("Error: {}\n", executor.GetErrorMessage())};
+
   // This is temporary until we have a ret opcode.
+  string output;
   if (StackSize() > 0)
-    Log("Top value: {}", Pop());
+    output += FormatLogMessage(format("Top value: {}", Pop()));
+  return {0, output};
+}
+
+// The analysis of a program from an analyzed file does not apply to it once
+// it is optimized.
+int Execute(span<Instruction> instructions, Options options, string& output,
+            const ProgramAnalysis* analysis) {
+  if (options.optimize) {
+    Optimizer optimizer(instructions);
+    output += optimizer.GetReport();
+    return VerifyAndProcess(optimizer.GetInstructions(), options.engine,
+                            output, nullptr);
+  }
+
+  return VerifyAndProcess(instructions, options.engine, output, analysis);
+}
+
+int VerifyAndProcess(span<Instruction> instructions, Engine engine,
+                     string& output, const ProgramAnalysis* analysis) {
+  auto program = analysis != nullptr ? VerifiedProgram(instructions, *analysis)
+                                     : VerifiedProgram(instructions);
+  if (!program.IsVerified()) {
+    output += format("Error: {}\n", program.GetErrorMessage());
+    return 1;
+  }
+
+  if (engine == Engine::Verified)
+    program.Execute();
+  else
+    Process(instructions, engine);
   return 0;
 }
 
-int ProcessBytecodeFile(const char* muFilePath) {
-  Loader loader(muFilePath);
-  if (loader.GetInstructions().size() == 0) {
-    print("Error: {}\n", loader.GetErrorMessage());
+bool TryReadManifest(const char* manifestPath, vector<string>& filePaths) {
+  ifstream manifest(manifestPath);
+  if (!manifest)
+    return false;
+
+  auto directory = path(manifestPath).parent_path();
+  string line;
+  while (getline(manifest, line)) {
+    auto begin = line.find_first_not_of(" \t\r");
+    if (begin == string::npos || line[begin] == '#')
+      continue;
+    auto end = line.find_last_not_of(" \t\r");
+    filePaths.push_back(
+        (directory / line.substr(begin, end - begin + 1)).string());
+  }
+  return true;
+}
+
+string GetDefaultCacheDirectory() {
+  if (auto cacheHome = getenv("XDG_CACHE_HOME"); cacheHome && *cacheHome)
+    return (path(cacheHome) / "mu").string();
+  if (auto home = getenv("HOME"); home && *home)
+    return (path(home) / ".cache" / "mu").string();
+  return "";
+}
+
+static Server* runningServer = nullptr;
+
+static void StopServer(int) { runningServer->Stop(); }
+
+int Serve(const char* socketPath, Engine engine, size_t numberOfThreads) {
+  Server server(socketPath, engine, numberOfThreads);
+  if (!server.IsListening()) {
+    print("Error: {}\n", server.GetErrorMessage());
     return 1;
   }
 
-  Process(loader.GetInstructions());
+  runningServer = &server;
+  struct sigaction action = {};
+  action.sa_handler = StopServer;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  Log(format("Serving on '{}'.", socketPath));
+  fflush(stdout);
+  server.Serve();
+  Log(format("Served {} requests.", server.GetNumberOfRequests()));
   return 0;
 }
 
+int Convert(bool assemble, BytecodeFormat bytecodeFormat, bool optimize,
+            const char* inputPath, const char* outputPath) {
+  auto readStdin = AreEqual(inputPath, "-");
+  auto writeStdout = AreEqual(outputPath, "-");
+  auto input = readStdin ? stdin : fopen(inputPath, "rb");
+  if (input == nullptr) {
+    print(stderr, "Error: The file '{}' cannot be read.\n", inputPath);
+    return 1;
+  }
+  auto output = writeStdout ? stdout : fopen(outputPath, "wb");
+  if (output == nullptr) {
+    print(stderr, "Error: The file '{}' cannot be written.\n", outputPath);
+    if (!readStdin)
+      fclose(input);
+    return 1;
+  }
+
+  auto exitCode = 0;
+  size_t numberOfInstructions = 0;
+  try {
+    numberOfInstructions =
+        assemble ? Assemble(input, output, bytecodeFormat, optimize)
+                 : Disassemble(input, output);
+  } catch (const exception& e) {
+    print(stderr, "Error: {}\n", e.what());
+    exitCode = 1;
+  }
+
+  if (!readStdin)
+    fclose(input);
+  if (!writeStdout && fclose(output) != 0 && exitCode == 0) {
+    print(stderr, "Error: The file '{}' cannot be written.\n", outputPath);
+    exitCode = 1;
+  }
+
+  // A partly written file is removed, so it is never mistaken for a program.
+  if (exitCode != 0 && !writeStdout)
+    remove(outputPath);
+  else if (!writeStdout)
+    Log(format("{} {} instructions to '{}'.",
+               assemble ? "Assembled" : "Disassembled", numberOfInstructions,
+               outputPath));
+  return exitCode;
+}
+
 bool AreEqual(const char* left, const char* right) {
   return strcmp(left, right) == 0;
 }
@@ -105,12 +539,3 @@ bool StartsWith(const char* haystack, const char* needle) {
 bool IsMutextFile(const char* filePath) {
   return string(filePath).ends_with(".mut");
 }
-
-// This exposes the current test name inside a TEST_CASE.
-// It is really helpful for benchmarking, as we can name the test case and
-// benchmark the same string, and only write it once. See
-// https://github.com/doctest/doctest/issues/345 for this suggestion.
-// It must be in this file because DOCTEST_CONFIG_IMPLEMENT is here.
-const char* GetCurrentTestName() {
-  return doctest::detail::g_cs->currentTest->m_name;
-}
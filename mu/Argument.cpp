@@ -1,6 +1,11 @@
 #include "Configuration.hpp"
 
 #include <cassert>
+#include <cmath>
+using std::isnan;
+using std::signbit;
+#include <cstring>
+using std::memcmp;
 #include <limits>
 using std::numeric_limits;
 
@@ -8,9 +13,40 @@ using std::numeric_limits;
 using fmt::format;
 
 #include "Argument.hpp"
+#include "Bytecode.hpp"
 
-ArgumentType Argument::Type() const { return m_Type; }
+#if defined(MU_NAN_BOXING)
+int32_t Argument::i32() const {
+  assert(Type() == ArgumentType::i32);
+  return (int32_t)(uint32_t)m_Bits;
+}
+
+// The 48 bits of the value are sign extended.
+int64_t Argument::i64() const {
+  assert(Type() == ArgumentType::i64);
+  return (int64_t)(m_Bits << 16) >> 16;
+}
 
+float Argument::f32() const {
+  assert(Type() == ArgumentType::f32);
+  return bit_cast<float>((uint32_t)m_Bits);
+}
+
+double Argument::f64() const {
+  assert(Type() == ArgumentType::f64);
+  return bit_cast<double>(m_Bits);
+}
+
+bool Argument::b() const {
+  assert(Type() == ArgumentType::b);
+  return (m_Bits & 1) != 0;
+}
+
+char Argument::c() const {
+  assert(Type() == ArgumentType::c);
+  return (char)(uint8_t)m_Bits;
+}
+#else
 int32_t Argument::i32() const {
   assert(m_Type == ArgumentType::i32);
   return m_Data.i32;
@@ -40,6 +76,7 @@ char Argument::c() const {
   assert(m_Type == ArgumentType::c);
   return m_Data.c;
 }
+#endif
 
 bool operator==(const Argument& left, const Argument& right) {
   if (left.Type() != right.Type())
@@ -98,7 +135,7 @@ TEST_CASE("Verify argument behavior") {
   }
 
   SUBCASE("Can get the value of a 64-bit integer") {
-    const int64_t expected = numeric_limits<int64_t>::max() - 2;
+    const int64_t expected = MaximumI64Argument - 2;
     Argument entry(expected);
     CHECK(entry.i64() == expected);
   }
@@ -279,4 +316,71 @@ TEST_CASE("Verify argument behavior") {
     Argument argument('a');
     CHECK("a (char)" == format("{}", argument));
   }
+
+  SUBCASE("Every type keeps the extremes of its values") {
+    CHECK(Argument(numeric_limits<int32_t>::min()).i32() ==
+          numeric_limits<int32_t>::min());
+    CHECK(Argument(MinimumI64Argument).i64() == MinimumI64Argument);
+    CHECK(Argument((int64_t)-1).i64() == -1);
+    CHECK(Argument(numeric_limits<float>::lowest()).f32() ==
+          numeric_limits<float>::lowest());
+    CHECK(Argument(-numeric_limits<double>::infinity()).f64() ==
+          -numeric_limits<double>::infinity());
+    CHECK(signbit(Argument(-0.0).f64()));
+    CHECK(Argument('\xFF').c() == '\xFF');
+    CHECK_FALSE(Argument(false).b());
+  }
+
+  SUBCASE("A NaN is an f64") {
+    Argument argument(-numeric_limits<double>::quiet_NaN());
+    CHECK(argument.Type() == ArgumentType::f64);
+    CHECK(isnan(argument.f64()));
+    CHECK(argument != argument);
+  }
+
+  SUBCASE("An argument can be rebuilt from its type and its bits") {
+    const Argument arguments[] = {
+        42, MinimumI64Argument, -1.5f, 2.5, true, 'a', Argument()};
+    for (auto argument : arguments)
+      CHECK(Argument::FromBits(argument.Type(), argument.Bits()) == argument);
+  }
+
+  SUBCASE("A value can be read from the bits of its argument") {
+    CHECK(GetValueFromBits<ArgumentType::i32>(Argument(-42).Bits()) == -42);
+    CHECK(GetValueFromBits<ArgumentType::i64>(
+              Argument(MinimumI64Argument).Bits()) == MinimumI64Argument);
+    CHECK(GetValueFromBits<ArgumentType::f32>(Argument(-1.5f).Bits()) == -1.5f);
+    CHECK(GetValueFromBits<ArgumentType::f64>(Argument(2.5).Bits()) == 2.5);
+  }
+
+#if !defined(MU_NAN_BOXING)
+  SUBCASE("The bits a value does not use are zero") {
+    CHECK(Argument().Bits() == 0);
+    CHECK(Argument(-1).Bits() == 0xFFFFFFFF);
+    CHECK(Argument(-1.5f).Bits() == bit_cast<uint32_t>(-1.5f));
+    CHECK(Argument(true).Bits() == 1);
+    CHECK(Argument('a').Bits() == 'a');
+  }
+#endif
+}
+
+#if defined(MU_NAN_BOXING)
+TEST_CASE("Verify NaN-boxed argument behavior") {
+  SUBCASE("An argument is one 64-bit word") {
+    CHECK(sizeof(Argument) == sizeof(uint64_t));
+    CHECK(sizeof(Instruction) == 2 * sizeof(uint64_t));
+  }
+
+  SUBCASE("An i64 wraps around at 48 bits") {
+    CHECK(Argument(MaximumI64Argument + 1).i64() == MinimumI64Argument);
+    CHECK(Argument(MinimumI64Argument - 1).i64() == MaximumI64Argument);
+  }
+
+  SUBCASE("Every NaN is the same f64") {
+    auto negative = Argument(-numeric_limits<double>::quiet_NaN());
+    auto signaling = Argument(numeric_limits<double>::signaling_NaN());
+    CHECK(memcmp(&negative, &signaling, sizeof(Argument)) == 0);
+    CHECK_FALSE(signbit(negative.f64()));
+  }
 }
+#endif
@@ -1,13 +1,113 @@
 #pragma once
 
+#include <bit>
+using std::bit_cast;
 #include <cassert>
 #include <cstdint>
+#include <limits>
+using std::numeric_limits;
 
 #include <fmt/core.h>
 #include <fmt/format.h>
 
 enum class ArgumentType { None, i64, i32, f32, f64, b, c };
 
+// Tables indexed by argument type use this size, so keep it in sync with the
+// last entry in ArgumentType.
+constexpr size_t NumberOfArgumentTypes = (size_t)ArgumentType::c + 1;
+
+// Packs the types of the operands of a binary operation in to one byte, so both
+// can be tested at once.
+constexpr uint8_t PackOperandTypes(ArgumentType left, ArgumentType right) {
+  return (uint8_t)((size_t)left << 4 | (size_t)right);
+}
+
+// == Representation ==
+//
+// By default an argument is its type and an eight byte union of the values, so
+// it takes 16 bytes, and an instruction takes 24. A build with MU_NAN_BOXING
+// packs the type and the value of an argument in to one 64-bit word instead,
+// which halves the size of every value on the stack and of each instruction.
+//
+// A NaN-boxed f64 is its own bits. Every other type is boxed in a negative
+// quiet NaN: the top 16 bits are NaNBoxTag plus the type, and the value is in
+// the low 48 bits. An f64 NaN is always stored as the same positive quiet NaN,
+// so no f64 is mistaken for a boxed value. Only its sign and payload are lost.
+//
+// An i64 has to fit in 48 bits, so a NaN-boxed i64 is a 48-bit integer. The
+// parser rejects i64 values outside of MinimumI64Argument and
+// MaximumI64Argument, and i64 arithmetic wraps around at 48 bits, just as it
+// does at 64 bits in the default build. Columns (see Column.hpp) still hold
+// full 64-bit values, which wrap when a row is read as an argument.
+//
+// Bytecode files hold instructions as they are in memory, so a build with
+// MU_NAN_BOXING reads and writes its own kind of bytecode (see Loader.hpp).
+
+#if defined(MU_NAN_BOXING)
+constexpr int64_t MaximumI64Argument = (1ll << 47) - 1;
+constexpr int64_t MinimumI64Argument = -(1ll << 47);
+
+struct Argument {
+  constexpr Argument() : m_Bits(Box(ArgumentType::None, 0)) {}
+
+  constexpr Argument(int32_t value)
+      : m_Bits(Box(ArgumentType::i32, (uint32_t)value)) {}
+
+  constexpr Argument(int64_t value)
+      : m_Bits(Box(ArgumentType::i64, (uint64_t)value & PayloadMask)) {}
+
+  constexpr Argument(float value)
+      : m_Bits(Box(ArgumentType::f32, bit_cast<uint32_t>(value))) {}
+
+  constexpr Argument(double value)
+      : m_Bits(value != value ? CanonicalNaN : bit_cast<uint64_t>(value)) {}
+
+  constexpr Argument(bool value) : m_Bits(Box(ArgumentType::b, value)) {}
+
+  constexpr Argument(char value)
+      : m_Bits(Box(ArgumentType::c, (uint8_t)value)) {}
+
+  // Every f64 is less than the first boxed value, since its NaNs are positive.
+  ArgumentType Type() const {
+    auto tag = m_Bits >> 48;
+    if (tag < NaNBoxTag)
+      return ArgumentType::f64;
+    return (ArgumentType)(tag - NaNBoxTag);
+  }
+
+  // The value stack (see ValueStack.hpp) keeps the types of its entries apart
+  // from the bits of their values. A NaN-boxed argument is all bits, so its
+  // type is only a copy of the one in the bits.
+  uint64_t Bits() const { return m_Bits; }
+
+  static Argument FromBits(ArgumentType, uint64_t bits) {
+    Argument argument;
+    argument.m_Bits = bits;
+    return argument;
+  }
+
+  int64_t i64() const;
+  int32_t i32() const;
+  float f32() const;
+  double f64() const;
+  bool b() const;
+  char c() const;
+
+private:
+  static constexpr uint64_t NaNBoxTag = 0xFFF8;
+  static constexpr uint64_t PayloadMask = (1ull << 48) - 1;
+  static constexpr uint64_t CanonicalNaN = 0x7FF8000000000000;
+
+  static constexpr uint64_t Box(ArgumentType type, uint64_t payload) {
+    return (NaNBoxTag + (uint64_t)type) << 48 | payload;
+  }
+
+  uint64_t m_Bits;
+};
+#else
+constexpr int64_t MaximumI64Argument = numeric_limits<int64_t>::max();
+constexpr int64_t MinimumI64Argument = numeric_limits<int64_t>::min();
+
 union ArgumentData {
   int64_t i64;
   int32_t i32;
@@ -18,29 +118,46 @@ union ArgumentData {
 };
 
 struct Argument {
-  constexpr Argument() : m_Type(ArgumentType::None) {}
+  // The data is zeroed before the value is stored, so the bytes a narrower
+  // value does not use are zero in Bits() and in written bytecode.
+  constexpr Argument() : m_Type(ArgumentType::None), m_Data{.i64 = 0} {}
 
-  constexpr Argument(int32_t value) : m_Type(ArgumentType::i32) {
+  constexpr Argument(int32_t value)
+      : m_Type(ArgumentType::i32), m_Data{.i64 = 0} {
     m_Data.i32 = value;
   }
 
-  constexpr Argument(int64_t value) : m_Type(ArgumentType::i64) {
-    m_Data.i64 = value;
-  }
+  constexpr Argument(int64_t value)
+      : m_Type(ArgumentType::i64), m_Data{.i64 = value} {}
 
-  constexpr Argument(float value) : m_Type(ArgumentType::f32) {
+  constexpr Argument(float value)
+      : m_Type(ArgumentType::f32), m_Data{.i64 = 0} {
     m_Data.f32 = value;
   }
 
-  constexpr Argument(double value) : m_Type(ArgumentType::f64) {
-    m_Data.f64 = value;
+  constexpr Argument(double value)
+      : m_Type(ArgumentType::f64), m_Data{.f64 = value} {}
+
+  constexpr Argument(bool value) : m_Type(ArgumentType::b), m_Data{.i64 = 0} {
+    m_Data.b = value;
+  }
+
+  constexpr Argument(char value) : m_Type(ArgumentType::c), m_Data{.i64 = 0} {
+    m_Data.c = value;
   }
 
-  constexpr Argument(bool value) : m_Type(ArgumentType::b) { m_Data.b = value; }
+  ArgumentType Type() const { return m_Type; }
 
-  constexpr Argument(char value) : m_Type(ArgumentType::c) { m_Data.c = value; }
+  // The value stack (see ValueStack.hpp) keeps the types of its entries apart
+  // from the bits of their values.
+  uint64_t Bits() const { return bit_cast<uint64_t>(m_Data); }
 
-  ArgumentType Type() const;
+  static Argument FromBits(ArgumentType type, uint64_t bits) {
+    Argument argument;
+    argument.m_Type = type;
+    argument.m_Data = bit_cast<ArgumentData>(bits);
+    return argument;
+  }
 
   int64_t i64() const;
   int32_t i32() const;
@@ -53,6 +170,32 @@ private:
   ArgumentType m_Type;
   ArgumentData m_Data;
 };
+#endif
+
+// Reads a value of the given type from the bits of an argument, as the argument
+// would return it.
+template <ArgumentType type> auto GetValueFromBits(uint64_t bits) {
+#if defined(MU_NAN_BOXING)
+  if constexpr (type == ArgumentType::i32)
+    return (int32_t)(uint32_t)bits;
+  else if constexpr (type == ArgumentType::i64)
+    return (int64_t)(bits << 16) >> 16;
+  else if constexpr (type == ArgumentType::f32)
+    return bit_cast<float>((uint32_t)bits);
+  else
+    return bit_cast<double>(bits);
+#else
+  auto data = bit_cast<ArgumentData>(bits);
+  if constexpr (type == ArgumentType::i32)
+    return data.i32;
+  else if constexpr (type == ArgumentType::i64)
+    return data.i64;
+  else if constexpr (type == ArgumentType::f32)
+    return data.f32;
+  else
+    return data.f64;
+#endif
+}
 
 bool operator==(const Argument& left, const Argument& right);
 
@@ -0,0 +1,720 @@
+#include "Configuration.hpp"
+
+#include <algorithm>
+using std::max;
+using std::min;
+#include <cstdint>
+#include <cstring>
+using std::memcmp;
+using std::memcpy;
+using std::memset;
+#include <iterator>
+using std::back_inserter;
+#include <limits>
+using std::numeric_limits;
+#include <new>
+#include <stdexcept>
+using std::runtime_error;
+#include <string>
+using std::string;
+
+#include <fmt/format.h>
+using fmt::format;
+using fmt::format_to;
+using fmt::memory_buffer;
+
+#include "Assembler.hpp"
+#include "Compression.hpp"
+#include "Loader.hpp"
+#include "Mutext/Parser.hpp"
+#include "Optimizer.hpp"
+#include "VerifiedProgram.hpp"
+
+// == Assembler ==
+//
+// Programs are written as μtext, but production loads μ bytecode, which the
+// loader maps straight in to memory. The assembler converts μtext to bytecode,
+// and the disassembler converts bytecode back to μtext.
+//
+// Both of them stream. The assembler parses a batch of lines at a time with
+// ParseMutextStream and writes each batch through a BytecodeWriter, and the
+// disassembler reads a block of instructions at a time, so a program of any
+// size converts in the same small amount of memory.
+//
+// The padding bytes in the bytecode are written as zero, so a program always
+// assembles to the same bytes, and compresses well.
+
+static const size_t BatchSize = 4096;
+static const size_t InstructionsPerAnalyzedBlock = 65536;
+
+// Only the bytes of the value are written to the copy, so the rest of it stays
+// zero.
+static void CopyInstruction(const Instruction& instruction, Instruction& copy) {
+  memset((void*)&copy, 0, sizeof(copy));
+  copy.opCode = instruction.opCode;
+  auto& argument = instruction.argument;
+  switch (argument.Type()) {
+  case ArgumentType::i32:
+    new (&copy.argument) Argument(argument.i32());
+    break;
+  case ArgumentType::i64:
+    new (&copy.argument) Argument(argument.i64());
+    break;
+  case ArgumentType::f32:
+    new (&copy.argument) Argument(argument.f32());
+    break;
+  case ArgumentType::f64:
+    new (&copy.argument) Argument(argument.f64());
+    break;
+  case ArgumentType::b:
+    new (&copy.argument) Argument(argument.b());
+    break;
+  case ArgumentType::c:
+    new (&copy.argument) Argument(argument.c());
+    break;
+  default:
+    new (&copy.argument) Argument();
+    break;
+  }
+}
+
+BytecodeWriter::BytecodeWriter(FILE* bytecode, BytecodeFormat format)
+    : m_bytecode(bytecode), m_format(format),
+      m_buffer(format == BytecodeFormat::Compressed
+                   ? InstructionsPerCompressedBlock
+                   : BatchSize),
+      m_numberOfBufferedInstructions(0), m_numberOfInstructions(0),
+      m_offset(0), m_operandTypes(nullptr), m_maximumStackDepth(0) {
+  auto magic = Loader::MuMagicHeader;
+  if (format == BytecodeFormat::Compressed)
+    magic = Loader::MuCompressedMagicHeader;
+  else if (format == BytecodeFormat::Analyzed)
+    magic = Loader::MuAnalyzedMagicHeader;
+  if (format == BytecodeFormat::Analyzed &&
+      (m_operandTypes = tmpfile()) == nullptr)
+    throw runtime_error("The analysis of the bytecode cannot be written.");
+  WriteBytes(&magic, sizeof(magic));
+}
+
+BytecodeWriter::~BytecodeWriter() {
+  if (m_operandTypes != nullptr)
+    fclose(m_operandTypes);
+}
+
+void BytecodeWriter::Write(span<const Instruction> instructions) {
+  for (auto& instruction : instructions) {
+    if (m_numberOfBufferedInstructions == m_buffer.size())
+      Flush();
+    CopyInstruction(instruction, m_buffer[m_numberOfBufferedInstructions++]);
+  }
+  m_numberOfInstructions += instructions.size();
+}
+
+void BytecodeWriter::Flush() {
+  auto count = m_numberOfBufferedInstructions;
+  m_numberOfBufferedInstructions = 0;
+  auto instructions = as_bytes(span(m_buffer).first(count));
+  if (m_format == BytecodeFormat::Analyzed)
+    Analyze(span(m_buffer).first(count));
+  if (m_format != BytecodeFormat::Compressed) {
+    WriteBytes(instructions.data(), instructions.size());
+  } else if (count > 0) {
+    m_compressedBlock.clear();
+    CompressBlock(instructions, m_compressedBlock);
+    CompressedBlockHeader header{(uint32_t)m_compressedBlock.size(),
+                                 (uint32_t)count};
+    m_blockOffsets.push_back(m_offset);
+    WriteBytes(&header, sizeof(header));
+    WriteBytes(m_compressedBlock.data(), m_compressedBlock.size());
+  }
+  if (fflush(m_bytecode) != 0)
+    throw runtime_error("The bytecode cannot be written.");
+}
+
+void BytecodeWriter::Finish() {
+  Flush();
+  if (m_format == BytecodeFormat::Compressed) {
+    CompressedBlockHeader end{0, 0};
+    WriteBytes(&end, sizeof(end));
+    CompressedTrailer trailer{m_offset, m_numberOfInstructions};
+    WriteBytes(m_blockOffsets.data(),
+               m_blockOffsets.size() * sizeof(uint64_t));
+    WriteBytes(&trailer, sizeof(trailer));
+  } else if (m_format == BytecodeFormat::Analyzed) {
+    WriteAnalysis();
+  }
+  if (fflush(m_bytecode) != 0)
+    throw runtime_error("The bytecode cannot be written.");
+}
+
+size_t BytecodeWriter::GetNumberOfInstructions() const {
+  return m_numberOfInstructions;
+}
+
+// Each batch is verified from the types the batches before it left on the
+// stack, and only replaces the types of the values it pops, so a deep stack
+// takes no longer to analyze than a shallow one. A block boundary is recorded
+// where the stack is empty, once a block is long enough to be worth checking on
+// a thread of its own.
+void BytecodeWriter::Analyze(span<Instruction> instructions) {
+  auto firstIndex =
+      (m_offset - sizeof(Loader::MuAnalyzedMagicHeader)) / sizeof(Instruction);
+  VerifiedProgram program(instructions, m_stackTypes, firstIndex);
+  if (!program.IsVerified())
+    throw runtime_error(program.GetErrorMessage());
+
+  auto operandTypes = program.GetOperandTypes();
+  if (fwrite(operandTypes.data(), 1, operandTypes.size(), m_operandTypes) !=
+      operandTypes.size())
+    throw runtime_error("The analysis of the bytecode cannot be written.");
+
+  auto depth = m_stackTypes.size();
+  auto lastBoundary = m_blockBoundaries.empty() ? 0 : m_blockBoundaries.back();
+  for (size_t i = 0; i < instructions.size(); i++) {
+    auto index = firstIndex + i;
+    if (depth == 0 && index >= lastBoundary + InstructionsPerAnalyzedBlock) {
+      m_blockBoundaries.push_back(index);
+      lastBoundary = index;
+    }
+    if (instructions[i].opCode == OpCode::Push)
+      depth++;
+    else
+      depth--;
+  }
+
+  // The program's own stack starts below its inputs.
+  auto base = m_stackTypes.size() - program.GetNumberOfInputs();
+  m_maximumStackDepth =
+      max(m_maximumStackDepth, base + program.GetMaximumStackDepth());
+  auto resultTypes = program.GetResultTypes();
+  m_stackTypes.resize(base);
+  m_stackTypes.insert(m_stackTypes.end(), resultTypes.begin(),
+                      resultTypes.end());
+}
+
+void BytecodeWriter::WriteAnalysis() {
+  auto headerSize = sizeof(Loader::MuAnalyzedMagicHeader);
+  SectionEntry sections[] = {
+      {(uint32_t)SectionKind::Code, 0, headerSize,
+       m_numberOfInstructions * sizeof(Instruction)},
+      {(uint32_t)SectionKind::OperandTypes, 0, 0, m_numberOfInstructions},
+      {(uint32_t)SectionKind::BlockBoundaries, 0, 0,
+       m_blockBoundaries.size() * sizeof(uint64_t)}};
+
+  WritePadding();
+  sections[1].offset = m_offset;
+  rewind(m_operandTypes);
+  char buffer[BatchSize];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), m_operandTypes)) > 0)
+    WriteBytes(buffer, size);
+  if (ferror(m_operandTypes) || m_offset != sections[1].offset +
+                                                m_numberOfInstructions)
+    throw runtime_error("The analysis of the bytecode cannot be read.");
+
+  WritePadding();
+  sections[2].offset = m_offset;
+  WriteBytes(m_blockBoundaries.data(), sections[2].size);
+
+  AnalyzedFooter footer{MuFormatVersion,
+                        BytecodeVersion,
+                        m_numberOfInstructions,
+                        m_maximumStackDepth,
+                        m_offset,
+                        std::size(sections)};
+  WriteBytes(sections, sizeof(sections));
+  WriteBytes(&footer, sizeof(footer));
+}
+
+void BytecodeWriter::WriteBytes(const void* data, size_t size) {
+  if (size > 0 && fwrite(data, 1, size, m_bytecode) != size)
+    throw runtime_error("The bytecode cannot be written.");
+  m_offset += size;
+}
+
+// Each section starts on an eight byte boundary, so the loader can use it
+// where it is mapped.
+void BytecodeWriter::WritePadding() {
+  uint64_t zero = 0;
+  WriteBytes(&zero, (sizeof(zero) - m_offset % sizeof(zero)) % sizeof(zero));
+}
+
+size_t Assemble(FILE* mutext, FILE* bytecode, BytecodeFormat format,
+                bool optimize) {
+  BytecodeWriter writer(bytecode, format);
+  if (optimize) {
+    // The optimizer works on the whole program, so it is parsed before any of
+    // it is written.
+    vector<Instruction> instructions;
+    ParseMutextStream(mutext, BatchSize, [&](vector<Instruction> batch) {
+      instructions.insert(instructions.end(), batch.begin(), batch.end());
+      return true;
+    });
+    Optimizer optimizer(instructions);
+    writer.Write(optimizer.GetInstructions());
+  } else {
+    ParseMutextStream(mutext, BatchSize, [&](vector<Instruction> batch) {
+      writer.Write(batch);
+      return true;
+    });
+  }
+  writer.Finish();
+  return writer.GetNumberOfInstructions();
+}
+
+static bool IsMutextWhitespace(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static void AppendMutext(const Instruction& instruction, size_t index,
+                         memory_buffer& mutext) {
+  if ((size_t)instruction.opCode >= NumberOfOpCodes)
+    throw runtime_error(format("Instruction {} has the unknown opcode {}.",
+                               index, (int)instruction.opCode));
+
+  auto name = GetInstructionMetadata(instruction.opCode).name;
+  auto& argument = instruction.argument;
+  auto type = argument.Type();
+  if (instruction.opCode != OpCode::Push) {
+    if (type != ArgumentType::None)
+      throw runtime_error(format("Instruction {} is {} with an argument, which "
+                                 "\u03BCtext cannot represent.",
+                                 index, name));
+    format_to(back_inserter(mutext), "{}\n", name);
+    return;
+  }
+
+  if (type == ArgumentType::None || (size_t)type >= NumberOfArgumentTypes)
+    throw runtime_error(
+        format("Instruction {} is Push without an argument.", index));
+  if (type == ArgumentType::c && IsMutextWhitespace(argument.c()))
+    throw runtime_error(format("Instruction {} pushes a whitespace character, "
+                               "which \u03BCtext cannot represent.",
+                               index));
+
+  // The floating point values are written with the fewest digits that parse
+  // back to the same value.
+  auto out = back_inserter(mutext);
+  format_to(out, "Push {}:", GetArgumentTypeTag(type));
+  if (type == ArgumentType::i32)
+    format_to(out, "{}\n", argument.i32());
+  else if (type == ArgumentType::i64)
+    format_to(out, "{}\n", argument.i64());
+  else if (type == ArgumentType::f32)
+    format_to(out, "{}\n", argument.f32());
+  else if (type == ArgumentType::f64)
+    format_to(out, "{}\n", argument.f64());
+  else if (type == ArgumentType::b)
+    format_to(out, "{}\n", argument.b());
+  else
+    format_to(out, "{}\n", argument.c());
+}
+
+static void WriteMutext(span<const Instruction> instructions,
+                        size_t& numberOfInstructions, memory_buffer& text,
+                        FILE* mutext) {
+  text.clear();
+  for (auto& instruction : instructions)
+    AppendMutext(instruction, numberOfInstructions++, text);
+  if (fwrite(text.data(), 1, text.size(), mutext) != text.size())
+    throw runtime_error("The \u03BCtext cannot be written.");
+}
+
+// The blocks are read in order until the empty block header that ends them,
+// so the block index is not needed, and the bytecode can come from a pipe.
+static void DisassembleBlocks(FILE* bytecode, FILE* mutext,
+                              size_t& numberOfInstructions) {
+  vector<byte> compressed;
+  vector<Instruction> instructions;
+  memory_buffer text;
+  for (size_t block = 0;; block++) {
+    CompressedBlockHeader header;
+    if (fread(&header, sizeof(header), 1, bytecode) != 1)
+      throw runtime_error("The bytecode ends part way through a block.");
+    if (header.compressedSize == 0 && header.numberOfInstructions == 0)
+      return;
+    if (header.numberOfInstructions > InstructionsPerCompressedBlock)
+      throw runtime_error("The bytecode is not valid Mu bytecode.");
+
+    compressed.resize(header.compressedSize);
+    if (fread(compressed.data(), 1, compressed.size(), bytecode) !=
+        compressed.size())
+      throw runtime_error("The bytecode ends part way through a block.");
+    instructions.resize(header.numberOfInstructions);
+    if (!DecompressBlock(compressed, as_writable_bytes(span(instructions))))
+      throw runtime_error(
+          format("Block {} of the bytecode is not valid.", block));
+    WriteMutext(instructions, numberOfInstructions, text, mutext);
+  }
+}
+
+// The code of an analyzed file is found from its section table, which is at
+// the end of the file, so the file has to be seekable. Returns the number of
+// instructions, and leaves the file at the first of them.
+static uint64_t SeekToCode(FILE* bytecode) {
+  AnalyzedFooter footer;
+  if (fseeko(bytecode, -(off_t)sizeof(footer), SEEK_END) != 0)
+    throw runtime_error(
+        "Analyzed bytecode cannot be disassembled from a pipe.");
+  if (fread(&footer, sizeof(footer), 1, bytecode) != 1)
+    throw runtime_error("The bytecode cannot be read.");
+  if (footer.formatVersion != MuFormatVersion ||
+      footer.bytecodeVersion != BytecodeVersion)
+    throw runtime_error(
+        "The bytecode was written by a different version of the VM.");
+
+  if (fseeko(bytecode, footer.sectionTableOffset, SEEK_SET) != 0)
+    throw runtime_error("The bytecode is not valid Mu bytecode.");
+  for (uint64_t i = 0; i < footer.numberOfSections; i++) {
+    SectionEntry section;
+    if (fread(&section, sizeof(section), 1, bytecode) != 1)
+      throw runtime_error("The bytecode is not valid Mu bytecode.");
+    if (section.kind != (uint32_t)SectionKind::Code)
+      continue;
+    if (section.size / sizeof(Instruction) != footer.numberOfInstructions ||
+        fseeko(bytecode, section.offset, SEEK_SET) != 0)
+      break;
+    return footer.numberOfInstructions;
+  }
+  throw runtime_error("The bytecode is not valid Mu bytecode.");
+}
+
+size_t Disassemble(FILE* bytecode, FILE* mutext) {
+  uint32_t magic = 0;
+  char header[sizeof(Loader::MuMagicHeader)];
+  if (fread(header, sizeof(header), 1, bytecode) == 1)
+    memcpy(&magic, header, sizeof(magic));
+  if (magic != Loader::MuMagicHeader &&
+      magic != Loader::MuCompressedMagicHeader &&
+      magic != Loader::MuAnalyzedMagicHeader)
+    throw runtime_error("The bytecode is not valid Mu bytecode.");
+
+  size_t numberOfInstructions = 0;
+  if (magic == Loader::MuCompressedMagicHeader)
+    DisassembleBlocks(bytecode, mutext, numberOfInstructions);
+
+  // Plain bytecode is instructions until the end of the file.
+  auto remaining = numeric_limits<uint64_t>::max();
+  if (magic == Loader::MuAnalyzedMagicHeader)
+    remaining = SeekToCode(bytecode);
+
+  vector<Instruction> instructions(BatchSize);
+  memory_buffer text;
+  auto endOfInput = magic == Loader::MuCompressedMagicHeader || remaining == 0;
+  while (!endOfInput) {
+    auto blockSize =
+        min<uint64_t>(instructions.size(), remaining) * sizeof(Instruction);
+    auto size = fread(instructions.data(), 1, blockSize, bytecode);
+    if (size < blockSize) {
+      if (ferror(bytecode))
+        throw runtime_error("The bytecode cannot be read.");
+      if (size % sizeof(Instruction) != 0 ||
+          magic == Loader::MuAnalyzedMagicHeader)
+        throw runtime_error(
+            "The bytecode ends part way through an instruction.");
+      endOfInput = true;
+    }
+    remaining -= size / sizeof(Instruction);
+    if (remaining == 0)
+      endOfInput = true;
+    WriteMutext(span(instructions).first(size / sizeof(Instruction)),
+                numberOfInstructions, text, mutext);
+  }
+
+  if (fflush(mutext) != 0)
+    throw runtime_error("The \u03BCtext cannot be written.");
+  return numberOfInstructions;
+}
+
+static FILE* CreateStream(const string& contents) {
+  auto file = tmpfile();
+  fwrite(contents.data(), 1, contents.size(), file);
+  rewind(file);
+  return file;
+}
+
+static string ReadStream(FILE* file) {
+  rewind(file);
+  string contents;
+  char buffer[4096];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    contents.append(buffer, size);
+  return contents;
+}
+
+static string AssembleToBytes(const string& mutext,
+                              BytecodeFormat format = BytecodeFormat::Plain,
+                              bool optimize = false) {
+  auto input = CreateStream(mutext);
+  auto output = tmpfile();
+  Assemble(input, output, format, optimize);
+  auto bytecode = ReadStream(output);
+  fclose(input);
+  fclose(output);
+  return bytecode;
+}
+
+static string DisassembleBytes(const string& bytecode) {
+  auto input = CreateStream(bytecode);
+  auto output = tmpfile();
+  Disassemble(input, output);
+  auto mutext = ReadStream(output);
+  fclose(input);
+  fclose(output);
+  return mutext;
+}
+
+TEST_CASE("Verify assembler behavior") {
+  SUBCASE("Assembles a file the loader can load") {
+    auto bytecode = AssembleToBytes("Push i32:2\n\nPush i32:3\nAdd\n");
+    TestFile testFile("assembled.mu", (const byte*)bytecode.data(),
+                      bytecode.size());
+    Instruction expectedInstructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    Loader loader("assembled.mu");
+    VerifyInstructions(expectedInstructions, loader.GetInstructions());
+  }
+
+  SUBCASE("Disassembles to the μtext it was assembled from") {
+    string mutext = "Nop\nPush i32:-7\nPush i64:3000000000\nPush f32:0.1\n"
+                    "Push f64:-2.5e-300\nPush b:true\nPush c:z\nPop\nAdd\n"
+                    "Subtract\n";
+    CHECK(DisassembleBytes(AssembleToBytes(mutext)) == mutext);
+  }
+
+  SUBCASE("Optimizes the program before writing it when asked") {
+    string mutext = "Push i32:2\nPush i32:3\nAdd\nPush c:a\nPop\nPush i32:4\n";
+    for (auto format : {BytecodeFormat::Plain, BytecodeFormat::Compressed,
+                        BytecodeFormat::Analyzed}) {
+      auto bytecode = AssembleToBytes(mutext, format, true);
+      CHECK(DisassembleBytes(bytecode) == "Push i32:5\nPush i32:4\n");
+      CHECK(AssembleToBytes("Push i32:5\nPush i32:4\n", format) == bytecode);
+    }
+    CHECK(DisassembleBytes(AssembleToBytes(mutext)) == mutext);
+  }
+
+  SUBCASE("Writes the same bytes for the same program") {
+    Instruction instructions[] = {{OpCode::Push, 'a'}, {OpCode::Push, 1.5f}};
+    auto file = tmpfile();
+    BytecodeWriter writer(file);
+    writer.Write(instructions);
+    writer.Flush();
+    CHECK(writer.GetNumberOfInstructions() == 2);
+    CHECK(ReadStream(file) == AssembleToBytes("Push c:a\nPush f32:1.5\n"));
+    fclose(file);
+  }
+
+  SUBCASE("Streams programs bigger than its buffers") {
+    string mutext;
+    for (auto i = 0; i < 10000; i++)
+      mutext += format("Push i64:{}\nPush f64:{}.25\nSubtract\n", i, i);
+    auto bytecode = AssembleToBytes(mutext);
+    CHECK(bytecode.size() ==
+          sizeof(Loader::MuMagicHeader) + 30000 * sizeof(Instruction));
+    CHECK(DisassembleBytes(bytecode) == mutext);
+  }
+
+  SUBCASE("Compresses programs a block at a time") {
+    string mutext;
+    for (auto i = 0; i < 100000; i++)
+      mutext += format("Push i32:{}\nPush i32:2\nAdd\nPop\n", i % 10);
+    auto bytecode = AssembleToBytes(mutext, BytecodeFormat::Compressed);
+    CHECK(bytecode.size() * 10 < 400000 * sizeof(Instruction));
+    CHECK(DisassembleBytes(bytecode) == mutext);
+
+    TestFile testFile("assembled.mu", (const byte*)bytecode.data(),
+                      bytecode.size());
+    Loader loader("assembled.mu");
+    REQUIRE(loader.IsCompressed());
+    CHECK(loader.GetNumberOfInstructions() == 400000);
+    vector<Instruction> instructions;
+    REQUIRE(loader.ReadInstructions(instructions));
+    auto uncompressed = AssembleToBytes(mutext);
+    CHECK(memcmp(instructions.data(),
+                 uncompressed.data() + sizeof(Loader::MuMagicHeader),
+                 uncompressed.size() - sizeof(Loader::MuMagicHeader)) == 0);
+  }
+
+  SUBCASE("Compresses an empty program") {
+    auto bytecode = AssembleToBytes("", BytecodeFormat::Compressed);
+    CHECK(DisassembleBytes(bytecode) == "");
+    TestFile testFile("assembled.mu", (const byte*)bytecode.data(),
+                      bytecode.size());
+    Loader loader("assembled.mu");
+    CHECK(loader.GetErrorMessage() == "");
+    CHECK(loader.GetNumberOfInstructions() == 0);
+  }
+
+  SUBCASE("Reports the line of μtext that cannot be assembled") {
+    CHECK_THROWS_WITH_AS(AssembleToBytes("Pop\nPush i32:x\n"),
+                         "Line 2: Invalid i32 value 'x'.", MutextParseError);
+  }
+
+  SUBCASE("Rejects bytecode that is not valid") {
+    CHECK_THROWS_WITH(DisassembleBytes("mu"),
+                      "The bytecode is not valid Mu bytecode.");
+    auto bytecode = AssembleToBytes("Pop\nPop\n");
+    CHECK_THROWS_WITH(DisassembleBytes(bytecode.substr(0, bytecode.size() - 1)),
+                      "The bytecode ends part way through an instruction.");
+
+    Instruction instructions[] = {{OpCode::Add, 1}, {OpCode::Push, ' '}};
+    auto file = tmpfile();
+    BytecodeWriter writer(file);
+    writer.Write(instructions);
+    writer.Flush();
+    auto withArgument = ReadStream(file);
+    fclose(file);
+    CHECK_THROWS_WITH(DisassembleBytes(withArgument),
+                      "Instruction 0 is Add with an argument, which "
+                      "\u03BCtext cannot represent.");
+    withArgument.erase(sizeof(Loader::MuMagicHeader), sizeof(Instruction));
+    CHECK_THROWS_WITH(DisassembleBytes(withArgument),
+                      "Instruction 0 pushes a whitespace character, which "
+                      "\u03BCtext cannot represent.");
+
+    auto compressed = AssembleToBytes("Pop\nPop\n", BytecodeFormat::Compressed);
+    CHECK_THROWS_WITH(DisassembleBytes(compressed.substr(0, 20)),
+                      "The bytecode ends part way through a block.");
+    compressed[sizeof(Loader::MuMagicHeader) + sizeof(CompressedBlockHeader)] =
+        '\xFF';
+    CHECK_THROWS_WITH(DisassembleBytes(compressed),
+                      "Block 0 of the bytecode is not valid.");
+  }
+
+  SUBCASE("Writes the analysis of a program") {
+    string mutext;
+    for (auto i = 0; i < 50000; i++)
+      mutext += format("Push i32:{}\nPush f64:2.5\nAdd\nPop\n", i);
+    mutext += "Push i64:1\nPush i64:2\n";
+    auto bytecode = AssembleToBytes(mutext, BytecodeFormat::Analyzed);
+    CHECK(DisassembleBytes(bytecode) == mutext);
+
+    TestFile testFile("assembled.mu", (const byte*)bytecode.data(),
+                      bytecode.size());
+    Loader loader("assembled.mu");
+    REQUIRE(loader.GetErrorMessage() == "");
+    CHECK(loader.GetNumberOfInstructions() == 200002);
+    auto analysis = loader.GetAnalysis();
+    REQUIRE(analysis != nullptr);
+    CHECK(analysis->maximumStackDepth == 2);
+    REQUIRE(analysis->operandTypes.size() == 200002);
+    CHECK(analysis->operandTypes[2] ==
+          PackOperandTypes(ArgumentType::i32, ArgumentType::f64));
+    REQUIRE(analysis->blockBoundaries.size() == 3);
+    CHECK(analysis->blockBoundaries[0] == 65536);
+    CHECK(analysis->blockBoundaries[2] == 196608);
+
+    VerifiedProgram program(loader.GetInstructions(), *analysis);
+    CHECK(program.IsVerified());
+    CHECK(program.GetResultTypes().size() == 2);
+  }
+
+  SUBCASE("Writes the analysis of a program whose stack keeps growing") {
+    string mutext;
+    for (auto i = 0; i < 10000; i++)
+      mutext += "Push i32:1\n";
+    mutext += "Add\nPush f64:0.5\nSubtract\nPop\nPop\n";
+    for (auto i = 0; i < 5000; i++)
+      mutext += "Push c:a\n";
+    auto bytecode = AssembleToBytes(mutext, BytecodeFormat::Analyzed);
+
+    TestFile testFile("assembled.mu", (const byte*)bytecode.data(),
+                      bytecode.size());
+    Loader loader("assembled.mu");
+    auto analysis = loader.GetAnalysis();
+    REQUIRE(analysis != nullptr);
+    CHECK(analysis->maximumStackDepth == 14997);
+    CHECK(analysis->operandTypes[10002] ==
+          PackOperandTypes(ArgumentType::i32, ArgumentType::f64));
+
+    VerifiedProgram program(loader.GetInstructions(), *analysis);
+    REQUIRE(program.IsVerified());
+    auto resultTypes = program.GetResultTypes();
+    REQUIRE(resultTypes.size() == 14997);
+    CHECK(resultTypes[9996] == ArgumentType::i32);
+    CHECK(resultTypes[9997] == ArgumentType::c);
+  }
+
+  SUBCASE("Does not write the analysis of a program that is not valid") {
+    CHECK_THROWS_WITH(
+        AssembleToBytes("Push i32:1\nPush b:true\nAdd\n",
+                        BytecodeFormat::Analyzed),
+        "Instruction 2 (Add) has no result for i32 and bool operands.");
+
+    string mutext;
+    for (auto i = 0; i < 5000; i++)
+      mutext += "Push i32:1\nPop\n";
+    CHECK_THROWS_WITH(AssembleToBytes(mutext + "Pop\n",
+                                      BytecodeFormat::Analyzed),
+                      "Instruction 10000 pops from an empty stack.");
+  }
+
+  SUBCASE("Rejects analyzed bytecode from another version of the VM") {
+    auto bytecode =
+        AssembleToBytes("Push i32:1\n", BytecodeFormat::Analyzed);
+    bytecode[bytecode.size() - sizeof(AnalyzedFooter)] = 2;
+    CHECK_THROWS_WITH(
+        DisassembleBytes(bytecode),
+        "The bytecode was written by a different version of the VM.");
+  }
+}
+
+TEST_CASE("Verify assembler performance") {
+  auto mutext = GenerateArithmeticMutext(250000);
+  auto input = CreateStream(mutext);
+  auto bytecode = CreateStream(AssembleToBytes(mutext));
+  auto output = tmpfile();
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).batch(mutext.size()).unit("B");
+
+  b.run("Assemble", [&] {
+    rewind(input);
+    rewind(output);
+    Assemble(input, output);
+  });
+
+  b.run("Disassemble", [&] {
+    rewind(bytecode);
+    rewind(output);
+    Disassemble(bytecode, output);
+  });
+
+  b.run("Assemble compressed", [&] {
+    rewind(input);
+    rewind(output);
+    Assemble(input, output, BytecodeFormat::Compressed);
+  });
+
+  auto compressed =
+      CreateStream(AssembleToBytes(mutext, BytecodeFormat::Compressed));
+  b.run("Disassemble compressed", [&] {
+    rewind(compressed);
+    rewind(output);
+    Disassemble(compressed, output);
+  });
+
+  b.run("Assemble analyzed", [&] {
+    rewind(input);
+    rewind(output);
+    Assemble(input, output, BytecodeFormat::Analyzed);
+  });
+
+  string growing;
+  for (auto i = 0; i < 1000000; i++)
+    growing += "Push i32:1\n";
+  auto growingInput = CreateStream(growing);
+  b.batch(growing.size());
+  b.run("Assemble analyzed with a stack that keeps growing", [&] {
+    rewind(growingInput);
+    rewind(output);
+    Assemble(growingInput, output, BytecodeFormat::Analyzed);
+  });
+
+  fclose(input);
+  fclose(growingInput);
+  fclose(bytecode);
+  fclose(compressed);
+  fclose(output);
+}
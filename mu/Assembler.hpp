@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+using std::byte;
+#include <cstdint>
+#include <cstdio>
+using std::FILE;
+#include <span>
+using std::span;
+#include <vector>
+using std::vector;
+
+#include "Bytecode.hpp"
+
+// A compressed file is written in blocks (see Compression.hpp), and an analyzed
+// one carries the analysis of its program (see Loader.hpp).
+enum class BytecodeFormat { Plain, Compressed, Analyzed };
+
+// Writes a μ bytecode file a buffer at a time. The header is written first.
+// A compressed file is written a block at a time, and its block index is
+// written by Finish. The program in an analyzed file is verified as it is
+// written, and its analysis is written by Finish.
+class BytecodeWriter {
+public:
+  explicit BytecodeWriter(FILE* bytecode,
+                          BytecodeFormat format = BytecodeFormat::Plain);
+  ~BytecodeWriter();
+
+  void Write(span<const Instruction> instructions);
+
+  // Writes the instructions that are still buffered. Throws if the bytecode
+  // cannot be written, or the program of an analyzed file is not valid.
+  void Flush();
+
+  // Flushes, then writes the block index of a compressed file, or the analysis
+  // of an analyzed one. Nothing can be written after it.
+  void Finish();
+
+  size_t GetNumberOfInstructions() const;
+
+private:
+  FILE* m_bytecode;
+  BytecodeFormat m_format;
+  vector<Instruction> m_buffer;
+  size_t m_numberOfBufferedInstructions;
+  size_t m_numberOfInstructions;
+  vector<byte> m_compressedBlock;
+  vector<uint64_t> m_blockOffsets;
+  uint64_t m_offset;
+
+  // The analysis of the instructions that have been flushed. The operand types
+  // are kept in a temporary file until Finish.
+  vector<ArgumentType> m_stackTypes;
+  FILE* m_operandTypes;
+  size_t m_maximumStackDepth;
+  vector<uint64_t> m_blockBoundaries;
+
+  void Analyze(span<Instruction> instructions);
+  void WriteAnalysis();
+  void WriteBytes(const void* data, size_t size);
+  void WritePadding();
+};
+
+// These convert between μtext and μ bytecode a batch of instructions at a
+// time, so the memory they use does not depend on the size of the program.
+// Each returns the number of instructions it converted, and throws if the
+// input is not valid or the output cannot be written. The disassembler reads
+// bytecode in every format, but an analyzed file has to be seekable. A program
+// that is optimized (see Optimizer.hpp) is parsed in full before it is written,
+// so its memory does depend on its size.
+size_t Assemble(FILE* mutext, FILE* bytecode,
+                BytecodeFormat format = BytecodeFormat::Plain,
+                bool optimize = false);
+size_t Disassemble(FILE* bytecode, FILE* mutext);
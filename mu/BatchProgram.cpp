@@ -0,0 +1,317 @@
+#include "Configuration.hpp"
+
+#include <random>
+using std::mt19937;
+#include <stdexcept>
+using std::logic_error;
+#include <string>
+using std::string;
+
+#include <fmt/core.h>
+using fmt::format;
+
+#include "BatchProgram.hpp"
+#include "InstructionProcessor.hpp"
+#include "Interpreter/Interpreter.hpp"
+#include "ValueStack.hpp"
+
+// == Batch Program ==
+//
+// Some programs are executed for many independent inputs. Executing them once
+// for each input pays for the dispatch of every instruction once per input. A
+// batch program executes the program once for all of the inputs instead.
+//
+// Each slot of the stack holds a column, with one value for each row of the
+// inputs. A push adds a constant column, which stores its value once, and each
+// operation computes its result for every row with the evaluate columns
+// function of its instruction (see BinaryArithmeticOperation.hpp). So one
+// dispatch is shared by all of the rows.
+//
+// Only instructions with an evaluate columns function can execute on columns,
+// and every value in a column has the same type, so an operation has one type
+// of result for all of its rows.
+//
+// The columns the program computes are kept, and their storage is used again
+// by later operations and later executions, so executing a program again does
+// not allocate anything but its results.
+
+BatchProgram::BatchProgram(span<Instruction> instructions)
+    : m_instructions(instructions) {}
+
+vector<Column> BatchProgram::Execute(span<const Column> inputs) {
+  auto numberOfRows = inputs.empty() ? 0 : inputs[0].GetNumberOfRows();
+  for (auto& input : inputs) {
+    if (input.GetNumberOfRows() != numberOfRows)
+      throw logic_error("The inputs do not have the same number of rows.");
+  }
+
+  // The stack refers to the inputs in place. Every other column on it is
+  // owned by the program, and goes back to the spare columns when it is
+  // popped.
+  vector<const Column*> stack;
+  for (auto& input : inputs)
+    stack.push_back(&input);
+
+  auto isInput = [&](const Column* column) {
+    return column >= inputs.data() && column < inputs.data() + inputs.size();
+  };
+  auto release = [&](const Column* column) {
+    if (!isInput(column))
+      m_spareColumns.push_back((Column*)column);
+  };
+  auto releaseAll = [&] {
+    for (auto column : stack)
+      release(column);
+  };
+
+  auto fail = [&](string message) {
+    releaseAll();
+    throw logic_error(message);
+  };
+
+  for (size_t i = 0; i < m_instructions.size(); i++) {
+    auto instruction = m_instructions[i];
+    if (instruction.opCode == OpCode::Push) {
+      auto column = GetSpareColumn();
+      column->ResetToConstant(instruction.argument, numberOfRows);
+      stack.push_back(column);
+      continue;
+    }
+
+    if (instruction.opCode == OpCode::Pop) {
+      if (stack.empty())
+        fail(format("Instruction {} pops from an empty stack.", i));
+      release(stack.back());
+      stack.pop_back();
+      continue;
+    }
+
+    if (!HasInstruction(instruction.opCode))
+      fail(format("Instruction {} has an unexpected opcode: {}.", i,
+                  (int)instruction.opCode));
+
+    auto evaluateColumns =
+        GetInstructionMetadata(instruction.opCode).evaluateColumns;
+    if (evaluateColumns == nullptr)
+      fail(format("Instruction {} ({}) cannot execute on columns.", i,
+                  instruction.opCode));
+    if (stack.size() < 2)
+      fail(format("Instruction {} pops from an empty stack.", i));
+
+    auto result = GetSpareColumn();
+    auto right = stack.back();
+    stack.pop_back();
+    auto left = stack.back();
+
+    evaluateColumns(*left, *right, *result);
+    stack.back() = result;
+    release(left);
+    release(right);
+
+    if (result->GetType() == ArgumentType::None)
+      fail(format("Instruction {} ({}) has no result for the types of its "
+                  "operands.",
+                  i, instruction.opCode));
+  }
+
+  vector<Column> results;
+  for (auto column : stack)
+    results.push_back(*column);
+  releaseAll();
+  return results;
+}
+
+Column* BatchProgram::GetSpareColumn() {
+  if (m_spareColumns.empty())
+    return &m_columns.emplace_back();
+
+  auto column = m_spareColumns.back();
+  m_spareColumns.pop_back();
+  return column;
+}
+
+static vector<Argument> ProcessEachRow(span<Instruction> instructions,
+                                       span<const Column> inputs,
+                                       size_t numberOfRows) {
+  auto stackSize = StackSize();
+  vector<Argument> results;
+  for (size_t row = 0; row < numberOfRows; row++) {
+    for (auto& input : inputs)
+      Push(input.Get(row));
+    Process(instructions);
+    while (StackSize() > stackSize)
+      results.push_back(Pop());
+  }
+  return results;
+}
+
+static vector<Argument> GetEachRow(span<const Column> columns,
+                                   size_t numberOfRows) {
+  vector<Argument> results;
+  for (size_t row = 0; row < numberOfRows; row++) {
+    for (auto column = columns.rbegin(); column != columns.rend(); column++)
+      results.push_back(column->Get(row));
+  }
+  return results;
+}
+
+static Column GenerateColumn(ArgumentType type, size_t numberOfRows,
+                             mt19937& random) {
+  Column column(type, numberOfRows);
+  for (size_t row = 0; row < numberOfRows; row++) {
+    auto value = (int32_t)(random() % 2000) - 1000;
+    if (type == ArgumentType::i32)
+      column.Set(row, value);
+    else if (type == ArgumentType::i64)
+      column.Set(row, (int64_t)value * 1000000000);
+    else if (type == ArgumentType::f32)
+      column.Set(row, value / 8.0f);
+    else
+      column.Set(row, value / 16.0);
+  }
+  return column;
+}
+
+TEST_CASE("Verify batch program behavior") {
+  const ArgumentType types[] = {ArgumentType::i32, ArgumentType::i64,
+                                ArgumentType::f32, ArgumentType::f64};
+  const Argument constants[] = {7, (int64_t)-8, 9.5f, -10.25};
+
+  SUBCASE("Verify that each row matches the instruction processor for each "
+          "pair of types") {
+    mt19937 random(42);
+    // This is not a multiple of the vector width, so the last rows are
+    // computed one at a time.
+    const size_t numberOfRows = 37;
+    for (auto opCode : {OpCode::Add, OpCode::Subtract}) {
+      for (auto leftType : types) {
+        for (auto rightType : types) {
+          Column inputs[] = {GenerateColumn(leftType, numberOfRows, random),
+                             GenerateColumn(rightType, numberOfRows, random)};
+          Instruction instructions[] = {{opCode}};
+
+          auto results = BatchProgram(instructions).Execute(inputs);
+          CHECK(GetEachRow(results, numberOfRows) ==
+                ProcessEachRow(instructions, inputs, numberOfRows));
+        }
+      }
+    }
+  }
+
+  SUBCASE("Verify that each row matches the instruction processor with a "
+          "constant operand") {
+    mt19937 random(42);
+    const size_t numberOfRows = 21;
+    for (auto type : types) {
+      for (auto constant : constants) {
+        Column inputs[] = {GenerateColumn(type, numberOfRows, random)};
+
+        Instruction instructions[] = {{OpCode::Push, constant},
+                                      {OpCode::Push, 2},
+                                      {OpCode::Pop},
+                                      {OpCode::Add},
+                                      {OpCode::Push, constant},
+                                      {OpCode::Push, constant},
+                                      {OpCode::Add},
+                                      {OpCode::Subtract}};
+        auto results = BatchProgram(instructions).Execute(inputs);
+        CHECK(GetEachRow(results, numberOfRows) ==
+              ProcessEachRow(instructions, inputs, numberOfRows));
+      }
+    }
+  }
+
+  SUBCASE("Values left on the stack are returned from the bottom up") {
+    const int32_t values[] = {1, 2, 3};
+    Column inputs[] = {Column::FromValues<int32_t>(values)};
+    Instruction instructions[] = {{OpCode::Push, 2.5}, {OpCode::Push, 'a'}};
+
+    auto results = BatchProgram(instructions).Execute(inputs);
+    REQUIRE(results.size() == 3);
+    CHECK(results[0].Get(2) == Argument(3));
+    CHECK(results[1].Get(2) == Argument(2.5));
+    CHECK(results[2].Get(2) == Argument('a'));
+  }
+
+  SUBCASE("A program can be executed more than once") {
+    const double values[] = {1.5, 2.5, 3.5};
+    Column inputs[] = {Column::FromValues<double>(values)};
+    Instruction instructions[] = {
+        {OpCode::Push, 1}, {OpCode::Subtract}, {OpCode::Push, 2}};
+    BatchProgram program(instructions);
+
+    for (auto i = 0; i < 3; i++) {
+      auto results = program.Execute(inputs);
+      REQUIRE(results.size() == 2);
+      CHECK(results[0].Get(2) == Argument(2.5));
+      CHECK(results[1].Get(2) == Argument(2));
+      CHECK(inputs[0].Get(2) == Argument(3.5));
+    }
+  }
+
+  SUBCASE("Inputs with different numbers of rows are an error") {
+    Column inputs[] = {Column(ArgumentType::i32, 2),
+                       Column(ArgumentType::i32, 3)};
+    Instruction instructions[] = {{OpCode::Add}};
+    CHECK_THROWS_AS(BatchProgram(instructions).Execute(inputs), logic_error);
+  }
+
+  SUBCASE("Popping from an empty stack is an error") {
+    Column inputs[] = {Column(ArgumentType::i32, 2)};
+    Instruction instructions[] = {{OpCode::Push, 1}, {OpCode::Pop},
+                                  {OpCode::Add}};
+    CHECK_THROWS_AS(BatchProgram(instructions).Execute(inputs), logic_error);
+  }
+
+  SUBCASE("An unexpected opcode is an error") {
+    Instruction instructions[] = {{(OpCode)42}};
+    CHECK_THROWS_AS(BatchProgram(instructions).Execute({}), logic_error);
+  }
+
+  SUBCASE("Operands without a result are an error") {
+    Column inputs[] = {Column(ArgumentType::i32, 2)};
+    Instruction instructions[] = {{OpCode::Push, true}, {OpCode::Add}};
+    CHECK_THROWS_AS(BatchProgram(instructions).Execute(inputs), logic_error);
+  }
+
+  SUBCASE("An instruction without an evaluate columns function is an error") {
+    auto metadata = GetInstructionMetadata(OpCode::Nop);
+    RegisterInstruction(OpCode::Nop, {.execute = [] {}, .name = "Nop"});
+
+    Instruction instructions[] = {{OpCode::Nop}};
+    CHECK_THROWS_AS(BatchProgram(instructions).Execute({}), logic_error);
+
+    RegisterInstruction(OpCode::Nop, metadata);
+  }
+}
+
+TEST_CASE("Verify batch program performance") {
+  const size_t numberOfRows = 100000;
+  mt19937 random(42);
+  Column inputs[] = {GenerateColumn(ArgumentType::i32, numberOfRows, random),
+                     GenerateColumn(ArgumentType::f64, numberOfRows, random)};
+
+  // x - (y + 1) + 2.5
+  Instruction instructions[] = {{OpCode::Push, 1},   {OpCode::Add},
+                                {OpCode::Subtract},  {OpCode::Push, 2.5},
+                                {OpCode::Add}};
+
+  BatchProgram program(instructions);
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(numberOfRows);
+
+  b.run("Process each row with the direct-threaded engine", [&] {
+    for (size_t row = 0; row < numberOfRows; row++) {
+      Push(inputs[0].Get(row));
+      Push(inputs[1].Get(row));
+      Process(instructions, Engine::DirectThreaded);
+      Pop();
+    }
+  });
+
+  b.run("Execute a batch program", [&] {
+    auto results = program.Execute(inputs);
+    ankerl::nanobench::doNotOptimizeAway(results);
+  });
+}
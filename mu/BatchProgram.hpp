@@ -0,0 +1,32 @@
+#pragma once
+
+#include <deque>
+using std::deque;
+#include <span>
+using std::span;
+#include <vector>
+using std::vector;
+
+#include "Bytecode.hpp"
+#include "Column.hpp"
+
+class BatchProgram {
+public:
+  BatchProgram(span<Instruction> instructions);
+
+  // Executes the program once for every row of the inputs. The inputs are the
+  // values on the stack before the program starts, from the bottom up, and they
+  // must all have the same number of rows. Returns the values left on the
+  // stack, from the bottom up.
+  vector<Column> Execute(span<const Column> inputs);
+
+private:
+  span<Instruction> m_instructions;
+
+  // The columns computed by the program are kept for the next execution, so
+  // it can use their storage again.
+  deque<Column> m_columns;
+  vector<Column*> m_spareColumns;
+
+  Column* GetSpareColumn();
+};
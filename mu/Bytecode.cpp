@@ -1,49 +1,170 @@
 #include "Configuration.hpp"
 
-#include <unordered_map>
-using std::unordered_map;
+#include <array>
+using std::array;
+#include <functional>
+using std::less;
+#include <set>
+using std::set;
+#include <stdexcept>
+using std::logic_error;
+#include <string>
+using std::string;
+
+#include <fmt/core.h>
+using fmt::format;
 
 #include "Bytecode.hpp"
 
 #include "Interpreter/Add.hpp"
 #include "Interpreter/Subtract.hpp"
+#include "Mutext/StringUtils.hpp"
+
+// == Instruction Registry ==
+//
+// The registry is a table indexed by opcode, so finding the metadata for an
+// instruction is a single load. The compiler builds the table, so there is no
+// work to do at startup. The opcodes that the instruction processor handles
+// itself have a name, but nothing to execute.
+
+static constexpr array<InstructionMetadata, NumberOfOpCodes>
+BuildInstructionTable() {
+  array<InstructionMetadata, NumberOfOpCodes> instructions{};
+  instructions[(size_t)OpCode::Nop] = {.name = "Nop"};
+  instructions[(size_t)OpCode::Push] = {.name = "Push"};
+  instructions[(size_t)OpCode::Pop] = {.name = "Pop"};
+  instructions[(size_t)OpCode::Add] = GetAddMetadata();
+  instructions[(size_t)OpCode::Subtract] = GetSubtractMetadata();
+  return instructions;
+}
+
+static constexpr auto BuiltInInstructions = BuildInstructionTable();
+
+static constinit auto Instructions = BuiltInInstructions;
+
+// Once an instruction has been registered at runtime, its name might not be in
+// the mnemonic table below.
+static bool HasRegisteredInstructions = false;
+
+// Anything that caches what it found in the registry can check this version to
+// learn that an instruction has been registered since.
+static uint32_t InstructionRegistryVersion = 0;
 
-static unordered_map<OpCode, InstructionMetadata> Instructions;
+// == Mnemonic Lookup ==
+//
+// The mnemonics of the built-in instructions are found with a perfect hash (see
+// StringUtils.hpp), so a lookup is one hash, one load and one string
+// comparison.
 
-void InitializeInstructions() {
-  RegisterInstruction(OpCode::Add, GetAddMetadata());
-  RegisterInstruction(OpCode::Subtract, GetSubtractMetadata());
+static consteval array<string_view, NumberOfOpCodes> GetBuiltInMnemonics() {
+  array<string_view, NumberOfOpCodes> mnemonics{};
+  for (size_t i = 0; i < NumberOfOpCodes; i++)
+    mnemonics[i] = BuiltInInstructions[i].name;
+  return mnemonics;
 }
 
+static constexpr PerfectHash<8> Mnemonics(GetBuiltInMnemonics());
+
+// The registry keeps a copy of each name that is registered, so the caller does
+// not need to keep the name alive. Each name is only copied once, and the
+// copies are never freed, so metadata read from the registry stays valid after
+// the instruction is registered again.
+static string_view KeepInstructionName(string_view name) {
+  static set<string, less<>> names;
+  auto found = names.find(name);
+  if (found == names.end())
+    found = names.emplace(name).first;
+  return *found;
+}
+
+// The registry has a slot for each opcode, and no room for any other.
 void RegisterInstruction(OpCode opCode, InstructionMetadata metadata) {
-  Instructions[opCode] = metadata;
+  if ((size_t)opCode >= NumberOfOpCodes)
+    throw logic_error(
+        format("Cannot register an instruction for opcode {}", (int)opCode));
+
+  metadata.name = KeepInstructionName(metadata.name);
+  Instructions[(size_t)opCode] = metadata;
+  HasRegisteredInstructions = true;
+  InstructionRegistryVersion++;
 }
 
-bool HasInstruction(OpCode opCode) { return Instructions.contains(opCode); }
+uint32_t GetInstructionRegistryVersion() { return InstructionRegistryVersion; }
 
-OpCode GetOpCode(string name) {
-  for (auto& [opCode, metadata] : Instructions) {
-    if (metadata.name == name) {
-      return opCode;
+bool HasInstruction(OpCode opCode) {
+  return (size_t)opCode < NumberOfOpCodes &&
+         Instructions[(size_t)opCode].execute != nullptr;
+}
+
+const InstructionMetadata& GetInstructionMetadata(OpCode opCode) {
+  return Instructions[(size_t)opCode];
+}
+
+OpCode GetOpCode(string_view name) {
+  auto slot = Mnemonics.Find(name);
+  if (slot != Mnemonics.EmptySlot && Instructions[slot].name == name)
+    return (OpCode)slot;
+
+  if (HasRegisteredInstructions) {
+    for (size_t i = 0; i < NumberOfOpCodes; i++) {
+      if (Instructions[i].name == name)
+        return (OpCode)i;
     }
   }
 
   return OpCode::Nop;
 }
 
-void ExecuteInstruction(OpCode opCode) { Instructions[opCode].execute(); }
+void ExecuteInstruction(OpCode opCode) {
+  Instructions[(size_t)opCode].execute();
+}
+
+static Argument SampleOf(ArgumentType type) {
+  switch (type) {
+  case ArgumentType::i32:
+    return 1;
+  case ArgumentType::i64:
+    return (int64_t)1;
+  case ArgumentType::f32:
+    return 1.0f;
+  case ArgumentType::f64:
+    return 1.0;
+  case ArgumentType::b:
+    return true;
+  case ArgumentType::c:
+    return 'a';
+  default:
+    return Argument();
+  }
+}
+
+// Evaluating the specialized function on sample values of the operand types
+// gives the type of its result.
+EvaluateInstructionFunc SpecializeInstruction(OpCode opCode, ArgumentType left,
+                                              ArgumentType right,
+                                              ArgumentType& resultType) {
+  if (!HasInstruction(opCode) || left == ArgumentType::None ||
+      right == ArgumentType::None)
+    return nullptr;
 
-string GetInstructionName(OpCode opCode) { return Instructions[opCode].name; }
+  auto specialize = Instructions[(size_t)opCode].specialize;
+  if (specialize == nullptr)
+    return nullptr;
+
+  auto evaluate = specialize(left, right);
+  if (evaluate != nullptr)
+    resultType = evaluate(SampleOf(left), SampleOf(right)).Type();
+  return evaluate;
+}
+
+string GetInstructionName(OpCode opCode) {
+  return string(Instructions[(size_t)opCode].name);
+}
 
 bool operator==(Instruction left, Instruction right) {
   return left.opCode == right.opCode && left.argument == right.argument;
 }
 
-bool MockInstructionCalled = false;
-void MockInstruction() { MockInstructionCalled = true; }
-InstructionMetadata MockInstructionMetadata = {.execute = MockInstruction,
-                                               .name = "MockInstruction"};
-
 TEST_CASE("Verify instruction registration behavior") {
   SUBCASE("Verify that instructions can be executed") {
     RegisterInstruction(OpCode::Nop, MockInstructionMetadata);
@@ -56,6 +177,17 @@ TEST_CASE("Verify instruction registration behavior") {
     CHECK(GetInstructionName(OpCode::Nop) == "MockInstruction");
   }
 
+  SUBCASE("Verify that registering an instruction changes the version") {
+    auto version = GetInstructionRegistryVersion();
+    RegisterInstruction(OpCode::Nop, MockInstructionMetadata);
+    CHECK(GetInstructionRegistryVersion() != version);
+  }
+
+  SUBCASE("Verify that instruction metadata can be retrieved") {
+    RegisterInstruction(OpCode::Nop, MockInstructionMetadata);
+    CHECK(GetInstructionMetadata(OpCode::Nop).execute == MockInstruction);
+  }
+
   SUBCASE("Verify that instructions can be checked for existence") {
     RegisterInstruction(OpCode::Nop, MockInstructionMetadata);
     CHECK(HasInstruction(OpCode::Nop));
@@ -65,4 +197,91 @@ TEST_CASE("Verify instruction registration behavior") {
     RegisterInstruction(OpCode::Nop, MockInstructionMetadata);
     CHECK(GetOpCode("MockInstruction") == OpCode::Nop);
   }
+
+  SUBCASE("Verify that the built-in instructions exist without registration") {
+    CHECK(HasInstruction(OpCode::Add));
+    CHECK(HasInstruction(OpCode::Subtract));
+  }
+
+  SUBCASE("Verify that the opcodes handled by the processor do not execute") {
+    CHECK_FALSE(HasInstruction(OpCode::Push));
+    CHECK_FALSE(HasInstruction(OpCode::Pop));
+  }
+
+  SUBCASE("Verify that out of range opcodes do not exist") {
+    CHECK_FALSE(HasInstruction((OpCode)NumberOfOpCodes));
+  }
+
+  SUBCASE("Verify that out of range opcodes cannot be registered") {
+    auto version = GetInstructionRegistryVersion();
+    CHECK_THROWS_AS(RegisterInstruction((OpCode)NumberOfOpCodes,
+                                        MockInstructionMetadata),
+                    logic_error);
+    CHECK(GetInstructionRegistryVersion() == version);
+  }
+
+  SUBCASE("Verify that built-in instructions can be retrieved by name") {
+    CHECK(GetOpCode("Push") == OpCode::Push);
+    CHECK(GetOpCode("Pop") == OpCode::Pop);
+    CHECK(GetOpCode("Add") == OpCode::Add);
+    CHECK(GetOpCode("Subtract") == OpCode::Subtract);
+  }
+
+  SUBCASE("Verify that an unknown name is a Nop") {
+    CHECK(GetOpCode("Multiply") == OpCode::Nop);
+    CHECK(GetOpCode("") == OpCode::Nop);
+  }
+
+  SUBCASE("Verify that built-in instructions can be specialized") {
+    auto resultType = ArgumentType::None;
+    CHECK(SpecializeInstruction(OpCode::Add, ArgumentType::i32,
+                                ArgumentType::f64, resultType) ==
+          SpecializeAdd(ArgumentType::i32, ArgumentType::f64));
+    CHECK(resultType == ArgumentType::f64);
+  }
+
+  SUBCASE("Verify that instructions are not specialized for unknown types") {
+    auto resultType = ArgumentType::None;
+    CHECK(SpecializeInstruction(OpCode::Add, ArgumentType::None,
+                                ArgumentType::i32, resultType) == nullptr);
+    CHECK(SpecializeInstruction(OpCode::Add, ArgumentType::b,
+                                ArgumentType::i32, resultType) == nullptr);
+    CHECK(SpecializeInstruction(OpCode::Nop, ArgumentType::i32,
+                                ArgumentType::i32, resultType) == nullptr);
+    CHECK(resultType == ArgumentType::None);
+  }
+
+  SUBCASE("Verify that the registry keeps its own copy of the name") {
+    auto metadata = MockInstructionMetadata;
+    {
+      string name = "TemporaryInstruction";
+      metadata.name = name;
+      RegisterInstruction(OpCode::Nop, metadata);
+      name.assign(name.size(), 'x');
+    }
+    CHECK(GetInstructionName(OpCode::Nop) == "TemporaryInstruction");
+    CHECK(GetOpCode("TemporaryInstruction") == OpCode::Nop);
+  }
+
+  SUBCASE("Verify that a registered instruction replaces the built-in name") {
+    RegisterInstruction(OpCode::Subtract, MockInstructionMetadata);
+    CHECK(GetOpCode("MockInstruction") == OpCode::Subtract);
+    CHECK(GetOpCode("Subtract") == OpCode::Nop);
+    RegisterInstruction(OpCode::Subtract, GetSubtractMetadata());
+  }
+}
+
+TEST_CASE("Verify instruction lookup performance") {
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true);
+
+  b.run("Find an opcode by name", [] {
+    auto opCode = GetOpCode("Subtract");
+    ankerl::nanobench::doNotOptimizeAway(opCode);
+  });
+
+  b.run("Check that an instruction exists", [] {
+    auto exists = HasInstruction(OpCode::Add);
+    ankerl::nanobench::doNotOptimizeAway(exists);
+  });
 }
@@ -4,6 +4,8 @@
 
 #include <string>
 using std::string;
+#include <string_view>
+using std::string_view;
 
 #include <fmt/format.h>
 
@@ -30,24 +32,71 @@ enum class OpCode {
   Subtract
 };
 
+// Tables indexed by opcode use this size, so keep it in sync with the last
+// entry in OpCode.
+constexpr size_t NumberOfOpCodes = (size_t)OpCode::Subtract + 1;
+
 struct Instruction {
   OpCode opCode;
   Argument argument;
 };
 
+// Bytecode that was saved by one build of the VM is only used by a build with
+// the same version, so change this whenever the meaning of an opcode changes.
+constexpr uint32_t BytecodeVersion = 1;
+
 typedef void (*ExecuteInstructionFunc)();
 
+// A decoded program (see DecodedProgram.hpp) executes each instruction with a
+// handler. An instruction can provide handlers specialized for the types of the
+// values on the stack when it first executes. The quicken function returns the
+// specialized handler, or nullptr if there is none for those types.
+struct DecodedInstruction;
+typedef DecodedInstruction* (*DecodedHandler)(DecodedInstruction* instruction);
+typedef DecodedHandler (*QuickenInstructionFunc)();
+
+// An instruction that pops two values and pushes one result can compute that
+// result without the value stack. The optimizer uses this to fold constants.
+// It returns an empty argument when there is no result for the given types.
+typedef Argument (*EvaluateInstructionFunc)(Argument left, Argument right);
+
+// When the types of the operands are known ahead of time, an instruction can
+// provide an evaluate function that only handles those types. The specialize
+// function returns it, or nullptr if there is none for those types.
+typedef EvaluateInstructionFunc (*SpecializeInstructionFunc)(
+    ArgumentType left, ArgumentType right);
+
+// A batch program (see BatchProgram.hpp) executes an instruction once for a
+// whole column of rows. The evaluate columns function computes the result for
+// every row, and leaves the result column empty when there is no result for the
+// types of the operands.
+class Column;
+typedef void (*EvaluateColumnsFunc)(const Column& left, const Column& right,
+                                    Column& result);
+
 struct InstructionMetadata {
   ExecuteInstructionFunc execute;
-  string name;
+  string_view name;
+  QuickenInstructionFunc quicken;
+  EvaluateInstructionFunc evaluate;
+  SpecializeInstructionFunc specialize;
+  EvaluateColumnsFunc evaluateColumns;
 };
 
-void InitializeInstructions();
-
+// The registry copies the name, so it does not need to outlive the call.
 void RegisterInstruction(OpCode opCode, InstructionMetadata metadata);
+uint32_t GetInstructionRegistryVersion();
 bool HasInstruction(OpCode opCode);
-OpCode GetOpCode(string name);
+const InstructionMetadata& GetInstructionMetadata(OpCode opCode);
+OpCode GetOpCode(string_view name);
 void ExecuteInstruction(OpCode opCode);
+
+// Returns the evaluate function of the instruction specialized for the operand
+// types, and sets resultType to the type of its result. Returns nullptr if the
+// instruction has no evaluate function for those types.
+EvaluateInstructionFunc SpecializeInstruction(OpCode opCode, ArgumentType left,
+                                              ArgumentType right,
+                                              ArgumentType& resultType);
 string GetInstructionName(OpCode opCode);
 
 bool operator==(Instruction left, Instruction right);
@@ -56,20 +105,18 @@ template <> struct fmt::formatter<OpCode> : formatter<string_view> {
   // parse is inherited from formatter<string_view>.
   template <typename FormatContext>
   auto format(OpCode opCode, FormatContext& ctx) {
-    string_view name = "unknown";
-    if (opCode == OpCode::Nop)
-      name = "Nop";
-    else if (opCode == OpCode::Push)
-      name = "Push";
-    else if (opCode == OpCode::Pop)
-      name = "Pop";
-    else if (HasInstruction(opCode))
+    string name = "unknown";
+    if ((size_t)opCode < NumberOfOpCodes)
       name = GetInstructionName(opCode);
 
     return formatter<string_view>::format(name, ctx);
   }
 };
 
+// Only the tests include doctest, so programs that use the library don't need
+// it.
+#if defined(DOCTEST_LIBRARY_INCLUDED)
 inline doctest::String toString(const OpCode& value) {
   return fmt::format("{}", value).c_str();
 }
+#endif
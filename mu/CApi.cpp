@@ -0,0 +1,175 @@
+#include "Configuration.hpp"
+
+#include <new>
+using std::nothrow;
+
+#include "CApi.h"
+#include "Program.hpp"
+
+// == C API ==
+//
+// Each handle is a program. The C types mirror the C++ ones, and the asserts
+// below keep them in sync.
+
+struct mu_program {
+  Program program;
+};
+
+static_assert((int)MU_TYPE_NONE == (int)ArgumentType::None &&
+              (int)MU_TYPE_I64 == (int)ArgumentType::i64 &&
+              (int)MU_TYPE_I32 == (int)ArgumentType::i32 &&
+              (int)MU_TYPE_F32 == (int)ArgumentType::f32 &&
+              (int)MU_TYPE_F64 == (int)ArgumentType::f64 &&
+              (int)MU_TYPE_BOOL == (int)ArgumentType::b &&
+              (int)MU_TYPE_CHAR == (int)ArgumentType::c);
+
+static_assert((int)MU_ENGINE_LOOP == (int)Engine::Loop &&
+              (int)MU_ENGINE_DIRECT_THREADED == (int)Engine::DirectThreaded &&
+              (int)MU_ENGINE_TAIL_CALL == (int)Engine::TailCall &&
+              (int)MU_ENGINE_JIT == (int)Engine::Jit &&
+              (int)MU_ENGINE_REGISTER == (int)Engine::Register &&
+              (int)MU_ENGINE_VERIFIED == (int)Engine::Verified &&
+              (int)MU_ENGINE_DECODED == (int)Engine::Decoded &&
+              (int)MU_ENGINE_TIERED == (int)Engine::Tiered);
+
+// No exception may cross the C API, so one that is thrown while a program is
+// created, such as when it cannot be allocated, means there is no program.
+template <typename Create> static mu_program* CreateProgram(Create create) {
+  try {
+    return new (nothrow) mu_program{create()};
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+mu_program* mu_load(const char* mu_file_path) {
+  return CreateProgram([&] { return Program::Load(mu_file_path); });
+}
+
+mu_program* mu_parse(const char* mutext) {
+  return CreateProgram([&] { return Program::Parse(mutext); });
+}
+
+mu_program* mu_parse_file(const char* mutext_file_path) {
+  return CreateProgram([&] { return Program::ParseFile(mutext_file_path); });
+}
+
+void mu_free(mu_program* program) { delete program; }
+
+bool mu_is_valid(const mu_program* program) {
+  return program->program.IsValid();
+}
+
+const char* mu_error_message(const mu_program* program) {
+  return program->program.GetErrorMessage().c_str();
+}
+
+// The engine comes from C, so it may be any int.
+bool mu_execute(mu_program* program, mu_engine engine) {
+  if ((int)engine < MU_ENGINE_LOOP || (int)engine > MU_ENGINE_TIERED)
+    return false;
+  try {
+    return program->program.Execute((Engine)engine);
+  } catch (...) {
+    return false;
+  }
+}
+
+size_t mu_result_count(const mu_program* program) {
+  return program->program.GetResults().size();
+}
+
+mu_value mu_result(const mu_program* program, size_t index) {
+  mu_value value = {MU_TYPE_NONE, {}};
+  if (index >= mu_result_count(program))
+    return value;
+
+  auto result = program->program.GetResults()[index];
+  value.type = (mu_type)result.Type();
+  switch (result.Type()) {
+  case ArgumentType::i64:
+    value.as.i64 = result.i64();
+    break;
+  case ArgumentType::i32:
+    value.as.i32 = result.i32();
+    break;
+  case ArgumentType::f32:
+    value.as.f32 = result.f32();
+    break;
+  case ArgumentType::f64:
+    value.as.f64 = result.f64();
+    break;
+  case ArgumentType::b:
+    value.as.b = result.b();
+    break;
+  case ArgumentType::c:
+    value.as.c = result.c();
+    break;
+  default:
+    break;
+  }
+  return value;
+}
+
+TEST_CASE("Verify C API behavior") {
+  SUBCASE("Parse and execute a program") {
+    auto program = mu_parse("Push i32:5\nPush f64:6.5\nAdd\nPush i64:7\n");
+    REQUIRE(program != nullptr);
+    CHECK(mu_is_valid(program));
+    CHECK(mu_execute(program, MU_ENGINE_VERIFIED));
+    REQUIRE(mu_result_count(program) == 2);
+    CHECK(mu_result(program, 0).type == MU_TYPE_F64);
+    CHECK(mu_result(program, 1).type == MU_TYPE_I64);
+    CHECK(mu_result(program, 1).as.i64 == 7);
+    CHECK(mu_error_message(program)[0] == '\0');
+    mu_free(program);
+  }
+
+  SUBCASE("Load and execute a program") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Subtract}};
+    TestMuFile testFile("test.mu", instructions);
+
+    auto program = mu_load("test.mu");
+    CHECK(mu_execute(program, MU_ENGINE_DIRECT_THREADED));
+    CHECK(mu_result(program, 0).as.i32 == -1);
+    mu_free(program);
+  }
+
+  SUBCASE("Parse a file and execute the program") {
+    TestFile testFile("test.mut", "Push c:a\n");
+
+    auto program = mu_parse_file("test.mut");
+    CHECK(mu_execute(program, MU_ENGINE_LOOP));
+    CHECK(mu_result(program, 0).type == MU_TYPE_CHAR);
+    CHECK(mu_result(program, 0).as.c == 'a');
+    mu_free(program);
+  }
+
+  SUBCASE("A program that is not valid has an error message") {
+    auto program = mu_load("does_not_exist.mu");
+    CHECK_FALSE(mu_is_valid(program));
+    CHECK_FALSE(mu_execute(program, MU_ENGINE_VERIFIED));
+    CHECK(mu_error_message(program)[0] != '\0');
+    CHECK(mu_result_count(program) == 0);
+    mu_free(program);
+  }
+
+  SUBCASE("An engine that does not exist is rejected") {
+    auto program = mu_parse("Push i32:1\n");
+    CHECK_FALSE(mu_execute(program, (mu_engine)(MU_ENGINE_TIERED + 1)));
+    CHECK_FALSE(mu_execute(program, (mu_engine)-1));
+    CHECK(mu_result_count(program) == 0);
+    CHECK(mu_execute(program, MU_ENGINE_TIERED));
+    mu_free(program);
+  }
+
+  SUBCASE("A result past the last one has no type") {
+    auto program = mu_parse("Push i32:1\n");
+    CHECK(mu_execute(program, MU_ENGINE_VERIFIED));
+    CHECK(mu_result(program, 0).type == MU_TYPE_I32);
+    CHECK(mu_result(program, 1).type == MU_TYPE_NONE);
+    CHECK(mu_result(program, SIZE_MAX).type == MU_TYPE_NONE);
+    mu_free(program);
+  }
+}
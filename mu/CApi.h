@@ -0,0 +1,80 @@
+#ifndef MU_CAPI_H
+#define MU_CAPI_H
+
+/* The C API for embedding the VM. It wraps the Program class (see
+   Program.hpp) for callers that cannot use C++. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mu_program mu_program;
+
+/* These match the argument types of the VM (see Argument.hpp). */
+typedef enum mu_type {
+  MU_TYPE_NONE,
+  MU_TYPE_I64,
+  MU_TYPE_I32,
+  MU_TYPE_F32,
+  MU_TYPE_F64,
+  MU_TYPE_BOOL,
+  MU_TYPE_CHAR
+} mu_type;
+
+typedef struct mu_value {
+  mu_type type;
+  union {
+    int64_t i64;
+    int32_t i32;
+    float f32;
+    double f64;
+    bool b;
+    char c;
+  } as;
+} mu_value;
+
+/* The engines match the engines of the VM (see InstructionProcessor.hpp). */
+typedef enum mu_engine {
+  MU_ENGINE_LOOP,
+  MU_ENGINE_DIRECT_THREADED,
+  MU_ENGINE_TAIL_CALL,
+  MU_ENGINE_JIT,
+  MU_ENGINE_REGISTER,
+  MU_ENGINE_VERIFIED,
+  MU_ENGINE_DECODED,
+  MU_ENGINE_TIERED
+} mu_engine;
+
+/* Each of these returns a program, even when it is not valid, so the error
+   message can be read. Free it with mu_free. They return NULL only when they
+   cannot create the program, such as when it cannot be allocated. */
+mu_program* mu_load(const char* mu_file_path);
+mu_program* mu_parse(const char* mutext);
+mu_program* mu_parse_file(const char* mutext_file_path);
+void mu_free(mu_program* program);
+
+bool mu_is_valid(const mu_program* program);
+
+/* The message is empty when there is no error. It is valid until the program
+   next executes or is freed. */
+const char* mu_error_message(const mu_program* program);
+
+/* Executes the program on the calling thread, and returns false if the
+   program is not valid, the engine is not one of the engines above, or the
+   execution fails. */
+bool mu_execute(mu_program* program, mu_engine engine);
+
+/* The values the last execution left on the stack, from the bottom up. A
+   value past the last one has the type MU_TYPE_NONE. */
+size_t mu_result_count(const mu_program* program);
+mu_value mu_result(const mu_program* program, size_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
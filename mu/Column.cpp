@@ -0,0 +1,162 @@
+#include "Configuration.hpp"
+
+#include <stdexcept>
+using std::logic_error;
+
+#include "Column.hpp"
+
+// == Column ==
+
+static size_t GetSizeOfType(ArgumentType type) {
+  switch (type) {
+  case ArgumentType::i32:
+  case ArgumentType::f32:
+    return 4;
+  case ArgumentType::i64:
+  case ArgumentType::f64:
+    return 8;
+  case ArgumentType::b:
+  case ArgumentType::c:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+Column::Column()
+    : m_type(ArgumentType::None), m_numberOfRows(0), m_isConstant(false) {}
+
+Column::Column(ArgumentType type, size_t numberOfRows) : Column() {
+  Reset(type, numberOfRows);
+}
+
+Column Column::Constant(Argument value, size_t numberOfRows) {
+  Column column;
+  column.ResetToConstant(value, numberOfRows);
+  return column;
+}
+
+ArgumentType Column::GetType() const { return m_type; }
+
+size_t Column::GetNumberOfRows() const { return m_numberOfRows; }
+
+bool Column::IsConstant() const { return m_isConstant; }
+
+void Column::Reset(ArgumentType type, size_t numberOfRows) {
+  auto size = GetSizeOfType(type) * numberOfRows;
+  m_storage.resize((size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  m_type = type;
+  m_numberOfRows = numberOfRows;
+  m_isConstant = false;
+}
+
+void Column::ResetToConstant(Argument value, size_t numberOfRows) {
+  Reset(value.Type(), 1);
+  Set(0, value);
+  m_numberOfRows = numberOfRows;
+  m_isConstant = true;
+}
+
+Argument Column::Get(size_t row) const {
+  assert(row < m_numberOfRows);
+  if (m_isConstant)
+    row = 0;
+
+  switch (m_type) {
+  case ArgumentType::i32:
+    return GetData<int32_t>()[row];
+  case ArgumentType::i64:
+    return GetData<int64_t>()[row];
+  case ArgumentType::f32:
+    return GetData<float>()[row];
+  case ArgumentType::f64:
+    return GetData<double>()[row];
+  case ArgumentType::b:
+    return GetData<bool>()[row];
+  case ArgumentType::c:
+    return GetData<char>()[row];
+  default:
+    return Argument();
+  }
+}
+
+void Column::Set(size_t row, Argument value) {
+  assert(row < m_numberOfRows);
+  if (value.Type() != m_type)
+    throw logic_error("The value does not have the type of the column.");
+  if (m_isConstant)
+    throw logic_error("The values of a constant column cannot be set.");
+
+  switch (m_type) {
+  case ArgumentType::i32:
+    GetData<int32_t>()[row] = value.i32();
+    break;
+  case ArgumentType::i64:
+    GetData<int64_t>()[row] = value.i64();
+    break;
+  case ArgumentType::f32:
+    GetData<float>()[row] = value.f32();
+    break;
+  case ArgumentType::f64:
+    GetData<double>()[row] = value.f64();
+    break;
+  case ArgumentType::b:
+    GetData<bool>()[row] = value.b();
+    break;
+  case ArgumentType::c:
+    GetData<char>()[row] = value.c();
+    break;
+  default:
+    break;
+  }
+}
+
+TEST_CASE("Verify column behavior") {
+  SUBCASE("A column holds a value for each row") {
+    Column column(ArgumentType::i64, 3);
+    column.Set(0, (int64_t)1);
+    column.Set(1, (int64_t)2);
+    column.Set(2, (int64_t)3);
+    CHECK(column.GetType() == ArgumentType::i64);
+    CHECK(column.GetNumberOfRows() == 3);
+    CHECK_FALSE(column.IsConstant());
+    CHECK(column.Get(1) == Argument((int64_t)2));
+    CHECK(column.GetData<int64_t>()[2] == 3);
+  }
+
+  SUBCASE("A column can be created from values") {
+    const float values[] = {1.5f, 2.5f};
+    auto column = Column::FromValues<float>(values);
+    CHECK(column.GetType() == ArgumentType::f32);
+    CHECK(column.Get(0) == Argument(1.5f));
+    CHECK(column.Get(1) == Argument(2.5f));
+  }
+
+  SUBCASE("A constant column holds the same value for every row") {
+    auto column = Column::Constant('a', 1000);
+    CHECK(column.IsConstant());
+    CHECK(column.GetNumberOfRows() == 1000);
+    CHECK(column.Get(0) == Argument('a'));
+    CHECK(column.Get(999) == Argument('a'));
+    CHECK_THROWS_AS(column.Set(0, 'b'), logic_error);
+  }
+
+  SUBCASE("A value of another type cannot be set") {
+    Column column(ArgumentType::i32, 1);
+    CHECK_THROWS_AS(column.Set(0, 1.0), logic_error);
+  }
+
+  SUBCASE("Resetting a column changes its type and number of rows") {
+    Column column(ArgumentType::b, 10);
+    column.Reset(ArgumentType::f64, 5);
+    CHECK(column.GetType() == ArgumentType::f64);
+    CHECK(column.GetNumberOfRows() == 5);
+    column.Set(4, 4.5);
+    CHECK(column.Get(4) == Argument(4.5));
+
+    column.ResetToConstant(7, 20);
+    CHECK(column.IsConstant());
+    CHECK(column.GetNumberOfRows() == 20);
+    CHECK(column.Get(19) == Argument(7));
+  }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+using std::span;
+#include <type_traits>
+using std::is_same_v;
+#include <vector>
+using std::vector;
+
+#include "Argument.hpp"
+
+// Returns the argument type that holds values of type T.
+template <typename T> constexpr ArgumentType GetArgumentType() {
+  if constexpr (is_same_v<T, int32_t>)
+    return ArgumentType::i32;
+  else if constexpr (is_same_v<T, int64_t>)
+    return ArgumentType::i64;
+  else if constexpr (is_same_v<T, float>)
+    return ArgumentType::f32;
+  else if constexpr (is_same_v<T, double>)
+    return ArgumentType::f64;
+  else if constexpr (is_same_v<T, bool>)
+    return ArgumentType::b;
+  else if constexpr (is_same_v<T, char>)
+    return ArgumentType::c;
+  else
+    return ArgumentType::None;
+}
+
+// A column holds one value of the same type for each row of a batch (see
+// BatchProgram.hpp). The values are stored contiguously, so an operation can
+// process many rows at once. A constant column stores one value, which it holds
+// for every row.
+class Column {
+public:
+  Column();
+  Column(ArgumentType type, size_t numberOfRows);
+
+  static Column Constant(Argument value, size_t numberOfRows);
+
+  template <typename T> static Column FromValues(span<const T> values) {
+    Column column(GetArgumentType<T>(), values.size());
+    auto data = column.GetData<T>();
+    for (size_t i = 0; i < values.size(); i++)
+      data[i] = values[i];
+    return column;
+  }
+
+  ArgumentType GetType() const;
+  size_t GetNumberOfRows() const;
+  bool IsConstant() const;
+
+  // Changes the type and the number of rows, keeping the storage when it is
+  // large enough. The values are not preserved.
+  void Reset(ArgumentType type, size_t numberOfRows);
+  void ResetToConstant(Argument value, size_t numberOfRows);
+
+  Argument Get(size_t row) const;
+  void Set(size_t row, Argument value);
+
+  // The data of a constant column has one value.
+  template <typename T> T* GetData() {
+    assert(GetArgumentType<T>() == m_type);
+    return (T*)m_storage.data();
+  }
+
+  template <typename T> const T* GetData() const {
+    assert(GetArgumentType<T>() == m_type);
+    return (const T*)m_storage.data();
+  }
+
+private:
+  ArgumentType m_type;
+  size_t m_numberOfRows;
+  bool m_isConstant;
+
+  // The storage is in 64-bit words, so the data is aligned for every type.
+  vector<uint64_t> m_storage;
+};
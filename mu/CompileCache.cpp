@@ -0,0 +1,376 @@
+#include "Configuration.hpp"
+
+#include <algorithm>
+using std::sort;
+#include <chrono>
+using std::chrono::hours;
+#include <cstdio>
+using std::fclose;
+using std::fopen;
+using std::remove;
+using std::rename;
+#include <cstring>
+using std::memcpy;
+using std::strlen;
+#include <exception>
+using std::exception;
+#include <filesystem>
+using std::filesystem::create_directories;
+using std::filesystem::directory_iterator;
+using std::filesystem::file_size;
+using std::filesystem::file_time_type;
+using std::filesystem::filesystem_error;
+using std::filesystem::last_write_time;
+using std::filesystem::path;
+using std::filesystem::remove_all;
+#include <memory>
+using std::make_unique;
+#include <system_error>
+using std::error_code;
+#include <vector>
+using std::vector;
+
+#include <unistd.h>
+
+#include <fmt/core.h>
+using fmt::format;
+
+#include "Assembler.hpp"
+#include "CompileCache.hpp"
+#include "Mutext/Parser.hpp"
+#include "ReadOnlyMemoryMappedFile.hpp"
+
+// == Compile Cache ==
+//
+// The same large μtext programs are executed again and again, and parsing them
+// each time is wasted work. The compile cache keeps the bytecode for each
+// program in a directory, named by a hash of the μtext, so a program that is
+// found there is mapped by the loader instead of parsed.
+//
+// Bytecode is written to a temporary file which is renamed in to place, so a
+// process never sees a file that another process is still writing. A file
+// that was cut short by a crash has the wrong size, and is removed when it is
+// found. When the cache grows past its maximum size, the programs that were
+// least recently used are removed. Each one that is found is touched, so the
+// time it was last written is the time it was last used.
+
+// This is XXH64, which hashes 32 bytes at a time, much faster than the μtext
+// can be parsed.
+static const uint64_t Prime1 = 11400714785074694791ull;
+static const uint64_t Prime2 = 14029467366897019727ull;
+static const uint64_t Prime3 = 1609587929392839161ull;
+static const uint64_t Prime4 = 9650029242287828579ull;
+static const uint64_t Prime5 = 2870177450012600261ull;
+
+static uint64_t RotateLeft(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t Read64(const byte* bytes) {
+  uint64_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+static uint32_t Read32(const byte* bytes) {
+  uint32_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+static uint64_t HashRound(uint64_t accumulator, uint64_t input) {
+  accumulator += input * Prime2;
+  return RotateLeft(accumulator, 31) * Prime1;
+}
+
+static uint64_t MergeRound(uint64_t hash, uint64_t accumulator) {
+  hash ^= HashRound(0, accumulator);
+  return hash * Prime1 + Prime4;
+}
+
+static uint64_t HashBytes(span<const byte> bytes, uint64_t seed) {
+  auto next = bytes.data();
+  auto end = next + bytes.size();
+  uint64_t hash;
+
+  if (bytes.size() >= 32) {
+    uint64_t accumulators[] = {seed + Prime1 + Prime2, seed + Prime2, seed,
+                               seed - Prime1};
+    for (; end - next >= 32; next += 32) {
+      for (auto i = 0; i < 4; i++)
+        accumulators[i] = HashRound(accumulators[i], Read64(next + i * 8));
+    }
+    hash = RotateLeft(accumulators[0], 1) + RotateLeft(accumulators[1], 7) +
+           RotateLeft(accumulators[2], 12) + RotateLeft(accumulators[3], 18);
+    for (auto accumulator : accumulators)
+      hash = MergeRound(hash, accumulator);
+  } else {
+    hash = seed + Prime5;
+  }
+
+  hash += bytes.size();
+  for (; end - next >= 8; next += 8) {
+    hash ^= HashRound(0, Read64(next));
+    hash = RotateLeft(hash, 27) * Prime1 + Prime4;
+  }
+  if (end - next >= 4) {
+    hash ^= Read32(next) * Prime1;
+    hash = RotateLeft(hash, 23) * Prime2 + Prime3;
+    next += 4;
+  }
+  for (; next < end; next++) {
+    hash ^= (uint8_t)*next * Prime5;
+    hash = RotateLeft(hash, 11) * Prime1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= Prime2;
+  hash ^= hash >> 29;
+  hash *= Prime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+static span<const byte> AsBytes(const char* text) {
+  return {(const byte*)text, strlen(text)};
+}
+
+TEST_CASE("Verify HashBytes behavior") {
+  SUBCASE("Gives the same hashes as XXH64") {
+    CHECK(HashBytes(AsBytes(""), 0) == 0xEF46DB3751D8E999ull);
+    CHECK(HashBytes(AsBytes("a"), 0) == 0xD24EC4F1A98C6E5Bull);
+    CHECK(HashBytes(AsBytes("abc"), 0) == 0x44BC2CF5AD770999ull);
+    CHECK(HashBytes(AsBytes("Nobody inspects the spammish repetition"), 0) ==
+          0xFBCEA83C8A378BF1ull);
+  }
+
+  SUBCASE("Every byte changes the hash") {
+    string text = "Push i32:1\nPush i32:2\nAdd\nPush f64:0.5\nSubtract\n";
+    auto hash = HashBytes(AsBytes(text.c_str()), 0);
+    auto allDifferent = true;
+    for (size_t i = 0; i < text.size(); i++) {
+      auto changed = text;
+      changed[i] ^= 1;
+      allDifferent =
+          allDifferent && HashBytes(AsBytes(changed.c_str()), 0) != hash;
+    }
+    CHECK(allDifferent);
+    CHECK(HashBytes(AsBytes(text.c_str()), 1) != hash);
+  }
+}
+
+CompileCache::CompileCache(const string& directory, uint64_t maximumSize)
+    : m_directory(directory), m_maximumSize(maximumSize),
+      m_numberOfTemporaryFiles(0) {
+  error_code error;
+  create_directories(m_directory, error);
+}
+
+uint64_t CompileCache::GetKey(span<const byte> mutext) {
+  // The layout of an instruction and the number of opcodes are part of the
+  // seed too, so a change to either one that forgets the version still misses.
+  uint64_t seed = (uint64_t)BytecodeVersion << 32 |
+                  sizeof(Instruction) << 8 | NumberOfOpCodes;
+  return HashBytes(mutext, seed);
+}
+
+unique_ptr<Loader> CompileCache::Find(uint64_t key) {
+  auto cachedPath = GetPath(key);
+  auto loader = make_unique<Loader>(cachedPath.c_str());
+  auto numberOfInstructions = loader->GetInstructions().size();
+  if (numberOfInstructions == 0)
+    return nullptr;
+
+  error_code error;
+  if (file_size(cachedPath, error) != sizeof(Loader::MuMagicHeader) +
+                                          numberOfInstructions *
+                                              sizeof(Instruction)) {
+    loader.reset();
+    remove(cachedPath.c_str());
+    return nullptr;
+  }
+
+  last_write_time(cachedPath, file_time_type::clock::now(), error);
+  return loader;
+}
+
+bool CompileCache::Store(uint64_t key, span<const Instruction> instructions) {
+  auto cachedPath = GetPath(key);
+  auto temporaryPath = format("{}.{}.{}.tmp", cachedPath, getpid(),
+                              m_numberOfTemporaryFiles++);
+  auto file = fopen(temporaryPath.c_str(), "wb");
+  if (file == nullptr)
+    return false;
+
+  auto written = true;
+  try {
+    BytecodeWriter writer(file);
+    writer.Write(instructions);
+    writer.Flush();
+  } catch (const exception&) {
+    written = false;
+  }
+  written = fclose(file) == 0 && written;
+  if (!written || rename(temporaryPath.c_str(), cachedPath.c_str()) != 0) {
+    remove(temporaryPath.c_str());
+    return false;
+  }
+
+  // Another process can remove a file while it is being looked at, which is
+  // not a reason to fail.
+  try {
+    Evict();
+  } catch (const filesystem_error&) {
+  }
+  return true;
+}
+
+uint64_t CompileCache::GetSize() const {
+  uint64_t size = 0;
+  error_code error;
+  for (auto& entry : directory_iterator(m_directory, error)) {
+    auto fileSize = entry.file_size(error);
+    if (entry.path().extension() == ".mu" && !error)
+      size += fileSize;
+  }
+  return size;
+}
+
+string CompileCache::GetPath(uint64_t key) const {
+  return format("{}/{:016x}.mu", m_directory, key);
+}
+
+void CompileCache::Evict() {
+  struct CachedProgram {
+    path cachedPath;
+    file_time_type lastUsed;
+    uint64_t size;
+  };
+
+  vector<CachedProgram> programs;
+  uint64_t size = 0;
+  for (auto& entry : directory_iterator(m_directory)) {
+    if (entry.path().extension() != ".mu")
+      continue;
+    programs.push_back({entry.path(), entry.last_write_time(),
+                        entry.file_size()});
+    size += programs.back().size;
+  }
+  if (size <= m_maximumSize)
+    return;
+
+  sort(programs.begin(), programs.end(), [](auto& left, auto& right) {
+    return left.lastUsed < right.lastUsed;
+  });
+  for (auto& program : programs) {
+    if (size <= m_maximumSize)
+      break;
+    error_code error;
+    if (std::filesystem::remove(program.cachedPath, error))
+      size -= program.size;
+  }
+}
+
+// Each test starts with an empty cache, which is removed at the end.
+class TestCompileCache : public CompileCache {
+public:
+  TestCompileCache(uint64_t maximumSize = DefaultCompileCacheSize)
+      : CompileCache(CreateEmptyDirectory(), maximumSize) {}
+  ~TestCompileCache() { remove_all("test-cache"); }
+
+private:
+  static string CreateEmptyDirectory() {
+    remove_all("test-cache");
+    return "test-cache";
+  }
+};
+
+static uint64_t GetTestKey(const char* mutext) {
+  return CompileCache::GetKey(AsBytes(mutext));
+}
+
+TEST_CASE("Verify CompileCache behavior") {
+  Instruction instructions[] = {
+      {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+
+  SUBCASE("Finds the bytecode it stored") {
+    TestCompileCache cache;
+    auto key = GetTestKey("Push i32:2\nPush i32:3\nAdd\n");
+    CHECK(cache.Find(key) == nullptr);
+    REQUIRE(cache.Store(key, instructions));
+    auto loader = cache.Find(key);
+    REQUIRE(loader != nullptr);
+    VerifyInstructions(instructions, loader->GetInstructions());
+  }
+
+  SUBCASE("Programs with different μtext have different keys") {
+    CHECK(GetTestKey("Push i32:2\n") != GetTestKey("Push i32:3\n"));
+    CHECK(GetTestKey("Push i32:2\n") != GetTestKey("Push i32:2\n\n"));
+  }
+
+  SUBCASE("Leaves no temporary files") {
+    TestCompileCache cache;
+    cache.Store(1, instructions);
+    cache.Store(1, instructions);
+    auto numberOfFiles = 0;
+    for (auto& entry : directory_iterator("test-cache")) {
+      CHECK(entry.path().extension() == ".mu");
+      numberOfFiles++;
+    }
+    CHECK(numberOfFiles == 1);
+  }
+
+  SUBCASE("Removes bytecode that was cut short") {
+    TestCompileCache cache;
+    cache.Store(1, instructions);
+    std::filesystem::resize_file("test-cache/0000000000000001.mu",
+                                 sizeof(Loader::MuMagicHeader) +
+                                     sizeof(Instruction) + 1);
+    CHECK(cache.Find(1) == nullptr);
+    CHECK(cache.GetSize() == 0);
+  }
+
+  SUBCASE("Removes the least recently used programs when it is full") {
+    auto programSize = sizeof(Loader::MuMagicHeader) + sizeof(instructions);
+    TestCompileCache cache(programSize * 2);
+    cache.Store(1, instructions);
+    cache.Store(2, instructions);
+    CHECK(cache.GetSize() == programSize * 2);
+
+    // The file times are set, so the test does not depend on how precise the
+    // clock of the file system is.
+    auto now = file_time_type::clock::now();
+    last_write_time("test-cache/0000000000000001.mu",
+                    now - hours(2));
+    last_write_time("test-cache/0000000000000002.mu",
+                    now - hours(3));
+    cache.Find(1);
+    cache.Store(3, instructions);
+    CHECK(cache.GetSize() == programSize * 2);
+    CHECK(cache.Find(1) != nullptr);
+    CHECK(cache.Find(2) == nullptr);
+    CHECK(cache.Find(3) != nullptr);
+  }
+}
+
+TEST_CASE("Verify compile cache performance") {
+  auto mutext = GenerateArithmeticMutext(250000);
+  TestFile testFile("performance.mut", mutext.c_str());
+  TestCompileCache cache;
+  auto mutextBytes = AsBytes(mutext.c_str());
+  cache.Store(CompileCache::GetKey(mutextBytes),
+              ParseMutextFile("performance.mut"));
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(mutext.size()).unit("B");
+
+  b.run("Parse the μtext", [] {
+    ankerl::nanobench::doNotOptimizeAway(ParseMutextFile("performance.mut"));
+  });
+
+  b.run("Hash the μtext and load the cached bytecode", [&] {
+    ReadOnlyMemoryMappedFile file("performance.mut");
+    auto key = CompileCache::GetKey({file.GetBuffer(), file.GetSize()});
+    ankerl::nanobench::doNotOptimizeAway(cache.Find(key));
+  });
+}
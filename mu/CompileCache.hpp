@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+using std::atomic;
+#include <cstddef>
+using std::byte;
+#include <cstdint>
+#include <memory>
+using std::unique_ptr;
+#include <span>
+using std::span;
+#include <string>
+using std::string;
+
+#include "Bytecode.hpp"
+#include "Loader.hpp"
+
+const uint64_t DefaultCompileCacheSize = 1024 * 1024 * 1024;
+
+class CompileCache {
+public:
+  // The directory is created if it does not exist.
+  explicit CompileCache(const string& directory,
+                        uint64_t maximumSize = DefaultCompileCacheSize);
+
+  // The key of a μtext program is a hash of its contents and the bytecode
+  // version, so a program that has changed, or was cached by a VM with a
+  // different bytecode version, is not found.
+  static uint64_t GetKey(span<const byte> mutext);
+
+  // Returns a loader for the cached bytecode, or nullptr if the program is not
+  // in the cache.
+  unique_ptr<Loader> Find(uint64_t key);
+
+  // Saves the bytecode so that other processes never see part of it, then
+  // removes the least recently used programs until the cache fits in its
+  // maximum size. Returns false if the bytecode cannot be saved.
+  bool Store(uint64_t key, span<const Instruction> instructions);
+
+  // The total size of the cached bytecode files.
+  uint64_t GetSize() const;
+
+private:
+  string m_directory;
+  uint64_t m_maximumSize;
+  atomic<uint64_t> m_numberOfTemporaryFiles;
+
+  string GetPath(uint64_t key) const;
+  void Evict();
+};
+
+// Internal API
+static uint64_t HashBytes(span<const byte> bytes, uint64_t seed);
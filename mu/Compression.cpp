@@ -0,0 +1,274 @@
+#include "Configuration.hpp"
+
+#include <algorithm>
+using std::min;
+#include <cstring>
+using std::memcpy;
+#include <new>
+#include <random>
+using std::mt19937;
+
+#include "Bytecode.hpp"
+#include "Compression.hpp"
+
+// == Compression ==
+//
+// Bytecode compresses well. Each instruction is 24 bytes, most of which are
+// padding, type tags and small values that repeat from one instruction to the
+// next. The codec is LZ77 in the style of LZ4, which decompresses quickly
+// enough to keep ahead of execution.
+//
+// The compressed bytes are a list of sequences. Each sequence is a token byte,
+// some literal bytes, then a match: a two byte offset back in to the output,
+// and the number of bytes to copy from there. The high four bits of the token
+// are the number of literals and the low four bits are the length of the match
+// less MinimumMatchLength. When either is 15, bytes that are added to it
+// follow, and the last of them is less than 255. The last sequence has only
+// literals.
+
+static const size_t MinimumMatchLength = 4;
+static const size_t MaximumOffset = 65535;
+static const int HashBits = 14;
+static const size_t FastCopySize = 16;
+
+static uint32_t Read32(const byte* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static size_t Hash(uint32_t value) {
+  return (value * 2654435761u) >> (32 - HashBits);
+}
+
+static void WriteLength(size_t length, vector<byte>& output) {
+  for (; length >= 255; length -= 255)
+    output.push_back(byte{255});
+  output.push_back((byte)length);
+}
+
+// A match length of zero ends the block.
+static void WriteSequence(const byte* literals, size_t numberOfLiterals,
+                          size_t offset, size_t matchLength,
+                          vector<byte>& output) {
+  auto literalsToken = min<size_t>(numberOfLiterals, 15);
+  auto matchToken =
+      matchLength == 0 ? 0 : min<size_t>(matchLength - MinimumMatchLength, 15);
+  output.push_back((byte)(literalsToken << 4 | matchToken));
+  if (literalsToken == 15)
+    WriteLength(numberOfLiterals - 15, output);
+  output.insert(output.end(), literals, literals + numberOfLiterals);
+  if (matchLength == 0)
+    return;
+
+  output.push_back((byte)(offset & 0xFF));
+  output.push_back((byte)(offset >> 8));
+  if (matchToken == 15)
+    WriteLength(matchLength - MinimumMatchLength - 15, output);
+}
+
+void CompressBlock(span<const byte> input, vector<byte>& output) {
+  // The last position each hash of four bytes was seen at.
+  vector<uint32_t> positions(1 << HashBits, 0);
+  auto data = input.data();
+  auto size = input.size();
+  size_t literals = 0;
+  size_t position = 0;
+  while (position + MinimumMatchLength <= size) {
+    auto value = Read32(data + position);
+    auto& entry = positions[Hash(value)];
+    size_t candidate = entry;
+    entry = (uint32_t)position;
+    if (candidate >= position || position - candidate > MaximumOffset ||
+        Read32(data + candidate) != value) {
+      position++;
+      continue;
+    }
+
+    auto length = MinimumMatchLength;
+    while (position + length < size &&
+           data[candidate + length] == data[position + length])
+      length++;
+    WriteSequence(data + literals, position - literals, position - candidate,
+                  length, output);
+    position += length;
+    literals = position;
+  }
+  WriteSequence(data + literals, size - literals, 0, 0, output);
+}
+
+static bool ReadLength(const byte*& input, const byte* end, size_t& length) {
+  byte value;
+  do {
+    if (input == end)
+      return false;
+    value = *input++;
+    length += (size_t)value;
+  } while (value == byte{255});
+  return true;
+}
+
+bool DecompressBlock(span<const byte> input, span<byte> output) {
+  auto in = input.data();
+  auto inEnd = in + input.size();
+  auto out = output.data();
+  auto outEnd = out + output.size();
+  while (in < inEnd) {
+    auto token = (size_t)*in++;
+    size_t literals = token >> 4;
+
+    // Most sequences are short, and are far from the ends of the input and the
+    // output, so fixed size copies of more bytes than they need are faster than
+    // copies of just the right size.
+    auto offset = literals < 15 && inEnd - in >= FastCopySize + 2
+                      ? (size_t)in[literals] | (size_t)in[literals + 1] << 8
+                      : 0;
+    if ((token & 15) < 15 && offset >= FastCopySize &&
+        offset <= (size_t)(out - output.data()) + literals &&
+        outEnd - out >= 3 * FastCopySize) {
+      memcpy(out, in, FastCopySize);
+      in += literals + 2;
+      out += literals;
+      auto match = out - offset;
+      memcpy(out, match, FastCopySize);
+      memcpy(out + FastCopySize, match + FastCopySize, FastCopySize);
+      out += (token & 15) + MinimumMatchLength;
+      continue;
+    }
+
+    if (literals == 15 && !ReadLength(in, inEnd, literals))
+      return false;
+    if (literals > (size_t)(inEnd - in) || literals > (size_t)(outEnd - out))
+      return false;
+    // An empty output has no buffer to copy to.
+    if (literals > 0)
+      memcpy(out, in, literals);
+    in += literals;
+    out += literals;
+    if (in == inEnd)
+      break;
+
+    if (inEnd - in < 2)
+      return false;
+    offset = (size_t)in[0] | (size_t)in[1] << 8;
+    in += 2;
+    size_t length = (token & 15) + MinimumMatchLength;
+    if ((token & 15) == 15 && !ReadLength(in, inEnd, length))
+      return false;
+    if (offset == 0 || offset > (size_t)(out - output.data()) ||
+        length > (size_t)(outEnd - out))
+      return false;
+
+    // The match can overlap the bytes it produces, when it repeats the last
+    // offset bytes. Those repeat every offset bytes, so copying from the start
+    // of the match never reads bytes that have not been written, and each copy
+    // can be twice as long as the one before.
+    auto match = out - offset;
+    while (length > 0) {
+      auto size = min<size_t>(out - match, length);
+      memcpy(out, match, size);
+      out += size;
+      length -= size;
+    }
+  }
+  return out == outEnd;
+}
+
+static vector<byte> Compress(span<const byte> input) {
+  vector<byte> output;
+  CompressBlock(input, output);
+  return output;
+}
+
+// The instructions are zeroed first, so the padding is the same in each one,
+// as it is in bytecode files.
+static vector<Instruction> CreateProgram(size_t numberOfInstructions) {
+  vector<Instruction> instructions(numberOfInstructions);
+  for (size_t i = 0; i < numberOfInstructions; i++) {
+    if (i % 4 < 2) {
+      instructions[i].opCode = OpCode::Push;
+      new (&instructions[i].argument) Argument((int32_t)i);
+    } else {
+      instructions[i].opCode = i % 4 == 2 ? OpCode::Add : OpCode::Pop;
+    }
+  }
+  return instructions;
+}
+
+TEST_CASE("Verify compression behavior") {
+  SUBCASE("Decompresses to the bytes that were compressed") {
+    mt19937 random(42);
+    vector<byte> input(100000);
+    for (size_t i = 0; i < input.size(); i++)
+      input[i] = (byte)(i % 1000 < 500 ? random() % 4 : random());
+    auto compressed = Compress(input);
+    vector<byte> output(input.size());
+    REQUIRE(DecompressBlock(compressed, output));
+    CHECK(output == input);
+  }
+
+  SUBCASE("Long runs of the same bytes decompress") {
+    vector<byte> input(70000, byte{7});
+    input[0] = byte{1};
+    auto compressed = Compress(input);
+    CHECK(compressed.size() < 400);
+    vector<byte> output(input.size());
+    REQUIRE(DecompressBlock(compressed, output));
+    CHECK(output == input);
+  }
+
+  SUBCASE("Short and empty inputs decompress") {
+    for (size_t size = 0; size < 20; size++) {
+      vector<byte> input(size, byte{3});
+      auto compressed = Compress(input);
+      vector<byte> output(size);
+      REQUIRE(DecompressBlock(compressed, output));
+      CHECK(output == input);
+    }
+  }
+
+  SUBCASE("Bytecode compresses to a small part of its size") {
+    auto instructions = CreateProgram(InstructionsPerCompressedBlock);
+    auto compressed = Compress(as_bytes(span(instructions)));
+    CHECK(compressed.size() * 4 < instructions.size() * sizeof(Instruction));
+  }
+
+  SUBCASE("Input that is not valid is rejected") {
+    vector<byte> input(1000, byte{5});
+    auto compressed = Compress(input);
+    vector<byte> output(input.size());
+    CHECK_FALSE(DecompressBlock(span(compressed).first(compressed.size() / 2),
+                                output));
+
+    vector<byte> tooSmall(input.size() - 1);
+    CHECK_FALSE(DecompressBlock(compressed, tooSmall));
+
+    // A match from before the start of the output.
+    vector<byte> badOffset = {byte{0x10}, byte{1}, byte{2}, byte{0}};
+    CHECK_FALSE(DecompressBlock(badOffset, output));
+  }
+}
+
+TEST_CASE("Verify compression performance") {
+  auto instructions = CreateProgram(InstructionsPerCompressedBlock);
+  auto input = as_bytes(span(instructions));
+  auto compressed = Compress(input);
+  vector<Instruction> output(instructions.size());
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(input.size()).unit("byte");
+
+  b.run("Copy a block", [&] {
+    memcpy(output.data(), instructions.data(), input.size());
+    ankerl::nanobench::doNotOptimizeAway(output);
+  });
+
+  b.run("Decompress a block", [&] {
+    DecompressBlock(compressed, as_writable_bytes(span(output)));
+    ankerl::nanobench::doNotOptimizeAway(output);
+  });
+
+  b.run("Compress a block", [&] {
+    ankerl::nanobench::doNotOptimizeAway(Compress(input));
+  });
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+using std::byte;
+#include <cstdint>
+#include <span>
+using std::span;
+#include <vector>
+using std::vector;
+
+// A compressed .mu file starts with Loader::MuCompressedMagicHeader. Then
+// there are the blocks, which each start with a CompressedBlockHeader, then an
+// empty block header, then the offset in the file of each block, and then a
+// CompressedTrailer.
+struct CompressedBlockHeader {
+  uint32_t compressedSize;
+  uint32_t numberOfInstructions;
+};
+
+struct CompressedTrailer {
+  uint64_t indexOffset;
+  uint64_t numberOfInstructions;
+};
+
+const size_t InstructionsPerCompressedBlock = 65536;
+
+// Appends the compressed bytes to the output.
+void CompressBlock(span<const byte> input, vector<byte>& output);
+
+// Returns false if the input is not valid, or does not decompress to exactly
+// the size of the output.
+bool DecompressBlock(span<const byte> input, span<byte> output);
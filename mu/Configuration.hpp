@@ -2,8 +2,13 @@
 
 #include <nanobench.h>
 
-// This is implemented in main.cpp.
+// These are implemented in TestMain.cpp.
 const char* GetCurrentTestName();
 
+// The number of times operator new has been called, so benchmarks can report
+// allocations. It is always zero with the address sanitizer, which replaces
+// operator new itself.
+size_t GetNumberOfAllocations();
+
 #include "Log.hpp"
 #include "TestUtilities.hpp"
@@ -0,0 +1,586 @@
+#include "Configuration.hpp"
+
+#include <algorithm>
+using std::min;
+#include <array>
+using std::array;
+#include <stdexcept>
+using std::logic_error;
+#include <utility>
+using std::index_sequence;
+using std::make_index_sequence;
+
+#include <fmt/core.h>
+using fmt::format;
+
+#include "DecodedProgram.hpp"
+#include "InstructionProcessor.hpp"
+#include "Interpreter/Interpreter.hpp"
+#include "Superinstructions.hpp"
+#include "ValueStack.hpp"
+
+// == Decoded Program ==
+//
+// The instruction processor looks at the opcode of each instruction every time
+// it executes it. A decoded program does that work once: each instruction is
+// decoded to the handler that executes it and the operand that handler needs.
+//
+// Decoding is lazy. The program is split into blocks, and each block is decoded
+// the first time execution reaches it. The decoded instructions are kept, so
+// executing the program again only pays for the handlers. μ has no branches
+// yet, so every block is a fixed-size run of instructions.
+//
+// Common sequences of instructions are fused into superinstructions, which
+// execute the whole sequence with one dispatch. The first instruction of the
+// sequence gets the handler for the superinstruction, and the instructions
+// after it are decoded as usual, so the superinstruction can read their
+// operands in place. The sequences are generated at build time from profiles of
+// the workloads in the corpus directory (see
+// tools/generate_superinstructions.py).
+//
+// Instructions that know how to quicken themselves start with a handler that
+// asks for a specialized handler the first time it executes, and replaces
+// itself with that one (see BinaryArithmeticOperation.hpp).
+//
+// The decoded program refers to the instructions it was created from, so they
+// must outlive it. If an instruction is registered after decoding, the whole
+// program is decoded again before it next executes.
+
+static DecodedInstruction* PushHandler(DecodedInstruction* instruction) {
+  Push(instruction->operand);
+  return instruction + 1;
+}
+
+static DecodedInstruction* PopHandler(DecodedInstruction* instruction) {
+  Pop();
+  return instruction + 1;
+}
+
+// The opcode is part of the handler, so executing a registered instruction is a
+// single load from the instruction registry. This keeps instructions registered
+// after decoding working, just like the instruction processor.
+template <OpCode opCode>
+static DecodedInstruction* RegisteredHandler(DecodedInstruction* instruction) {
+  ExecuteInstruction(opCode);
+  return instruction + 1;
+}
+
+template <OpCode opCode>
+static DecodedInstruction* QuickeningHandler(DecodedInstruction* instruction) {
+  auto handler = GetInstructionMetadata(opCode).quicken();
+  if (handler == nullptr)
+    handler = RegisteredHandler<opCode>;
+
+  instruction->handler = handler;
+  return handler(instruction);
+}
+
+template <size_t... OpCodes>
+static constexpr auto BuildRegisteredHandlers(index_sequence<OpCodes...>) {
+  return array<DecodedHandler, NumberOfOpCodes>{
+      RegisteredHandler<(OpCode)OpCodes>...};
+}
+
+template <size_t... OpCodes>
+static constexpr auto BuildQuickeningHandlers(index_sequence<OpCodes...>) {
+  return array<DecodedHandler, NumberOfOpCodes>{
+      QuickeningHandler<(OpCode)OpCodes>...};
+}
+
+static constexpr auto RegisteredHandlers =
+    BuildRegisteredHandlers(make_index_sequence<NumberOfOpCodes>());
+
+static constexpr auto QuickeningHandlers =
+    BuildQuickeningHandlers(make_index_sequence<NumberOfOpCodes>());
+
+// An opcode that cannot be executed is only an error once execution reaches it,
+// in the same way as it is for the instruction processor.
+static DecodedInstruction*
+UnexpectedOpCodeHandler(DecodedInstruction* instruction) {
+  throw logic_error(
+      format("Unexpected opcode: {}", instruction->operand.i32()));
+}
+
+// The first instruction of a superinstruction holds the superinstruction
+// handler in its slot, so its own handler executes on a copy of it. A handler
+// that quickens or rewrites itself does so in the copy, which is kept for next
+// time.
+static void ExecuteFirstFusedInstruction(DecodedInstruction& instruction) {
+  DecodedInstruction first = {instruction.fusedHandler};
+  first.handler(&first);
+  instruction.fusedHandler = first.handler;
+}
+
+// Every fused instruction but a push or a pop uses its own handler, which might
+// be quickened.
+template <size_t index, OpCode opCode>
+static void ExecuteFusedInstruction(DecodedInstruction* instruction) {
+  if constexpr (opCode == OpCode::Push)
+    Push(instruction[index].operand);
+  else if constexpr (opCode == OpCode::Pop)
+    Pop();
+  else if constexpr (index == 0)
+    ExecuteFirstFusedInstruction(instruction[0]);
+  else
+    instruction[index].handler(&instruction[index]);
+}
+
+template <OpCode... opCodes, size_t... indices>
+static void ExecuteFusedInstructions(DecodedInstruction* instruction,
+                                     index_sequence<indices...>) {
+  (ExecuteFusedInstruction<indices, opCodes>(instruction), ...);
+}
+
+template <OpCode... opCodes>
+static DecodedInstruction*
+SuperinstructionHandler(DecodedInstruction* instruction) {
+  ExecuteFusedInstructions<opCodes...>(
+      instruction, make_index_sequence<sizeof...(opCodes)>());
+  return instruction + sizeof...(opCodes);
+}
+
+static constexpr size_t MaximumSuperinstructionLength = 3;
+
+struct Superinstruction {
+  DecodedHandler handler;
+  size_t length;
+  OpCode opCodes[MaximumSuperinstructionLength];
+};
+
+template <typename... OpCodes> constexpr size_t CountOpCodes(OpCodes...) {
+  static_assert(sizeof...(OpCodes) <= MaximumSuperinstructionLength);
+  return sizeof...(OpCodes);
+}
+
+#define DEFINE_SUPERINSTRUCTION(...)                                           \
+  {SuperinstructionHandler<__VA_ARGS__>, CountOpCodes(__VA_ARGS__),            \
+   {__VA_ARGS__}},
+
+// The list ends with an empty superinstruction, so it is never empty.
+static constexpr Superinstruction Superinstructions[] = {
+    SUPERINSTRUCTIONS(DEFINE_SUPERINSTRUCTION){}};
+
+#undef DEFINE_SUPERINSTRUCTION
+
+static bool CanExecute(OpCode opCode) {
+  return opCode == OpCode::Push || opCode == OpCode::Pop ||
+         HasInstruction(opCode);
+}
+
+static bool Matches(const Superinstruction& superinstruction,
+                    span<Instruction> instructions) {
+  if (instructions.size() < superinstruction.length)
+    return false;
+
+  for (size_t i = 0; i < superinstruction.length; i++) {
+    if (instructions[i].opCode != superinstruction.opCodes[i] ||
+        !CanExecute(instructions[i].opCode))
+      return false;
+  }
+  return true;
+}
+
+static DecodedInstruction Decode(Instruction instruction,
+                                 DecodeOptions options) {
+  auto opCode = instruction.opCode;
+  if (opCode == OpCode::Push)
+    return {PushHandler, instruction.argument};
+  if (opCode == OpCode::Pop)
+    return {PopHandler};
+  if (!HasInstruction(opCode))
+    return {UnexpectedOpCodeHandler, (int32_t)opCode};
+  if (options.quicken && GetInstructionMetadata(opCode).quicken != nullptr)
+    return {QuickeningHandlers[(size_t)opCode]};
+  return {RegisteredHandlers[(size_t)opCode]};
+}
+
+DecodedProgram::DecodedProgram(span<Instruction> instructions,
+                               DecodeOptions options)
+    : m_instructions(instructions), m_options(options),
+      m_registryVersion(GetInstructionRegistryVersion()),
+      m_decodedInstructions(instructions.size()),
+      m_isBlockDecoded(GetNumberOfBlocks()), m_numberOfDecodedBlocks(0) {}
+
+void DecodedProgram::Execute() {
+  if (m_registryVersion != GetInstructionRegistryVersion()) {
+    m_registryVersion = GetInstructionRegistryVersion();
+    m_isBlockDecoded.assign(GetNumberOfBlocks(), false);
+    m_numberOfDecodedBlocks = 0;
+  }
+
+  for (size_t block = 0; block < GetNumberOfBlocks(); block++) {
+    if (!m_isBlockDecoded[block])
+      DecodeBlock(block);
+
+    auto start = block * BlockSize;
+    auto end = min(start + BlockSize, m_instructions.size());
+
+    auto instruction = m_decodedInstructions.data() + start;
+    auto lastInstruction = m_decodedInstructions.data() + end;
+    while (instruction != lastInstruction)
+      instruction = instruction->handler(instruction);
+  }
+}
+
+span<const DecodedInstruction> DecodedProgram::GetDecodedInstructions() const {
+  return m_decodedInstructions;
+}
+
+size_t DecodedProgram::GetNumberOfBlocks() const {
+  return (m_instructions.size() + BlockSize - 1) / BlockSize;
+}
+
+size_t DecodedProgram::GetNumberOfDecodedBlocks() const {
+  return m_numberOfDecodedBlocks;
+}
+
+void DecodedProgram::DecodeBlock(size_t block) {
+  auto start = block * BlockSize;
+  auto end = min(start + BlockSize, m_instructions.size());
+  for (auto i = start; i < end; i++)
+    m_decodedInstructions[i] = Decode(m_instructions[i], m_options);
+
+  if (m_options.fuse)
+    FuseBlock(start, end);
+
+  m_isBlockDecoded[block] = true;
+  m_numberOfDecodedBlocks++;
+}
+
+// Superinstructions are listed longest and most common first, so the first
+// one that matches is the best one. They never cross the end of a block.
+void DecodedProgram::FuseBlock(size_t start, size_t end) {
+  auto i = start;
+  while (i < end) {
+    auto instructions = m_instructions.subspan(i, end - i);
+    auto length = 1;
+    for (auto& superinstruction : Superinstructions) {
+      if (superinstruction.length != 0 &&
+          Matches(superinstruction, instructions)) {
+        auto& first = m_decodedInstructions[i];
+        if (instructions[0].opCode != OpCode::Push &&
+            instructions[0].opCode != OpCode::Pop)
+          first.fusedHandler = first.handler;
+        first.handler = superinstruction.handler;
+        length = superinstruction.length;
+        break;
+      }
+    }
+    i += length;
+  }
+}
+
+TEST_CASE("Verify decoded program behavior") {
+  SUBCASE("Push two values and add") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    DecodedProgram program(instructions);
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+  }
+
+  SUBCASE("Push three values, pop one and subtract") {
+    Instruction instructions[] = {{OpCode::Push, 2},
+                                  {OpCode::Push, 3},
+                                  {OpCode::Push, 8},
+                                  {OpCode::Pop},
+                                  {OpCode::Subtract}};
+    DecodedProgram program(instructions);
+    program.Execute();
+    CHECK(Pop().i32() == -1);
+  }
+
+  SUBCASE("A program can be executed more than once") {
+    Instruction instructions[] = {
+        {OpCode::Push, 40}, {OpCode::Push, 2}, {OpCode::Add}};
+    DecodedProgram program(instructions);
+    program.Execute();
+    program.Execute();
+    CHECK(Pop().i32() == 42);
+    CHECK(Pop().i32() == 42);
+  }
+
+  SUBCASE("Nothing is decoded before the program executes") {
+    Instruction instructions[] = {{OpCode::Push, 2}, {OpCode::Pop}};
+    DecodedProgram program(instructions);
+    CHECK(program.GetNumberOfBlocks() == 1);
+    CHECK(program.GetNumberOfDecodedBlocks() == 0);
+  }
+
+  SUBCASE("Each block is decoded once") {
+    vector<Instruction> instructions;
+    for (size_t i = 0; i < DecodedProgram::BlockSize; i++) {
+      instructions.push_back({OpCode::Push, 1});
+      instructions.push_back({OpCode::Pop});
+    }
+
+    DecodedProgram program(instructions);
+    program.Execute();
+    program.Execute();
+    CHECK(program.GetNumberOfBlocks() == 2);
+    CHECK(program.GetNumberOfDecodedBlocks() == 2);
+  }
+
+  SUBCASE("Blocks after an unexpected opcode are not decoded") {
+    vector<Instruction> instructions(DecodedProgram::BlockSize * 2,
+                                     {OpCode::Push, 1});
+    instructions[DecodedProgram::BlockSize / 2] = {(OpCode)42};
+
+    auto stackSize = StackSize();
+    DecodedProgram program(instructions);
+    CHECK_THROWS_AS(program.Execute(), logic_error);
+    CHECK(program.GetNumberOfDecodedBlocks() == 1);
+    CHECK(StackSize() == stackSize + DecodedProgram::BlockSize / 2);
+    while (StackSize() > stackSize)
+      Pop();
+  }
+
+  SUBCASE("Instructions registered after decoding are executed") {
+    static bool MockAddCalled = false;
+    Instruction instructions[] = {
+        {OpCode::Push, 1}, {OpCode::Push, 2}, {OpCode::Add}};
+    DecodedProgram program(instructions);
+    program.Execute();
+    CHECK(Pop().i32() == 3);
+
+    RegisterInstruction(OpCode::Add, {.execute = [] { MockAddCalled = true; },
+                                      .name = "MockAdd"});
+    program.Execute();
+    RegisterInstruction(OpCode::Add, GetAddMetadata());
+
+    CHECK(MockAddCalled);
+    CHECK(Pop().i32() == 2);
+    CHECK(Pop().i32() == 1);
+  }
+}
+
+TEST_CASE("Verify quickening behavior") {
+  SUBCASE("An instruction keeps its quickened handler") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    DecodedProgram program(instructions);
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+    auto quickenedHandler = program.GetDecodedInstructions()[2].handler;
+
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+    CHECK(program.GetDecodedInstructions()[2].handler == quickenedHandler);
+  }
+
+  SUBCASE("A quickened instruction still handles other types") {
+    Instruction instructions[] = {{OpCode::Add}};
+    DecodedProgram program(instructions);
+    Push(2);
+    Push(3);
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+    auto quickenedHandler = program.GetDecodedInstructions()[0].handler;
+
+    Push(2.5);
+    Push(1);
+    program.Execute();
+    CHECK(Pop().f64() == 3.5);
+    CHECK(program.GetDecodedInstructions()[0].handler != quickenedHandler);
+
+    Push((int64_t)4);
+    Push(1.5f);
+    program.Execute();
+    CHECK(Pop().f32() == 5.5f);
+  }
+
+  SUBCASE("Instructions are not rewritten when quickening is disabled") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Subtract}};
+    DecodedProgram program(instructions, {.quicken = false});
+    program.Execute();
+    CHECK(Pop().i32() == -1);
+    auto handler = program.GetDecodedInstructions()[2].handler;
+
+    program.Execute();
+    CHECK(Pop().i32() == -1);
+    CHECK(program.GetDecodedInstructions()[2].handler == handler);
+  }
+}
+
+TEST_CASE("Verify superinstruction behavior") {
+  SUBCASE("Each superinstruction matches executing its instructions") {
+    for (auto& superinstruction : Superinstructions) {
+      if (superinstruction.length == 0)
+        continue;
+
+      vector<Instruction> instructions;
+      for (size_t i = 0; i < superinstruction.length; i++) {
+        auto opCode = superinstruction.opCodes[i];
+        if (opCode == OpCode::Push)
+          instructions.push_back({opCode, (int32_t)i + 1});
+        else
+          instructions.push_back({opCode});
+      }
+
+      // Leave enough values on the stack for any instruction to use.
+      auto stackSize = StackSize();
+      auto pushOperands = [] {
+        for (auto i = 0; i < 4; i++)
+          Push(i + 10);
+      };
+
+      pushOperands();
+      DecodedProgram unfused(instructions, {.fuse = false});
+      unfused.Execute();
+      vector<Argument> expected;
+      while (StackSize() > stackSize)
+        expected.push_back(Pop());
+
+      pushOperands();
+      DecodedProgram fused(instructions);
+      fused.Execute();
+      vector<Argument> actual;
+      while (StackSize() > stackSize)
+        actual.push_back(Pop());
+
+      CHECK(fused.GetDecodedInstructions()[0].handler ==
+            superinstruction.handler);
+      CHECK(actual == expected);
+    }
+  }
+
+  SUBCASE("A fused instruction is quickened") {
+    for (auto& superinstruction : Superinstructions) {
+      auto opCode = superinstruction.opCodes[0];
+      if (superinstruction.length == 0 || !HasInstruction(opCode) ||
+          GetInstructionMetadata(opCode).quicken == nullptr)
+        continue;
+
+      vector<Instruction> instructions;
+      for (size_t i = 0; i < superinstruction.length; i++)
+        instructions.push_back({superinstruction.opCodes[i], 1});
+
+      auto stackSize = StackSize();
+      for (auto i = 0; i < 4; i++)
+        Push(i + 10);
+      auto quickenedHandler = GetInstructionMetadata(opCode).quicken();
+
+      DecodedProgram program(instructions);
+      program.Execute();
+      auto& first = program.GetDecodedInstructions()[0];
+      CHECK(first.handler == superinstruction.handler);
+      CHECK(first.fusedHandler == quickenedHandler);
+      while (StackSize() > stackSize)
+        Pop();
+    }
+  }
+
+  SUBCASE("Instructions are not fused when fusing is disabled") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    DecodedProgram program(instructions, {.fuse = false});
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+    CHECK(program.GetDecodedInstructions()[0].handler == PushHandler);
+  }
+
+  SUBCASE("Instructions that cannot execute are not fused") {
+    for (auto& superinstruction : Superinstructions) {
+      if (superinstruction.length == 0)
+        continue;
+
+      vector<Instruction> instructions;
+      for (size_t i = 0; i < superinstruction.length; i++)
+        instructions.push_back({superinstruction.opCodes[i], 1});
+      instructions.back().opCode = (OpCode)42;
+
+      auto stackSize = StackSize();
+      for (auto i = 0; i < 4; i++)
+        Push(i + 10);
+
+      DecodedProgram program(instructions);
+      CHECK_THROWS_AS(program.Execute(), logic_error);
+      CHECK(program.GetDecodedInstructions()[0].handler !=
+            superinstruction.handler);
+      while (StackSize() > stackSize)
+        Pop();
+    }
+  }
+}
+
+TEST_CASE("Verify decoded program performance") {
+  vector<Instruction> instructions;
+  for (auto i = 0; i < 1000; i++) {
+    instructions.push_back({OpCode::Push, 43});
+    instructions.push_back({OpCode::Push, 42});
+    instructions.push_back({OpCode::Add});
+    instructions.push_back({OpCode::Pop});
+  }
+
+  DecodedProgram program(instructions);
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(instructions.size());
+
+  b.run("Process with the direct-threaded engine",
+        [&] { Process(instructions, Engine::DirectThreaded); });
+
+  b.run("Execute a decoded program", [&] { program.Execute(); });
+}
+
+TEST_CASE("Verify quickening performance") {
+  const Argument values[] = {42, (int64_t)43, 44.5f, 45.5};
+
+  vector<Instruction> monomorphicInstructions;
+  vector<Instruction> mixedTypeInstructions;
+  for (auto i = 0; i < 250; i++) {
+    for (auto left : values) {
+      for (auto right : values) {
+        auto opCode = (i % 2 == 0) ? OpCode::Add : OpCode::Subtract;
+        monomorphicInstructions.push_back({OpCode::Push, 43});
+        monomorphicInstructions.push_back({OpCode::Push, 42});
+        monomorphicInstructions.push_back({opCode});
+        monomorphicInstructions.push_back({OpCode::Pop});
+
+        mixedTypeInstructions.push_back({OpCode::Push, left});
+        mixedTypeInstructions.push_back({OpCode::Push, right});
+        mixedTypeInstructions.push_back({opCode});
+        mixedTypeInstructions.push_back({OpCode::Pop});
+      }
+    }
+  }
+
+  DecodedProgram monomorphic(monomorphicInstructions, {.quicken = false});
+  DecodedProgram quickenedMonomorphic(monomorphicInstructions);
+  DecodedProgram mixedType(mixedTypeInstructions, {.quicken = false});
+  DecodedProgram quickenedMixedType(mixedTypeInstructions);
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName())
+      .relative(true)
+      .batch(monomorphicInstructions.size());
+
+  b.run("Monomorphic program", [&] { monomorphic.Execute(); });
+  b.run("Quickened monomorphic program",
+        [&] { quickenedMonomorphic.Execute(); });
+  b.run("Mixed-type program", [&] { mixedType.Execute(); });
+  b.run("Quickened mixed-type program", [&] { quickenedMixedType.Execute(); });
+}
+
+TEST_CASE("Verify superinstruction performance") {
+  vector<Instruction> instructions;
+  for (auto i = 0; i < 1000; i++) {
+    instructions.push_back({OpCode::Push, 43});
+    instructions.push_back({OpCode::Push, 42});
+    instructions.push_back({OpCode::Add});
+    instructions.push_back({OpCode::Push, 2});
+    instructions.push_back({OpCode::Subtract});
+    instructions.push_back({OpCode::Pop});
+  }
+
+  DecodedProgram program(instructions, {.fuse = false});
+  DecodedProgram fusedProgram(instructions);
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(instructions.size());
+
+  b.run("Execute a decoded program", [&] { program.Execute(); });
+  b.run("Execute a decoded program with superinstructions",
+        [&] { fusedProgram.Execute(); });
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <span>
+using std::span;
+#include <vector>
+using std::vector;
+
+#include "Bytecode.hpp"
+
+// Each decoded instruction holds the handler (see Bytecode.hpp) that executes
+// it and returns the next instruction to execute. The first instruction of a
+// superinstruction holds the handler for the superinstruction instead, so if it
+// has no operand, it keeps its own handler in place of one.
+struct DecodedInstruction {
+  DecodedHandler handler;
+  union {
+    Argument operand = Argument();
+    DecodedHandler fusedHandler;
+  };
+};
+
+struct DecodeOptions {
+  // Rewrite instructions to handlers specialized for the types they see.
+  bool quicken = true;
+
+  // Execute common sequences of instructions with one handler.
+  bool fuse = true;
+};
+
+class DecodedProgram {
+public:
+  DecodedProgram(span<Instruction> instructions, DecodeOptions options = {});
+
+  void Execute();
+
+  span<const DecodedInstruction> GetDecodedInstructions() const;
+
+  size_t GetNumberOfBlocks() const;
+  size_t GetNumberOfDecodedBlocks() const;
+
+  static constexpr size_t BlockSize = 256;
+
+private:
+  span<Instruction> m_instructions;
+  DecodeOptions m_options;
+  uint32_t m_registryVersion;
+  vector<DecodedInstruction> m_decodedInstructions;
+  vector<bool> m_isBlockDecoded;
+  size_t m_numberOfDecodedBlocks;
+
+  void DecodeBlock(size_t block);
+  void FuseBlock(size_t start, size_t end);
+};
@@ -7,44 +7,286 @@ using std::logic_error;
 using fmt::format;
 
 #include "Bytecode.hpp"
+#include "DecodedProgram.hpp"
 #include "InstructionProcessor.hpp"
 #include "Interpreter/Interpreter.hpp"
+#include "Jit/JitProgram.hpp"
+#include "RegisterProgram.hpp"
+#include "TailCallInterpreter.hpp"
+#include "TieredProgram.hpp"
 #include "ValueStack.hpp"
+#include "VerifiedProgram.hpp"
 
 // == Instruction Processor ==
 //
 // The instruction processor identifies each instruction and calls the proper
 // implemenatation for that instruction.
 
-void Process(span<Instruction> instructions) {
+static void ProcessLoop(span<Instruction> instructions);
+static void ProcessDirectThreaded(span<Instruction> instructions);
+static void ExecuteRegisteredInstruction(OpCode opCode);
+
+void Process(span<Instruction> instructions, Engine engine) {
+  if (engine == Engine::Loop)
+    ProcessLoop(instructions);
+  else if (engine == Engine::TailCall)
+    ProcessTailCall(instructions);
+  else if (engine == Engine::Jit)
+    JitProgram(instructions).Execute();
+  else if (engine == Engine::Register)
+    RegisterProgram(instructions).Execute();
+  else if (engine == Engine::Verified)
+    VerifiedProgram(instructions).Execute();
+  else if (engine == Engine::Decoded)
+    DecodedProgram(instructions).Execute();
+  else if (engine == Engine::Tiered)
+    TieredProgram(instructions).Execute();
+  else
+    ProcessDirectThreaded(instructions);
+}
+
+bool TryGetEngine(string_view name, Engine& engine) {
+  if (name == "loop")
+    engine = Engine::Loop;
+  else if (name == "threaded")
+    engine = Engine::DirectThreaded;
+  else if (name == "tailcall")
+    engine = Engine::TailCall;
+  else if (name == "jit")
+    engine = Engine::Jit;
+  else if (name == "register")
+    engine = Engine::Register;
+  else if (name == "verified")
+    engine = Engine::Verified;
+  else if (name == "decoded")
+    engine = Engine::Decoded;
+  else if (name == "tiered")
+    engine = Engine::Tiered;
+  else
+    return false;
+  return true;
+}
+
+static void ProcessLoop(span<Instruction> instructions) {
   for (auto& ins : instructions) {
     if (ins.opCode == OpCode::Push)
       Push(ins.argument);
     else if (ins.opCode == OpCode::Pop)
       Pop();
-    else if (HasInstruction(ins.opCode))
-      ExecuteInstruction(ins.opCode);
     else
-      throw logic_error(format("Unexpected opcode: {}", (int)ins.opCode));
+      ExecuteRegisteredInstruction(ins.opCode);
   }
 }
 
+// The direct-threaded engine keeps a table with the address of the handler for
+// each opcode. Every handler ends with its own copy of the dispatch code, so
+// the branch predictor can learn which handler usually follows which. The
+// built-in instructions are called directly, without looking them up in the
+// instruction registry. Any other opcode, including ones that are out of range,
+// goes through the registry just like the loop engine. So does a built-in
+// instruction that another one was registered in place of, which is checked
+// once for each call.
+static void ProcessDirectThreaded(span<Instruction> instructions) {
+#if defined(__GNUC__)
+  static_assert(NumberOfOpCodes == 5,
+                "Add a handler for the new opcode to the table below");
+  void* handlers[NumberOfOpCodes + 1] = {
+      &&RegisteredHandler, &&PushHandler,     &&PopHandler,
+      &&AddHandler,        &&SubtractHandler, &&RegisteredHandler};
+  if (GetInstructionMetadata(OpCode::Add).execute != Add)
+    handlers[(size_t)OpCode::Add] = &&RegisteredHandler;
+  if (GetInstructionMetadata(OpCode::Subtract).execute != Subtract)
+    handlers[(size_t)OpCode::Subtract] = &&RegisteredHandler;
+
+  auto ins = instructions.data();
+  auto end = ins + instructions.size();
+
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    if (ins == end)                                                            \
+      return;                                                                  \
+    auto index = (size_t)ins->opCode;                                          \
+    goto *handlers[index < NumberOfOpCodes ? index : NumberOfOpCodes];         \
+  } while (0)
+
+  DISPATCH();
+
+PushHandler:
+  Push(ins->argument);
+  ins++;
+  DISPATCH();
+
+PopHandler:
+  Pop();
+  ins++;
+  DISPATCH();
+
+AddHandler:
+  Add();
+  ins++;
+  DISPATCH();
+
+SubtractHandler:
+  Subtract();
+  ins++;
+  DISPATCH();
+
+RegisteredHandler:
+  ExecuteRegisteredInstruction(ins->opCode);
+  ins++;
+  DISPATCH();
+
+#undef DISPATCH
+#else
+  // Without labels as values there is no way to thread the handlers together,
+  // so use the loop instead.
+  ProcessLoop(instructions);
+#endif
+}
+
+static void ExecuteRegisteredInstruction(OpCode opCode) {
+  if (HasInstruction(opCode))
+    ExecuteInstruction(opCode);
+  else
+    throw logic_error(format("Unexpected opcode: {}", (int)opCode));
+}
+
+const Engine AllEngines[] = {Engine::Loop,     Engine::DirectThreaded,
+                             Engine::TailCall, Engine::Jit,
+                             Engine::Register, Engine::Verified,
+                             Engine::Decoded,  Engine::Tiered};
+
 TEST_CASE("Verify instruction processing behavior") {
   SUBCASE("Push two values and add") {
-    Instruction instructions[] = {
-        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
-    Process(instructions);
-    CHECK(Pop().i32() == 5);
+    for (auto engine : AllEngines) {
+      Instruction instructions[] = {
+          {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+      Process(instructions, engine);
+      CHECK(Pop().i32() == 5);
+    }
   }
 
   SUBCASE("Push three values, pop one and subtract") {
-    // This should do 2 - 3
-    Instruction instructions[] = {{OpCode::Push, 2},
-                                  {OpCode::Push, 3},
-                                  {OpCode::Push, 8},
-                                  {OpCode::Pop},
+    for (auto engine : AllEngines) {
+      // This should do 2 - 3
+      Instruction instructions[] = {{OpCode::Push, 2},
+                                    {OpCode::Push, 3},
+                                    {OpCode::Push, 8},
+                                    {OpCode::Pop},
+                                    {OpCode::Subtract}};
+      Process(instructions, engine);
+      CHECK(Pop().i32() == -1);
+    }
+  }
+
+  SUBCASE("Processing no instructions does nothing") {
+    for (auto engine : AllEngines) {
+      auto stackSize = StackSize();
+      Process(span<Instruction>(), engine);
+      CHECK(StackSize() == stackSize);
+    }
+  }
+
+  SUBCASE("A registered instruction replaces a built-in one") {
+    // The replacement can be evaluated and specialized as well, so that the
+    // verified engine can follow it through the program.
+    static constexpr EvaluateInstructionFunc Evaluate42 =
+        [](Argument, Argument) { return Argument(42); };
+    auto metadata = GetInstructionMetadata(OpCode::Add);
+    RegisterInstruction(OpCode::Add,
+                        {.execute =
+                             [] {
+                               Pop();
+                               Pop();
+                               Push(42);
+                             },
+                         .name = "Add",
+                         .evaluate = Evaluate42,
+                         .specialize = [](ArgumentType, ArgumentType) {
+                           return Evaluate42;
+                         }});
+
+    for (auto engine : AllEngines) {
+      Instruction instructions[] = {
+          {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+      Process(instructions, engine);
+      CHECK(Pop().i32() == 42);
+    }
+
+    RegisterInstruction(OpCode::Add, metadata);
+  }
+
+  SUBCASE("Operands with no result are popped") {
+    Instruction instructions[] = {{OpCode::Push, 1},
+                                  {OpCode::Push, true},
+                                  {OpCode::Push, 2},
+                                  {OpCode::Add},
+                                  {OpCode::Push, 'a'},
                                   {OpCode::Subtract}};
-    Process(instructions);
-    CHECK(Pop().i32() == -1);
+    for (auto engine : AllEngines) {
+      auto stackSize = StackSize();
+      // The verified engine rejects the program before it executes.
+      if (engine == Engine::Verified)
+        CHECK_THROWS_AS(Process(instructions, engine), logic_error);
+      else
+        Process(instructions, engine);
+      CHECK(StackSize() == stackSize);
+    }
+  }
+
+  SUBCASE("An unexpected opcode is an error") {
+    for (auto engine : AllEngines) {
+      Instruction instructions[] = {{(OpCode)42}};
+      CHECK_THROWS_AS(Process(instructions, engine), logic_error);
+    }
+  }
+}
+
+TEST_CASE("Verify engine names") {
+  Engine engine = Engine::Loop;
+
+  SUBCASE("The loop engine can be found by name") {
+    CHECK(TryGetEngine("threaded", engine));
+    CHECK(TryGetEngine("loop", engine));
+    CHECK(engine == Engine::Loop);
+  }
+
+  SUBCASE("The direct-threaded engine can be found by name") {
+    CHECK(TryGetEngine("threaded", engine));
+    CHECK(engine == Engine::DirectThreaded);
+  }
+
+  SUBCASE("The tail call engine can be found by name") {
+    CHECK(TryGetEngine("tailcall", engine));
+    CHECK(engine == Engine::TailCall);
+  }
+
+  SUBCASE("The JIT engine can be found by name") {
+    CHECK(TryGetEngine("jit", engine));
+    CHECK(engine == Engine::Jit);
+  }
+
+  SUBCASE("The register engine can be found by name") {
+    CHECK(TryGetEngine("register", engine));
+    CHECK(engine == Engine::Register);
+  }
+
+  SUBCASE("The verified engine can be found by name") {
+    CHECK(TryGetEngine("verified", engine));
+    CHECK(engine == Engine::Verified);
+  }
+
+  SUBCASE("The decoded engine can be found by name") {
+    CHECK(TryGetEngine("decoded", engine));
+    CHECK(engine == Engine::Decoded);
+  }
+
+  SUBCASE("The tiered engine can be found by name") {
+    CHECK(TryGetEngine("tiered", engine));
+    CHECK(engine == Engine::Tiered);
+  }
+
+  SUBCASE("An unknown engine name is not found") {
+    CHECK_FALSE(TryGetEngine("unknown", engine));
   }
 }
@@ -2,7 +2,54 @@
 
 #include <span>
 using std::span;
+#include <string_view>
+using std::string_view;
 
 #include "Bytecode.hpp"
 
-void Process(span<Instruction> instructions);
+// Each engine executes instructions with a different dispatch strategy. All of
+// the engines produce the same results.
+enum class Engine {
+  // Looks up each instruction in the instruction registry as it executes.
+  Loop,
+
+  // Jumps directly from the end of one instruction handler to the next one,
+  // using computed goto where the compiler supports it.
+  DirectThreaded,
+
+  // Executes each instruction with a handler that tail calls the handler for
+  // the next one (see TailCallInterpreter.hpp).
+  TailCall,
+
+  // Compiles the instructions to native code before executing them (see
+  // Jit/JitProgram.hpp). This uses the direct-threaded engine on platforms
+  // without a JIT.
+  Jit,
+
+  // Translates the instructions to register instructions before executing
+  // them (see RegisterProgram.hpp).
+  Register,
+
+  // Verifies the instructions, then executes them without checking the stack
+  // or the operand types (see VerifiedProgram.hpp). The instructions must not
+  // pop values that were on the stack before they started.
+  Verified,
+
+  // Decodes the instructions to handlers, which are quickened and fused as
+  // they execute (see DecodedProgram.hpp).
+  Decoded,
+
+  // Starts in the decoded engine, and compiles the instructions once they have
+  // executed often enough (see TieredProgram.hpp). Instructions that only
+  // execute once are never compiled.
+  Tiered
+};
+
+// Executes the instructions once. An engine that prepares the instructions
+// before it executes them does so on every call, so a program that executes
+// many times should be a Program (see Program.hpp), which keeps what each
+// engine prepared from one execution to the next.
+void Process(span<Instruction> instructions,
+             Engine engine = Engine::DirectThreaded);
+
+bool TryGetEngine(string_view name, Engine& engine);
@@ -3,16 +3,37 @@
 #include <limits>
 using std::numeric_limits;
 
+#include <vector>
+using std::vector;
+
 #include "Bytecode.hpp"
+#include "InstructionProcessor.hpp"
 #include "Interpreter/Add.hpp"
 #include "Interpreter/BinaryArithmeticOperation.hpp"
 #include "ValueStack.hpp"
 
-void Add() {
-  PerformBinaryOperation([](auto left, auto right) { return left + right; });
+static auto AddOperation = [](auto left, auto right) {
+  return left + right;
+};
+
+void Add() { PerformBinaryOperation(AddOperation); }
+
+DecodedHandler QuickenAdd() {
+  return QuickenBinaryOperation<decltype(AddOperation)>();
 }
 
-InstructionMetadata GetAddMetadata() { return {.execute = Add, .name = "Add"}; }
+Argument EvaluateAdd(Argument left, Argument right) {
+  return EvaluateBinaryOperation(left, right, AddOperation);
+}
+
+EvaluateInstructionFunc SpecializeAdd(ArgumentType left, ArgumentType right) {
+  return SpecializeBinaryOperation<decltype(AddOperation)>(left, right);
+}
+
+void EvaluateAddColumns(const Column& left, const Column& right,
+                        Column& result) {
+  EvaluateBinaryOperationColumns<decltype(AddOperation)>(left, right, result);
+}
 
 TEST_CASE("Verify add opcode behavior") {
   SUBCASE("Verify add opcode behavior a 32-bit integer and a 32-bit integer") {
@@ -28,8 +49,8 @@ TEST_CASE("Verify add opcode behavior") {
   SUBCASE(
       "Verify add opcode behavior for a 32-bit integer and a 64-bit integer") {
     const int32_t left = 15;
-    const int64_t right = numeric_limits<int64_t>::max() - 20;
-    const int64_t expected = numeric_limits<int64_t>::max() - 5;
+    const int64_t right = MaximumI64Argument - 20;
+    const int64_t expected = MaximumI64Argument - 5;
     Push(left);
     Push(right);
     Add();
@@ -60,9 +81,9 @@ TEST_CASE("Verify add opcode behavior") {
 
   SUBCASE("Verify add opcode behavior for a 64-bit integer and and 64-bit "
           "integer") {
-    const int64_t left = numeric_limits<int64_t>::max() - 20;
+    const int64_t left = MaximumI64Argument - 20;
     const int64_t right = 15;
-    const int64_t expected = numeric_limits<int64_t>::max() - 5;
+    const int64_t expected = MaximumI64Argument - 5;
     Push(left);
     Push(right);
     Add();
@@ -71,9 +92,9 @@ TEST_CASE("Verify add opcode behavior") {
 
   SUBCASE(
       "Verify add opcode behavior for a 64-bit integer and a 32-bit integer") {
-    const int64_t left = numeric_limits<int64_t>::max() - 20;
+    const int64_t left = MaximumI64Argument - 20;
     const int32_t right = 15;
-    const int64_t expected = numeric_limits<int64_t>::max() - 5;
+    const int64_t expected = MaximumI64Argument - 5;
     Push(left);
     Push(right);
     Add();
@@ -82,9 +103,9 @@ TEST_CASE("Verify add opcode behavior") {
 
   SUBCASE(
       "Verify add opcode behavior for a 64-bit integer and a 32-bit float") {
-    const int64_t left = numeric_limits<int64_t>::max() - 20;
+    const int64_t left = MaximumI64Argument - 20;
     const float right = 15;
-    const float expected = numeric_limits<int64_t>::max() - 5;
+    const float expected = MaximumI64Argument - 5;
     Push(left);
     Push(right);
     Add();
@@ -93,9 +114,9 @@ TEST_CASE("Verify add opcode behavior") {
 
   SUBCASE(
       "Verify add opcode behavior for a 64-bit integer and a 64-bit float") {
-    const int64_t left = numeric_limits<int64_t>::max() - 20;
+    const int64_t left = MaximumI64Argument - 20;
     const double right = 15;
-    const double expected = numeric_limits<int64_t>::max() - 5;
+    const double expected = MaximumI64Argument - 5;
     Push(left);
     Push(right);
     Add();
@@ -126,8 +147,8 @@ TEST_CASE("Verify add opcode behavior") {
   SUBCASE(
       "Verify add opcode behavior for a 32-bit float and a 64-bit integer") {
     const float left = 15;
-    const int64_t right = numeric_limits<int64_t>::max() - 20;
-    const float expected = numeric_limits<int64_t>::max() - 5;
+    const int64_t right = MaximumI64Argument - 20;
+    const float expected = MaximumI64Argument - 5;
     Push(left);
     Push(right);
     Add();
@@ -156,9 +177,9 @@ TEST_CASE("Verify add opcode behavior") {
 
   SUBCASE(
       "Verify add opcode behavior for a 64-bit float and and 64-bit integer") {
-    const double left = numeric_limits<int64_t>::max() - 20;
+    const double left = MaximumI64Argument - 20;
     const int64_t right = 15;
-    const double expected = numeric_limits<int64_t>::max() - 5;
+    const double expected = MaximumI64Argument - 5;
     Push(left);
     Push(right);
     Add();
@@ -196,12 +217,160 @@ TEST_CASE("Verify add opcode behavior") {
   }
 
   SUBCASE("Verify add opcode 64-bit integer overflow") {
-    const int64_t left = numeric_limits<int64_t>::max();
+    const int64_t left = MaximumI64Argument;
     const int64_t right = 1;
     Push(left);
     Push(right);
     Add();
-    CHECK(Pop().i64() == numeric_limits<int64_t>::min());
+    CHECK(Pop().i64() == MinimumI64Argument);
+  }
+}
+
+TEST_CASE("Verify add opcode evaluation behavior") {
+  SUBCASE("Verify that evaluating add matches add for each pair of "
+          "types") {
+    const Argument values[] = {42, (int64_t)43, 44.5f, 45.5};
+    for (auto left : values) {
+      for (auto right : values) {
+        Push(left);
+        Push(right);
+        Add();
+        CHECK(EvaluateAdd(left, right) == Pop());
+      }
+    }
+  }
+
+  SUBCASE("Verify that add cannot be evaluated for booleans") {
+    CHECK(EvaluateAdd(true, 1).Type() == ArgumentType::None);
+    CHECK(EvaluateAdd(1, 'a').Type() == ArgumentType::None);
+  }
+}
+
+TEST_CASE("Verify add opcode specialization behavior") {
+  SUBCASE("Verify that specialized add matches add for each pair of "
+          "types") {
+    const Argument values[] = {42, (int64_t)43, 44.5f, 45.5};
+    for (auto left : values) {
+      for (auto right : values) {
+        auto evaluate = SpecializeAdd(left.Type(), right.Type());
+        REQUIRE(evaluate != nullptr);
+        CHECK(evaluate(left, right) == EvaluateAdd(left, right));
+      }
+    }
+  }
+
+  SUBCASE("Verify that add is not specialized for booleans") {
+    CHECK(SpecializeAdd(ArgumentType::b, ArgumentType::i32) == nullptr);
+    CHECK(SpecializeAdd(ArgumentType::None, ArgumentType::i32) == nullptr);
+  }
+}
+
+TEST_CASE("Verify add opcode quickening behavior") {
+  SUBCASE("Verify that quickened add matches add for each pair of types") {
+    const Argument values[] = {42, (int64_t)43, 44.5f, 45.5};
+    for (auto left : values) {
+      for (auto right : values) {
+        Push(left);
+        Push(right);
+        Add();
+        auto expected = Pop();
+
+        Push(left);
+        Push(right);
+        auto handler = QuickenAdd();
+        REQUIRE(handler != nullptr);
+        DecodedInstruction instruction = {handler};
+        CHECK(handler(&instruction) == &instruction + 1);
+        CHECK(Pop() == expected);
+      }
+    }
+  }
+
+  SUBCASE("Verify that add is not quickened for booleans") {
+    Push(true);
+    Push(false);
+    CHECK(QuickenAdd() == nullptr);
+    Pop();
+    Pop();
+  }
+}
+
+TEST_CASE("Verify add opcode JIT behavior") {
+  SUBCASE("Verify that the JIT matches the instruction processor for each pair "
+          "of types") {
+    const Argument values[] = {42,
+                               numeric_limits<int32_t>::max(),
+                               MaximumI64Argument - 20,
+                               MinimumI64Argument,
+                               44.5f,
+                               -0.1f,
+                               45.5,
+                               1e-300};
+    for (auto left : values) {
+      for (auto right : values) {
+        Instruction instructions[] = {
+            {OpCode::Push, left}, {OpCode::Push, right}, {OpCode::Add}};
+        Process(instructions, Engine::DirectThreaded);
+        auto expected = Pop();
+
+        Process(instructions, Engine::Jit);
+        CHECK(Pop() == expected);
+      }
+    }
+  }
+
+  SUBCASE("Verify that the JIT matches the instruction processor for values "
+          "pushed before the program") {
+    const Argument values[] = {42, (int64_t)43, 44.5f, 45.5};
+    for (auto left : values) {
+      for (auto right : values) {
+        Instruction instructions[] = {{OpCode::Push, right}, {OpCode::Add}};
+        Push(left);
+        Process(instructions, Engine::DirectThreaded);
+        auto expected = Pop();
+
+        Push(left);
+        Process(instructions, Engine::Jit);
+        CHECK(Pop() == expected);
+      }
+    }
+  }
+}
+
+TEST_CASE("Verify add opcode column behavior") {
+  const int32_t values[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  auto column = Column::FromValues<int32_t>(values);
+
+  SUBCASE("Add a column and a constant on the left") {
+    Column result;
+    EvaluateAddColumns(Column::Constant(0.5f, 10), column, result);
+    CHECK(result.GetType() == ArgumentType::f32);
+    CHECK_FALSE(result.IsConstant());
+    for (size_t row = 0; row < 10; row++)
+      CHECK(result.Get(row) == Argument(values[row] + 0.5f));
+  }
+
+  SUBCASE("Add two columns") {
+    Column result;
+    EvaluateAddColumns(column, column, result);
+    CHECK(result.GetType() == ArgumentType::i32);
+    for (size_t row = 0; row < 10; row++)
+      CHECK(result.Get(row) == Argument(values[row] * 2));
+  }
+
+  SUBCASE("Adding two constants makes a constant") {
+    Column result;
+    EvaluateAddColumns(Column::Constant((int64_t)2, 10),
+                       Column::Constant(3, 10), result);
+    CHECK(result.IsConstant());
+    CHECK(result.GetNumberOfRows() == 10);
+    CHECK(result.Get(9) == Argument((int64_t)5));
+  }
+
+  SUBCASE("There is no result for booleans") {
+    Column result;
+    EvaluateAddColumns(Column::Constant(true, 10), column, result);
+    CHECK(result.GetType() == ArgumentType::None);
   }
 }
 
@@ -228,3 +397,25 @@ TEST_CASE("Verify add opcode performance") {
     Pop();
   });
 }
+
+TEST_CASE("Verify add opcode dispatch performance") {
+  vector<Instruction> instructions;
+  for (auto i = 0; i < 1000; i++) {
+    instructions.push_back({OpCode::Push, 43});
+    instructions.push_back({OpCode::Push, 42});
+    instructions.push_back({OpCode::Add});
+    instructions.push_back({OpCode::Pop});
+  }
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(instructions.size());
+
+  b.run("Add two integers with the loop engine",
+        [&] { Process(instructions, Engine::Loop); });
+
+  b.run("Add two integers with the direct-threaded engine",
+        [&] { Process(instructions, Engine::DirectThreaded); });
+
+  b.run("Add two integers with the tail call engine",
+        [&] { Process(instructions, Engine::TailCall); });
+}
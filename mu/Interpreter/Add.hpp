@@ -3,4 +3,17 @@
 #include "Bytecode.hpp"
 
 void Add();
-InstructionMetadata GetAddMetadata();
+DecodedHandler QuickenAdd();
+Argument EvaluateAdd(Argument left, Argument right);
+EvaluateInstructionFunc SpecializeAdd(ArgumentType left, ArgumentType right);
+void EvaluateAddColumns(const Column& left, const Column& right,
+                        Column& result);
+
+constexpr InstructionMetadata GetAddMetadata() {
+  return {.execute = Add,
+          .name = "Add",
+          .quicken = QuickenAdd,
+          .evaluate = EvaluateAdd,
+          .specialize = SpecializeAdd,
+          .evaluateColumns = EvaluateAddColumns};
+}
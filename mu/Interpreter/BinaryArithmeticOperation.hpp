@@ -1,52 +1,368 @@
 #pragma once
 
+#include <array>
+using std::array;
 #include <cassert>
+#include <iterator>
+using std::size;
+#include <utility>
+using std::index_sequence;
+using std::make_index_sequence;
 
+#include "Column.hpp"
+#include "DecodedProgram.hpp"
 #include "ValueStack.hpp"
 
+// Evaluates the operation with the usual arithmetic conversions for the types
+// of its operands. There is no operation for some types, such as booleans, so
+// this returns an empty argument for them.
 template <typename OperationCallback>
-void PerformBinaryOperation(OperationCallback&& op) {
-  assert(StackSize() >= 2);
-
-  auto right = Pop();
-  auto left = Pop();
-
+Argument EvaluateBinaryOperation(Argument left, Argument right,
+                                 OperationCallback&& op) {
   if (left.Type() == ArgumentType::i32) {
     if (right.Type() == ArgumentType::i32)
-      Push(op(left.i32(), right.i32()));
+      return op(left.i32(), right.i32());
     else if (right.Type() == ArgumentType::i64)
-      Push(op(left.i32(), right.i64()));
+      return op(left.i32(), right.i64());
     else if (right.Type() == ArgumentType::f32)
-      Push(op(left.i32(), right.f32()));
+      return op(left.i32(), right.f32());
     else if (right.Type() == ArgumentType::f64)
-      Push(op(left.i32(), right.f64()));
+      return op(left.i32(), right.f64());
   } else if (left.Type() == ArgumentType::i64) {
     if (right.Type() == ArgumentType::i64)
-      Push(op(left.i64(), right.i64()));
+      return op(left.i64(), right.i64());
     else if (right.Type() == ArgumentType::i32)
-      Push(op(left.i64(), right.i32()));
+      return op(left.i64(), right.i32());
     else if (right.Type() == ArgumentType::f32)
-      Push(op(left.i64(), right.f32()));
+      return op(left.i64(), right.f32());
     else if (right.Type() == ArgumentType::f64)
-      Push(op(left.i64(), right.f64()));
+      return op(left.i64(), right.f64());
   } else if (left.Type() == ArgumentType::f32) {
     if (right.Type() == ArgumentType::f32)
-      Push(op(left.f32(), right.f32()));
+      return op(left.f32(), right.f32());
     else if (right.Type() == ArgumentType::i32)
-      Push(op(left.f32(), right.i32()));
+      return op(left.f32(), right.i32());
     else if (right.Type() == ArgumentType::i64)
-      Push(op(left.f32(), right.i64()));
+      return op(left.f32(), right.i64());
     else if (right.Type() == ArgumentType::f64)
-      Push(op(left.f32(), right.f64()));
+      return op(left.f32(), right.f64());
   } else if (left.Type() == ArgumentType::f64) {
     if (right.Type() == ArgumentType::f64)
-      Push(op(left.f64(), right.f64()));
+      return op(left.f64(), right.f64());
     else if (right.Type() == ArgumentType::i32)
-      Push(op(left.f64(), right.i32()));
+      return op(left.f64(), right.i32());
     else if (right.Type() == ArgumentType::i64)
-      Push(op(left.f64(), right.i64()));
+      return op(left.f64(), right.i64());
     else if (right.Type() == ArgumentType::f32)
-      Push(op(left.f64(), right.f32()));
-  } else
-    assert(0 && "Missing binary arithmetic operation case");
+      return op(left.f64(), right.f32());
+  }
+
+  return Argument();
+}
+
+// == Stack Operands ==
+//
+// The value stack keeps the types of its entries apart from their values (see
+// ValueStack.hpp), so the types of both operands are tested at once, as one
+// packed byte, and the operation reads the values and writes its result in
+// place, without building an argument for each of them.
+
+// The types of the two values on top of the value stack, packed by
+// PackOperandTypes.
+inline uint8_t PeekOperandTypes() {
+  assert(StackSize() >= 2);
+  auto types = valueStack.typeData() + StackSize() - 2;
+  return PackOperandTypes((ArgumentType)types[0], (ArgumentType)types[1]);
+}
+
+// Replaces the two values on top of the value stack, which must have the given
+// types, with the result of the operation.
+template <ArgumentType leftType, ArgumentType rightType,
+          typename OperationCallback>
+[[gnu::always_inline]] inline void ReplaceOperands(OperationCallback&& op) {
+  auto index = StackSize() - 2;
+  auto types = valueStack.typeData() + index;
+  auto values = valueStack.valueData() + index;
+  auto result = op(GetValueFromBits<leftType>(values[0]),
+                   GetValueFromBits<rightType>(values[1]));
+  types[0] = (uint8_t)GetArgumentType<decltype(result)>();
+  values[0] = Argument(result).Bits();
+  valueStack.pop();
+}
+
+#define MU_OPERAND_TYPES(left, right)                                          \
+  case PackOperandTypes(ArgumentType::left, ArgumentType::right):              \
+    return ReplaceOperands<ArgumentType::left, ArgumentType::right>(op)
+
+template <typename OperationCallback>
+void PerformBinaryOperation(OperationCallback&& op) {
+  switch (PeekOperandTypes()) {
+    MU_OPERAND_TYPES(i32, i32);
+    MU_OPERAND_TYPES(i32, i64);
+    MU_OPERAND_TYPES(i32, f32);
+    MU_OPERAND_TYPES(i32, f64);
+    MU_OPERAND_TYPES(i64, i64);
+    MU_OPERAND_TYPES(i64, i32);
+    MU_OPERAND_TYPES(i64, f32);
+    MU_OPERAND_TYPES(i64, f64);
+    MU_OPERAND_TYPES(f32, f32);
+    MU_OPERAND_TYPES(f32, i32);
+    MU_OPERAND_TYPES(f32, i64);
+    MU_OPERAND_TYPES(f32, f64);
+    MU_OPERAND_TYPES(f64, f64);
+    MU_OPERAND_TYPES(f64, i32);
+    MU_OPERAND_TYPES(f64, i64);
+    MU_OPERAND_TYPES(f64, f32);
+  }
+
+  // There is no operation for these types, so both operands are popped and
+  // nothing is pushed, as in every engine.
+  valueStack.pop();
+  valueStack.pop();
+}
+
+#undef MU_OPERAND_TYPES
+
+// == Quickening ==
+//
+// The first time a decoded binary operation executes, it is rewritten to a
+// handler specialized for the types of its operands, so later executions skip
+// the type checks above. The specialized handler still guards against other
+// types. If the guard fails, the instruction is rewritten to the generic
+// handler for good, since its operands do not have stable types.
+
+template <ArgumentType type> auto GetValue(Argument argument) {
+  if constexpr (type == ArgumentType::i32)
+    return argument.i32();
+  else if constexpr (type == ArgumentType::i64)
+    return argument.i64();
+  else if constexpr (type == ArgumentType::f32)
+    return argument.f32();
+  else
+    return argument.f64();
+}
+
+template <typename Operation>
+DecodedInstruction* GenericBinaryOperation(DecodedInstruction* instruction) {
+  PerformBinaryOperation(Operation{});
+  return instruction + 1;
+}
+
+template <typename Operation, ArgumentType leftType, ArgumentType rightType>
+DecodedInstruction* QuickenedBinaryOperation(DecodedInstruction* instruction) {
+  if (PeekOperandTypes() != PackOperandTypes(leftType, rightType)) {
+    instruction->handler = GenericBinaryOperation<Operation>;
+    return instruction->handler(instruction);
+  }
+
+  ReplaceOperands<leftType, rightType>(Operation{});
+  return instruction + 1;
+}
+
+constexpr ArgumentType ArithmeticTypes[] = {
+    ArgumentType::i32, ArgumentType::i64, ArgumentType::f32, ArgumentType::f64};
+
+constexpr size_t NumberOfArithmeticTypes = size(ArithmeticTypes);
+
+typedef array<array<DecodedHandler, NumberOfArgumentTypes>,
+              NumberOfArgumentTypes>
+    QuickenedBinaryOperationTable;
+
+template <typename Operation, size_t... Indices>
+constexpr QuickenedBinaryOperationTable
+BuildQuickenedBinaryOperations(index_sequence<Indices...>) {
+  QuickenedBinaryOperationTable handlers{};
+  ((handlers[(size_t)ArithmeticTypes[Indices / NumberOfArithmeticTypes]]
+            [(size_t)ArithmeticTypes[Indices % NumberOfArithmeticTypes]] =
+        QuickenedBinaryOperation<
+            Operation, ArithmeticTypes[Indices / NumberOfArithmeticTypes],
+            ArithmeticTypes[Indices % NumberOfArithmeticTypes]>),
+   ...);
+  return handlers;
+}
+
+template <typename Operation>
+constexpr QuickenedBinaryOperationTable QuickenedBinaryOperations =
+    BuildQuickenedBinaryOperations<Operation>(
+        make_index_sequence<NumberOfArithmeticTypes *
+                            NumberOfArithmeticTypes>());
+
+template <typename Operation> DecodedHandler QuickenBinaryOperation() {
+  if (StackSize() < 2)
+    return nullptr;
+
+  auto leftType = (size_t)Peek(1).Type();
+  auto rightType = (size_t)Peek(0).Type();
+  return QuickenedBinaryOperations<Operation>[leftType][rightType];
+}
+
+// == Specialization ==
+//
+// A register program (see RegisterProgram.hpp) knows the types of most of its
+// operands when it translates the program, so it can use an evaluate function
+// for just those types instead of checking them each time.
+
+template <typename Operation, ArgumentType leftType, ArgumentType rightType>
+Argument SpecializedBinaryOperation(Argument left, Argument right) {
+  return Operation{}(GetValue<leftType>(left), GetValue<rightType>(right));
+}
+
+typedef array<array<EvaluateInstructionFunc, NumberOfArgumentTypes>,
+              NumberOfArgumentTypes>
+    SpecializedBinaryOperationTable;
+
+template <typename Operation, size_t... Indices>
+constexpr SpecializedBinaryOperationTable
+BuildSpecializedBinaryOperations(index_sequence<Indices...>) {
+  SpecializedBinaryOperationTable evaluates{};
+  ((evaluates[(size_t)ArithmeticTypes[Indices / NumberOfArithmeticTypes]]
+             [(size_t)ArithmeticTypes[Indices % NumberOfArithmeticTypes]] =
+        SpecializedBinaryOperation<
+            Operation, ArithmeticTypes[Indices / NumberOfArithmeticTypes],
+            ArithmeticTypes[Indices % NumberOfArithmeticTypes]>),
+   ...);
+  return evaluates;
+}
+
+template <typename Operation>
+constexpr SpecializedBinaryOperationTable SpecializedBinaryOperations =
+    BuildSpecializedBinaryOperations<Operation>(
+        make_index_sequence<NumberOfArithmeticTypes *
+                            NumberOfArithmeticTypes>());
+
+template <typename Operation>
+EvaluateInstructionFunc SpecializeBinaryOperation(ArgumentType leftType,
+                                                  ArgumentType rightType) {
+  return SpecializedBinaryOperations<Operation>[(size_t)leftType]
+                                               [(size_t)rightType];
+}
+
+// == Columns ==
+//
+// A batch program (see BatchProgram.hpp) evaluates each operation for a whole
+// column of rows. The kernels below are plain loops over the rows, with the
+// usual arithmetic conversions made explicit, so the compiler vectorizes them:
+// it processes as many rows as fit in a vector register at a time, and the rows
+// left over at the end one at a time.
+//
+// On x86-64 each kernel is compiled twice, once for the baseline SSE2
+// instructions and once for AVX2, which is used when the processor has it.
+
+template <typename Operation, typename Left, typename Right>
+using ColumnResult = decltype(Operation{}(Left{}, Right{}));
+
+template <typename Operation, typename Left, typename Right,
+          bool leftIsConstant, bool rightIsConstant>
+[[gnu::always_inline]] inline void
+EvaluateColumnRows(const Left* left, const Right* right,
+                   ColumnResult<Operation, Left, Right>* result,
+                   size_t numberOfRows) {
+  typedef ColumnResult<Operation, Left, Right> Result;
+  for (size_t row = 0; row < numberOfRows; row++)
+    result[row] = Operation{}((Result)left[leftIsConstant ? 0 : row],
+                              (Result)right[rightIsConstant ? 0 : row]);
+}
+
+template <typename Operation, typename Left, typename Right,
+          bool leftIsConstant, bool rightIsConstant>
+void EvaluateColumnRowsWithSse2(const Left* left, const Right* right,
+                                ColumnResult<Operation, Left, Right>* result,
+                                size_t numberOfRows) {
+  EvaluateColumnRows<Operation, Left, Right, leftIsConstant, rightIsConstant>(
+      left, right, result, numberOfRows);
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+template <typename Operation, typename Left, typename Right,
+          bool leftIsConstant, bool rightIsConstant>
+[[gnu::target("avx2")]] void
+EvaluateColumnRowsWithAvx2(const Left* left, const Right* right,
+                           ColumnResult<Operation, Left, Right>* result,
+                           size_t numberOfRows) {
+  EvaluateColumnRows<Operation, Left, Right, leftIsConstant, rightIsConstant>(
+      left, right, result, numberOfRows);
+}
+#endif
+
+template <typename Operation, typename Left, typename Right,
+          bool leftIsConstant, bool rightIsConstant>
+void EvaluateColumnRowsForProcessor(
+    const Left* left, const Right* right,
+    ColumnResult<Operation, Left, Right>* result, size_t numberOfRows) {
+#if defined(__GNUC__) && defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    EvaluateColumnRowsWithAvx2<Operation, Left, Right, leftIsConstant,
+                               rightIsConstant>(left, right, result,
+                                                numberOfRows);
+    return;
+  }
+#endif
+  EvaluateColumnRowsWithSse2<Operation, Left, Right, leftIsConstant,
+                             rightIsConstant>(left, right, result,
+                                              numberOfRows);
+}
+
+template <typename Operation, ArgumentType leftType, ArgumentType rightType>
+void EvaluateColumnsOfTypes(const Column& left, const Column& right,
+                            Column& result) {
+  typedef decltype(GetValue<leftType>(Argument())) Left;
+  typedef decltype(GetValue<rightType>(Argument())) Right;
+  typedef ColumnResult<Operation, Left, Right> Result;
+
+  assert(left.GetNumberOfRows() == right.GetNumberOfRows());
+  auto numberOfRows = left.GetNumberOfRows();
+  auto leftData = left.GetData<Left>();
+  auto rightData = right.GetData<Right>();
+
+  if (left.IsConstant() && right.IsConstant()) {
+    result.ResetToConstant(Operation{}(leftData[0], rightData[0]),
+                           numberOfRows);
+    return;
+  }
+
+  result.Reset(GetArgumentType<Result>(), numberOfRows);
+  auto resultData = result.GetData<Result>();
+  if (left.IsConstant())
+    EvaluateColumnRowsForProcessor<Operation, Left, Right, true, false>(
+        leftData, rightData, resultData, numberOfRows);
+  else if (right.IsConstant())
+    EvaluateColumnRowsForProcessor<Operation, Left, Right, false, true>(
+        leftData, rightData, resultData, numberOfRows);
+  else
+    EvaluateColumnRowsForProcessor<Operation, Left, Right, false, false>(
+        leftData, rightData, resultData, numberOfRows);
+}
+
+typedef array<array<EvaluateColumnsFunc, NumberOfArgumentTypes>,
+              NumberOfArgumentTypes>
+    BinaryOperationColumnsTable;
+
+template <typename Operation, size_t... Indices>
+constexpr BinaryOperationColumnsTable
+BuildBinaryOperationColumns(index_sequence<Indices...>) {
+  BinaryOperationColumnsTable evaluates{};
+  ((evaluates[(size_t)ArithmeticTypes[Indices / NumberOfArithmeticTypes]]
+             [(size_t)ArithmeticTypes[Indices % NumberOfArithmeticTypes]] =
+        EvaluateColumnsOfTypes<
+            Operation, ArithmeticTypes[Indices / NumberOfArithmeticTypes],
+            ArithmeticTypes[Indices % NumberOfArithmeticTypes]>),
+   ...);
+  return evaluates;
+}
+
+template <typename Operation>
+constexpr BinaryOperationColumnsTable BinaryOperationColumns =
+    BuildBinaryOperationColumns<Operation>(
+        make_index_sequence<NumberOfArithmeticTypes *
+                            NumberOfArithmeticTypes>());
+
+template <typename Operation>
+void EvaluateBinaryOperationColumns(const Column& left, const Column& right,
+                                    Column& result) {
+  auto evaluate = BinaryOperationColumns<Operation>[(size_t)left.GetType()]
+                                                   [(size_t)right.GetType()];
+  if (evaluate == nullptr)
+    result.Reset(ArgumentType::None, 0);
+  else
+    evaluate(left, right, result);
 }
@@ -3,16 +3,34 @@
 #include <limits>
 using std::numeric_limits;
 
+#include "InstructionProcessor.hpp"
 #include "Interpreter/BinaryArithmeticOperation.hpp"
 #include "Interpreter/Subtract.hpp"
 #include "ValueStack.hpp"
 
-void Subtract() {
-  PerformBinaryOperation([](auto left, auto right) { return left - right; });
+static auto SubtractOperation = [](auto left, auto right) {
+  return left - right;
+};
+
+void Subtract() { PerformBinaryOperation(SubtractOperation); }
+
+DecodedHandler QuickenSubtract() {
+  return QuickenBinaryOperation<decltype(SubtractOperation)>();
+}
+
+Argument EvaluateSubtract(Argument left, Argument right) {
+  return EvaluateBinaryOperation(left, right, SubtractOperation);
+}
+
+EvaluateInstructionFunc SpecializeSubtract(ArgumentType left,
+                                           ArgumentType right) {
+  return SpecializeBinaryOperation<decltype(SubtractOperation)>(left, right);
 }
 
-InstructionMetadata GetSubtractMetadata() {
-  return {.execute = Subtract, .name = "Subtract"};
+void EvaluateSubtractColumns(const Column& left, const Column& right,
+                             Column& result) {
+  EvaluateBinaryOperationColumns<decltype(SubtractOperation)>(left, right,
+                                                              result);
 }
 
 TEST_CASE("Verify subtract opcode behavior") {
@@ -30,8 +48,8 @@ TEST_CASE("Verify subtract opcode behavior") {
   SUBCASE("Verify subtract opcode behavior for a 32-bit integer and a 64-bit "
           "integer") {
     const int32_t left = 15;
-    const int64_t right = numeric_limits<int64_t>::max();
-    const int64_t expected = numeric_limits<int64_t>::min() + 16;
+    const int64_t right = MaximumI64Argument;
+    const int64_t expected = MinimumI64Argument + 16;
     Push(left);
     Push(right);
     Subtract();
@@ -62,9 +80,9 @@ TEST_CASE("Verify subtract opcode behavior") {
 
   SUBCASE("Verify subtract opcode behavior for a 64-bit integer and a 64-bit "
           "integer") {
-    const int64_t left = numeric_limits<int64_t>::max() - 20;
+    const int64_t left = MaximumI64Argument - 20;
     const int64_t right = 15;
-    const int64_t expected = numeric_limits<int64_t>::max() - 35;
+    const int64_t expected = MaximumI64Argument - 35;
     Push(left);
     Push(right);
     Subtract();
@@ -73,9 +91,9 @@ TEST_CASE("Verify subtract opcode behavior") {
 
   SUBCASE("Verify subtract opcode behavior for a 64-bit integer and a 32-bit "
           "integer") {
-    const int64_t left = numeric_limits<int64_t>::max() - 20;
+    const int64_t left = MaximumI64Argument - 20;
     const int32_t right = 15;
-    const int64_t expected = numeric_limits<int64_t>::max() - 35;
+    const int64_t expected = MaximumI64Argument - 35;
     Push(left);
     Push(right);
     Subtract();
@@ -84,9 +102,9 @@ TEST_CASE("Verify subtract opcode behavior") {
 
   SUBCASE("Verify subtract opcode behavior for a 64-bit integer and a 32-bit "
           "float") {
-    const int64_t left = numeric_limits<int64_t>::max() - 20;
+    const int64_t left = MaximumI64Argument - 20;
     const float right = -15;
-    const float expected = numeric_limits<int64_t>::max() - 5;
+    const float expected = MaximumI64Argument - 5;
     Push(left);
     Push(right);
     Subtract();
@@ -95,9 +113,9 @@ TEST_CASE("Verify subtract opcode behavior") {
 
   SUBCASE("Verify subtract opcode behavior for a 64-bit integer and a 64-bit "
           "float") {
-    const int64_t left = numeric_limits<int64_t>::max() - 20;
+    const int64_t left = MaximumI64Argument - 20;
     const double right = -15;
-    const double expected = numeric_limits<int64_t>::max() - 5;
+    const double expected = MaximumI64Argument - 5;
     Push(left);
     Push(right);
     Subtract();
@@ -129,8 +147,8 @@ TEST_CASE("Verify subtract opcode behavior") {
   SUBCASE("Verify subtract opcode behavior for a 32-bit float and a 64-bit "
           "integer") {
     const float left = 15;
-    const int64_t right = numeric_limits<int64_t>::max() - 20;
-    const float expected = -(numeric_limits<int64_t>::max() - 5);
+    const int64_t right = MaximumI64Argument - 20;
+    const float expected = -(MaximumI64Argument - 5);
     Push(left);
     Push(right);
     Subtract();
@@ -202,12 +220,170 @@ TEST_CASE("Verify subtract opcode behavior") {
   }
 
   SUBCASE("Verify subtract opcode 64-bit integer overflow") {
-    const int64_t left = numeric_limits<int64_t>::min();
+    const int64_t left = MinimumI64Argument;
     const int64_t right = 1;
     Push(left);
     Push(right);
     Subtract();
-    CHECK(Pop().i64() == numeric_limits<int64_t>::max());
+    CHECK(Pop().i64() == MaximumI64Argument);
+  }
+}
+
+TEST_CASE("Verify subtract opcode evaluation behavior") {
+  SUBCASE("Verify that evaluating subtract matches subtract for each pair of "
+          "types") {
+    const Argument values[] = {42, (int64_t)43, 44.5f, 45.5};
+    for (auto left : values) {
+      for (auto right : values) {
+        Push(left);
+        Push(right);
+        Subtract();
+        CHECK(EvaluateSubtract(left, right) == Pop());
+      }
+    }
+  }
+
+  SUBCASE("Verify that subtract cannot be evaluated for booleans") {
+    CHECK(EvaluateSubtract(true, 1).Type() == ArgumentType::None);
+    CHECK(EvaluateSubtract(1, 'a').Type() == ArgumentType::None);
+  }
+}
+
+TEST_CASE("Verify subtract opcode specialization behavior") {
+  SUBCASE("Verify that specialized subtract matches subtract for each pair of "
+          "types") {
+    const Argument values[] = {42, (int64_t)43, 44.5f, 45.5};
+    for (auto left : values) {
+      for (auto right : values) {
+        auto evaluate = SpecializeSubtract(left.Type(), right.Type());
+        REQUIRE(evaluate != nullptr);
+        CHECK(evaluate(left, right) == EvaluateSubtract(left, right));
+      }
+    }
+  }
+
+  SUBCASE("Verify that subtract is not specialized for booleans") {
+    CHECK(SpecializeSubtract(ArgumentType::b, ArgumentType::i32) == nullptr);
+    CHECK(SpecializeSubtract(ArgumentType::None, ArgumentType::i32) == nullptr);
+  }
+}
+
+TEST_CASE("Verify subtract opcode quickening behavior") {
+  SUBCASE("Verify that quickened subtract matches subtract for each pair of "
+          "types") {
+    const Argument values[] = {42, (int64_t)43, 44.5f, 45.5};
+    for (auto left : values) {
+      for (auto right : values) {
+        Push(left);
+        Push(right);
+        Subtract();
+        auto expected = Pop();
+
+        Push(left);
+        Push(right);
+        auto handler = QuickenSubtract();
+        REQUIRE(handler != nullptr);
+        DecodedInstruction instruction = {handler};
+        CHECK(handler(&instruction) == &instruction + 1);
+        CHECK(Pop() == expected);
+      }
+    }
+  }
+
+  SUBCASE("Verify that subtract is not quickened for booleans") {
+    Push(true);
+    Push(false);
+    CHECK(QuickenSubtract() == nullptr);
+    Pop();
+    Pop();
+  }
+}
+
+TEST_CASE("Verify subtract opcode JIT behavior") {
+  SUBCASE("Verify that the JIT matches the instruction processor for each pair "
+          "of types") {
+    const Argument values[] = {42,
+                               numeric_limits<int32_t>::max(),
+                               MaximumI64Argument - 20,
+                               MinimumI64Argument,
+                               44.5f,
+                               -0.1f,
+                               45.5,
+                               1e-300};
+    for (auto left : values) {
+      for (auto right : values) {
+        Instruction instructions[] = {
+            {OpCode::Push, left}, {OpCode::Push, right}, {OpCode::Subtract}};
+        Process(instructions, Engine::DirectThreaded);
+        auto expected = Pop();
+
+        Process(instructions, Engine::Jit);
+        CHECK(Pop() == expected);
+      }
+    }
+  }
+
+  SUBCASE("Verify that the JIT matches the instruction processor for values "
+          "pushed before the program") {
+    const Argument values[] = {42, (int64_t)43, 44.5f, 45.5};
+    for (auto left : values) {
+      for (auto right : values) {
+        Instruction instructions[] = {{OpCode::Push, right},
+                                      {OpCode::Subtract}};
+        Push(left);
+        Process(instructions, Engine::DirectThreaded);
+        auto expected = Pop();
+
+        Push(left);
+        Process(instructions, Engine::Jit);
+        CHECK(Pop() == expected);
+      }
+    }
+  }
+}
+
+TEST_CASE("Verify subtract opcode column behavior") {
+  const int32_t values[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  auto column = Column::FromValues<int32_t>(values);
+
+  SUBCASE("Subtract a column from a constant on the left") {
+    Column result;
+    EvaluateSubtractColumns(Column::Constant(0.5f, 10), column, result);
+    CHECK(result.GetType() == ArgumentType::f32);
+    CHECK_FALSE(result.IsConstant());
+    for (size_t row = 0; row < 10; row++)
+      CHECK(result.Get(row) == Argument(0.5f - values[row]));
+  }
+
+  SUBCASE("Subtract a constant on the right from a column") {
+    Column result;
+    EvaluateSubtractColumns(column, Column::Constant(2.5, 10), result);
+    CHECK(result.GetType() == ArgumentType::f64);
+    for (size_t row = 0; row < 10; row++)
+      CHECK(result.Get(row) == Argument(values[row] - 2.5));
+  }
+
+  SUBCASE("Subtract two columns") {
+    Column result;
+    EvaluateSubtractColumns(column, column, result);
+    CHECK(result.GetType() == ArgumentType::i32);
+    for (size_t row = 0; row < 10; row++)
+      CHECK(result.Get(row) == Argument(0));
+  }
+
+  SUBCASE("Subtracting two constants makes a constant") {
+    Column result;
+    EvaluateSubtractColumns(Column::Constant((int64_t)2, 10),
+                            Column::Constant(3, 10), result);
+    CHECK(result.IsConstant());
+    CHECK(result.GetNumberOfRows() == 10);
+    CHECK(result.Get(9) == Argument((int64_t)-1));
+  }
+
+  SUBCASE("There is no result for booleans") {
+    Column result;
+    EvaluateSubtractColumns(Column::Constant(true, 10), column, result);
+    CHECK(result.GetType() == ArgumentType::None);
   }
 }
 
@@ -1,4 +1,20 @@
 #pragma once
 
+#include "Bytecode.hpp"
+
 void Subtract();
-InstructionMetadata GetSubtractMetadata();
+DecodedHandler QuickenSubtract();
+Argument EvaluateSubtract(Argument left, Argument right);
+EvaluateInstructionFunc SpecializeSubtract(ArgumentType left,
+                                           ArgumentType right);
+void EvaluateSubtractColumns(const Column& left, const Column& right,
+                             Column& result);
+
+constexpr InstructionMetadata GetSubtractMetadata() {
+  return {.execute = Subtract,
+          .name = "Subtract",
+          .quicken = QuickenSubtract,
+          .evaluate = EvaluateSubtract,
+          .specialize = SpecializeSubtract,
+          .evaluateColumns = EvaluateSubtractColumns};
+}
@@ -0,0 +1,626 @@
+#include "Configuration.hpp"
+
+#include <algorithm>
+using std::find_if;
+#include <bit>
+using std::bit_cast;
+#include <cstring>
+using std::memcpy;
+#include <exception>
+using std::current_exception;
+using std::exception_ptr;
+using std::make_exception_ptr;
+using std::rethrow_exception;
+#include <iterator>
+using std::size;
+#include <stdexcept>
+using std::logic_error;
+using std::runtime_error;
+#include <utility>
+using std::exchange;
+#include <vector>
+using std::vector;
+
+#include <fmt/core.h>
+using fmt::format;
+
+#include <sys/mman.h>
+
+#include "DecodedProgram.hpp"
+#include "InstructionProcessor.hpp"
+#include "Interpreter/Interpreter.hpp"
+#include "Jit/JitProgram.hpp"
+#include "Jit/X64Assembler.hpp"
+#include "ValueStack.hpp"
+
+// == JIT Program ==
+//
+// A JIT program compiles its instructions to x86-64 code once, and executes
+// that code directly. The value stack slots the program pushes itself are kept
+// in callee-saved registers, so a push is a move of a constant into a register
+// and a pop just frees the register. Since every value the program pushes is a
+// constant, the compiler knows the type of each of those slots, and emits Add
+// and Subtract as the machine instructions for those types. These follow the
+// same arithmetic conversions as the interpreter, so the results are bit for
+// bit the same.
+//
+// Everything else goes back to the interpreter: the registers are flushed to
+// the value stack and the generated code calls the registered instruction.
+// That covers operands that were on the stack before the program started (their
+// types are only known at runtime), types the JIT has no code for, and any
+// registered instruction.
+//
+// The generated code never unwinds: a call that throws saves the exception and
+// returns false, and the generated code returns to Execute, which rethrows it.
+//
+// The program refers to the instructions it was compiled from, so they must
+// outlive it. If an instruction is registered after compiling, the program is
+// compiled again before it next executes.
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define MU_JIT_AVAILABLE 1
+#else
+#define MU_JIT_AVAILABLE 0
+#endif
+
+bool IsJitAvailable() { return MU_JIT_AVAILABLE; }
+
+// -- Runtime support --
+//
+// The generated code calls these functions with the System V calling
+// convention.
+
+static thread_local exception_ptr PendingException;
+
+static uint64_t GetBits(Argument argument) {
+  switch (argument.Type()) {
+  case ArgumentType::i32:
+    return (uint32_t)argument.i32();
+  case ArgumentType::i64:
+    return (uint64_t)argument.i64();
+  case ArgumentType::f32:
+    return bit_cast<uint32_t>(argument.f32());
+  case ArgumentType::f64:
+    return bit_cast<uint64_t>(argument.f64());
+  case ArgumentType::b:
+    return argument.b();
+  case ArgumentType::c:
+    return (uint8_t)argument.c();
+  default:
+    return 0;
+  }
+}
+
+static Argument MakeArgument(uint64_t bits, ArgumentType type) {
+  switch (type) {
+  case ArgumentType::i32:
+    return (int32_t)bits;
+  case ArgumentType::i64:
+    return (int64_t)bits;
+  case ArgumentType::f32:
+    return bit_cast<float>((uint32_t)bits);
+  case ArgumentType::f64:
+    return bit_cast<double>(bits);
+  case ArgumentType::b:
+    return bits != 0;
+  case ArgumentType::c:
+    return (char)bits;
+  default:
+    return Argument();
+  }
+}
+
+// The value stack throws bad_alloc when it cannot grow.
+static bool PushValue(uint64_t bits, ArgumentType type) {
+  try {
+    Push(MakeArgument(bits, type));
+    return true;
+  } catch (...) {
+    PendingException = current_exception();
+    return false;
+  }
+}
+
+static bool PopValue() {
+  try {
+    Pop();
+    return true;
+  } catch (...) {
+    PendingException = current_exception();
+    return false;
+  }
+}
+
+static bool CallInstruction(ExecuteInstructionFunc execute) {
+  try {
+    execute();
+    return true;
+  } catch (...) {
+    PendingException = current_exception();
+    return false;
+  }
+}
+
+static bool FailWithUnexpectedOpCode(OpCode opCode) {
+  PendingException = make_exception_ptr(
+      logic_error(format("Unexpected opcode: {}", (int)opCode)));
+  return false;
+}
+
+// -- Compiler --
+
+static constexpr Register ValueRegisters[] = {
+    Register::rbx, Register::r12, Register::r13, Register::r14, Register::r15};
+
+static bool IsInteger(ArgumentType type) {
+  return type == ArgumentType::i32 || type == ArgumentType::i64;
+}
+
+static bool IsArithmetic(ArgumentType type) {
+  return IsInteger(type) || type == ArgumentType::f32 ||
+         type == ArgumentType::f64;
+}
+
+// The JIT only has code for the built-in Add and Subtract. If another
+// instruction is registered for those opcodes, it is called like any other.
+static bool IsNativeBinaryOperation(OpCode opCode) {
+  if (!HasInstruction(opCode))
+    return false;
+
+  auto execute = GetInstructionMetadata(opCode).execute;
+  return (opCode == OpCode::Add && execute == Add) ||
+         (opCode == OpCode::Subtract && execute == Subtract);
+}
+
+class JitCompiler {
+public:
+  vector<uint8_t> Compile(span<Instruction> instructions);
+
+private:
+  struct ValueSlot {
+    Register reg;
+    ArgumentType type;
+  };
+
+  X64Assembler m_assembler;
+
+  // The top of the value stack that is held in registers, bottom first. The
+  // rest of the value stack is in memory.
+  vector<ValueSlot> m_slots;
+
+  // Jumps taken when a call fails.
+  vector<size_t> m_failureJumps;
+
+  bool CompileInstruction(Instruction instruction);
+  void CompilePush(Argument argument);
+  void CompilePop();
+  void CompileBinaryOperation(OpCode opCode);
+  void CompileCall(OpCode opCode);
+
+  Register AllocateRegister();
+  void StoreSlot(ValueSlot slot);
+  void Flush();
+  void LoadFloatingPoint(XmmRegister destination, ValueSlot slot,
+                         ArgumentType type);
+  void CheckResult();
+};
+
+vector<uint8_t> JitCompiler::Compile(span<Instruction> instructions) {
+  for (auto reg : ValueRegisters)
+    m_assembler.PushRegister(reg);
+
+  for (auto instruction : instructions) {
+    if (!CompileInstruction(instruction))
+      break;
+  }
+
+  Flush();
+  m_assembler.MoveImmediate(Register::rax, 1);
+  auto success = m_assembler.Jump();
+
+  auto failure = m_assembler.GetPosition();
+  for (auto jump : m_failureJumps)
+    m_assembler.BindJump(jump, failure);
+  m_assembler.MoveImmediate(Register::rax, 0);
+
+  m_assembler.BindJump(success, m_assembler.GetPosition());
+  for (auto i = size(ValueRegisters); i > 0; i--)
+    m_assembler.PopRegister(ValueRegisters[i - 1]);
+  m_assembler.Return();
+
+  auto code = m_assembler.GetCode();
+  return vector<uint8_t>(code.begin(), code.end());
+}
+
+// Returns false if execution can never get past this instruction.
+bool JitCompiler::CompileInstruction(Instruction instruction) {
+  auto opCode = instruction.opCode;
+  if (opCode == OpCode::Push) {
+    CompilePush(instruction.argument);
+  } else if (opCode == OpCode::Pop) {
+    CompilePop();
+  } else if (IsNativeBinaryOperation(opCode) && m_slots.size() >= 2 &&
+             IsArithmetic(m_slots[m_slots.size() - 2].type) &&
+             IsArithmetic(m_slots.back().type)) {
+    CompileBinaryOperation(opCode);
+  } else if (HasInstruction(opCode)) {
+    CompileCall(opCode);
+  } else {
+    Flush();
+    m_assembler.MoveImmediate(Register::rdi, (int64_t)opCode);
+    m_assembler.Call((const void*)FailWithUnexpectedOpCode);
+    m_failureJumps.push_back(m_assembler.Jump());
+    return false;
+  }
+
+  return true;
+}
+
+void JitCompiler::CompilePush(Argument argument) {
+  auto reg = AllocateRegister();
+  m_assembler.MoveImmediate(reg, (int64_t)GetBits(argument));
+  m_slots.push_back({reg, argument.Type()});
+}
+
+void JitCompiler::CompilePop() {
+  if (m_slots.empty()) {
+    m_assembler.Call((const void*)PopValue);
+    CheckResult();
+  } else {
+    m_slots.pop_back();
+  }
+}
+
+void JitCompiler::CompileBinaryOperation(OpCode opCode) {
+  auto right = m_slots.back();
+  m_slots.pop_back();
+  auto& left = m_slots.back();
+  auto subtract = opCode == OpCode::Subtract;
+
+  if (left.type == ArgumentType::i32 && right.type == ArgumentType::i32) {
+    if (subtract)
+      m_assembler.Subtract32(left.reg, right.reg);
+    else
+      m_assembler.Add32(left.reg, right.reg);
+  } else if (IsInteger(left.type) && IsInteger(right.type)) {
+    if (left.type == ArgumentType::i32)
+      m_assembler.SignExtend32(left.reg, left.reg);
+    if (right.type == ArgumentType::i32)
+      m_assembler.SignExtend32(right.reg, right.reg);
+
+    if (subtract)
+      m_assembler.Subtract64(left.reg, right.reg);
+    else
+      m_assembler.Add64(left.reg, right.reg);
+#if defined(MU_NAN_BOXING)
+    // An i64 argument wraps around at 48 bits (see Argument.hpp).
+    m_assembler.SignExtend48(left.reg);
+#endif
+    left.type = ArgumentType::i64;
+  } else {
+    auto type =
+        left.type == ArgumentType::f64 || right.type == ArgumentType::f64
+            ? ArgumentType::f64
+            : ArgumentType::f32;
+    LoadFloatingPoint(XmmRegister::xmm0, left, type);
+    LoadFloatingPoint(XmmRegister::xmm1, right, type);
+
+    if (type == ArgumentType::f32) {
+      if (subtract)
+        m_assembler.SubtractFloat(XmmRegister::xmm0, XmmRegister::xmm1);
+      else
+        m_assembler.AddFloat(XmmRegister::xmm0, XmmRegister::xmm1);
+      m_assembler.MoveFromXmm32(left.reg, XmmRegister::xmm0);
+    } else {
+      if (subtract)
+        m_assembler.SubtractDouble(XmmRegister::xmm0, XmmRegister::xmm1);
+      else
+        m_assembler.AddDouble(XmmRegister::xmm0, XmmRegister::xmm1);
+      m_assembler.MoveFromXmm64(left.reg, XmmRegister::xmm0);
+    }
+    left.type = type;
+  }
+}
+
+void JitCompiler::CompileCall(OpCode opCode) {
+  Flush();
+  m_assembler.MoveImmediate(Register::rdi,
+                            (int64_t)GetInstructionMetadata(opCode).execute);
+  m_assembler.Call((const void*)CallInstruction);
+  CheckResult();
+}
+
+// When every register is in use, the bottom slot moves to the value stack in
+// memory, since it will be needed last.
+Register JitCompiler::AllocateRegister() {
+  if (m_slots.size() == size(ValueRegisters)) {
+    StoreSlot(m_slots.front());
+    m_slots.erase(m_slots.begin());
+  }
+
+  for (auto reg : ValueRegisters) {
+    auto slot = find_if(m_slots.begin(), m_slots.end(),
+                        [reg](ValueSlot slot) { return slot.reg == reg; });
+    if (slot == m_slots.end())
+      return reg;
+  }
+
+  assert(0 && "No free register");
+  return Register::rbx;
+}
+
+void JitCompiler::StoreSlot(ValueSlot slot) {
+  m_assembler.Move(Register::rdi, slot.reg);
+  m_assembler.MoveImmediate(Register::rsi, (int64_t)slot.type);
+  m_assembler.Call((const void*)PushValue);
+  CheckResult();
+}
+
+void JitCompiler::Flush() {
+  for (auto slot : m_slots)
+    StoreSlot(slot);
+  m_slots.clear();
+}
+
+// Converts the value in the slot to the given floating point type, just like
+// the usual arithmetic conversions in C++.
+void JitCompiler::LoadFloatingPoint(XmmRegister destination, ValueSlot slot,
+                                    ArgumentType type) {
+  auto isDouble = type == ArgumentType::f64;
+  switch (slot.type) {
+  case ArgumentType::i32:
+    if (isDouble)
+      m_assembler.Int32ToDouble(destination, slot.reg);
+    else
+      m_assembler.Int32ToFloat(destination, slot.reg);
+    break;
+  case ArgumentType::i64:
+    if (isDouble)
+      m_assembler.Int64ToDouble(destination, slot.reg);
+    else
+      m_assembler.Int64ToFloat(destination, slot.reg);
+    break;
+  case ArgumentType::f32:
+    m_assembler.MoveToXmm32(destination, slot.reg);
+    if (isDouble)
+      m_assembler.FloatToDouble(destination, destination);
+    break;
+  default:
+    m_assembler.MoveToXmm64(destination, slot.reg);
+    break;
+  }
+}
+
+void JitCompiler::CheckResult() {
+  m_assembler.TestLowByte(Register::rax);
+  m_failureJumps.push_back(m_assembler.JumpIfZero());
+}
+
+// -- Program --
+
+JitProgram::JitProgram(span<Instruction> instructions)
+    : m_instructions(instructions), m_code(nullptr), m_codeSize(0) {
+  Compile();
+}
+
+JitProgram::~JitProgram() { Release(); }
+
+void JitProgram::Execute() {
+  if (m_registryVersion != GetInstructionRegistryVersion()) {
+    Release();
+    Compile();
+  }
+
+  if (m_code == nullptr) {
+    Process(m_instructions, Engine::DirectThreaded);
+    return;
+  }
+
+  auto function = (bool (*)())m_code;
+  if (!function())
+    rethrow_exception(exchange(PendingException, nullptr));
+}
+
+bool JitProgram::IsCompiled() const { return m_code != nullptr; }
+
+size_t JitProgram::GetCodeSize() const { return m_codeSize; }
+
+void JitProgram::Compile() {
+  m_registryVersion = GetInstructionRegistryVersion();
+#if MU_JIT_AVAILABLE
+  auto code = JitCompiler().Compile(m_instructions);
+
+  // The code is written before it is made executable, so the memory is never
+  // writable and executable at the same time.
+  auto memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+    return;
+
+  memcpy(memory, code.data(), code.size());
+  if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, code.size());
+    return;
+  }
+
+  m_code = memory;
+  m_codeSize = code.size();
+#endif
+}
+
+void JitProgram::Release() {
+  if (m_code != nullptr)
+    munmap(m_code, m_codeSize);
+  m_code = nullptr;
+  m_codeSize = 0;
+}
+
+static void ExecuteJitProgram(span<Instruction> instructions) {
+  JitProgram(instructions).Execute();
+}
+
+TEST_CASE("Verify JIT program behavior") {
+  SUBCASE("The JIT is available on x86-64") {
+#if defined(__x86_64__) && !defined(_WIN32)
+    Instruction instructions[] = {{OpCode::Push, 2}};
+    JitProgram program(instructions);
+    CHECK(IsJitAvailable());
+    CHECK(program.IsCompiled());
+    CHECK(program.GetCodeSize() > 0);
+#endif
+  }
+
+  SUBCASE("Push two values and add") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    JitProgram program(instructions);
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+  }
+
+  SUBCASE("Push three values, pop one and subtract") {
+    Instruction instructions[] = {{OpCode::Push, 2},
+                                  {OpCode::Push, 3},
+                                  {OpCode::Push, 8},
+                                  {OpCode::Pop},
+                                  {OpCode::Subtract}};
+    JitProgram program(instructions);
+    program.Execute();
+    CHECK(Pop().i32() == -1);
+  }
+
+  SUBCASE("A program can be executed more than once") {
+    Instruction instructions[] = {
+        {OpCode::Push, 40}, {OpCode::Push, 2}, {OpCode::Add}};
+    JitProgram program(instructions);
+    program.Execute();
+    program.Execute();
+    CHECK(Pop().i32() == 42);
+    CHECK(Pop().i32() == 42);
+  }
+
+  SUBCASE("Values of every type can be pushed") {
+    Instruction instructions[] = {
+        {OpCode::Push, 42},   {OpCode::Push, (int64_t)-43},
+        {OpCode::Push, 4.5f}, {OpCode::Push, -45.5},
+        {OpCode::Push, true}, {OpCode::Push, 'a'},
+        {OpCode::Push}};
+    VerifyMatchesProcess(instructions, ExecuteJitProgram);
+  }
+
+  SUBCASE("Mixed types follow the usual arithmetic conversions") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2},      {OpCode::Push, (int64_t)-3},
+        {OpCode::Add},          {OpCode::Push, 0.1f},
+        {OpCode::Subtract},     {OpCode::Push, 7},
+        {OpCode::Add},          {OpCode::Push, 1e100},
+        {OpCode::Subtract},     {OpCode::Push, (int64_t)1 << 40},
+        {OpCode::Add}};
+    VerifyMatchesProcess(instructions, ExecuteJitProgram);
+  }
+
+  SUBCASE("More values than registers are kept on the stack") {
+    vector<Instruction> instructions;
+    for (auto i = 0; i < 20; i++)
+      instructions.push_back({OpCode::Push, i});
+    instructions.push_back({OpCode::Pop});
+    for (auto i = 0; i < 10; i++)
+      instructions.push_back({OpCode::Subtract});
+    VerifyMatchesProcess(instructions, ExecuteJitProgram);
+  }
+
+  SUBCASE("Values pushed before the program can be used") {
+    Instruction instructions[] = {{OpCode::Push, 3},
+                                  {OpCode::Subtract},
+                                  {OpCode::Push, 2.5},
+                                  {OpCode::Add},
+                                  {OpCode::Add}};
+    Push(10);
+    Push((int64_t)20);
+    Process(instructions);
+    auto expected = Pop();
+
+    Push(10);
+    Push((int64_t)20);
+    JitProgram program(instructions);
+    program.Execute();
+    CHECK(Pop() == expected);
+  }
+
+  SUBCASE("Values pushed before the program can be popped") {
+    auto stackSize = StackSize();
+    Push(1);
+    Push(2);
+    Instruction instructions[] = {{OpCode::Pop}, {OpCode::Pop}};
+    JitProgram program(instructions);
+    program.Execute();
+    CHECK(StackSize() == stackSize);
+  }
+
+  SUBCASE("An unexpected opcode is an error") {
+    auto stackSize = StackSize();
+    Instruction instructions[] = {{OpCode::Push, 1}, {(OpCode)42}};
+    JitProgram program(instructions);
+    CHECK_THROWS_AS(program.Execute(), logic_error);
+    CHECK(StackSize() == stackSize + 1);
+    CHECK(Pop().i32() == 1);
+  }
+
+  SUBCASE("An exception thrown by an instruction is rethrown") {
+    auto stackSize = StackSize();
+    auto metadata = GetInstructionMetadata(OpCode::Nop);
+    RegisterInstruction(OpCode::Nop,
+                        {.execute = [] { throw runtime_error("Failed"); },
+                         .name = "Nop"});
+
+    Instruction instructions[] = {{OpCode::Push, 1}, {OpCode::Nop}};
+    JitProgram program(instructions);
+    CHECK_THROWS_AS(program.Execute(), runtime_error);
+    CHECK(Pop().i32() == 1);
+    CHECK(StackSize() == stackSize);
+
+    RegisterInstruction(OpCode::Nop, metadata);
+  }
+
+  SUBCASE("An instruction registered after compiling is executed") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    JitProgram program(instructions);
+
+    MockInstructionCalled = false;
+    RegisterInstruction(OpCode::Add,
+                        {.execute = [] { MockInstructionCalled = true; },
+                         .name = "Add"});
+    program.Execute();
+    CHECK(MockInstructionCalled);
+    CHECK(Pop().i32() == 3);
+    CHECK(Pop().i32() == 2);
+
+    RegisterInstruction(OpCode::Add, GetAddMetadata());
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+  }
+}
+
+TEST_CASE("Verify JIT program performance") {
+  vector<Instruction> instructions;
+  for (auto i = 0; i < 1000; i++) {
+    instructions.push_back({OpCode::Push, 43});
+    instructions.push_back({OpCode::Push, 42});
+    instructions.push_back({OpCode::Add});
+    instructions.push_back({OpCode::Pop});
+  }
+
+  DecodedProgram decodedProgram(instructions);
+  JitProgram jitProgram(instructions);
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(instructions.size());
+
+  b.run("Process with the direct-threaded engine",
+        [&] { Process(instructions, Engine::DirectThreaded); });
+
+  b.run("Execute a decoded program", [&] { decodedProgram.Execute(); });
+
+  b.run("Execute a JIT program", [&] { jitProgram.Execute(); });
+}
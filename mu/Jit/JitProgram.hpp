@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+using std::span;
+
+#include "Bytecode.hpp"
+
+// Returns true if the JIT can generate native code on this platform.
+bool IsJitAvailable();
+
+class JitProgram {
+public:
+  JitProgram(span<Instruction> instructions);
+  ~JitProgram();
+
+  JitProgram(const JitProgram&) = delete;
+  JitProgram& operator=(const JitProgram&) = delete;
+
+  void Execute();
+
+  // A program that could not be compiled executes with the instruction
+  // processor instead.
+  bool IsCompiled() const;
+  size_t GetCodeSize() const;
+
+private:
+  span<Instruction> m_instructions;
+  uint32_t m_registryVersion;
+  void* m_code;
+  size_t m_codeSize;
+
+  void Compile();
+  void Release();
+};
@@ -0,0 +1,343 @@
+#include "Configuration.hpp"
+
+#include <cassert>
+#include <cstring>
+using std::memcpy;
+#include <initializer_list>
+using std::initializer_list;
+
+#include "Jit/X64Assembler.hpp"
+
+// == x86-64 Assembler ==
+//
+// Most of the instructions here operate on two registers, and are encoded as:
+//
+//   [legacy prefix] [REX prefix] opcode ModRM
+//
+// The REX prefix selects 64-bit operands (W) and extends the register numbers
+// in the ModRM byte (R and B) to reach r8-r15. It is omitted when it is not
+// needed, so the encodings match what an assembler would produce.
+
+static uint8_t Number(Register reg) { return (uint8_t)reg; }
+static uint8_t Number(XmmRegister reg) { return (uint8_t)reg; }
+
+span<const uint8_t> X64Assembler::GetCode() const { return m_code; }
+
+size_t X64Assembler::GetPosition() const { return m_code.size(); }
+
+void X64Assembler::PushRegister(Register reg) {
+  EmitRex(false, 0, Number(reg));
+  Emit(0x50 + (Number(reg) & 7));
+}
+
+void X64Assembler::PopRegister(Register reg) {
+  EmitRex(false, 0, Number(reg));
+  Emit(0x58 + (Number(reg) & 7));
+}
+
+void X64Assembler::Return() { Emit(0xC3); }
+
+void X64Assembler::Call(const void* function) {
+  MoveImmediate(Register::rax, (int64_t)function);
+  // call rax
+  Emit(0xFF);
+  EmitModRM(2, Number(Register::rax));
+}
+
+void X64Assembler::MoveImmediate(Register destination, int64_t value) {
+  auto rm = Number(destination);
+  if (value >= 0 && value <= UINT32_MAX) {
+    // mov r32, imm32 clears the upper half of the register.
+    EmitRex(false, 0, rm);
+    Emit(0xB8 + (rm & 7));
+    EmitUint32((uint32_t)value);
+  } else if (value >= INT32_MIN && value <= INT32_MAX) {
+    // mov r64, imm32 sign extends the value.
+    EmitRegisterInstruction(0xC7, true, 0, rm);
+    EmitUint32((uint32_t)value);
+  } else {
+    EmitRex(true, 0, rm);
+    Emit(0xB8 + (rm & 7));
+    EmitUint64((uint64_t)value);
+  }
+}
+
+void X64Assembler::Move(Register destination, Register source) {
+  EmitRegisterInstruction(0x89, true, Number(source), Number(destination));
+}
+
+void X64Assembler::SignExtend32(Register destination, Register source) {
+  EmitRegisterInstruction(0x63, true, Number(destination), Number(source));
+}
+
+void X64Assembler::Add32(Register destination, Register source) {
+  EmitRegisterInstruction(0x01, false, Number(source), Number(destination));
+}
+
+void X64Assembler::Subtract32(Register destination, Register source) {
+  EmitRegisterInstruction(0x29, false, Number(source), Number(destination));
+}
+
+void X64Assembler::Add64(Register destination, Register source) {
+  EmitRegisterInstruction(0x01, true, Number(source), Number(destination));
+}
+
+void X64Assembler::Subtract64(Register destination, Register source) {
+  EmitRegisterInstruction(0x29, true, Number(source), Number(destination));
+}
+
+// The register is shifted left 16 bits, then arithmetically right 16 bits.
+void X64Assembler::SignExtend48(Register reg) {
+  EmitRegisterInstruction(0xC1, true, 4, Number(reg));
+  Emit(16);
+  EmitRegisterInstruction(0xC1, true, 7, Number(reg));
+  Emit(16);
+}
+
+void X64Assembler::TestLowByte(Register reg) {
+  // Without a REX prefix, the byte registers 4-7 are ah, ch, dh and bh rather
+  // than the low bytes of rsp, rbp, rsi and rdi.
+  EmitRex(false, Number(reg), Number(reg), Number(reg) >= 4);
+  Emit(0x84);
+  EmitModRM(Number(reg), Number(reg));
+}
+
+void X64Assembler::MoveToXmm32(XmmRegister destination, Register source) {
+  EmitSseInstruction(0x66, 0x6E, false, Number(destination), Number(source));
+}
+
+void X64Assembler::MoveToXmm64(XmmRegister destination, Register source) {
+  EmitSseInstruction(0x66, 0x6E, true, Number(destination), Number(source));
+}
+
+void X64Assembler::MoveFromXmm32(Register destination, XmmRegister source) {
+  EmitSseInstruction(0x66, 0x7E, false, Number(source), Number(destination));
+}
+
+void X64Assembler::MoveFromXmm64(Register destination, XmmRegister source) {
+  EmitSseInstruction(0x66, 0x7E, true, Number(source), Number(destination));
+}
+
+void X64Assembler::Int32ToFloat(XmmRegister destination, Register source) {
+  EmitSseInstruction(0xF3, 0x2A, false, Number(destination), Number(source));
+}
+
+void X64Assembler::Int64ToFloat(XmmRegister destination, Register source) {
+  EmitSseInstruction(0xF3, 0x2A, true, Number(destination), Number(source));
+}
+
+void X64Assembler::Int32ToDouble(XmmRegister destination, Register source) {
+  EmitSseInstruction(0xF2, 0x2A, false, Number(destination), Number(source));
+}
+
+void X64Assembler::Int64ToDouble(XmmRegister destination, Register source) {
+  EmitSseInstruction(0xF2, 0x2A, true, Number(destination), Number(source));
+}
+
+void X64Assembler::FloatToDouble(XmmRegister destination, XmmRegister source) {
+  EmitSseInstruction(0xF3, 0x5A, false, Number(destination), Number(source));
+}
+
+void X64Assembler::AddFloat(XmmRegister destination, XmmRegister source) {
+  EmitSseInstruction(0xF3, 0x58, false, Number(destination), Number(source));
+}
+
+void X64Assembler::SubtractFloat(XmmRegister destination, XmmRegister source) {
+  EmitSseInstruction(0xF3, 0x5C, false, Number(destination), Number(source));
+}
+
+void X64Assembler::AddDouble(XmmRegister destination, XmmRegister source) {
+  EmitSseInstruction(0xF2, 0x58, false, Number(destination), Number(source));
+}
+
+void X64Assembler::SubtractDouble(XmmRegister destination,
+                                  XmmRegister source) {
+  EmitSseInstruction(0xF2, 0x5C, false, Number(destination), Number(source));
+}
+
+size_t X64Assembler::JumpIfZero() {
+  auto jump = GetPosition();
+  Emit(0x0F);
+  Emit(0x84);
+  EmitUint32(0);
+  return jump;
+}
+
+size_t X64Assembler::Jump() {
+  auto jump = GetPosition();
+  Emit(0xE9);
+  EmitUint32(0);
+  return jump;
+}
+
+void X64Assembler::BindJump(size_t jump, size_t target) {
+  // The displacement is the last four bytes of the jump, and it is relative to
+  // the end of the jump.
+  auto end = jump + (m_code[jump] == 0xE9 ? 5 : 6);
+  auto displacement = (int32_t)(target - end);
+  memcpy(&m_code[end - 4], &displacement, sizeof(displacement));
+}
+
+void X64Assembler::Emit(uint8_t value) { m_code.push_back(value); }
+
+void X64Assembler::EmitUint32(uint32_t value) {
+  for (auto i = 0; i < 4; i++)
+    Emit((uint8_t)(value >> (i * 8)));
+}
+
+void X64Assembler::EmitUint64(uint64_t value) {
+  for (auto i = 0; i < 8; i++)
+    Emit((uint8_t)(value >> (i * 8)));
+}
+
+void X64Assembler::EmitRex(bool wide, uint8_t reg, uint8_t rm, bool force) {
+  uint8_t rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3);
+  if (rex != 0x40 || force)
+    Emit(rex);
+}
+
+void X64Assembler::EmitModRM(uint8_t reg, uint8_t rm) {
+  // Mode 3 means that the r/m field names a register rather than memory.
+  Emit(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void X64Assembler::EmitRegisterInstruction(uint8_t opCode, bool wide,
+                                           uint8_t reg, uint8_t rm) {
+  EmitRex(wide, reg, rm);
+  Emit(opCode);
+  EmitModRM(reg, rm);
+}
+
+void X64Assembler::EmitSseInstruction(uint8_t prefix, uint8_t opCode,
+                                      bool wide, uint8_t reg, uint8_t rm) {
+  // The legacy prefix must come before the REX prefix.
+  Emit(prefix);
+  EmitRex(wide, reg, rm);
+  Emit(0x0F);
+  Emit(opCode);
+  EmitModRM(reg, rm);
+}
+
+// The expected encodings come from llvm-mc.
+static void VerifyCode(const X64Assembler& assembler,
+                       initializer_list<uint8_t> expected) {
+  auto code = assembler.GetCode();
+  REQUIRE(code.size() == expected.size());
+  auto i = 0;
+  for (auto value : expected)
+    CHECK(code[i++] == value);
+}
+
+TEST_CASE("Verify x86-64 assembler behavior") {
+  X64Assembler a;
+
+  SUBCASE("Push and pop registers") {
+    a.PushRegister(Register::rbx);
+    a.PushRegister(Register::r12);
+    a.PopRegister(Register::r15);
+    a.Return();
+    VerifyCode(a, {0x53, 0x41, 0x54, 0x41, 0x5F, 0xC3});
+  }
+
+  SUBCASE("Call a function") {
+    a.Call((const void*)0x1122334455667788);
+    VerifyCode(a, {0x48, 0xB8, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11,
+                   0xFF, 0xD0});
+  }
+
+  SUBCASE("Move a small positive immediate") {
+    a.MoveImmediate(Register::rbx, 42);
+    a.MoveImmediate(Register::r12, 42);
+    VerifyCode(a, {0xBB, 0x2A, 0x00, 0x00, 0x00, 0x41, 0xBC, 0x2A, 0x00, 0x00,
+                   0x00});
+  }
+
+  SUBCASE("Move a small negative immediate") {
+    a.MoveImmediate(Register::rbx, -1);
+    a.MoveImmediate(Register::r15, -2);
+    VerifyCode(a, {0x48, 0xC7, 0xC3, 0xFF, 0xFF, 0xFF, 0xFF, 0x49, 0xC7, 0xC7,
+                   0xFE, 0xFF, 0xFF, 0xFF});
+  }
+
+  SUBCASE("Move a large immediate") {
+    a.MoveImmediate(Register::r13, 0x100000000);
+    VerifyCode(a, {0x49, 0xBD, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00});
+  }
+
+  SUBCASE("Move and sign extend registers") {
+    a.Move(Register::rdi, Register::rbx);
+    a.Move(Register::rdi, Register::r12);
+    a.SignExtend32(Register::rbx, Register::rbx);
+    a.SignExtend32(Register::r12, Register::r13);
+    VerifyCode(a, {0x48, 0x89, 0xDF, 0x4C, 0x89, 0xE7, 0x48, 0x63, 0xDB, 0x4D,
+                   0x63, 0xE5});
+  }
+
+  SUBCASE("Integer arithmetic") {
+    a.Add32(Register::rbx, Register::r12);
+    a.Subtract32(Register::r12, Register::rbx);
+    a.Add64(Register::rbx, Register::r12);
+    a.Subtract64(Register::r15, Register::r14);
+    VerifyCode(a, {0x44, 0x01, 0xE3, 0x41, 0x29, 0xDC, 0x4C, 0x01, 0xE3, 0x4D,
+                   0x29, 0xF7});
+  }
+
+  SUBCASE("Sign extend 48 bits") {
+    a.SignExtend48(Register::rbx);
+    a.SignExtend48(Register::r12);
+    VerifyCode(a, {0x48, 0xC1, 0xE3, 0x10, 0x48, 0xC1, 0xFB, 0x10, 0x49, 0xC1,
+                   0xE4, 0x10, 0x49, 0xC1, 0xFC, 0x10});
+  }
+
+  SUBCASE("Test the low byte of a register") {
+    a.TestLowByte(Register::rax);
+    a.TestLowByte(Register::r12);
+    VerifyCode(a, {0x84, 0xC0, 0x45, 0x84, 0xE4});
+  }
+
+  SUBCASE("Move between general purpose and SSE registers") {
+    a.MoveToXmm32(XmmRegister::xmm0, Register::rbx);
+    a.MoveToXmm32(XmmRegister::xmm1, Register::r12);
+    a.MoveToXmm64(XmmRegister::xmm0, Register::rbx);
+    a.MoveToXmm64(XmmRegister::xmm1, Register::r13);
+    a.MoveFromXmm32(Register::rbx, XmmRegister::xmm0);
+    a.MoveFromXmm32(Register::r12, XmmRegister::xmm0);
+    a.MoveFromXmm64(Register::rbx, XmmRegister::xmm0);
+    a.MoveFromXmm64(Register::r14, XmmRegister::xmm0);
+    VerifyCode(a, {0x66, 0x0F, 0x6E, 0xC3, 0x66, 0x41, 0x0F, 0x6E, 0xCC,
+                   0x66, 0x48, 0x0F, 0x6E, 0xC3, 0x66, 0x49, 0x0F, 0x6E,
+                   0xCD, 0x66, 0x0F, 0x7E, 0xC3, 0x66, 0x41, 0x0F, 0x7E,
+                   0xC4, 0x66, 0x48, 0x0F, 0x7E, 0xC3, 0x66, 0x49, 0x0F,
+                   0x7E, 0xC6});
+  }
+
+  SUBCASE("Convert values") {
+    a.Int32ToFloat(XmmRegister::xmm0, Register::rbx);
+    a.Int64ToFloat(XmmRegister::xmm1, Register::r12);
+    a.Int32ToDouble(XmmRegister::xmm0, Register::r13);
+    a.Int64ToDouble(XmmRegister::xmm1, Register::rbx);
+    a.FloatToDouble(XmmRegister::xmm0, XmmRegister::xmm1);
+    VerifyCode(a, {0xF3, 0x0F, 0x2A, 0xC3, 0xF3, 0x49, 0x0F, 0x2A, 0xCC,
+                   0xF2, 0x41, 0x0F, 0x2A, 0xC5, 0xF2, 0x48, 0x0F, 0x2A,
+                   0xCB, 0xF3, 0x0F, 0x5A, 0xC1});
+  }
+
+  SUBCASE("Floating point arithmetic") {
+    a.AddFloat(XmmRegister::xmm0, XmmRegister::xmm1);
+    a.SubtractFloat(XmmRegister::xmm0, XmmRegister::xmm1);
+    a.AddDouble(XmmRegister::xmm0, XmmRegister::xmm1);
+    a.SubtractDouble(XmmRegister::xmm0, XmmRegister::xmm1);
+    VerifyCode(a, {0xF3, 0x0F, 0x58, 0xC1, 0xF3, 0x0F, 0x5C, 0xC1, 0xF2, 0x0F,
+                   0x58, 0xC1, 0xF2, 0x0F, 0x5C, 0xC1});
+  }
+
+  SUBCASE("Jumps are bound relative to their end") {
+    auto forward = a.JumpIfZero();
+    a.Return();
+    a.BindJump(forward, a.GetPosition());
+    auto backward = a.Jump();
+    a.BindJump(backward, 0);
+    VerifyCode(a, {0x0F, 0x84, 0x01, 0x00, 0x00, 0x00, 0xC3, 0xE9, 0xF4, 0xFF,
+                   0xFF, 0xFF});
+  }
+}
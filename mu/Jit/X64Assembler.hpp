@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+using std::span;
+#include <vector>
+using std::vector;
+
+// The values match the register numbers used in x86-64 instruction encodings.
+enum class Register : uint8_t {
+  rax,
+  rcx,
+  rdx,
+  rbx,
+  rsp,
+  rbp,
+  rsi,
+  rdi,
+  r8,
+  r9,
+  r10,
+  r11,
+  r12,
+  r13,
+  r14,
+  r15
+};
+
+enum class XmmRegister : uint8_t { xmm0, xmm1 };
+
+// The assembler emits the few x86-64 instructions the JIT needs into a code
+// buffer. General purpose registers hold both integers and the bits of floating
+// point values, so the SSE instructions only use xmm0 and xmm1 as scratch
+// registers.
+class X64Assembler {
+public:
+  span<const uint8_t> GetCode() const;
+  size_t GetPosition() const;
+
+  void PushRegister(Register reg);
+  void PopRegister(Register reg);
+  void Return();
+
+  // Calls the function through rax, so rax does not need to be preserved.
+  void Call(const void* function);
+
+  // Uses the shortest encoding for the value.
+  void MoveImmediate(Register destination, int64_t value);
+
+  void Move(Register destination, Register source);
+  void SignExtend32(Register destination, Register source);
+  void Add32(Register destination, Register source);
+  void Subtract32(Register destination, Register source);
+  void Add64(Register destination, Register source);
+  void Subtract64(Register destination, Register source);
+
+  // Sign extends the low 48 bits of the register to all 64 of them.
+  void SignExtend48(Register reg);
+  void TestLowByte(Register reg);
+
+  void MoveToXmm32(XmmRegister destination, Register source);
+  void MoveToXmm64(XmmRegister destination, Register source);
+  void MoveFromXmm32(Register destination, XmmRegister source);
+  void MoveFromXmm64(Register destination, XmmRegister source);
+  void Int32ToFloat(XmmRegister destination, Register source);
+  void Int64ToFloat(XmmRegister destination, Register source);
+  void Int32ToDouble(XmmRegister destination, Register source);
+  void Int64ToDouble(XmmRegister destination, Register source);
+  void FloatToDouble(XmmRegister destination, XmmRegister source);
+  void AddFloat(XmmRegister destination, XmmRegister source);
+  void SubtractFloat(XmmRegister destination, XmmRegister source);
+  void AddDouble(XmmRegister destination, XmmRegister source);
+  void SubtractDouble(XmmRegister destination, XmmRegister source);
+
+  // Jumps are emitted with a placeholder target. Each returns the position of
+  // the jump, which should be passed to BindJump once the target is known.
+  size_t JumpIfZero();
+  size_t Jump();
+  void BindJump(size_t jump, size_t target);
+
+private:
+  vector<uint8_t> m_code;
+
+  void Emit(uint8_t value);
+  void EmitUint32(uint32_t value);
+  void EmitUint64(uint64_t value);
+  void EmitRex(bool wide, uint8_t reg, uint8_t rm, bool force = false);
+  void EmitModRM(uint8_t reg, uint8_t rm);
+  void EmitRegisterInstruction(uint8_t opCode, bool wide, uint8_t reg,
+                               uint8_t rm);
+  void EmitSseInstruction(uint8_t prefix, uint8_t opCode, bool wide,
+                          uint8_t reg, uint8_t rm);
+};
@@ -1,8 +1,32 @@
 #include "Configuration.hpp"
 
+#include <algorithm>
+using std::max;
+using std::min;
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+using std::memcpy;
+#include <filesystem>
+using std::filesystem::file_size;
+using std::filesystem::resize_file;
+#include <future>
+using std::async;
+using std::future;
+using std::launch;
+#include <system_error>
+using std::error_code;
+#include <vector>
+using std::vector;
+
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <fmt/core.h>
 using fmt::format;
 
+#include "Assembler.hpp"
+#include "Compression.hpp"
 #include "Loader.hpp"
 
 // == Loader ==
@@ -10,32 +34,358 @@ using fmt::format;
 // Instructions can be loaded from a binary file. This class opens that file
 // and provides a list of instructions to be executed. It closes the file
 // when the instance of the Loadrer does out of scope.
+//
+// A file that is bigger than memory is mapped a window at a time, and its
+// instructions are only available through ForEachWindow. So are those of a
+// compressed file, which are decompressed a block at a time as they are
+// visited.
+//
+// An analyzed file carries the analysis of its program in sections after its
+// instructions, which the loader provides along with them, so they do not
+// need to be analyzed again.
+
+static uint64_t GetFileSize(const char* filePath) {
+  error_code error;
+  auto size = file_size(filePath, error);
+  return error ? 0 : size;
+}
 
 Loader::Loader(const char* muFilePath)
-    : m_muFilePath(muFilePath), m_muFile(muFilePath),
-      m_errorCondition(ErrorCondition::NoError) {
-  auto fileData = m_muFile.GetBuffer();
-  if (fileData == nullptr) {
+    : Loader(muFilePath,
+             MemoryMapOptions::ForFileSize(GetFileSize(muFilePath))) {}
+
+Loader::Loader(const char* muFilePath, MemoryMapOptions options)
+    : m_muFilePath(muFilePath), m_windowSize(options.windowSize),
+      m_muFile(muFilePath, options), m_fileData(m_muFile.GetBuffer()),
+      m_fileSize(m_muFile.GetSize()), m_inMemory(false) {
+  auto header = sizeof(MuMagicHeader);
+  ReadHeader(m_windowSize != 0 ? m_muFile.MapWindow(0, header) : m_fileData);
+}
+
+// Bytecode that is already in memory, such as a request to the server, is in
+// the same format as a file, so it is read in the same way. The loader does not
+// copy it, so it must outlive the loader.
+Loader::Loader(span<const byte> muBytecode)
+    : m_windowSize(0), m_muFile(""), m_fileData(muBytecode.data()),
+      m_fileSize(muBytecode.size()), m_inMemory(true) {
+  ReadHeader(m_fileData);
+}
+
+void Loader::ReadHeader(const byte* fileData) {
+  m_compressed = false;
+  m_analyzed = false;
+  m_codeOffset = sizeof(MuMagicHeader);
+  m_numberOfInstructions = 0;
+  m_errorCondition = ErrorCondition::NoError;
+
+  auto header = sizeof(MuMagicHeader);
+  uint32_t magic = 0;
+  if (fileData != nullptr && m_fileSize >= header)
+    memcpy(&magic, fileData, sizeof(magic));
+
+  if (fileData == nullptr && !m_inMemory) {
     m_errorCondition = ErrorCondition::FileDoesNotExist;
-  } else if (*(uint32_t*)fileData != MuMagicHeader) {
+  } else if (magic == MuCompressedMagicHeader) {
+    m_compressed = true;
+    if (!ReadBlockIndex())
+      m_errorCondition = ErrorCondition::InvalidHeader;
+  } else if (magic == MuAnalyzedMagicHeader) {
+    if (!ReadSections() && m_errorCondition == ErrorCondition::NoError)
+      m_errorCondition = ErrorCondition::InvalidHeader;
+  } else if (magic != MuMagicHeader ||
+             (m_inMemory && (m_fileSize - header) % sizeof(Instruction) != 0)) {
     m_errorCondition = ErrorCondition::InvalidHeader;
   } else {
-    auto instructionBuffer = (Instruction*)(fileData + sizeof(MuMagicHeader));
-    auto numberOfInstructions = m_muFile.GetSize() / sizeof(Instruction);
-    m_instructions = span<Instruction>{instructionBuffer, numberOfInstructions};
+    m_numberOfInstructions = (m_fileSize - header) / sizeof(Instruction);
+    if (!IsWindowed())
+      m_instructions = span<Instruction>{(Instruction*)(fileData + header),
+                                         m_numberOfInstructions};
   }
 }
 
+bool Loader::IsMuBytecode(span<const byte> bytes) {
+  uint32_t magic = 0;
+  if (bytes.size() >= sizeof(MuMagicHeader))
+    memcpy(&magic, bytes.data(), sizeof(magic));
+  return magic == MuMagicHeader || magic == MuCompressedMagicHeader ||
+         magic == MuAnalyzedMagicHeader;
+}
+
 span<Instruction> Loader::GetInstructions() const { return m_instructions; }
 
 string Loader::GetErrorMessage() const {
+  if (m_inMemory && m_errorCondition == ErrorCondition::VersionMismatch)
+    return "The bytecode was written by a different version of the VM.";
+  if (m_inMemory && m_errorCondition != ErrorCondition::NoError)
+    return "The bytecode is not valid Mu bytecode.";
   if (m_errorCondition == ErrorCondition::FileDoesNotExist)
     return format("The file '{}' does not exist.", m_muFilePath);
   if (m_errorCondition == ErrorCondition::InvalidHeader)
     return format("The file '{}' is not a valid Mu file.", m_muFilePath);
+  if (m_errorCondition == ErrorCondition::CannotMapWindow)
+    return format("The file '{}' cannot be read.", m_muFilePath);
+  if (m_errorCondition == ErrorCondition::InvalidBlock)
+    return format("The file '{}' has a compressed block that is not valid.",
+                  m_muFilePath);
+  if (m_errorCondition == ErrorCondition::VersionMismatch)
+    return format("The file '{}' was written by a different version of the VM.",
+                  m_muFilePath);
   return "";
 }
 
+size_t Loader::GetNumberOfInstructions() const {
+  return m_numberOfInstructions;
+}
+
+bool Loader::IsWindowed() const { return m_windowSize != 0 || m_compressed; }
+
+bool Loader::IsCompressed() const { return m_compressed; }
+
+const ProgramAnalysis* Loader::GetAnalysis() const {
+  return m_analyzed ? &m_analysis : nullptr;
+}
+
+bool Loader::ForEachWindow(const function<bool(span<Instruction>)>& visit) {
+  if (m_compressed)
+    return ForEachBlock(visit);
+  if (!IsWindowed())
+    return visit(m_instructions);
+
+  auto instructionsPerWindow =
+      max<size_t>(m_windowSize / sizeof(Instruction), 1);
+  for (size_t first = 0; first < m_numberOfInstructions;
+       first += instructionsPerWindow) {
+    auto count = min(instructionsPerWindow, m_numberOfInstructions - first);
+    auto window = m_muFile.MapWindow(m_codeOffset + first * sizeof(Instruction),
+                                     count * sizeof(Instruction));
+    if (window == nullptr) {
+      m_errorCondition = ErrorCondition::CannotMapWindow;
+      return false;
+    }
+    if (!visit({(Instruction*)window, count}))
+      return false;
+  }
+  return true;
+}
+
+bool Loader::ReadInstructions(vector<Instruction>& instructions) {
+  instructions.reserve(instructions.size() + m_numberOfInstructions);
+  return ForEachWindow([&](span<Instruction> window) {
+    instructions.insert(instructions.end(), window.begin(), window.end());
+    return true;
+  });
+}
+
+const byte* Loader::MapBytes(uint64_t offset, size_t size) {
+  if (m_windowSize != 0)
+    return m_muFile.MapWindow(offset, size);
+  if (offset > m_fileSize || size > m_fileSize - offset)
+    return nullptr;
+  return m_fileData + offset;
+}
+
+// The offsets of the blocks are read when the file is loaded, but the blocks
+// are only read as they are executed.
+bool Loader::ReadBlockIndex() {
+  auto header = sizeof(MuMagicHeader);
+  if (m_fileSize < header + sizeof(CompressedBlockHeader) +
+                     sizeof(CompressedTrailer))
+    return false;
+
+  CompressedTrailer trailer;
+  auto trailerOffset = m_fileSize - sizeof(trailer);
+  auto trailerData = MapBytes(trailerOffset, sizeof(trailer));
+  if (trailerData == nullptr)
+    return false;
+  memcpy(&trailer, trailerData, sizeof(trailer));
+  if (trailer.indexOffset < header + sizeof(CompressedBlockHeader) ||
+      trailer.indexOffset > trailerOffset ||
+      (trailerOffset - trailer.indexOffset) % sizeof(uint64_t) != 0)
+    return false;
+
+  m_blockOffsets.resize((trailerOffset - trailer.indexOffset) /
+                        sizeof(uint64_t));
+  if (!m_blockOffsets.empty()) {
+    auto index = MapBytes(trailer.indexOffset,
+                          m_blockOffsets.size() * sizeof(uint64_t));
+    if (index == nullptr)
+      return false;
+    memcpy(m_blockOffsets.data(), index,
+           m_blockOffsets.size() * sizeof(uint64_t));
+  }
+
+  // The empty block header that ends the blocks is the end of the last one.
+  m_blockOffsets.push_back(trailer.indexOffset -
+                           sizeof(CompressedBlockHeader));
+  uint64_t previousOffset = header;
+  for (auto offset : m_blockOffsets) {
+    if (offset < previousOffset)
+      return false;
+    previousOffset = offset;
+  }
+
+  // The count is checked against the blocks before anything is allocated for
+  // it, so a corrupt trailer cannot ask for more memory than the blocks hold.
+  auto numberOfBlocks = m_blockOffsets.size() - 1;
+  if (trailer.numberOfInstructions >
+      numberOfBlocks * InstructionsPerCompressedBlock)
+    return false;
+  m_numberOfInstructions = trailer.numberOfInstructions;
+  return true;
+}
+
+// The sections are checked when the file is loaded, so the analysis can refer
+// straight in to the mapped file. A file that is mapped a window at a time
+// only keeps where its code is, and is executed without its analysis.
+bool Loader::ReadSections() {
+  auto header = sizeof(MuAnalyzedMagicHeader);
+  if (m_fileSize < header + sizeof(AnalyzedFooter))
+    return false;
+
+  AnalyzedFooter footer;
+  auto footerOffset = m_fileSize - sizeof(footer);
+  auto footerData = MapBytes(footerOffset, sizeof(footer));
+  if (footerData == nullptr)
+    return false;
+  memcpy(&footer, footerData, sizeof(footer));
+  if (footer.formatVersion != MuFormatVersion ||
+      footer.bytecodeVersion != BytecodeVersion) {
+    m_errorCondition = ErrorCondition::VersionMismatch;
+    return false;
+  }
+
+  auto tableOffset = footer.sectionTableOffset;
+  if (tableOffset < header || tableOffset > footerOffset ||
+      (footerOffset - tableOffset) % sizeof(SectionEntry) != 0 ||
+      (footerOffset - tableOffset) / sizeof(SectionEntry) !=
+          footer.numberOfSections)
+    return false;
+  vector<SectionEntry> sections(footer.numberOfSections);
+  if (!sections.empty()) {
+    auto table = MapBytes(tableOffset, sections.size() * sizeof(SectionEntry));
+    if (table == nullptr)
+      return false;
+    memcpy(sections.data(), table, sections.size() * sizeof(SectionEntry));
+  }
+
+  const SectionEntry* code = nullptr;
+  const SectionEntry* operandTypes = nullptr;
+  const SectionEntry* blockBoundaries = nullptr;
+  for (auto& section : sections) {
+    if (section.offset < header || section.offset % sizeof(uint64_t) != 0 ||
+        section.offset > tableOffset ||
+        section.size > tableOffset - section.offset)
+      return false;
+    if (section.kind == (uint32_t)SectionKind::Code)
+      code = &section;
+    else if (section.kind == (uint32_t)SectionKind::OperandTypes)
+      operandTypes = &section;
+    else if (section.kind == (uint32_t)SectionKind::BlockBoundaries)
+      blockBoundaries = &section;
+  }
+
+  auto numberOfInstructions = footer.numberOfInstructions;
+  if (code == nullptr || code->size % sizeof(Instruction) != 0 ||
+      code->size / sizeof(Instruction) != numberOfInstructions ||
+      (operandTypes != nullptr &&
+       operandTypes->size != numberOfInstructions) ||
+      (blockBoundaries != nullptr &&
+       blockBoundaries->size % sizeof(uint64_t) != 0))
+    return false;
+
+  m_numberOfInstructions = numberOfInstructions;
+  m_codeOffset = code->offset;
+  if (IsWindowed())
+    return true;
+
+  auto fileData = m_fileData;
+  m_instructions = span<Instruction>{(Instruction*)(fileData + code->offset),
+                                     m_numberOfInstructions};
+  if (operandTypes != nullptr && blockBoundaries != nullptr) {
+    m_analyzed = true;
+    m_analysis.maximumStackDepth = footer.maximumStackDepth;
+    m_analysis.operandTypes = {
+        (const uint8_t*)(fileData + operandTypes->offset), operandTypes->size};
+    m_analysis.blockBoundaries = {
+        (const uint64_t*)(fileData + blockBoundaries->offset),
+        blockBoundaries->size / sizeof(uint64_t)};
+  }
+  return true;
+}
+
+bool Loader::ReadBlock(size_t block, vector<Instruction>& instructions) {
+  auto offset = m_blockOffsets[block];
+  auto size = m_blockOffsets[block + 1] - offset;
+  if (size < sizeof(CompressedBlockHeader))
+    return false;
+  auto data = MapBytes(offset, size);
+  if (data == nullptr)
+    return false;
+
+  CompressedBlockHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (header.compressedSize != size - sizeof(header) ||
+      header.numberOfInstructions > InstructionsPerCompressedBlock)
+    return false;
+  instructions.resize(header.numberOfInstructions);
+  return DecompressBlock({data + sizeof(header), header.compressedSize},
+                         as_writable_bytes(span(instructions)));
+}
+
+// A helper thread decompresses the next block while the one before it is
+// visited, so execution only waits for the first block.
+bool Loader::ForEachBlock(const function<bool(span<Instruction>)>& visit) {
+  if (m_errorCondition != ErrorCondition::NoError || m_blockOffsets.empty())
+    return false;
+
+  auto numberOfBlocks = m_blockOffsets.size() - 1;
+  vector<Instruction> blocks[2];
+  auto readBlock = [&](size_t block) {
+    return ReadBlock(block, blocks[block % 2]);
+  };
+
+  future<bool> nextBlock;
+  if (numberOfBlocks > 0)
+    nextBlock = async(launch::async, readBlock, 0);
+  size_t numberOfInstructions = 0;
+  for (size_t block = 0; block < numberOfBlocks; block++) {
+    if (!nextBlock.get()) {
+      m_errorCondition = ErrorCondition::InvalidBlock;
+      return false;
+    }
+    if (block + 1 < numberOfBlocks)
+      nextBlock = async(launch::async, readBlock, block + 1);
+
+    numberOfInstructions += blocks[block % 2].size();
+    if (!visit(blocks[block % 2]))
+      return false;
+  }
+
+  if (numberOfInstructions != m_numberOfInstructions) {
+    m_errorCondition = ErrorCondition::InvalidBlock;
+    return false;
+  }
+  return true;
+}
+
+static void WriteCompressedMuFile(const char* filePath,
+                                  span<const Instruction> instructions) {
+  auto file = fopen(filePath, "wb");
+  BytecodeWriter writer(file, BytecodeFormat::Compressed);
+  writer.Write(instructions);
+  writer.Finish();
+  fclose(file);
+}
+
+static void WriteAnalyzedMuFile(const char* filePath,
+                                span<const Instruction> instructions) {
+  auto file = fopen(filePath, "wb");
+  BytecodeWriter writer(file, BytecodeFormat::Analyzed);
+  writer.Write(instructions);
+  writer.Finish();
+  fclose(file);
+}
+
 TEST_CASE("Verify loader behavior") {
   SUBCASE("Provides instructions from file") {
     Instruction expectedInstructions[] = {
@@ -82,4 +432,383 @@ TEST_CASE("Verify loader behavior") {
     REQUIRE(muFile.GetErrorMessage() ==
             "The file 'invalidMuFile.mu' is not a valid Mu file.");
   }
+
+  SUBCASE("Provides instructions from file a window at a time") {
+    vector<Instruction> expectedInstructions;
+    for (auto i = 0; i < 1000; i++)
+      expectedInstructions.push_back({OpCode::Push, i});
+    TestMuFile testFile("test.mu", expectedInstructions);
+
+    MemoryMapOptions options;
+    options.windowSize = 100 * sizeof(Instruction) + 1;
+    Loader muFile("test.mu", options);
+    REQUIRE(muFile.IsWindowed());
+    CHECK(muFile.GetErrorMessage() == "");
+    CHECK(muFile.GetInstructions().empty());
+    CHECK(muFile.GetNumberOfInstructions() == 1000);
+
+    vector<Instruction> actualInstructions;
+    auto numberOfWindows = 0;
+    CHECK(muFile.ForEachWindow([&](span<Instruction> window) {
+      numberOfWindows++;
+      actualInstructions.insert(actualInstructions.end(), window.begin(),
+                                window.end());
+      return true;
+    }));
+    CHECK(numberOfWindows == 10);
+    VerifyInstructions(expectedInstructions, actualInstructions);
+  }
+
+  SUBCASE("Stops visiting windows when asked") {
+    Instruction expectedInstructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    TestMuFile testFile("test.mu", expectedInstructions);
+
+    MemoryMapOptions options;
+    options.windowSize = sizeof(Instruction);
+    Loader muFile("test.mu", options);
+    auto numberOfWindows = 0;
+    CHECK_FALSE(muFile.ForEachWindow([&](span<Instruction> window) {
+      numberOfWindows++;
+      return window[0].opCode != OpCode::Push || window[0].argument.i32() != 3;
+    }));
+    CHECK(numberOfWindows == 2);
+  }
+
+  SUBCASE("Every option loads the same instructions") {
+    Instruction expectedInstructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    TestMuFile testFile("test.mu", expectedInstructions);
+
+    for (auto option : {&MemoryMapOptions::populate,
+                        &MemoryMapOptions::hugePages,
+                        &MemoryMapOptions::readAhead}) {
+      MemoryMapOptions options;
+      options.*option = true;
+      Loader muFile("test.mu", options);
+      VerifyInstructions(expectedInstructions, muFile.GetInstructions());
+      auto numberOfWindows = 0;
+      CHECK(muFile.ForEachWindow([&](span<Instruction> window) {
+        numberOfWindows++;
+        return window.size() == 3;
+      }));
+      CHECK(numberOfWindows == 1);
+    }
+  }
+
+  SUBCASE("A windowed file that does not exist provides useful error message") {
+    MemoryMapOptions options;
+    options.windowSize = 4096;
+    Loader muFileThatDoesNotExist("nofile.mu", options);
+    CHECK(muFileThatDoesNotExist.GetNumberOfInstructions() == 0);
+    CHECK(muFileThatDoesNotExist.GetErrorMessage() ==
+          "The file 'nofile.mu' does not exist.");
+  }
+
+  SUBCASE("Provides instructions from a compressed file a block at a time") {
+    vector<Instruction> expectedInstructions;
+    for (auto i = 0; i < 150000; i++)
+      expectedInstructions.push_back({OpCode::Push, i % 7});
+    WriteCompressedMuFile("test.mu", expectedInstructions);
+
+    for (auto windowSize : {size_t(0), size_t(4096)}) {
+      MemoryMapOptions options;
+      options.windowSize = windowSize;
+      Loader muFile("test.mu", options);
+      REQUIRE(muFile.GetErrorMessage() == "");
+      REQUIRE(muFile.IsCompressed());
+      CHECK(muFile.IsWindowed());
+      CHECK(muFile.GetInstructions().empty());
+      CHECK(muFile.GetNumberOfInstructions() == 150000);
+
+      vector<Instruction> actualInstructions;
+      auto numberOfWindows = 0;
+      CHECK(muFile.ForEachWindow([&](span<Instruction> window) {
+        numberOfWindows++;
+        actualInstructions.insert(actualInstructions.end(), window.begin(),
+                                  window.end());
+        return true;
+      }));
+      CHECK(numberOfWindows == 3);
+      VerifyInstructions(expectedInstructions, actualInstructions);
+    }
+    std::remove("test.mu");
+  }
+
+  SUBCASE("Stops decompressing blocks when asked") {
+    vector<Instruction> instructions(200000, {OpCode::Pop});
+    WriteCompressedMuFile("test.mu", instructions);
+    Loader muFile("test.mu");
+    auto numberOfWindows = 0;
+    CHECK_FALSE(muFile.ForEachWindow([&](span<Instruction>) {
+      return ++numberOfWindows < 2;
+    }));
+    CHECK(numberOfWindows == 2);
+    CHECK(muFile.GetErrorMessage() == "");
+    std::remove("test.mu");
+  }
+
+  SUBCASE("A compressed block that is not valid provides an error message") {
+    vector<Instruction> instructions(100000, {OpCode::Pop});
+    WriteCompressedMuFile("test.mu", instructions);
+    auto file = fopen("test.mu", "r+b");
+    fseek(file, sizeof(Loader::MuMagicHeader) + sizeof(CompressedBlockHeader),
+          SEEK_SET);
+    fputc(0xFF, file);
+    fclose(file);
+
+    Loader muFile("test.mu");
+    vector<Instruction> actualInstructions;
+    CHECK_FALSE(muFile.ReadInstructions(actualInstructions));
+    CHECK(muFile.GetErrorMessage() ==
+          "The file 'test.mu' has a compressed block that is not valid.");
+    std::remove("test.mu");
+  }
+
+  SUBCASE("A compressed file without its block index is not valid") {
+    Instruction instructions[] = {{OpCode::Pop}};
+    WriteCompressedMuFile("test.mu", instructions);
+    resize_file("test.mu", file_size("test.mu") - 1);
+    Loader muFile("test.mu");
+    CHECK(muFile.GetErrorMessage() ==
+          "The file 'test.mu' is not a valid Mu file.");
+    std::remove("test.mu");
+  }
+
+  SUBCASE("No instructions are read from a compressed file that is too short") {
+    Instruction instructions[] = {{OpCode::Push, 2}};
+    auto bytecode = WriteBytecode(instructions, BytecodeFormat::Compressed);
+    for (auto size : {sizeof(Loader::MuMagicHeader), bytecode.size() - 1}) {
+      Loader muFile(span((const byte*)bytecode.data(), size));
+      CHECK(muFile.GetErrorMessage() ==
+            "The bytecode is not valid Mu bytecode.");
+      vector<Instruction> actualInstructions;
+      CHECK_FALSE(muFile.ReadInstructions(actualInstructions));
+      CHECK(actualInstructions.empty());
+    }
+  }
+
+  SUBCASE("A compressed file with more instructions than its blocks is not "
+          "valid") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    WriteCompressedMuFile("test.mu", instructions);
+    auto file = fopen("test.mu", "r+b");
+    fseek(file, -(long)sizeof(uint64_t), SEEK_END);
+    uint64_t numberOfInstructions = 1ull << 61;
+    fwrite(&numberOfInstructions, sizeof(numberOfInstructions), 1, file);
+    fclose(file);
+
+    Loader muFile("test.mu");
+    CHECK(muFile.GetNumberOfInstructions() == 0);
+    CHECK(muFile.GetErrorMessage() ==
+          "The file 'test.mu' is not a valid Mu file.");
+    vector<Instruction> actualInstructions;
+    CHECK_FALSE(muFile.ReadInstructions(actualInstructions));
+    std::remove("test.mu");
+  }
+
+  SUBCASE("Provides instructions and their analysis from an analyzed file") {
+    vector<Instruction> expectedInstructions;
+    for (auto i = 0; i < 1000; i++) {
+      expectedInstructions.push_back({OpCode::Push, i});
+      expectedInstructions.push_back({OpCode::Push, 2.0f});
+      expectedInstructions.push_back({OpCode::Subtract});
+    }
+    WriteAnalyzedMuFile("test.mu", expectedInstructions);
+
+    Loader muFile("test.mu");
+    REQUIRE(muFile.GetErrorMessage() == "");
+    CHECK_FALSE(muFile.IsWindowed());
+    VerifyInstructions(expectedInstructions, muFile.GetInstructions());
+    auto analysis = muFile.GetAnalysis();
+    REQUIRE(analysis != nullptr);
+    CHECK(analysis->maximumStackDepth == 1001);
+    REQUIRE(analysis->operandTypes.size() == 3000);
+    CHECK(analysis->operandTypes[2] ==
+          PackOperandTypes(ArgumentType::i32, ArgumentType::f32));
+    CHECK(analysis->blockBoundaries.empty());
+
+    MemoryMapOptions options;
+    options.windowSize = 4096;
+    Loader windowed("test.mu", options);
+    CHECK(windowed.GetAnalysis() == nullptr);
+    vector<Instruction> actualInstructions;
+    REQUIRE(windowed.ReadInstructions(actualInstructions));
+    VerifyInstructions(expectedInstructions, actualInstructions);
+    std::remove("test.mu");
+  }
+
+  SUBCASE("Skips the sections of an analyzed file it does not know") {
+    Instruction instructions[] = {{OpCode::Push, 2}, {OpCode::Pop}};
+    auto header = Loader::MuAnalyzedMagicHeader;
+    SectionEntry sections[] = {
+        {42, 0, sizeof(header), 8},
+        {(uint32_t)SectionKind::Code, 0, sizeof(header) + 8,
+         sizeof(instructions)}};
+    auto tableOffset = sizeof(header) + 8 + sizeof(instructions);
+    AnalyzedFooter footer{MuFormatVersion, BytecodeVersion, 2, 1, tableOffset,
+                          2};
+    vector<byte> data(tableOffset + sizeof(sections) + sizeof(footer));
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + sizeof(header) + 8, instructions,
+           sizeof(instructions));
+    memcpy(data.data() + tableOffset, sections, sizeof(sections));
+    memcpy(data.data() + tableOffset + sizeof(sections), &footer,
+           sizeof(footer));
+    TestFile testFile("test.mu", data.data(), data.size());
+
+    Loader muFile("test.mu");
+    REQUIRE(muFile.GetErrorMessage() == "");
+    VerifyInstructions(instructions, muFile.GetInstructions());
+    CHECK(muFile.GetAnalysis() == nullptr);
+  }
+
+  SUBCASE("An analyzed file from another version of the VM is not loaded") {
+    Instruction instructions[] = {{OpCode::Push, 2}};
+    WriteAnalyzedMuFile("test.mu", instructions);
+    auto file = fopen("test.mu", "r+b");
+    fseek(file, -(long)sizeof(AnalyzedFooter), SEEK_END);
+    fputc(MuFormatVersion + 1, file);
+    fclose(file);
+
+    Loader muFile("test.mu");
+    CHECK(muFile.GetInstructions().empty());
+    CHECK(muFile.GetErrorMessage() ==
+          "The file 'test.mu' was written by a different version of the VM.");
+    std::remove("test.mu");
+  }
+
+  SUBCASE("An analyzed file with a section outside of it is not valid") {
+    Instruction instructions[] = {{OpCode::Push, 2}};
+    WriteAnalyzedMuFile("test.mu", instructions);
+    auto file = fopen("test.mu", "r+b");
+    fseek(file, -(long)(sizeof(AnalyzedFooter) + sizeof(SectionEntry)),
+          SEEK_END);
+    SectionEntry section{(uint32_t)SectionKind::BlockBoundaries, 0, 1 << 20,
+                         8};
+    fwrite(&section, sizeof(section), 1, file);
+    fclose(file);
+
+    Loader muFile("test.mu");
+    CHECK(muFile.GetErrorMessage() ==
+          "The file 'test.mu' is not a valid Mu file.");
+    std::remove("test.mu");
+  }
+}
+
+// Writes a .mu file of about the given size, without holding it in memory.
+static void WriteMuFile(const char* filePath, uint64_t size,
+                        BytecodeFormat format = BytecodeFormat::Plain) {
+  auto file = fopen(filePath, "wb");
+  BytecodeWriter writer(file, format);
+  vector<Instruction> batch;
+  for (auto i = 0; i < 4096; i++) {
+    batch.push_back({OpCode::Push, i});
+    batch.push_back({OpCode::Pop});
+  }
+  auto batchSize = batch.size() * sizeof(Instruction);
+  for (uint64_t written = 0; written < size; written += batchSize)
+    writer.Write(batch);
+  writer.Finish();
+  fclose(file);
+}
+
+// Reads every instruction, as an engine does.
+static uint64_t TouchInstructions(Loader& loader) {
+  uint64_t sum = 0;
+  loader.ForEachWindow([&](span<Instruction> window) {
+    for (auto& instruction : window)
+      sum += (uint64_t)instruction.opCode;
+    return true;
+  });
+  return sum;
+}
+
+TEST_CASE("Verify loader performance") {
+  // Files of 10 GB take a long time to write, so they are only loaded when
+  // MU_LOADER_BENCHMARK_MAX_GB is 10.
+  uint64_t maximumSize = 1024 * 1024 * 1024;
+  if (auto maximumGigabytes = getenv("MU_LOADER_BENCHMARK_MAX_GB"))
+    maximumSize *= strtoull(maximumGigabytes, nullptr, 10);
+
+  for (uint64_t size = 1024 * 1024; size <= maximumSize; size *= 10) {
+    auto filePath = "performance.mu";
+    WriteMuFile(filePath, size);
+
+    ankerl::nanobench::Bench b;
+    b.title(format("{} ({} MB)", GetCurrentTestName(), size / 1024 / 1024))
+        .relative(true)
+        .epochs(size >= 100 * 1024 * 1024 ? 3 : 11)
+        .epochIterations(1)
+        .warmup(1);
+
+    auto load = [&](const char* name, MemoryMapOptions options) {
+      b.run(name, [&] {
+        Loader loader(filePath, options);
+        ankerl::nanobench::doNotOptimizeAway(TouchInstructions(loader));
+      });
+    };
+
+    load("No options", MemoryMapOptions());
+    MemoryMapOptions options;
+    options.populate = true;
+    load("Populate", options);
+    options = MemoryMapOptions();
+    options.readAhead = true;
+    load("Read ahead", options);
+    options = MemoryMapOptions();
+    options.hugePages = true;
+    load("Huge pages", options);
+    options = MemoryMapOptions();
+    options.readAhead = true;
+    options.windowSize = 64 * 1024 * 1024;
+    load("64 MB windows", options);
+    b.run("Options for the file size", [&] {
+      Loader loader(filePath);
+      ankerl::nanobench::doNotOptimizeAway(TouchInstructions(loader));
+    });
+
+    std::remove(filePath);
+  }
+}
+
+TEST_CASE("Verify compressed loader performance") {
+  auto size = 100 * 1024 * 1024;
+  WriteMuFile("performance.mu", size);
+  WriteMuFile("performance.muz", size, BytecodeFormat::Compressed);
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName())
+      .relative(true)
+      .epochs(5)
+      .epochIterations(1)
+      .warmup(1);
+
+  b.run("Uncompressed", [&] {
+    Loader loader("performance.mu");
+    ankerl::nanobench::doNotOptimizeAway(TouchInstructions(loader));
+  });
+
+  b.run("Compressed", [&] {
+    Loader loader("performance.muz");
+    ankerl::nanobench::doNotOptimizeAway(TouchInstructions(loader));
+  });
+
+  // The pages of the file are dropped from the page cache first, so they are
+  // read from the disk.
+  auto loadCold = [&](const char* name, const char* filePath) {
+    b.run(name, [&] {
+      auto file = open(filePath, O_RDONLY);
+      posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+      close(file);
+      Loader loader(filePath);
+      ankerl::nanobench::doNotOptimizeAway(TouchInstructions(loader));
+    });
+  };
+  loadCold("Uncompressed, from the disk", "performance.mu");
+  loadCold("Compressed, from the disk", "performance.muz");
+
+  std::remove("performance.mu");
+  std::remove("performance.muz");
 }
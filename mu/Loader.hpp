@@ -1,27 +1,128 @@
 #pragma once
 
+#include <cstddef>
+using std::byte;
+#include <cstdint>
+#include <functional>
+using std::function;
 #include <span>
 using std::span;
 #include <string>
 using std::string;
+#include <vector>
+using std::vector;
 
 #include "Bytecode.hpp"
 #include "ReadOnlyMemoryMappedFile.hpp"
+#include "VerifiedProgram.hpp"
+
+// An analyzed .mu file starts with Loader::MuAnalyzedMagicHeader, and ends
+// with an AnalyzedFooter. The footer gives the offset of the section table,
+// which has a SectionEntry for each section of the file. The code section is
+// the instructions, as they are in a plain .mu file, and the other sections
+// are the analysis of the program: the operand types of each instruction, and
+// the instructions the stack is empty before (see ProgramAnalysis). Each
+// section starts on an eight byte boundary. A loader skips the sections it
+// does not know, so new ones can be added without changing MuFormatVersion.
+enum class SectionKind : uint32_t {
+  Code = 1,
+  OperandTypes = 2,
+  BlockBoundaries = 3
+};
+
+struct SectionEntry {
+  uint32_t kind;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct AnalyzedFooter {
+  uint32_t formatVersion;
+  uint32_t bytecodeVersion;
+  uint64_t numberOfInstructions;
+  uint64_t maximumStackDepth;
+  uint64_t sectionTableOffset;
+  uint64_t numberOfSections;
+};
+
+constexpr uint32_t MuFormatVersion = 1;
 
 class Loader {
 public:
+  // The file is mapped with the options that suit its size.
   Loader(const char* muFilePath);
+  Loader(const char* muFilePath, MemoryMapOptions options);
+  // The bytecode is in the same format as a file, and must outlive the loader.
+  Loader(span<const byte> muBytecode);
 
+  // This is empty if the file is mapped a window at a time, or compressed.
   span<Instruction> GetInstructions() const;
   string GetErrorMessage() const;
 
+  size_t GetNumberOfInstructions() const;
+  bool IsWindowed() const;
+  bool IsCompressed() const;
+
+  // The analysis an analyzed file carries, or nullptr if it has none. It is
+  // only available when the instructions are, and lives as long as the loader.
+  const ProgramAnalysis* GetAnalysis() const;
+
+  // Calls visit with each window of instructions in order, or once with all of
+  // them if the file is not mapped a window at a time. The windows of a
+  // compressed file are its blocks. A window is only valid until the next one
+  // is visited. Returns false if visit returns false, or a window cannot be
+  // mapped or decompressed.
+  bool ForEachWindow(const function<bool(span<Instruction>)>& visit);
+
+  // Appends every instruction to the vector. Returns false if they cannot all
+  // be read.
+  bool ReadInstructions(vector<Instruction>& instructions);
+
+#if defined(MU_NAN_BOXING)
+  // Instructions are a different size when arguments are NaN-boxed (see
+  // Argument.hpp), so the bytecode of each build has its own headers.
+  static const uint64_t MuMagicHeader = 0xDAFFDBFF;
+  static const uint64_t MuCompressedMagicHeader = 0xDAFFDBFC;
+  static const uint64_t MuAnalyzedMagicHeader = 0xDAFFDBFD;
+#else
   static const uint64_t MuMagicHeader = 0xDAFFDAFF;
+  static const uint64_t MuCompressedMagicHeader = 0xDAFFDAFC;
+  static const uint64_t MuAnalyzedMagicHeader = 0xDAFFDAFD;
+#endif
+
+  // True if the bytes start with the header of any of the formats above.
+  static bool IsMuBytecode(span<const byte> bytes);
 
 private:
-  const char* m_muFilePath;
+  string m_muFilePath;
+  size_t m_windowSize;
   ReadOnlyMemoryMappedFile m_muFile;
+  const byte* m_fileData;
+  uint64_t m_fileSize;
+  bool m_inMemory;
+  bool m_compressed;
+  bool m_analyzed;
+  uint64_t m_codeOffset;
+  ProgramAnalysis m_analysis;
+  vector<uint64_t> m_blockOffsets;
   span<Instruction> m_instructions;
+  size_t m_numberOfInstructions;
 
-  enum class ErrorCondition { NoError, FileDoesNotExist, InvalidHeader };
+  enum class ErrorCondition {
+    NoError,
+    FileDoesNotExist,
+    InvalidHeader,
+    CannotMapWindow,
+    InvalidBlock,
+    VersionMismatch
+  };
   ErrorCondition m_errorCondition;
+
+  void ReadHeader(const byte* fileData);
+  const byte* MapBytes(uint64_t offset, size_t size);
+  bool ReadBlockIndex();
+  bool ReadSections();
+  bool ReadBlock(size_t block, vector<Instruction>& instructions);
+  bool ForEachBlock(const function<bool(span<Instruction>)>& visit);
 };
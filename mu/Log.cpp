@@ -4,4 +4,8 @@
 
 using fmt::print;
 
-void Log(string_view message) { print("[=== \u03BC ===] {}\n", message); }
+void Log(string_view message) { print("{}", FormatLogMessage(message)); }
+
+string FormatLogMessage(string_view message) {
+  return format("[=== \u03BC ===] {}\n", message);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+using std::string;
 using std::string_view;
 
 #include <fmt/format.h>
@@ -8,6 +9,9 @@ using fmt::format;
 
 void Log(string_view message);
 
+// Returns the message as Log prints it, for output that is printed later.
+string FormatLogMessage(string_view message);
+
 template <typename... Args>
 void Log(fmt::format_string<Args...> s, Args&&... args) {
   Log(fmt::format(s, std::forward<Args>(args)...));
@@ -1,20 +1,76 @@
 #include "Configuration.hpp"
 
 #include <algorithm>
-using std::all_of;
+using std::clamp;
+using std::max;
+using std::move;
+#include <array>
+using std::array;
 
 #include <charconv>
+using std::errc;
 using std::from_chars;
 
+#include <exception>
+using std::exception;
+#include <limits>
+using std::numeric_limits;
+#include <stdexcept>
+using std::invalid_argument;
 #include <string>
 using std::string;
+#include <thread>
+using std::thread;
+
+#include <fmt/core.h>
+using fmt::format;
 
 #include "Bytecode.hpp"
 #include "Parser.hpp"
+#include "ReadOnlyMemoryMappedFile.hpp"
+#include "Scanner.hpp"
 #include "StringUtils.hpp"
+#include "WorkStealingPool.hpp"
+
+// == μtext Parser ==
+//
+// Each line of μtext is one instruction. Large inputs are split in to one
+// chunk for each core, at line boundaries, and the chunks are parsed in
+// parallel. Each chunk counts its own lines, so the line number of an error is
+// found by adding the lines in the chunks before it. The instructions from
+// each chunk are stitched together in order.
+//
+// The parser does not copy the μtext. Files are memory mapped, and each line
+// and each part of a line is a view of the mapped file. Every line has room for
+// one instruction in a buffer that is sized before parsing starts, so each
+// chunk writes its instructions straight in to its part of the buffer, and
+// nothing is allocated for each line.
+//
+// Each chunk is scanned in to bit masks of its newlines, whitespace and colons,
+// and the parts of each line are found from the masks, so the bytes of a line
+// are only read again to look up its mnemonic and type and to parse its value.
+
+MutextParseError::MutextParseError(size_t lineNumber, const string& message)
+    : runtime_error(format("Line {}: {}", lineNumber, message)),
+      m_lineNumber(lineNumber) {}
+
+size_t MutextParseError::GetLineNumber() const { return m_lineNumber; }
 
 vector<Instruction> ParseMutextFile(const char* mutextFilePath) {
-  return Parse(GetFileContents(mutextFilePath).c_str());
+  ReadOnlyMemoryMappedFile file(mutextFilePath);
+  if (file.GetBuffer() == nullptr)
+    return {};
+
+  return ParseMutext(
+      string_view((const char*)file.GetBuffer(), file.GetSize()));
+}
+
+vector<Instruction> ParseMutext(const char* mutext) {
+  return ParseMutext(string_view(mutext));
+}
+
+vector<Instruction> ParseMutext(string_view mutext) {
+  return Parse(mutext, GetNumberOfChunks(mutext.size()));
 }
 
 TEST_CASE("Verify ParseMutextFile behavior") {
@@ -38,54 +94,453 @@ TEST_CASE("Verify ParseMutextFile behavior") {
     CHECK(instructions[1].argument.Type() == ArgumentType::i32);
     CHECK(instructions[1].argument.i32() == 42);
   }
+
+  SUBCASE("Returns no instructions when given an empty file") {
+    TestFile testFile("test.mut", "");
+    CHECK(ParseMutextFile("test.mut").empty());
+  }
+
+  SUBCASE("Can parse a file that does not end with a newline") {
+    TestFile testFile("test.mut", "Push i32:1\nPush f32:0.25");
+    auto instructions = ParseMutextFile("test.mut");
+    REQUIRE(instructions.size() == 2);
+    CHECK(instructions[1].argument.f32() == 0.25f);
+  }
 }
 
-static string GetFileContents(const char* filename) {
-  FILE* file = fopen(filename, "rb");
+// Before files were memory mapped, the parser read the whole file in to a
+// string, and copied each line that was not blank in to a string of its own
+// before parsing it. The benchmark below keeps that path as its baseline. The
+// lines are parsed with the same ParseLine, so the two only differ in how the
+// file and its lines are read.
+static vector<Instruction> ParseMutextFileByLines(const char* mutextFilePath) {
+  auto file = fopen(mutextFilePath, "rb");
   if (file == nullptr)
-    return "";
-
+    return {};
   fseek(file, 0, SEEK_END);
-  const size_t size = ftell(file);
+  string contents(ftell(file), '\0');
   fseek(file, 0, SEEK_SET);
-
-  string contents;
-  contents.resize(size);
-  fread(contents.data(), 1, size, file);
+  contents.resize(fread(contents.data(), 1, contents.size(), file));
   fclose(file);
 
-  return contents;
-}
+  vector<string> lines;
+  string::size_type begin = 0;
+  while (begin < contents.size()) {
+    auto end = contents.find('\n', begin);
+    if (end == string::npos)
+      end = contents.size();
+    auto line = contents.substr(begin, end - begin);
+    begin = end + 1;
+    if (!Trim(line).empty())
+      lines.push_back(string(Trim(line)));
+  }
 
-static vector<Instruction> Parse(const char* mutextFileData) {
-  auto lines = SplitStringIntoLines(mutextFileData);
   vector<Instruction> instructions;
-  for (auto& line : lines) {
+  for (auto& line : lines)
     instructions.push_back(ParseLine(line));
+  return instructions;
+}
+
+TEST_CASE("Verify ParseMutextFile performance") {
+  auto mutext = GenerateArithmeticMutext(250000);
+  TestFile testFile("performance.mut", mutext.c_str());
+
+  // Each run reports how many times it allocates. The baseline allocates for
+  // each line, and the memory mapped parser a fixed number of times.
+  auto countAllocations = [](auto parse) {
+    auto before = GetNumberOfAllocations();
+    parse();
+    return GetNumberOfAllocations() - before;
+  };
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(mutext.size()).unit("B");
+
+  auto parseLines = [] {
+    ankerl::nanobench::doNotOptimizeAway(
+        ParseMutextFileByLines("performance.mut"));
+  };
+  b.run(format("Parse a copy of each line, as before ({} allocations)",
+               countAllocations(parseLines)),
+        parseLines);
+
+  auto parseMapped = [] {
+    ankerl::nanobench::doNotOptimizeAway(ParseMutextFile("performance.mut"));
+  };
+  b.run(format("Parse the memory mapped file ({} allocations)",
+               countAllocations(parseMapped)),
+        parseMapped);
+}
+
+TEST_CASE("Verify ParseMutext behavior") {
+  SUBCASE("Can parse instructions from a string") {
+    auto instructions = ParseMutext("Push i32:42\nPush i32:1\nAdd\n");
+    CHECK(instructions.size() == 3);
+    CHECK(instructions[1].argument.i32() == 1);
+    CHECK(instructions[2].opCode == OpCode::Add);
+  }
+
+  SUBCASE("Returns no instructions when given an empty string") {
+    CHECK(ParseMutext("").empty());
+  }
+
+  SUBCASE("Parses only the μtext in the view") {
+    string_view mutext("Pop\nAdd\nPush i32:1", 8);
+    auto instructions = ParseMutext(mutext);
+    REQUIRE(instructions.size() == 2);
+    CHECK(instructions[1].opCode == OpCode::Add);
+  }
+
+  SUBCASE("Does not read past a view that ends part way through a line") {
+    // The copy has no null character after it, so reading past the end of the
+    // view is a heap buffer overflow.
+    string_view source = "Pop\nPush";
+    vector<char> mutext(source.begin(), source.end());
+    CHECK_THROWS_AS(ParseMutext(string_view(mutext.data(), mutext.size())),
+                    MutextParseError);
   }
+
+  SUBCASE("Reports the line that cannot be parsed") {
+    try {
+      ParseMutext("Push i32:1\n\nPush i32:2\nMultiply\nAdd\n");
+      FAIL("The μtext should not parse");
+    } catch (const MutextParseError& e) {
+      CHECK(e.GetLineNumber() == 4);
+      CHECK(string(e.what()) == "Line 4: Unknown instruction 'Multiply'.");
+    }
+  }
+}
+
+void ParseMutextStream(FILE* mutext, size_t batchSize,
+                       const function<bool(vector<Instruction>)>& consume) {
+  const size_t chunkSize = 64 * 1024;
+  string pending;
+  size_t lineNumber = 0;
+  vector<Instruction> batch;
+  batch.reserve(batchSize);
+
+  auto endOfInput = false;
+  while (!endOfInput) {
+    auto size = pending.size();
+    pending.resize(size + chunkSize);
+    auto count = fread(pending.data() + size, 1, chunkSize, mutext);
+    pending.resize(size + count);
+    if (count < chunkSize) {
+      if (ferror(mutext))
+        throw runtime_error("The \u03BCtext input cannot be read.");
+      endOfInput = true;
+      pending += '\n';
+    }
+
+    // Only complete lines are parsed. The rest waits for the next chunk.
+    string::size_type begin = 0;
+    string::size_type end;
+    while ((end = pending.find('\n', begin)) != string::npos) {
+      auto line = Trim(string_view(pending).substr(begin, end - begin));
+      begin = end + 1;
+      lineNumber++;
+      if (line.empty())
+        continue;
+
+      try {
+        batch.push_back(ParseLine(line));
+      } catch (const exception& e) {
+        throw MutextParseError(lineNumber, e.what());
+      }
+      if (batch.size() == batchSize) {
+        if (!consume(move(batch)))
+          return;
+        batch.clear();
+        batch.reserve(batchSize);
+      }
+    }
+    pending.erase(0, begin);
+  }
+
+  if (!batch.empty())
+    consume(move(batch));
+}
+
+// Writes the μtext to a temporary file, and parses it in batches.
+static vector<vector<Instruction>> ParseStream(const string& mutext,
+                                               size_t batchSize) {
+  auto file = tmpfile();
+  fwrite(mutext.data(), 1, mutext.size(), file);
+  rewind(file);
+
+  vector<vector<Instruction>> batches;
+  ParseMutextStream(file, batchSize, [&](vector<Instruction> batch) {
+    batches.push_back(move(batch));
+    return true;
+  });
+  fclose(file);
+  return batches;
+}
+
+TEST_CASE("Verify ParseMutextStream behavior") {
+  SUBCASE("Parses instructions in batches") {
+    auto batches = ParseStream("Push i32:1\nPush i32:2\nAdd\nPop\nPush c:a", 3);
+    REQUIRE(batches.size() == 2);
+    CHECK(batches[0].size() == 3);
+    CHECK(batches[0][1].argument.i32() == 2);
+    CHECK(batches[0][2].opCode == OpCode::Add);
+    CHECK(batches[1].size() == 2);
+    CHECK(batches[1][0].opCode == OpCode::Pop);
+    CHECK(batches[1][1].argument.c() == 'a');
+  }
+
+  SUBCASE("Parses an empty input to no batches") {
+    CHECK(ParseStream("", 10).empty());
+    CHECK(ParseStream("\n  \n", 10).empty());
+  }
+
+  SUBCASE("Lines can span chunks") {
+    string mutext;
+    for (auto i = 0; i < 50000; i++)
+      mutext += format("Push i32:{}\n\nPop\n", i);
+
+    auto batches = ParseStream(mutext, 4096);
+    size_t numberOfInstructions = 0;
+    int32_t numberOfPushes = 0;
+    auto inOrder = true;
+    for (auto& batch : batches) {
+      for (auto& instruction : batch) {
+        if (instruction.opCode == OpCode::Push)
+          inOrder = inOrder && instruction.argument.i32() == numberOfPushes++;
+        numberOfInstructions++;
+      }
+    }
+    CHECK(inOrder);
+    CHECK(numberOfInstructions == 100000);
+    CHECK(numberOfPushes == 50000);
+  }
+
+  SUBCASE("Reports the line that cannot be parsed") {
+    string mutext;
+    for (auto i = 0; i < 20000; i++)
+      mutext += "Push i32:1\n\n";
+    mutext += "Push i32:x\n";
+    CHECK_THROWS_WITH_AS(ParseStream(mutext, 100),
+                         "Line 40001: Invalid i32 value 'x'.",
+                         MutextParseError);
+  }
+
+  SUBCASE("Stops when the batch is not consumed") {
+    auto file = tmpfile();
+    fputs("Pop\nPop\nPop\nPop\nPop\n", file);
+    rewind(file);
+    auto numberOfBatches = 0;
+    ParseMutextStream(file, 2, [&](vector<Instruction>) {
+      numberOfBatches++;
+      return false;
+    });
+    fclose(file);
+    CHECK(numberOfBatches == 1);
+  }
+}
+
+static size_t GetNumberOfChunks(size_t mutextSize) {
+  // Smaller chunks are not worth starting a thread for.
+  const size_t minimumChunkSize = 1024 * 1024;
+  size_t numberOfCores = max(thread::hardware_concurrency(), 1u);
+  return clamp(mutextSize / minimumChunkSize, (size_t)1, numberOfCores);
+}
+
+namespace {
+struct ParsedChunk {
+  string_view mutext;
+
+  // The part of the instruction buffer for this chunk, which has room for an
+  // instruction on every line.
+  Instruction* instructions = nullptr;
+  size_t numberOfInstructions = 0;
+  size_t numberOfLines = 0;
+
+  // The line is counted from the start of the chunk.
+  size_t errorLine = 0;
+  string errorMessage;
+};
+} // namespace
+
+static size_t CountLines(string_view mutext) {
+  const size_t windowSize = 64 * 1024;
+  ScannedBlock blocks[windowSize / ScannedBlockSize];
+
+  size_t numberOfLines = 1;
+  for (size_t begin = 0; begin < mutext.size(); begin += windowSize) {
+    auto window = mutext.substr(begin, windowSize);
+    ScanMutext(window.data(), window.size(), blocks);
+    auto numberOfBlocks = (window.size() + ScannedBlockSize - 1) /
+                          ScannedBlockSize;
+    for (size_t i = 0; i < numberOfBlocks; i++)
+      numberOfLines += __builtin_popcountll(blocks[i].newlines);
+  }
+  return numberOfLines;
+}
+
+// Parses one line that the scanner has found, from begin up to the newline at
+// end. The masks find each part of the line without looking at its bytes
+// again. Returns false for a blank line. A line that is not in the usual form
+// is parsed again by ParseLine, so it gives the same errors.
+static bool ParseScannedLine(string_view window, const ScannedBlock* blocks,
+                             size_t begin, size_t end,
+                             Instruction& instruction) {
+  auto whitespace = &ScannedBlock::whitespace;
+  auto first = FindClearBit(blocks, whitespace, begin, end);
+  if (first == end)
+    return false;
+
+  auto mnemonicEnd = FindSetBit(blocks, whitespace, first, end);
+  auto argumentBegin = FindClearBit(blocks, whitespace, mnemonicEnd, end);
+  auto text = window.data();
+  auto opCode = GetOpCode(string_view(text + first, mnemonicEnd - first));
+  if (argumentBegin == end && opCode != OpCode::Push && opCode != OpCode::Nop) {
+    instruction = Instruction{opCode};
+    return true;
+  }
+
+  auto argumentEnd = FindSetBit(blocks, whitespace, argumentBegin, end);
+  auto colon =
+      FindSetBit(blocks, &ScannedBlock::colons, argumentBegin, argumentEnd);
+  if (opCode == OpCode::Push && argumentBegin != end &&
+      text[mnemonicEnd] == ' ' && colon != argumentEnd &&
+      FindClearBit(blocks, whitespace, argumentEnd, end) == end) {
+    instruction = Instruction{
+        OpCode::Push,
+        ParseValue(string_view(text + argumentBegin, colon - argumentBegin),
+                   string_view(text + colon + 1, argumentEnd - colon - 1))};
+    return true;
+  }
+
+  instruction = ParseLine(Trim(window.substr(begin, end - begin)));
+  return true;
+}
+
+static void ParseChunk(ParsedChunk& parsed) {
+  // The chunk is scanned a window at a time, so the masks stay in the cache.
+  const size_t windowSize = 64 * 1024;
+  ScannedBlock blocks[windowSize / ScannedBlockSize];
+
+  auto chunk = parsed.mutext;
+  string_view::size_type windowBegin = 0;
+  while (windowBegin < chunk.size()) {
+    auto window = chunk.substr(windowBegin, windowSize);
+    auto isLastWindow = windowBegin + window.size() == chunk.size();
+    ScanMutext(window.data(), window.size(), blocks);
+
+    // A line that goes past the end of the window starts the next window.
+    // The last line of the chunk does not need a newline.
+    size_t begin = 0;
+    while (begin < window.size()) {
+      auto end = FindSetBit(blocks, &ScannedBlock::newlines, begin,
+                            window.size());
+      if (end == window.size() && !isLastWindow)
+        break;
+
+      parsed.numberOfLines++;
+      try {
+        auto& instruction = parsed.instructions[parsed.numberOfInstructions];
+        if (ParseScannedLine(window, blocks, begin, end, instruction))
+          parsed.numberOfInstructions++;
+      } catch (const exception& e) {
+        parsed.errorLine = parsed.numberOfLines;
+        parsed.errorMessage = e.what();
+        return;
+      }
+      begin = end + 1;
+    }
+
+    if (begin == 0 && !isLastWindow) {
+      // A line longer than the window is rare enough to parse without masks.
+      auto end = chunk.find('\n', windowBegin);
+      if (end == string_view::npos)
+        end = chunk.size();
+      auto line = Trim(chunk.substr(windowBegin, end - windowBegin));
+      parsed.numberOfLines++;
+      try {
+        if (!line.empty())
+          parsed.instructions[parsed.numberOfInstructions++] = ParseLine(line);
+      } catch (const exception& e) {
+        parsed.errorLine = parsed.numberOfLines;
+        parsed.errorMessage = e.what();
+        return;
+      }
+      begin = end + 1 - windowBegin;
+    }
+    windowBegin += begin;
+  }
+}
+
+static vector<Instruction> Parse(string_view mutext, size_t numberOfChunks) {
+  auto chunks = SplitIntoChunks(mutext, numberOfChunks);
+  vector<ParsedChunk> parsedChunks(chunks.size());
+  vector<size_t> capacities(chunks.size());
+  for (size_t i = 0; i < chunks.size(); i++)
+    parsedChunks[i].mutext = chunks[i];
+
+  // The lines are counted in parallel too, and then each chunk parses in to
+  // its part of the buffer.
+  WorkStealingPool pool(chunks.size());
+  auto runOnEachChunk = [&](auto job) {
+    if (chunks.size() == 1)
+      job(0);
+    else
+      pool.Run(chunks.size(), job);
+  };
+
+  runOnEachChunk([&](size_t i) { capacities[i] = CountLines(chunks[i]); });
+  size_t capacity = 0;
+  for (auto chunkCapacity : capacities)
+    capacity += chunkCapacity;
+
+  vector<Instruction> instructions(capacity);
+  auto next = instructions.data();
+  for (size_t i = 0; i < chunks.size(); i++) {
+    parsedChunks[i].instructions = next;
+    next += capacities[i];
+  }
+  runOnEachChunk([&](size_t i) { ParseChunk(parsedChunks[i]); });
+
+  // Every chunk before the first one with an error was parsed to its end, so
+  // their lines are all counted.
+  size_t firstLine = 1;
+  for (auto& parsed : parsedChunks) {
+    if (!parsed.errorMessage.empty())
+      throw MutextParseError(firstLine + parsed.errorLine - 1,
+                             parsed.errorMessage);
+    firstLine += parsed.numberOfLines;
+  }
+
+  // Blank lines leave room at the end of each part, so the parts are moved
+  // down to close the gaps.
+  auto end = instructions.data();
+  for (auto& parsed : parsedChunks)
+    end = move(parsed.instructions,
+               parsed.instructions + parsed.numberOfInstructions, end);
+  instructions.resize(end - instructions.data());
   return instructions;
 }
 
 TEST_CASE("Verify Parse behavior") {
   SUBCASE("Can parse an empty file") {
-    auto instructions = Parse("");
+    auto instructions = Parse("", 1);
     CHECK(instructions.size() == 0);
   }
 
   SUBCASE("Can parse a single instruction") {
-    auto instructions = Parse("Pop\n");
+    auto instructions = Parse("Pop\n", 1);
     CHECK(instructions.size() == 1);
     CHECK(instructions[0].opCode == OpCode::Pop);
   }
 
   SUBCASE("Can parse a single instruction with a parameter") {
-    auto instructions = Parse("Add\n");
+    auto instructions = Parse("Add\n", 1);
     CHECK(instructions.size() == 1);
     CHECK(instructions[0].opCode == OpCode::Add);
   }
 
   SUBCASE("Can parse a single Push instruction with a parameter") {
-    auto instructions = Parse("Push i32:42\n");
+    auto instructions = Parse("Push i32:42\n", 1);
     CHECK(instructions.size() == 1);
     CHECK(instructions[0].opCode == OpCode::Push);
     CHECK(instructions[0].argument.Type() == ArgumentType::i32);
@@ -93,62 +548,179 @@ TEST_CASE("Verify Parse behavior") {
   }
 
   SUBCASE("Can parse two instructions") {
-    auto instructions = Parse("Pop\nPush i32:42\n");
+    auto instructions = Parse("Pop\nPush i32:42\n", 1);
     CHECK(instructions.size() == 2);
     CHECK(instructions[0].opCode == OpCode::Pop);
     CHECK(instructions[1].opCode == OpCode::Push);
     CHECK(instructions[1].argument.Type() == ArgumentType::i32);
     CHECK(instructions[1].argument.i32() == 42);
   }
-}
 
-vector<string> SplitStringIntoLines(const string& input) {
-  vector<string> lines;
-  string::size_type pos = 0;
-  string::size_type prev = 0;
-
-  while ((pos = input.find("\n", prev)) != string::npos) {
-    auto line = input.substr(prev, pos - prev);
-    if (!IsWhiteSpace(line)) {
-      lines.push_back(line);
-      prev = pos + 1;
+  SUBCASE("Skips lines that are only white space") {
+    auto instructions = Parse("Pop\n  \n\n\tAdd \r\n", 1);
+    CHECK(instructions.size() == 2);
+    CHECK(instructions[1].opCode == OpCode::Add);
+  }
+
+  SUBCASE("Any number of chunks gives the same instructions") {
+    string mutext;
+    for (auto i = 0; i < 1000; i++)
+      mutext += format("Push i32:{}\n\nPush i64:{}\nAdd\nPop\n", i, i * 2);
+    auto expected = Parse(mutext, 1);
+    CHECK(expected.size() == 4000);
+    for (size_t numberOfChunks = 2; numberOfChunks <= 8; numberOfChunks++) {
+      auto instructions = Parse(mutext, numberOfChunks);
+      REQUIRE(instructions.size() == expected.size());
+      auto same = true;
+      for (size_t i = 0; i < expected.size(); i++) {
+        same = same && instructions[i].opCode == expected[i].opCode &&
+               instructions[i].argument == expected[i].argument;
+      }
+      CHECK(same);
+    }
+  }
+
+  SUBCASE("Errors have the same line number for any number of chunks") {
+    string mutext;
+    for (auto i = 1; i <= 5000; i++) {
+      if (i == 3777)
+        mutext += "Push f64:1.5.5\n";
+      else if (i == 4500)
+        mutext += "Jump\n";
+      else
+        mutext += i % 3 == 0 ? "\n" : "Pop\n";
+    }
+    for (size_t numberOfChunks = 1; numberOfChunks <= 8; numberOfChunks++) {
+      CHECK_THROWS_WITH_AS(Parse(mutext, numberOfChunks),
+                           "Line 3777: Invalid f64 value '1.5.5'.",
+                           MutextParseError);
     }
   }
 
-  auto last_line = input.substr(prev);
-  if (!IsWhiteSpace(last_line))
-    lines.push_back(last_line);
+  SUBCASE("Lines can span the windows the scanner uses") {
+    string mutext;
+    for (auto i = 0; i < 20000; i++)
+      mutext += format("Push i64:{}\n  \r\nPop\n", (int64_t)i * 7919);
+    auto instructions = Parse(mutext, 1);
+    REQUIRE(instructions.size() == 40000);
+    auto same = true;
+    for (auto i = 0; i < 20000; i++) {
+      same = same && instructions[i * 2].argument.i64() == (int64_t)i * 7919 &&
+             instructions[i * 2 + 1].opCode == OpCode::Pop;
+    }
+    CHECK(same);
+  }
 
-  return lines;
-}
+  SUBCASE("Can parse lines longer than a window") {
+    string spaces(100000, ' ');
+    auto instructions = Parse(spaces + "Push" + spaces + "c:a\n" + spaces +
+                                  "\nAdd" + spaces,
+                              1);
+    REQUIRE(instructions.size() == 2);
+    CHECK(instructions[0].argument.c() == 'a');
+    CHECK(instructions[1].opCode == OpCode::Add);
+  }
 
-TEST_CASE("Verify SplitStringIntoLines behavior") {
-  SUBCASE("Can split a string into lines") {
-    auto lines = SplitStringIntoLines("Hello\nWorld");
-    CHECK(lines.size() == 2);
-    CHECK(lines[0] == "Hello");
-    CHECK(lines[1] == "World");
+  SUBCASE("Lines the scanner does not expect give the same errors") {
+    CHECK_THROWS_WITH(Parse("Pop\n\tPush\ti32:1\n", 1),
+                      "Line 2: Unknown instruction 'Push\ti32:1'.");
+    CHECK_THROWS_WITH(Parse("Push i32:1 2\n", 1),
+                      "Line 1: Invalid i32 value '1 2'.");
+    CHECK_THROWS_WITH(Parse("Push i32\n", 1),
+                      "Line 1: The argument 'i32' needs a type and a value, "
+                      "such as i32:42.");
+    CHECK_THROWS_WITH(Parse("Push\n", 1), "Line 1: Push needs an argument.");
+    CHECK_THROWS_WITH(Parse("Add c:a\n", 1),
+                      "Line 1: Add does not take an argument.");
+    CHECK_THROWS_WITH(Parse("Push u8:1\n", 1),
+                      "Line 1: Unknown argument type 'u8'.");
   }
+}
+
+TEST_CASE("Verify parallel parser performance") {
+  auto mutext = GenerateArithmeticMutext(250000);
+  auto numberOfCores = max(thread::hardware_concurrency(), 1u);
 
-  SUBCASE("Can split a string into lines with trailing newline") {
-    auto lines = SplitStringIntoLines("Yes\nNo\n");
-    CHECK(lines.size() == 2);
-    CHECK(lines[0] == "Yes");
-    CHECK(lines[1] == "No");
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(mutext.size()).unit("B");
+
+  b.run("Parse in one chunk",
+        [&] { ankerl::nanobench::doNotOptimizeAway(Parse(mutext, 1)); });
+
+  b.run(format("Parse in {} chunks", numberOfCores), [&] {
+    ankerl::nanobench::doNotOptimizeAway(Parse(mutext, numberOfCores));
+  });
+}
+
+// Each chunk but the last ends with a newline, so no line is split between
+// two chunks.
+static vector<string_view> SplitIntoChunks(string_view mutext,
+                                           size_t numberOfChunks) {
+  vector<string_view> chunks;
+  string_view::size_type begin = 0;
+  for (size_t i = 1; i < numberOfChunks && begin < mutext.size(); i++) {
+    auto middle = max(begin, mutext.size() * i / numberOfChunks);
+    auto end = mutext.find('\n', middle);
+    if (end == string_view::npos)
+      break;
+    chunks.push_back(mutext.substr(begin, end + 1 - begin));
+    begin = end + 1;
   }
+  if (chunks.empty() || begin < mutext.size())
+    chunks.push_back(mutext.substr(begin));
+  return chunks;
 }
 
-static bool IsWhiteSpace(const string& line) {
-  return all_of(line.begin(), line.end(), isspace);
+TEST_CASE("Verify SplitIntoChunks behavior") {
+  SUBCASE("Splits at line boundaries") {
+    auto chunks = SplitIntoChunks("Pop\nPop\nAdd\nPush i32:1\nPop", 3);
+    REQUIRE(chunks.size() == 3);
+    CHECK(chunks[0] == "Pop\nPop\nAdd\n");
+    CHECK(chunks[1] == "Push i32:1\n");
+    CHECK(chunks[2] == "Pop");
+  }
+
+  SUBCASE("Gives fewer chunks when there are not enough lines") {
+    auto chunks = SplitIntoChunks("Pop\nAdd\n", 8);
+    CHECK(chunks.size() == 2);
+    CHECK(chunks[0] == "Pop\n");
+    CHECK(chunks[1] == "Add\n");
+  }
+
+  SUBCASE("The chunks cover the input") {
+    string mutext;
+    for (auto i = 0; i < 100; i++)
+      mutext += format("Push i32:{}\n", i * 7919 % 1000);
+    for (size_t numberOfChunks = 1; numberOfChunks <= 16; numberOfChunks++) {
+      string joined;
+      for (auto chunk : SplitIntoChunks(mutext, numberOfChunks)) {
+        CHECK(chunk.ends_with('\n'));
+        joined += chunk;
+      }
+      CHECK(joined == mutext);
+    }
+  }
+
+  SUBCASE("An empty input is one empty chunk") {
+    auto chunks = SplitIntoChunks("", 4);
+    REQUIRE(chunks.size() == 1);
+    CHECK(chunks[0].empty());
+  }
 }
 
-static Instruction ParseLine(string line) {
+static Instruction ParseLine(string_view line) {
+  auto mnemonic = line.substr(0, line.find(' '));
+  if (mnemonic == "Push")
+    return Instruction{OpCode::Push, ParseArgument(line)};
+  if (mnemonic.size() != line.size())
+    throw invalid_argument(format("{} does not take an argument.", mnemonic));
   if (line == "Pop")
     return Instruction{OpCode::Pop};
-  else if (line.starts_with("Push"))
-    return Instruction{OpCode::Push, ParseArgument(line)};
 
-  return Instruction{GetOpCode(line)};
+  auto opCode = GetOpCode(line);
+  if (opCode == OpCode::Nop && GetInstructionName(OpCode::Nop) != line)
+    throw invalid_argument(format("Unknown instruction '{}'.", line));
+  return Instruction{opCode};
 }
 
 TEST_CASE("Verify ParseLine behavior") {
@@ -168,9 +740,15 @@ TEST_CASE("Verify ParseLine behavior") {
     auto instruction = ParseLine("Add");
     CHECK(instruction.opCode == OpCode::Add);
   }
+
+  SUBCASE("Rejects lines that are not instructions") {
+    CHECK_THROWS_WITH(ParseLine("Multiply"), "Unknown instruction 'Multiply'.");
+    CHECK_THROWS_WITH(ParseLine("Add i32:1"), "Add does not take an argument.");
+    CHECK_THROWS_WITH(ParseLine("Push"), "Push needs an argument.");
+  }
 }
 
-static bool ParseBoolFromString(string value) {
+static bool ParseBoolFromString(string_view value) {
   if (value == "true")
     return true;
   if (value == "false")
@@ -178,23 +756,65 @@ static bool ParseBoolFromString(string value) {
   return false;
 }
 
-static Argument ParseArgument(string line) {
-  auto argumentString = Trim(line.substr(line.find(" ")));
+template <typename T>
+static bool TryParseNumber(string_view text, T& value) {
+  auto end = text.data() + text.size();
+  auto [last, error] = from_chars(text.data(), end, value);
+  return error == errc() && last == end;
+}
 
-  auto colonPosition = argumentString.find(":");
-  auto type = FromString(argumentString.substr(0, colonPosition));
+static Argument ParseArgument(string_view line) {
+  auto spacePosition = line.find(' ');
+  if (spacePosition == string_view::npos)
+    throw invalid_argument("Push needs an argument.");
+  auto argumentString = Trim(line.substr(spacePosition));
+
+  auto colonPosition = argumentString.find(':');
+  if (colonPosition == string_view::npos)
+    throw invalid_argument(format(
+        "The argument '{}' needs a type and a value, such as i32:42.",
+        argumentString));
+  return ParseValue(argumentString.substr(0, colonPosition),
+                    argumentString.substr(colonPosition + 1));
+}
+
+static Argument ParseValue(string_view typeString, string_view valueString) {
+  auto type = FromString(typeString);
+  if (type == ArgumentType::None)
+    throw invalid_argument(format("Unknown argument type '{}'.", typeString));
+
+  auto invalidValue = [&] {
+    return invalid_argument(
+        format("Invalid {} value '{}'.", typeString, valueString));
+  };
 
-  auto valueString = argumentString.substr(colonPosition + 1);
-  int64_t value;
   if (type == ArgumentType::c) {
-    value = valueString[0];
-  } else if (type == ArgumentType::b) {
-    value = ParseBoolFromString(valueString);
-  } else {
-    from_chars(valueString.data(), valueString.data() + valueString.size(),
-               value);
+    if (valueString.size() != 1)
+      throw invalidValue();
+    return OfType(type, valueString[0]);
+  }
+
+  if (type == ArgumentType::b) {
+    if (valueString != "true" && valueString != "false")
+      throw invalidValue();
+    return OfType(type, ParseBoolFromString(valueString));
+  }
+
+  if (type == ArgumentType::f32 || type == ArgumentType::f64) {
+    double value;
+    if (!TryParseNumber(valueString, value))
+      throw invalidValue();
+    return OfType(type, value);
   }
 
+  int64_t value;
+  if (!TryParseNumber(valueString, value) ||
+      (type == ArgumentType::i32 &&
+       (value < numeric_limits<int32_t>::min() ||
+        value > numeric_limits<int32_t>::max())) ||
+      (type == ArgumentType::i64 &&
+       (value < MinimumI64Argument || value > MaximumI64Argument)))
+    throw invalidValue();
   return OfType(type, value);
 }
 
@@ -234,22 +854,71 @@ TEST_CASE("Verify ParseArgument behavior") {
     CHECK(argument.Type() == ArgumentType::c);
     CHECK(argument.c() == 'g');
   }
+
+  SUBCASE("Can parse fractional floating point arguments") {
+    CHECK(ParseArgument("unused f32:2.5").f32() == 2.5f);
+    CHECK(ParseArgument("unused f64:-0.125").f64() == -0.125);
+    CHECK(ParseArgument("unused f64:1e3").f64() == 1000.0);
+  }
+
+  SUBCASE("Rejects arguments that cannot be parsed") {
+    CHECK_THROWS_WITH(ParseArgument("unused i32"),
+                      "The argument 'i32' needs a type and a value, such as "
+                      "i32:42.");
+    CHECK_THROWS_WITH(ParseArgument("unused u8:4"),
+                      "Unknown argument type 'u8'.");
+    CHECK_THROWS_WITH(ParseArgument("unused i32:4x"),
+                      "Invalid i32 value '4x'.");
+    CHECK_THROWS_WITH(ParseArgument("unused i32:3000000000"),
+                      "Invalid i32 value '3000000000'.");
+    CHECK(ParseArgument("unused i64:3000000000").i64() == 3000000000);
+    CHECK(ParseArgument(format("unused i64:{}", MinimumI64Argument)).i64() ==
+          MinimumI64Argument);
+    auto tooBig = format("{}", (uint64_t)MaximumI64Argument + 1);
+    CHECK_THROWS_WITH(ParseArgument("unused i64:" + tooBig),
+                      format("Invalid i64 value '{}'.", tooBig).c_str());
+    CHECK_THROWS_WITH(ParseArgument("unused b:yes"), "Invalid b value 'yes'.");
+    CHECK_THROWS_WITH(ParseArgument("unused c:ab"), "Invalid c value 'ab'.");
+  }
 }
 
-static ArgumentType FromString(string typeString) {
-  if (typeString == "i32")
-    return ArgumentType::i32;
-  if (typeString == "i64")
-    return ArgumentType::i64;
-  if (typeString == "f32")
-    return ArgumentType::f32;
-  if (typeString == "f64")
-    return ArgumentType::f64;
-  if (typeString == "b")
-    return ArgumentType::b;
-  if (typeString == "c")
-    return ArgumentType::c;
-  return ArgumentType::None;
+// == Argument Type Lookup ==
+//
+// The type tags are found with a perfect hash, in the same way as the
+// mnemonics, so a lookup is one hash, one load and one string comparison.
+
+static constexpr array<string_view, NumberOfArgumentTypes> ArgumentTypeTags = {
+    "", "i64", "i32", "f32", "f64", "b", "c"};
+
+// The empty tag of None is left out of the table.
+static constexpr PerfectHash<8> TypeTags(ArgumentTypeTags);
+
+string_view GetArgumentTypeTag(ArgumentType type) {
+  return ArgumentTypeTags[(size_t)type];
+}
+
+static ArgumentType FromString(string_view typeString) {
+  auto slot = TypeTags.Find(typeString);
+  if (slot == TypeTags.EmptySlot || ArgumentTypeTags[slot] != typeString)
+    return ArgumentType::None;
+  return (ArgumentType)slot;
+}
+
+TEST_CASE("Verify FromString behavior") {
+  SUBCASE("Finds every argument type from its tag") {
+    for (size_t i = 1; i < NumberOfArgumentTypes; i++)
+      CHECK(FromString(ArgumentTypeTags[i]) == (ArgumentType)i);
+  }
+
+  SUBCASE("Finds the tag of every argument type") {
+    for (size_t i = 0; i < NumberOfArgumentTypes; i++)
+      CHECK(FromString(GetArgumentTypeTag((ArgumentType)i)) == (ArgumentType)i);
+  }
+
+  SUBCASE("Rejects strings that are not type tags") {
+    for (auto typeString : {"", "i", "i3", "i322", "u8", "I32", "bool", "f"})
+      CHECK(FromString(typeString) == ArgumentType::None);
+  }
 }
 
 static Argument OfType(ArgumentType argumentType, auto value) {
@@ -1,19 +1,57 @@
 #pragma once
 
+#include <cstdio>
+using std::FILE;
+#include <functional>
+using std::function;
+#include <stdexcept>
+using std::runtime_error;
+#include <string_view>
+using std::string_view;
 #include <vector>
 using std::vector;
 
 #include "Bytecode.hpp"
 
 // Public API
+
+// The parsers throw this for the first line they cannot parse. Its message
+// starts with the line number.
+class MutextParseError : public runtime_error {
+public:
+  MutextParseError(size_t lineNumber, const string& message);
+
+  size_t GetLineNumber() const;
+
+private:
+  size_t m_lineNumber;
+};
+
+// Large μtext is split in to chunks that are parsed in parallel.
 vector<Instruction> ParseMutextFile(const char* mutextFilePath);
+vector<Instruction> ParseMutext(const char* mutext);
+
+// The μtext does not need to end with a null character, so this can parse a
+// memory mapped file.
+vector<Instruction> ParseMutext(string_view mutext);
+
+// Parses μtext from a file, a pipe or stdin a chunk at a time, so the whole
+// input is never in memory. Each batch of up to batchSize instructions is
+// passed to consume, which returns false to stop parsing.
+void ParseMutextStream(FILE* mutext, size_t batchSize,
+                       const function<bool(vector<Instruction>)>& consume);
+
+// The tag that names an argument type in μtext, such as i32. None has an empty
+// tag.
+string_view GetArgumentTypeTag(ArgumentType type);
 
 // Internal API
-static string GetFileContents(const char* filename);
-static vector<Instruction> Parse(const char* mutextFileData);
-static vector<string> SplitStringIntoLines(const string& input);
-static Instruction ParseLine(string line);
-static bool IsWhiteSpace(const string& line);
-static Argument ParseArgument(string line);
-static ArgumentType FromString(string typeString);
+static size_t GetNumberOfChunks(size_t mutextSize);
+static vector<Instruction> Parse(string_view mutext, size_t numberOfChunks);
+static vector<string_view> SplitIntoChunks(string_view mutext,
+                                           size_t numberOfChunks);
+static Instruction ParseLine(string_view line);
+static Argument ParseArgument(string_view line);
+static Argument ParseValue(string_view typeString, string_view valueString);
+static ArgumentType FromString(string_view typeString);
 static Argument OfType(ArgumentType argumentType, auto value);
@@ -0,0 +1,258 @@
+#include "Configuration.hpp"
+
+#include <cstring>
+using std::memcpy;
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "Scanner.hpp"
+
+// == μtext Scanner ==
+//
+// The parser does not look at μtext a byte at a time. The scanner compares a
+// whole block of 64 bytes with each character the parser cares about, and
+// packs the results in to one bit for each byte. The parser then finds the
+// newlines, the spaces between the parts of a line and the colon in an
+// argument by counting zero bits, which skips up to 64 bytes at once.
+//
+// On x86-64 the blocks are compared 16 bytes at a time with SSE2, which every
+// x86-64 processor has, or 32 bytes at a time with AVX2 when the processor
+// supports it. Other processors scan a byte at a time.
+
+static void ScanWholeBlocks(const char* text, size_t numberOfBlocks,
+                            ScannedBlock* blocks) {
+#if defined(__GNUC__) && defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2"))
+    ScanBlocksWithAvx2(text, numberOfBlocks, blocks);
+  else
+    ScanBlocksWithSse2(text, numberOfBlocks, blocks);
+#else
+  ScanBlocks(text, numberOfBlocks, blocks);
+#endif
+}
+
+void ScanMutext(const char* text, size_t size, ScannedBlock* blocks) {
+  auto numberOfBlocks = size / ScannedBlockSize;
+  ScanWholeBlocks(text, numberOfBlocks, blocks);
+
+  // The last block is copied, so the scan does not read past the end of a
+  // memory mapped file. Zero is not a character the parser looks for.
+  auto rest = size % ScannedBlockSize;
+  if (rest != 0) {
+    char last[ScannedBlockSize] = {};
+    memcpy(last, text + numberOfBlocks * ScannedBlockSize, rest);
+    ScanWholeBlocks(last, 1, blocks + numberOfBlocks);
+  }
+}
+
+static bool IsMutextWhitespace(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static void ScanBlocks(const char* text, size_t numberOfBlocks,
+                       ScannedBlock* blocks) {
+  for (size_t i = 0; i < numberOfBlocks; i++) {
+    auto block = text + i * ScannedBlockSize;
+    ScannedBlock scanned{};
+    for (size_t j = 0; j < ScannedBlockSize; j++) {
+      uint64_t bit = 1ull << j;
+      scanned.newlines |= block[j] == '\n' ? bit : 0;
+      scanned.whitespace |= IsMutextWhitespace(block[j]) ? bit : 0;
+      scanned.colons |= block[j] == ':' ? bit : 0;
+    }
+    blocks[i] = scanned;
+  }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+// The characters from '\t' to '\r' are moved to the bottom of the signed range,
+// so one comparison finds all five of them.
+static constexpr char ControlWhitespaceOffset = (char)(0x80 - '\t');
+static constexpr char ControlWhitespaceLimit = (char)(0x80 + '\r' - '\t' + 1);
+
+static void ScanBlocksWithSse2(const char* text, size_t numberOfBlocks,
+                               ScannedBlock* blocks) {
+  auto newline = _mm_set1_epi8('\n');
+  auto space = _mm_set1_epi8(' ');
+  auto colon = _mm_set1_epi8(':');
+  auto offset = _mm_set1_epi8(ControlWhitespaceOffset);
+  auto limit = _mm_set1_epi8(ControlWhitespaceLimit);
+
+  for (size_t i = 0; i < numberOfBlocks; i++) {
+    ScannedBlock scanned{};
+    for (size_t j = 0; j < ScannedBlockSize; j += 16) {
+      auto bytes =
+          _mm_loadu_si128((const __m128i*)(text + i * ScannedBlockSize + j));
+      auto controls = _mm_cmplt_epi8(_mm_add_epi8(bytes, offset), limit);
+      auto whitespace = _mm_or_si128(controls, _mm_cmpeq_epi8(bytes, space));
+      scanned.newlines |=
+          (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline))
+          << j;
+      scanned.whitespace |= (uint64_t)(uint16_t)_mm_movemask_epi8(whitespace)
+                            << j;
+      scanned.colons |=
+          (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, colon))
+          << j;
+    }
+    blocks[i] = scanned;
+  }
+}
+
+[[gnu::target("avx2")]] static void
+ScanBlocksWithAvx2(const char* text, size_t numberOfBlocks,
+                   ScannedBlock* blocks) {
+  auto newline = _mm256_set1_epi8('\n');
+  auto space = _mm256_set1_epi8(' ');
+  auto colon = _mm256_set1_epi8(':');
+  auto offset = _mm256_set1_epi8(ControlWhitespaceOffset);
+  auto limit = _mm256_set1_epi8(ControlWhitespaceLimit);
+
+  for (size_t i = 0; i < numberOfBlocks; i++) {
+    ScannedBlock scanned{};
+    for (size_t j = 0; j < ScannedBlockSize; j += 32) {
+      auto bytes = _mm256_loadu_si256(
+          (const __m256i*)(text + i * ScannedBlockSize + j));
+      auto controls = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(bytes, offset));
+      auto whitespace =
+          _mm256_or_si256(controls, _mm256_cmpeq_epi8(bytes, space));
+      scanned.newlines |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                              _mm256_cmpeq_epi8(bytes, newline))
+                          << j;
+      scanned.whitespace |=
+          (uint64_t)(uint32_t)_mm256_movemask_epi8(whitespace) << j;
+      scanned.colons |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                            _mm256_cmpeq_epi8(bytes, colon))
+                        << j;
+    }
+    blocks[i] = scanned;
+  }
+}
+#endif
+
+// Every byte value, in an order that puts each of them at many positions in a
+// block.
+static string MakeScannerTestText(size_t size) {
+  string text(size, '\0');
+  for (size_t i = 0; i < size; i++)
+    text[i] = (char)(i * 37 + i / 256);
+  return text;
+}
+
+static bool HasSameMasks(const ScannedBlock& left, const ScannedBlock& right) {
+  return left.newlines == right.newlines &&
+         left.whitespace == right.whitespace && left.colons == right.colons;
+}
+
+TEST_CASE("Verify ScanMutext behavior") {
+  SUBCASE("Sets a bit for each character the parser looks for") {
+    ScannedBlock block;
+    ScanMutext("Push i32:1\n\tAdd\r\n", 17, &block);
+    CHECK(block.newlines == ((1ull << 10) | (1ull << 16)));
+    CHECK(block.whitespace ==
+          ((1ull << 4) | (1ull << 10) | (1ull << 11) | (1ull << 15) |
+           (1ull << 16)));
+    CHECK(block.colons == 1ull << 8);
+  }
+
+  SUBCASE("Gives the same masks as scanning a byte at a time") {
+    auto text = MakeScannerTestText(64 * 1024);
+    vector<ScannedBlock> expected(text.size() / ScannedBlockSize);
+    ScanBlocks(text.data(), expected.size(), expected.data());
+
+    for (auto size : {0, 1, 63, 64, 65, 1000, 64 * 1024}) {
+      vector<ScannedBlock> blocks((size + 63) / 64);
+      ScanMutext(text.data(), size, blocks.data());
+      auto same = true;
+      for (size_t i = 0; i < (size_t)size / ScannedBlockSize; i++)
+        same = same && HasSameMasks(blocks[i], expected[i]);
+      CHECK(same);
+    }
+
+#if defined(__GNUC__) && defined(__x86_64__)
+    vector<ScannedBlock> blocks(expected.size());
+    ScanBlocksWithSse2(text.data(), blocks.size(), blocks.data());
+    auto same = true;
+    for (size_t i = 0; i < blocks.size(); i++)
+      same = same && HasSameMasks(blocks[i], expected[i]);
+    CHECK(same);
+
+    if (__builtin_cpu_supports("avx2")) {
+      ScanBlocksWithAvx2(text.data(), blocks.size(), blocks.data());
+      for (size_t i = 0; i < blocks.size(); i++)
+        same = same && HasSameMasks(blocks[i], expected[i]);
+      CHECK(same);
+    }
+#endif
+  }
+
+  SUBCASE("Only the bytes of a partial block can have their bits set") {
+    string text(100, ' ');
+    ScannedBlock blocks[2];
+    ScanMutext(text.data(), 70, blocks);
+    CHECK(blocks[0].whitespace == ~0ull);
+    CHECK(blocks[1].whitespace == (1ull << 6) - 1);
+  }
+}
+
+TEST_CASE("Verify FindSetBit and FindClearBit behavior") {
+  string text(200, 'a');
+  text[5] = ' ';
+  text[130] = ' ';
+  text[131] = ' ';
+  ScannedBlock blocks[4];
+  ScanMutext(text.data(), text.size(), blocks);
+  auto whitespace = &ScannedBlock::whitespace;
+
+  SUBCASE("Finds set bits in this block and in later blocks") {
+    CHECK(FindSetBit(blocks, whitespace, 0, 200) == 5);
+    CHECK(FindSetBit(blocks, whitespace, 5, 200) == 5);
+    CHECK(FindSetBit(blocks, whitespace, 6, 200) == 130);
+    CHECK(FindSetBit(blocks, whitespace, 132, 200) == 200);
+  }
+
+  SUBCASE("Does not look past the end") {
+    CHECK(FindSetBit(blocks, whitespace, 6, 100) == 100);
+    CHECK(FindSetBit(blocks, whitespace, 0, 3) == 3);
+    CHECK(FindSetBit(blocks, whitespace, 3, 3) == 3);
+  }
+
+  SUBCASE("Finds clear bits") {
+    CHECK(FindClearBit(blocks, whitespace, 0, 200) == 0);
+    CHECK(FindClearBit(blocks, whitespace, 5, 200) == 6);
+    CHECK(FindClearBit(blocks, whitespace, 130, 200) == 132);
+    CHECK(FindClearBit(blocks, whitespace, 130, 131) == 131);
+  }
+}
+
+TEST_CASE("Verify ScanMutext performance") {
+  auto text = MakeScannerTestText(1024 * 1024);
+  vector<ScannedBlock> blocks(text.size() / ScannedBlockSize);
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(text.size()).unit("B");
+
+  b.run("Scan a byte at a time", [&] {
+    ScanBlocks(text.data(), blocks.size(), blocks.data());
+    ankerl::nanobench::doNotOptimizeAway(blocks.data());
+  });
+
+#if defined(__GNUC__) && defined(__x86_64__)
+  b.run("Scan with SSE2", [&] {
+    ScanBlocksWithSse2(text.data(), blocks.size(), blocks.data());
+    ankerl::nanobench::doNotOptimizeAway(blocks.data());
+  });
+
+  if (__builtin_cpu_supports("avx2")) {
+    b.run("Scan with AVX2", [&] {
+      ScanBlocksWithAvx2(text.data(), blocks.size(), blocks.data());
+      ankerl::nanobench::doNotOptimizeAway(blocks.data());
+    });
+  }
+#endif
+}
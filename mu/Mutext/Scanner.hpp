@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Public API
+
+// Each bit of a mask is one byte of the block, starting from the lowest bit.
+struct ScannedBlock {
+  uint64_t newlines;
+  uint64_t whitespace;
+  uint64_t colons;
+};
+
+constexpr size_t ScannedBlockSize = 64;
+
+// Classifies size bytes of μtext, with one block for every 64 bytes or part of
+// 64 bytes. Nothing past the end of the text is read. Whitespace is any of
+// " \n\r\t\f\v", the same characters Trim removes.
+void ScanMutext(const char* text, size_t size, ScannedBlock* blocks);
+
+// Finds the first byte from position up to end whose bit in the mask is set, or
+// end if there is not one.
+inline size_t FindSetBit(const ScannedBlock* blocks,
+                         uint64_t ScannedBlock::*mask, size_t position,
+                         size_t end) {
+  while (position < end) {
+    auto bits = blocks[position / ScannedBlockSize].*mask >>
+                (position % ScannedBlockSize);
+    if (bits != 0) {
+      position += __builtin_ctzll(bits);
+      return position < end ? position : end;
+    }
+    position = (position / ScannedBlockSize + 1) * ScannedBlockSize;
+  }
+  return end;
+}
+
+// Finds the first byte from position up to end whose bit in the mask is clear,
+// or end if there is not one.
+inline size_t FindClearBit(const ScannedBlock* blocks,
+                           uint64_t ScannedBlock::*mask, size_t position,
+                           size_t end) {
+  while (position < end) {
+    auto bits = ~(blocks[position / ScannedBlockSize].*mask) >>
+                (position % ScannedBlockSize);
+    if (bits != 0) {
+      position += __builtin_ctzll(bits);
+      return position < end ? position : end;
+    }
+    position = (position / ScannedBlockSize + 1) * ScannedBlockSize;
+  }
+  return end;
+}
+
+// Internal API
+static void ScanBlocks(const char* text, size_t numberOfBlocks,
+                       ScannedBlock* blocks);
+static void ScanBlocksWithSse2(const char* text, size_t numberOfBlocks,
+                               ScannedBlock* blocks);
+static void ScanBlocksWithAvx2(const char* text, size_t numberOfBlocks,
+                               ScannedBlock* blocks);
@@ -2,28 +2,32 @@
 
 #include "StringUtils.hpp"
 
-const string whitespace = " \n\r\t\f\v";
+constexpr string_view whitespace = " \n\r\t\f\v";
 
-string TrimLeft(const string& s) {
+string_view TrimLeft(string_view s) {
   size_t start = s.find_first_not_of(whitespace);
-  return (start == string::npos) ? "" : s.substr(start);
+  return (start == string_view::npos) ? string_view() : s.substr(start);
 }
 
 TEST_CASE("Removes whitepsace on the left") {
   CHECK("test  " == TrimLeft("  test  "));
 }
 
-string TrimRight(const string& s) {
+string_view TrimRight(string_view s) {
   size_t end = s.find_last_not_of(whitespace);
-  return (end == string::npos) ? "" : s.substr(0, end + 1);
+  return (end == string_view::npos) ? string_view() : s.substr(0, end + 1);
 }
 
 TEST_CASE("Removes whitepsace on the right") {
   CHECK("  test" == TrimRight("  test  "));
 }
 
-string Trim(const string& s) { return TrimRight(TrimLeft(s)); }
+string_view Trim(string_view s) { return TrimRight(TrimLeft(s)); }
 
 TEST_CASE("Removes whitepsace on the left and the right") {
   CHECK("test" == Trim("  test  "));
 }
+
+TEST_CASE("Trims a string that is only whitespace to an empty string") {
+  CHECK(Trim(" \t\r\n").empty());
+}
@@ -1,8 +1,73 @@
 #pragma once
 
-#include <string>
-using std::string;
+#include <array>
+using std::array;
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+using std::string_view;
 
-string TrimLeft(const string& s);
-string TrimRight(const string& s);
-string Trim(const string& s);
+// These return views of the string they are given, so they never allocate.
+string_view TrimLeft(string_view s);
+string_view TrimRight(string_view s);
+string_view Trim(string_view s);
+
+// A perfect hash of a set of strings known at compile time, such as the
+// mnemonics or the argument type tags. The compiler searches for a seed that
+// gives each string its own slot of the table, so a lookup is one hash, one
+// load and one string comparison. Empty strings are left out of the table.
+template <size_t TableSize> class PerfectHash {
+public:
+  static_assert(TableSize > 0 && (TableSize & (TableSize - 1)) == 0,
+                "The table size must be a power of two.");
+
+  static constexpr uint8_t EmptySlot = 0xFF;
+
+  template <size_t NumberOfKeys>
+  consteval PerfectHash(const array<string_view, NumberOfKeys>& keys)
+      : m_seed(0), m_slots{} {
+    static_assert(NumberOfKeys <= TableSize && NumberOfKeys < EmptySlot);
+    while (!IsPerfect(keys, m_seed))
+      m_seed++;
+    m_slots.fill(EmptySlot);
+    for (size_t i = 0; i < NumberOfKeys; i++) {
+      if (!keys[i].empty())
+        m_slots[Hash(keys[i], m_seed)] = (uint8_t)i;
+    }
+  }
+
+  // Returns the index of the only key the string can be, or EmptySlot. The
+  // caller compares them, since the string may be any other one.
+  constexpr uint8_t Find(string_view s) const {
+    return m_slots[Hash(s, m_seed)];
+  }
+
+private:
+  uint32_t m_seed;
+  array<uint8_t, TableSize> m_slots;
+
+  static constexpr size_t Hash(string_view s, uint32_t seed) {
+    // This is FNV-1a, starting from a seed mixed into the offset basis.
+    uint32_t hash = 2166136261u ^ seed;
+    for (auto c : s) {
+      hash ^= (uint8_t)c;
+      hash *= 16777619u;
+    }
+    return hash & (TableSize - 1);
+  }
+
+  template <size_t NumberOfKeys>
+  static consteval bool IsPerfect(const array<string_view, NumberOfKeys>& keys,
+                                  uint32_t seed) {
+    array<bool, TableSize> used{};
+    for (auto key : keys) {
+      if (key.empty())
+        continue;
+      auto slot = Hash(key, seed);
+      if (used[slot])
+        return false;
+      used[slot] = true;
+    }
+    return true;
+  }
+};
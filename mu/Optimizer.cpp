@@ -0,0 +1,280 @@
+#include "Configuration.hpp"
+
+#include <fmt/core.h>
+using fmt::format;
+
+#include "InstructionProcessor.hpp"
+#include "Optimizer.hpp"
+#include "ValueStack.hpp"
+
+// == Optimizer ==
+//
+// The optimizer rewrites a program to a shorter one that leaves the same values
+// on the value stack. It makes a single pass over the program, and after each
+// instruction it looks at the end of the optimized program for:
+//
+// * A binary operation on two constants, which it replaces with a push of the
+//   result. It uses the same arithmetic as the instruction itself, so the types
+//   are promoted just like they are at runtime.
+// * A push followed by a pop, which it removes.
+//
+// Since these rewrites happen at the end of the optimized program, the result
+// of one can enable the next, so `Push 5 / Push 6 / Add / Pop` is removed
+// completely. Nop instructions are dropped, unless an instruction has been
+// registered for the Nop opcode.
+
+Optimizer::Optimizer(span<Instruction> instructions)
+    : m_statistics{.originalInstructions = instructions.size()} {
+  m_instructions.reserve(instructions.size());
+  for (auto instruction : instructions)
+    Append(instruction);
+  m_statistics.optimizedInstructions = m_instructions.size();
+}
+
+span<Instruction> Optimizer::GetInstructions() { return m_instructions; }
+
+OptimizationStatistics Optimizer::GetStatistics() const { return m_statistics; }
+
+string Optimizer::GetReport() const {
+  auto removedInstructions = m_statistics.originalInstructions -
+                             m_statistics.optimizedInstructions;
+  auto percentRemoved = m_statistics.originalInstructions == 0
+                            ? 0.0
+                            : 100.0 * removedInstructions /
+                                  m_statistics.originalInstructions;
+  return format("Optimized {} instructions to {} ({:.1f}% fewer)\n"
+                "  Folded constant operations: {}\n"
+                "  Removed Push/Pop pairs: {}\n"
+                "  Removed Nops: {}\n",
+                m_statistics.originalInstructions,
+                m_statistics.optimizedInstructions, percentRemoved,
+                m_statistics.foldedOperations,
+                m_statistics.removedPushPopPairs, m_statistics.removedNops);
+}
+
+void Optimizer::Append(Instruction instruction) {
+  if (instruction.opCode == OpCode::Nop && !HasInstruction(OpCode::Nop)) {
+    m_statistics.removedNops++;
+    return;
+  }
+
+  m_instructions.push_back(instruction);
+  while (TryFoldConstants() || TryRemovePushPopPair()) {
+  }
+}
+
+bool Optimizer::TryFoldConstants() {
+  auto size = m_instructions.size();
+  if (size < 3)
+    return false;
+
+  auto& left = m_instructions[size - 3];
+  auto& right = m_instructions[size - 2];
+  auto& operation = m_instructions[size - 1];
+  if (left.opCode != OpCode::Push || right.opCode != OpCode::Push ||
+      !HasInstruction(operation.opCode))
+    return false;
+
+  auto evaluate = GetInstructionMetadata(operation.opCode).evaluate;
+  if (evaluate == nullptr)
+    return false;
+
+  auto result = evaluate(left.argument, right.argument);
+  if (result.Type() == ArgumentType::None)
+    return false;
+
+  m_instructions.resize(size - 2);
+  m_instructions.back() = {OpCode::Push, result};
+  m_statistics.foldedOperations++;
+  return true;
+}
+
+bool Optimizer::TryRemovePushPopPair() {
+  auto size = m_instructions.size();
+  if (size < 2 || m_instructions[size - 2].opCode != OpCode::Push ||
+      m_instructions[size - 1].opCode != OpCode::Pop)
+    return false;
+
+  m_instructions.resize(size - 2);
+  m_statistics.removedPushPopPairs++;
+  return true;
+}
+
+TEST_CASE("Verify optimizer behavior") {
+  SUBCASE("Folds a constant operation") {
+    Instruction instructions[] = {
+        {OpCode::Push, 5}, {OpCode::Push, 6}, {OpCode::Add}};
+    Instruction expectedInstructions[] = {{OpCode::Push, 11}};
+
+    Optimizer optimizer(instructions);
+
+    VerifyInstructions(expectedInstructions, optimizer.GetInstructions());
+    CHECK(optimizer.GetStatistics().foldedOperations == 1);
+  }
+
+  SUBCASE("Folds with the same type promotion as the instruction") {
+    Instruction instructions[] = {
+        {OpCode::Push, 5}, {OpCode::Push, 1.5}, {OpCode::Subtract}};
+    Instruction expectedInstructions[] = {{OpCode::Push, 3.5}};
+
+    Optimizer optimizer(instructions);
+
+    VerifyInstructions(expectedInstructions, optimizer.GetInstructions());
+  }
+
+  SUBCASE("Folds the result of a fold") {
+    Instruction instructions[] = {{OpCode::Push, 5},   {OpCode::Push, 6},
+                                  {OpCode::Add},       {OpCode::Push, 1},
+                                  {OpCode::Subtract}};
+    Instruction expectedInstructions[] = {{OpCode::Push, 10}};
+
+    Optimizer optimizer(instructions);
+
+    VerifyInstructions(expectedInstructions, optimizer.GetInstructions());
+    CHECK(optimizer.GetStatistics().foldedOperations == 2);
+  }
+
+  SUBCASE("Does not fold operations without a result for their types") {
+    Instruction instructions[] = {
+        {OpCode::Push, true}, {OpCode::Push, 6}, {OpCode::Add}};
+
+    Optimizer optimizer(instructions);
+
+    VerifyInstructions(instructions, optimizer.GetInstructions());
+  }
+
+  SUBCASE("Does not fold operations on values that are not constant") {
+    Instruction instructions[] = {{OpCode::Push, 6}, {OpCode::Add}};
+
+    Optimizer optimizer(instructions);
+
+    VerifyInstructions(instructions, optimizer.GetInstructions());
+  }
+
+  SUBCASE("Removes a push followed by a pop") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Pop}};
+    Instruction expectedInstructions[] = {{OpCode::Push, 2}};
+
+    Optimizer optimizer(instructions);
+
+    VerifyInstructions(expectedInstructions, optimizer.GetInstructions());
+    CHECK(optimizer.GetStatistics().removedPushPopPairs == 1);
+  }
+
+  SUBCASE("Removes a folded value that is popped") {
+    Instruction instructions[] = {{OpCode::Push, 5},
+                                  {OpCode::Push, 6},
+                                  {OpCode::Add},
+                                  {OpCode::Pop}};
+
+    Optimizer optimizer(instructions);
+
+    CHECK(optimizer.GetInstructions().empty());
+  }
+
+  SUBCASE("Keeps a pop of a value pushed before the program") {
+    Instruction instructions[] = {{OpCode::Pop}};
+
+    Optimizer optimizer(instructions);
+
+    VerifyInstructions(instructions, optimizer.GetInstructions());
+  }
+
+  SUBCASE("Removes Nops") {
+    // Other tests may have registered an instruction for the Nop opcode.
+    auto nopMetadata = GetInstructionMetadata(OpCode::Nop);
+    RegisterInstruction(OpCode::Nop, {.name = "Nop"});
+
+    Instruction instructions[] = {{OpCode::Nop}, {OpCode::Push, 2},
+                                  {OpCode::Nop}, {OpCode::Push, 3},
+                                  {OpCode::Nop}, {OpCode::Add}};
+    Instruction expectedInstructions[] = {{OpCode::Push, 5}};
+
+    Optimizer optimizer(instructions);
+
+    VerifyInstructions(expectedInstructions, optimizer.GetInstructions());
+    CHECK(optimizer.GetStatistics().removedNops == 3);
+
+    RegisterInstruction(OpCode::Nop, nopMetadata);
+  }
+
+  SUBCASE("Keeps Nops with a registered instruction") {
+    auto nopMetadata = GetInstructionMetadata(OpCode::Nop);
+    RegisterInstruction(OpCode::Nop, {.execute = [] {}, .name = "Nop"});
+
+    Instruction instructions[] = {{OpCode::Nop}};
+
+    Optimizer optimizer(instructions);
+
+    VerifyInstructions(instructions, optimizer.GetInstructions());
+
+    RegisterInstruction(OpCode::Nop, nopMetadata);
+  }
+
+  SUBCASE("The optimized program leaves the same values on the stack") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2},        {OpCode::Push, (int64_t)3},
+        {OpCode::Push, 8.5f},     {OpCode::Pop},
+        {OpCode::Subtract},       {OpCode::Push, 4},
+        {OpCode::Push, 7},        {OpCode::Push, 1},
+        {OpCode::Pop},            {OpCode::Subtract}};
+
+    Process(instructions);
+    auto expectedTop = Pop();
+    auto expectedNext = Pop();
+
+    Optimizer optimizer(instructions);
+    Process(optimizer.GetInstructions());
+
+    CHECK(Pop() == expectedTop);
+    CHECK(Pop() == expectedNext);
+    CHECK(optimizer.GetInstructions().size() == 2);
+  }
+
+  SUBCASE("Reports statistics") {
+    Instruction instructions[] = {{OpCode::Push, 5}, {OpCode::Push, 6},
+                                  {OpCode::Add},     {OpCode::Push, 1},
+                                  {OpCode::Pop},     {OpCode::Push, 2}};
+
+    Optimizer optimizer(instructions);
+
+    CHECK(optimizer.GetReport() == "Optimized 6 instructions to 2 (66.7% "
+                                   "fewer)\n"
+                                   "  Folded constant operations: 1\n"
+                                   "  Removed Push/Pop pairs: 1\n"
+                                   "  Removed Nops: 0\n");
+  }
+}
+
+TEST_CASE("Verify optimizer performance") {
+  vector<Instruction> instructions = {{OpCode::Push, 0}};
+  for (auto i = 0; i < 1000; i++) {
+    instructions.push_back({OpCode::Push, 43});
+    instructions.push_back({OpCode::Push, 42});
+    instructions.push_back({OpCode::Add});
+    instructions.push_back({OpCode::Push, 41});
+    instructions.push_back({OpCode::Subtract});
+    instructions.push_back({OpCode::Add});
+  }
+
+  Optimizer optimizer(instructions);
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(instructions.size());
+
+  b.run("Process the original program", [&] {
+    Process(instructions);
+    Pop();
+  });
+
+  b.run("Process the optimized program", [&] {
+    Process(optimizer.GetInstructions());
+    Pop();
+  });
+
+  b.run("Optimize the program", [&] {
+    Optimizer optimized(instructions);
+    ankerl::nanobench::doNotOptimizeAway(optimized);
+  });
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <span>
+using std::span;
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+
+#include "Bytecode.hpp"
+
+struct OptimizationStatistics {
+  size_t originalInstructions;
+  size_t optimizedInstructions;
+  size_t foldedOperations;
+  size_t removedPushPopPairs;
+  size_t removedNops;
+};
+
+class Optimizer {
+public:
+  Optimizer(span<Instruction> instructions);
+
+  span<Instruction> GetInstructions();
+  OptimizationStatistics GetStatistics() const;
+  string GetReport() const;
+
+private:
+  vector<Instruction> m_instructions;
+  OptimizationStatistics m_statistics;
+
+  void Append(Instruction instruction);
+  bool TryFoldConstants();
+  bool TryRemovePushPopPair();
+};
@@ -0,0 +1,340 @@
+#include "Configuration.hpp"
+
+#include <cstring>
+using std::memcpy;
+#include <exception>
+using std::exception;
+#include <fstream>
+using std::ifstream;
+#include <memory>
+using std::make_unique;
+#include <utility>
+using std::move;
+
+#include <fmt/core.h>
+using fmt::format;
+
+#include "DecodedProgram.hpp"
+#include "Jit/JitProgram.hpp"
+#include "Loader.hpp"
+#include "Mutext/Parser.hpp"
+#include "Program.hpp"
+#include "RegisterProgram.hpp"
+#include "TieredProgram.hpp"
+#include "ValueStack.hpp"
+#include "VerifiedProgram.hpp"
+
+// == Program ==
+//
+// Services that embed the VM load or parse each program once, then execute it
+// as often as they need to. A program is verified when it is created, so a bad
+// program is found before it first executes, and the verified engine can
+// execute it without runtime checks.
+//
+// Each execution starts from an empty value stack, and leaves it empty, so the
+// results of one execution never leak in to the next one on the same thread.
+
+Program::Program(vector<Instruction> instructions)
+    : m_instructions(move(instructions)),
+      m_verifiedProgram(make_unique<VerifiedProgram>(m_instructions)) {
+  if (!m_verifiedProgram->IsVerified())
+    m_errorMessage = m_verifiedProgram->GetErrorMessage();
+}
+
+// The analysis is copied with the instructions, and kept where moving the
+// program does not move it, because the verified program refers to it.
+Program::Program(vector<Instruction> instructions,
+                 const ProgramAnalysis& analysis)
+    : m_instructions(move(instructions)),
+      m_operandTypes(analysis.operandTypes.begin(),
+                     analysis.operandTypes.end()),
+      m_blockBoundaries(analysis.blockBoundaries.begin(),
+                        analysis.blockBoundaries.end()),
+      m_analysis(make_unique<ProgramAnalysis>(ProgramAnalysis{
+          analysis.maximumStackDepth, m_operandTypes, m_blockBoundaries})),
+      m_verifiedProgram(
+          make_unique<VerifiedProgram>(m_instructions, *m_analysis)) {
+  if (!m_verifiedProgram->IsVerified())
+    m_errorMessage = m_verifiedProgram->GetErrorMessage();
+}
+
+Program::Program(string errorMessage) : m_errorMessage(move(errorMessage)) {}
+
+Program::~Program() = default;
+Program::Program(Program&& other) = default;
+Program& Program::operator=(Program&& other) = default;
+
+Program Program::Load(const char* muFilePath) {
+  Loader loader(muFilePath);
+  if (loader.IsWindowed() && !loader.IsCompressed())
+    return Program(
+        format("The file '{}' is too big to load in to memory.", muFilePath));
+  return Load(loader);
+}
+
+Program Program::Load(span<const byte> muBytecode) {
+  Loader loader(muBytecode);
+  return Load(loader);
+}
+
+// The instructions and any analysis are copied out of the loader, so the
+// program does not need the file or the bytes it was loaded from once it is
+// created.
+Program Program::Load(Loader& loader) {
+  vector<Instruction> instructions;
+  if (!loader.GetErrorMessage().empty() ||
+      !loader.ReadInstructions(instructions))
+    return Program(loader.GetErrorMessage());
+  if (auto analysis = loader.GetAnalysis())
+    return Program(move(instructions), *analysis);
+  return Program(move(instructions));
+}
+
+Program Program::Parse(string_view mutext) {
+  try {
+    return Program(ParseMutext(mutext));
+  } catch (const MutextParseError& e) {
+    return Program(e.what());
+  }
+}
+
+Program Program::ParseFile(const char* mutextFilePath) {
+  if (!ifstream(mutextFilePath))
+    return Program(
+        format("The \u03BCtext file '{}' cannot be read.", mutextFilePath));
+  try {
+    return Program(ParseMutextFile(mutextFilePath));
+  } catch (const MutextParseError& e) {
+    return Program(e.what());
+  }
+}
+
+bool Program::IsValid() const {
+  return m_verifiedProgram != nullptr && m_verifiedProgram->IsVerified();
+}
+
+const string& Program::GetErrorMessage() const { return m_errorMessage; }
+
+span<const Instruction> Program::GetInstructions() const {
+  return m_instructions;
+}
+
+bool Program::Execute(Engine engine) {
+  m_results.clear();
+  if (!IsValid())
+    return false;
+
+  ClearValueStack();
+  try {
+    if (engine == Engine::Verified) {
+      m_verifiedProgram->Execute();
+    } else if (engine == Engine::Decoded) {
+      if (m_decodedProgram == nullptr)
+        m_decodedProgram = make_unique<DecodedProgram>(m_instructions);
+      m_decodedProgram->Execute();
+    } else if (engine == Engine::Jit) {
+      if (m_jitProgram == nullptr)
+        m_jitProgram = make_unique<JitProgram>(m_instructions);
+      m_jitProgram->Execute();
+    } else if (engine == Engine::Register) {
+      if (m_registerProgram == nullptr)
+        m_registerProgram = make_unique<RegisterProgram>(m_instructions);
+      m_registerProgram->Execute();
+    } else if (engine == Engine::Tiered) {
+      if (m_tieredProgram == nullptr)
+        m_tieredProgram = make_unique<TieredProgram>(m_instructions);
+      m_tieredProgram->Execute();
+    } else {
+      Process(m_instructions, engine);
+    }
+  } catch (const exception& e) {
+    m_errorMessage = e.what();
+    ClearValueStack();
+    return false;
+  }
+
+  auto stackSize = StackSize();
+  for (auto depth = stackSize - 1; depth >= 0; depth--)
+    m_results.push_back(Peek(depth));
+  ClearValueStack();
+
+  m_errorMessage.clear();
+  return true;
+}
+
+span<const Argument> Program::GetResults() const { return m_results; }
+
+TEST_CASE("Verify program behavior") {
+  SUBCASE("Parse and execute a program") {
+    auto program = Program::Parse("Push i32:5\nPush i32:6\nAdd\n");
+    REQUIRE(program.IsValid());
+    CHECK(program.GetInstructions().size() == 3);
+    CHECK(program.Execute());
+    REQUIRE(program.GetResults().size() == 1);
+    CHECK(program.GetResults()[0] == Argument(11));
+  }
+
+  SUBCASE("Every engine gives the same results") {
+    auto program = Program::Parse("Push i32:5\nPush i32:6\nPush f64:7\n"
+                                  "Subtract\n");
+    for (auto engine : {Engine::Loop, Engine::DirectThreaded, Engine::TailCall,
+                        Engine::Jit, Engine::Register, Engine::Verified,
+                        Engine::Decoded, Engine::Tiered}) {
+      CHECK(program.Execute(engine));
+      REQUIRE(program.GetResults().size() == 2);
+      CHECK(program.GetResults()[0] == Argument(5));
+      CHECK(program.GetResults()[1] == Argument(-1.0));
+    }
+  }
+
+  SUBCASE("Each execution starts from an empty stack and leaves it empty") {
+    Push(42);
+    auto stackSize = StackSize();
+    auto program = Program::Parse("Push i32:1\n");
+    CHECK(program.Execute());
+    CHECK(program.Execute());
+    CHECK(program.GetResults().size() == 1);
+    CHECK(StackSize() == 0);
+    CHECK(stackSize > 0);
+  }
+
+  SUBCASE("A program executes many times with the decoded engine") {
+    auto program = Program::Parse("Push i32:5\nPush i32:6\nAdd\n");
+    for (auto i = 0; i < 3; i++) {
+      CHECK(program.Execute(Engine::Decoded));
+      REQUIRE(program.GetResults().size() == 1);
+      CHECK(program.GetResults()[0] == Argument(11));
+    }
+  }
+
+  SUBCASE("A program executes many times with the register engine") {
+    auto program = Program::Parse("Push i32:5\nPush f64:6.5\nSubtract\n");
+    for (auto i = 0; i < 3; i++) {
+      CHECK(program.Execute(Engine::Register));
+      REQUIRE(program.GetResults().size() == 1);
+      CHECK(program.GetResults()[0] == Argument(-1.5));
+    }
+  }
+
+  SUBCASE("A program executes past the compile threshold when tiered") {
+    auto program = Program::Parse("Push i32:5\nPush i32:6\nAdd\n");
+    for (auto i = 0u; i <= TieringOptions().compileThreshold; i++) {
+      CHECK(program.Execute(Engine::Tiered));
+      REQUIRE(program.GetResults().size() == 1);
+      CHECK(program.GetResults()[0] == Argument(11));
+    }
+  }
+
+  SUBCASE("Load and execute a program") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Subtract}};
+    TestMuFile testFile("test.mu", instructions);
+
+    auto program = Program::Load("test.mu");
+    REQUIRE(program.IsValid());
+    CHECK(program.Execute());
+    CHECK(program.GetResults()[0] == Argument(-1));
+  }
+
+  SUBCASE("Load and execute a program from memory") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Subtract}};
+    vector<byte> bytecode(sizeof(Loader::MuMagicHeader) + sizeof(instructions));
+    auto magic = Loader::MuMagicHeader;
+    memcpy(bytecode.data(), &magic, sizeof(magic));
+    memcpy(bytecode.data() + sizeof(magic), instructions, sizeof(instructions));
+
+    auto program = Program::Load(span<const byte>(bytecode));
+    REQUIRE(program.IsValid());
+    CHECK(program.Execute());
+    CHECK(program.GetResults()[0] == Argument(-1));
+
+    bytecode[0] = byte{0};
+    CHECK(Program::Load(span<const byte>(bytecode)).GetErrorMessage() ==
+          "The bytecode is not valid Mu bytecode.");
+    CHECK_FALSE(Program::Load(span<const byte>()).IsValid());
+  }
+
+  SUBCASE("Load and execute a compressed program from memory") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Subtract}};
+    auto bytecode = WriteBytecode(instructions, BytecodeFormat::Compressed);
+
+    auto program = Program::Load(as_bytes(span(bytecode)));
+    REQUIRE(program.IsValid());
+    CHECK(program.GetInstructions().size() == 3);
+    CHECK(program.Execute());
+    CHECK(program.GetResults()[0] == Argument(-1));
+
+    bytecode.resize(bytecode.size() - 1);
+    CHECK(Program::Load(as_bytes(span(bytecode))).GetErrorMessage() ==
+          "The bytecode is not valid Mu bytecode.");
+  }
+
+  SUBCASE("An empty program loads in every format") {
+    for (auto format : {BytecodeFormat::Plain, BytecodeFormat::Compressed,
+                        BytecodeFormat::Analyzed}) {
+      auto bytecode = WriteBytecode({}, format);
+      auto program = Program::Load(as_bytes(span(bytecode)));
+      CHECK(program.IsValid());
+      CHECK(program.GetInstructions().empty());
+      CHECK(program.Execute());
+      CHECK(program.GetResults().empty());
+    }
+  }
+
+  SUBCASE("An analyzed program is checked against its analysis") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Subtract}};
+    auto bytecode = WriteBytecode(instructions, BytecodeFormat::Analyzed);
+
+    auto program = Program::Load(as_bytes(span(bytecode)));
+    REQUIRE(program.IsValid());
+    CHECK(program.Execute());
+    CHECK(program.GetResults()[0] == Argument(-1));
+
+    // The program is valid, but not with the stack depth the analysis gives.
+    uint64_t maximumStackDepth = 1;
+    memcpy(bytecode.data() + bytecode.size() - sizeof(AnalyzedFooter) +
+               offsetof(AnalyzedFooter, maximumStackDepth),
+           &maximumStackDepth, sizeof(maximumStackDepth));
+    CHECK(Program::Load(as_bytes(span(bytecode))).GetErrorMessage() ==
+          "Instruction 1 does not match the analysis of the program.");
+  }
+
+  SUBCASE("A file that cannot be loaded is not valid") {
+    auto program = Program::Load("does_not_exist.mu");
+    CHECK_FALSE(program.IsValid());
+    CHECK_FALSE(program.GetErrorMessage().empty());
+    CHECK_FALSE(program.Execute());
+  }
+
+  SUBCASE("A μtext file that cannot be read is not valid") {
+    auto program = Program::ParseFile("does_not_exist.mut");
+    CHECK_FALSE(program.IsValid());
+    CHECK(program.GetErrorMessage() ==
+          "The \u03BCtext file 'does_not_exist.mut' cannot be read.");
+  }
+
+  SUBCASE("μtext that cannot be parsed is not valid") {
+    auto program = Program::Parse("Push i32:1\nPush i32:one\n");
+    CHECK_FALSE(program.IsValid());
+    CHECK(program.GetErrorMessage() == "Line 2: Invalid i32 value 'one'.");
+  }
+
+  SUBCASE("A program that cannot be verified is not valid") {
+    auto program = Program::Parse("Push i32:1\nAdd\n");
+    CHECK_FALSE(program.IsValid());
+    CHECK(program.GetErrorMessage() ==
+          "Instruction 1 pops from an empty stack.");
+    CHECK_FALSE(program.Execute());
+    CHECK(program.GetResults().empty());
+  }
+
+  SUBCASE("A program can be moved") {
+    auto program = Program::Parse("Push i32:5\nPush i32:6\nAdd\n");
+    auto moved = move(program);
+    CHECK(moved.Execute());
+    CHECK(moved.GetResults()[0] == Argument(11));
+  }
+}
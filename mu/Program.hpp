@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+using std::byte;
+#include <memory>
+using std::unique_ptr;
+#include <span>
+using std::span;
+#include <string>
+using std::string;
+#include <string_view>
+using std::string_view;
+#include <vector>
+using std::vector;
+
+#include "Bytecode.hpp"
+#include "InstructionProcessor.hpp"
+
+class DecodedProgram;
+class JitProgram;
+class Loader;
+class RegisterProgram;
+class TieredProgram;
+class VerifiedProgram;
+struct ProgramAnalysis;
+
+// A program is the API for embedding the VM. It owns its instructions, and
+// verifies them before it executes them. Each program can execute on any
+// thread, but only on one thread at a time.
+class Program {
+public:
+  explicit Program(vector<Instruction> instructions);
+  ~Program();
+
+  Program(Program&& other);
+  Program& operator=(Program&& other);
+
+  // Loads μ bytecode, from a file or from memory in the same format. Compressed
+  // bytecode is decompressed, and analyzed bytecode is checked against its
+  // analysis instead of being analyzed again. A file that is too big for memory
+  // cannot be loaded, but StreamingExecutor can run it.
+  static Program Load(const char* muFilePath);
+  static Program Load(span<const byte> muBytecode);
+
+  // Parses μtext, from a string or from a file. The string does not need to end
+  // with a null character, and a null character in it is not valid μtext.
+  static Program Parse(string_view mutext);
+  static Program ParseFile(const char* mutextFilePath);
+
+  // A program is valid when it was loaded and verified. Otherwise, or when an
+  // execution fails, the error message says why.
+  bool IsValid() const;
+  const string& GetErrorMessage() const;
+
+  span<const Instruction> GetInstructions() const;
+
+  // Executes the program on the value stack of the calling thread, starting
+  // from an empty stack. Returns false if the program is not valid or the
+  // execution fails. An engine that prepares the program before it executes it
+  // only does so the first time.
+  bool Execute(Engine engine = Engine::Verified);
+
+  // The values the last execution left on the stack, from the bottom up.
+  span<const Argument> GetResults() const;
+
+private:
+  vector<Instruction> m_instructions;
+  vector<uint8_t> m_operandTypes;
+  vector<uint64_t> m_blockBoundaries;
+  unique_ptr<ProgramAnalysis> m_analysis;
+  unique_ptr<VerifiedProgram> m_verifiedProgram;
+  unique_ptr<DecodedProgram> m_decodedProgram;
+  unique_ptr<RegisterProgram> m_registerProgram;
+  unique_ptr<JitProgram> m_jitProgram;
+  unique_ptr<TieredProgram> m_tieredProgram;
+  string m_errorMessage;
+  vector<Argument> m_results;
+
+  Program(string errorMessage);
+  Program(vector<Instruction> instructions, const ProgramAnalysis& analysis);
+  static Program Load(Loader& loader);
+};
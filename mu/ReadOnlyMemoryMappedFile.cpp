@@ -7,22 +7,81 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-ReadOnlyMemoryMappedFile::ReadOnlyMemoryMappedFile(const char* filePath)
-    : m_fileSize(0), m_fileHandle(-1), m_fileBuffer(nullptr) {
+// == Memory Mapping ==
+//
+// A file that is mapped with no advice is read a page at a time, as each page
+// is first touched, which is slow for a large program that is read from start
+// to end. The kernel can fault in the whole file up front, read ahead of the
+// reader, or use huge pages so there are fewer pages to fault. A file that is
+// bigger than memory is mapped a window at a time, so the pages that have been
+// read can be dropped.
+//
+// The options are only advice, so the file is still mapped if the kernel
+// does not support one of them.
+
+static const uint64_t HugePageSize = 2 * 1024 * 1024;
+static const size_t DefaultWindowSize = 256 * 1024 * 1024;
+
+static uint64_t GetPhysicalMemorySize() {
+  return (uint64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
+}
+
+// Faulting in the whole file when it is mapped is the fastest way to load a
+// file of any size, as long as it fits in memory with room to spare. A file
+// that does not is read ahead instead, and one that is bigger than half of
+// memory is mapped a window at a time.
+MemoryMapOptions MemoryMapOptions::ForFileSize(uint64_t fileSize) {
+  auto physicalMemorySize = GetPhysicalMemorySize();
+  MemoryMapOptions options;
+  options.populate = fileSize <= physicalMemorySize / 4;
+  options.readAhead = !options.populate;
+  options.hugePages = fileSize >= HugePageSize;
+  if (fileSize > physicalMemorySize / 2)
+    options.windowSize = DefaultWindowSize;
+  return options;
+}
+
+TEST_CASE("Verify MemoryMapOptions behavior") {
+  SUBCASE("Small files are faulted in when they are mapped") {
+    auto options = MemoryMapOptions::ForFileSize(1024 * 1024);
+    CHECK(options.populate);
+    CHECK_FALSE(options.readAhead);
+    CHECK(options.windowSize == 0);
+  }
+
+  SUBCASE("Files that nearly fill memory are read ahead") {
+    auto options = MemoryMapOptions::ForFileSize(GetPhysicalMemorySize() / 3);
+    CHECK_FALSE(options.populate);
+    CHECK(options.readAhead);
+    CHECK(options.hugePages);
+    CHECK(options.windowSize == 0);
+  }
+
+  SUBCASE("Files bigger than memory are mapped a window at a time") {
+    auto options = MemoryMapOptions::ForFileSize(GetPhysicalMemorySize() * 2);
+    CHECK(options.windowSize == DefaultWindowSize);
+  }
+}
+
+ReadOnlyMemoryMappedFile::ReadOnlyMemoryMappedFile(const char* filePath,
+                                                   MemoryMapOptions options)
+    : m_fileHandle(-1), m_fileBuffer(nullptr), m_fileSize(0),
+      m_options(options), m_window(nullptr), m_windowMappedSize(0) {
   struct stat st;
   // The stat function returns zero if the file exists.
   if (stat(filePath, &st) == 0) {
     m_fileSize = st.st_size;
-
     m_fileHandle = open(filePath, O_RDONLY, 0);
-    m_fileBuffer = (byte*)mmap(0, m_fileSize, PROT_READ, MAP_FILE | MAP_PRIVATE,
-                               m_fileHandle, 0);
+    if (m_options.windowSize == 0)
+      m_fileBuffer = Map(0, m_fileSize);
   }
 }
 
 ReadOnlyMemoryMappedFile::~ReadOnlyMemoryMappedFile() {
   if (m_fileBuffer != nullptr)
     munmap(m_fileBuffer, m_fileSize);
+  if (m_window != nullptr)
+    munmap(m_window, m_windowMappedSize);
   if (m_fileHandle != -1)
     close(m_fileHandle);
 }
@@ -31,6 +90,43 @@ byte* ReadOnlyMemoryMappedFile::GetBuffer() { return m_fileBuffer; }
 
 size_t ReadOnlyMemoryMappedFile::GetSize() { return m_fileSize; }
 
+byte* ReadOnlyMemoryMappedFile::MapWindow(uint64_t offset, size_t size) {
+  if (m_window != nullptr) {
+    munmap(m_window, m_windowMappedSize);
+    m_window = nullptr;
+  }
+  if (m_fileHandle == -1 || size == 0 || offset + size > m_fileSize)
+    return nullptr;
+
+  uint64_t pageSize = sysconf(_SC_PAGE_SIZE);
+  auto start = offset - offset % pageSize;
+  m_windowMappedSize = offset + size - start;
+  m_window = Map(start, m_windowMappedSize);
+  return m_window == nullptr ? nullptr : m_window + (offset - start);
+}
+
+byte* ReadOnlyMemoryMappedFile::Map(uint64_t offset, size_t size) {
+  auto flags = MAP_FILE | MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+  if (m_options.populate)
+    flags |= MAP_POPULATE;
+#endif
+  auto buffer = mmap(0, size, PROT_READ, flags, m_fileHandle, offset);
+  // An empty file cannot be mapped.
+  if (buffer == MAP_FAILED)
+    return nullptr;
+
+#if defined(MADV_HUGEPAGE)
+  if (m_options.hugePages)
+    madvise(buffer, size, MADV_HUGEPAGE);
+#endif
+  if (m_options.readAhead) {
+    madvise(buffer, size, MADV_SEQUENTIAL);
+    madvise(buffer, size, MADV_WILLNEED);
+  }
+  return (byte*)buffer;
+}
+
 TEST_CASE("Verify read-only memory mapped file behavior") {
   SUBCASE("File that does not exist has zero size and a nullptr buffer") {
     ReadOnlyMemoryMappedFile doesNotExist("NoFile");
@@ -54,4 +150,38 @@ TEST_CASE("Verify read-only memory mapped file behavior") {
     REQUIRE(expectedData[2] == actualData[2]);
     REQUIRE(expectedData[3] == actualData[3]);
   }
+
+  SUBCASE("Maps a window of the file") {
+    byte data[10000];
+    for (size_t i = 0; i < sizeof(data); i++)
+      data[i] = (byte)(i % 251);
+    TestFile testFile("test.data", data, sizeof(data));
+
+    MemoryMapOptions options;
+    options.windowSize = 4096;
+    ReadOnlyMemoryMappedFile memoryMappedFile("test.data", options);
+    CHECK(memoryMappedFile.GetBuffer() == nullptr);
+    CHECK(memoryMappedFile.GetSize() == sizeof(data));
+
+    auto window = memoryMappedFile.MapWindow(5000, 4096);
+    REQUIRE(window != nullptr);
+    CHECK(window[0] == data[5000]);
+    CHECK(window[4095] == data[9095]);
+    window = memoryMappedFile.MapWindow(10, 20);
+    REQUIRE(window != nullptr);
+    CHECK(window[0] == data[10]);
+    CHECK(memoryMappedFile.MapWindow(9000, 2000) == nullptr);
+  }
+
+  SUBCASE("Every option maps the same data") {
+    byte expectedData[] = {byte{1}, byte{2}, byte{3}, byte{4}};
+    TestFile testFile("test.data", expectedData, sizeof(expectedData));
+    MemoryMapOptions options;
+    options.populate = true;
+    options.hugePages = true;
+    options.readAhead = true;
+    ReadOnlyMemoryMappedFile memoryMappedFile("test.data", options);
+    REQUIRE(memoryMappedFile.GetBuffer() != nullptr);
+    CHECK(memoryMappedFile.GetBuffer()[3] == byte{4});
+  }
 }
@@ -2,17 +2,53 @@
 
 #include <cstddef>
 using std::byte;
+#include <cstdint>
+
+struct MemoryMapOptions {
+  // Fault in every page when the file is mapped, instead of one page at a time
+  // as it is first read.
+  bool populate = false;
+
+  // Ask for transparent huge pages, where the kernel and file system have them.
+  bool hugePages = false;
+
+  // Tell the kernel the file is read from start to end, so it reads ahead.
+  bool readAhead = false;
+
+  // Zero maps the whole file. Otherwise only a window of this many bytes is
+  // mapped at a time, with MapWindow, so a file bigger than memory can be read.
+  size_t windowSize = 0;
+
+  // The options that load a file of this size fastest on this machine.
+  static MemoryMapOptions ForFileSize(uint64_t fileSize);
+};
 
 class ReadOnlyMemoryMappedFile {
 public:
-  ReadOnlyMemoryMappedFile(const char* filePath);
+  ReadOnlyMemoryMappedFile(const char* filePath,
+                           MemoryMapOptions options = MemoryMapOptions());
   ~ReadOnlyMemoryMappedFile();
 
+  // This is nullptr if the file does not exist, is empty, or is mapped a window
+  // at a time.
   byte* GetBuffer();
   size_t GetSize();
 
+  // Maps size bytes from the offset, and unmaps the window that was mapped
+  // before. Returns nullptr if the file is not open, or the bytes are not all
+  // in the file.
+  byte* MapWindow(uint64_t offset, size_t size);
+
 private:
   int m_fileHandle;
   byte* m_fileBuffer;
   size_t m_fileSize;
+  MemoryMapOptions m_options;
+
+  // The window is mapped from the start of a page, so it can start before the
+  // offset that was asked for.
+  byte* m_window;
+  size_t m_windowMappedSize;
+
+  byte* Map(uint64_t offset, size_t size);
 };
@@ -0,0 +1,475 @@
+#include "Configuration.hpp"
+
+#include <algorithm>
+using std::max;
+#include <stdexcept>
+using std::logic_error;
+
+#include <fmt/core.h>
+using fmt::format;
+
+#include "DecodedProgram.hpp"
+#include "InstructionProcessor.hpp"
+#include "Interpreter/Interpreter.hpp"
+#include "RegisterProgram.hpp"
+#include "ValueStack.hpp"
+
+// == Register Program ==
+//
+// Most stack instructions only move values on and off the value stack. A
+// register program translates them away: the translator keeps track of which
+// register holds each value stack slot, so a push of a constant emits nothing,
+// and a binary operation becomes one three-address instruction that reads its
+// operands from registers and writes its result to another one.
+//
+// The register file starts with the constants the program pushes, followed by
+// one register for each value stack slot the program uses. A slot that holds a
+// constant refers directly to the register of the constant.
+//
+// The translator also tracks the type of each register. Since every constant
+// has a known type, so do the results computed from them, and each operation
+// on them uses an evaluate function specialized for those types.
+//
+// The value stack is only used at the edges:
+//
+// * Registered instructions without an evaluate function operate on the value
+//   stack, so every slot is stored to it before they are called.
+// * So do operations whose result is only known at runtime: those on values
+//   that were on the stack before the program started, and those of
+//   instructions that cannot be specialized for the types of their operands.
+//   Either may have no result, and then the slots after them are not known.
+// * Every slot left at the end of the program is stored to the value stack, so
+//   it holds the same values as it would after the instruction processor.
+//
+// The program refers to the instructions it was translated from, so they must
+// outlive it. If an instruction is registered after translating, the program
+// is translated again before it next executes.
+
+class RegisterTranslator {
+public:
+  RegisterTranslator(vector<ThreeAddressInstruction>& instructions,
+                     vector<Argument>& registers)
+      : m_instructions(instructions), m_registers(registers),
+        m_numberOfSlots(0) {}
+
+  void Translate(span<Instruction> instructions);
+
+private:
+  vector<ThreeAddressInstruction>& m_instructions;
+  vector<Argument>& m_registers;
+
+  // The register for each slot at the top of the value stack, bottom first.
+  // The rest of the value stack is in memory.
+  vector<uint32_t> m_slots;
+
+  // The type of the value in each register at this point in the program, or
+  // None if it is only known at runtime.
+  vector<ArgumentType> m_types;
+
+  uint32_t m_numberOfSlots;
+
+  void TranslateEvaluate(OpCode opCode);
+  void Store();
+  void Emit(RegisterOpCode opCode, uint32_t destination = 0,
+            uint32_t left = 0, uint32_t right = 0,
+            OpCode instruction = OpCode::Nop,
+            EvaluateInstructionFunc evaluate = nullptr);
+  uint32_t SlotRegister(size_t slot);
+};
+
+void RegisterTranslator::Translate(span<Instruction> instructions) {
+  // The constants come first, so slot registers can be numbered as the slots
+  // are used.
+  for (auto instruction : instructions) {
+    if (instruction.opCode == OpCode::Push) {
+      m_registers.push_back(instruction.argument);
+      m_types.push_back(instruction.argument.Type());
+    }
+  }
+
+  uint32_t constant = 0;
+  for (auto instruction : instructions) {
+    auto opCode = instruction.opCode;
+    if (opCode == OpCode::Push) {
+      m_slots.push_back(constant++);
+    } else if (opCode == OpCode::Pop) {
+      if (m_slots.empty())
+        Emit(RegisterOpCode::Drop);
+      else
+        m_slots.pop_back();
+    } else if (HasInstruction(opCode) &&
+               GetInstructionMetadata(opCode).evaluate != nullptr) {
+      TranslateEvaluate(opCode);
+    } else if (HasInstruction(opCode)) {
+      Store();
+      Emit(RegisterOpCode::Call, 0, 0, 0, opCode);
+    } else {
+      Store();
+      Emit(RegisterOpCode::Unexpected, 0, 0, 0, opCode);
+      break;
+    }
+  }
+
+  Store();
+  m_registers.resize(m_registers.size() + m_numberOfSlots);
+}
+
+void RegisterTranslator::TranslateEvaluate(OpCode opCode) {
+  // An operation has no result for some types of operands, and then pops both
+  // and pushes nothing. The slots must be known when the program is translated,
+  // so an operation is only translated when the types of its operands are known
+  // and it is specialized for them. Otherwise, such as for values that were on
+  // the value stack before the program started, or for an instruction with only
+  // an evaluate function, it is executed on the value stack.
+  if (GetInstructionMetadata(opCode).specialize == nullptr ||
+      m_slots.size() < 2 || m_types[m_slots.end()[-2]] == ArgumentType::None ||
+      m_types[m_slots.end()[-1]] == ArgumentType::None) {
+    Store();
+    Emit(RegisterOpCode::Call, 0, 0, 0, opCode);
+    return;
+  }
+
+  auto right = m_slots.back();
+  m_slots.pop_back();
+  auto left = m_slots.back();
+  m_slots.pop_back();
+
+  // If there is no evaluate function for the types of the operands, the
+  // operation has no result for them.
+  auto resultType = ArgumentType::None;
+  auto evaluate = SpecializeInstruction(opCode, m_types[left], m_types[right],
+                                        resultType);
+  if (evaluate == nullptr)
+    return;
+
+  auto destination = SlotRegister(m_slots.size());
+  Emit(RegisterOpCode::Evaluate, destination, left, right, opCode, evaluate);
+  m_types[destination] = resultType;
+  m_slots.push_back(destination);
+}
+
+void RegisterTranslator::Store() {
+  for (auto reg : m_slots)
+    Emit(RegisterOpCode::Store, 0, reg);
+  m_slots.clear();
+}
+
+void RegisterTranslator::Emit(RegisterOpCode opCode, uint32_t destination,
+                              uint32_t left, uint32_t right,
+                              OpCode instruction,
+                              EvaluateInstructionFunc evaluate) {
+  m_instructions.push_back(
+      {opCode, destination, left, right, instruction, evaluate});
+}
+
+uint32_t RegisterTranslator::SlotRegister(size_t slot) {
+  m_numberOfSlots = max(m_numberOfSlots, (uint32_t)slot + 1);
+  auto reg = m_registers.size() + slot;
+  if (reg >= m_types.size())
+    m_types.resize(reg + 1, ArgumentType::None);
+  return reg;
+}
+
+RegisterProgram::RegisterProgram(span<Instruction> instructions)
+    : m_instructions(instructions) {
+  Translate();
+}
+
+void RegisterProgram::Execute() {
+  if (m_registryVersion != GetInstructionRegistryVersion())
+    Translate();
+
+  auto registers = m_registers.data();
+  for (auto& instruction : m_threeAddressInstructions) {
+    switch (instruction.opCode) {
+    case RegisterOpCode::Evaluate: {
+      registers[instruction.destination] = instruction.evaluate(
+          registers[instruction.left], registers[instruction.right]);
+      break;
+    }
+    case RegisterOpCode::Store:
+      Push(registers[instruction.left]);
+      break;
+    case RegisterOpCode::Drop:
+      Pop();
+      break;
+    case RegisterOpCode::Call:
+      ExecuteInstruction(instruction.instruction);
+      break;
+    case RegisterOpCode::Unexpected:
+      throw logic_error(
+          format("Unexpected opcode: {}", (int)instruction.instruction));
+    }
+  }
+}
+
+span<const ThreeAddressInstruction>
+RegisterProgram::GetThreeAddressInstructions() const {
+  return m_threeAddressInstructions;
+}
+
+size_t RegisterProgram::GetNumberOfRegisters() const {
+  return m_registers.size();
+}
+
+void RegisterProgram::Translate() {
+  m_registryVersion = GetInstructionRegistryVersion();
+  m_threeAddressInstructions.clear();
+  m_registers.clear();
+  RegisterTranslator(m_threeAddressInstructions, m_registers)
+      .Translate(m_instructions);
+}
+
+// A registered instruction with an evaluate function but no specialize
+// function, which only has a result for two i32 operands.
+static Argument EvaluateMultiplyI32(Argument left, Argument right) {
+  if (left.Type() != ArgumentType::i32 || right.Type() != ArgumentType::i32)
+    return Argument();
+  return left.i32() * right.i32();
+}
+
+static void MultiplyI32() {
+  auto right = Pop();
+  auto left = Pop();
+  auto result = EvaluateMultiplyI32(left, right);
+  if (result.Type() != ArgumentType::None)
+    Push(result);
+}
+
+TEST_CASE("Verify register program behavior") {
+  SUBCASE("Push two values and add") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    RegisterProgram program(instructions);
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+  }
+
+  SUBCASE("Push three values, pop one and subtract") {
+    Instruction instructions[] = {{OpCode::Push, 2},
+                                  {OpCode::Push, 3},
+                                  {OpCode::Push, 8},
+                                  {OpCode::Pop},
+                                  {OpCode::Subtract}};
+    RegisterProgram program(instructions);
+    program.Execute();
+    CHECK(Pop().i32() == -1);
+  }
+
+  SUBCASE("A program can be executed more than once") {
+    Instruction instructions[] = {
+        {OpCode::Push, 40}, {OpCode::Push, 2}, {OpCode::Add}};
+    RegisterProgram program(instructions);
+    program.Execute();
+    program.Execute();
+    CHECK(Pop().i32() == 42);
+    CHECK(Pop().i32() == 42);
+  }
+
+  SUBCASE("Pushes and pops are translated away") {
+    Instruction instructions[] = {{OpCode::Push, 43},
+                                  {OpCode::Push, 42},
+                                  {OpCode::Add},
+                                  {OpCode::Pop}};
+    RegisterProgram program(instructions);
+
+    auto threeAddressInstructions = program.GetThreeAddressInstructions();
+    REQUIRE(threeAddressInstructions.size() == 1);
+    CHECK(threeAddressInstructions[0].opCode == RegisterOpCode::Evaluate);
+    CHECK(threeAddressInstructions[0].left == 0);
+    CHECK(threeAddressInstructions[0].right == 1);
+    CHECK(threeAddressInstructions[0].destination == 2);
+    CHECK(program.GetNumberOfRegisters() == 3);
+  }
+
+  SUBCASE("Operations on values of known types are specialized") {
+    Instruction instructions[] = {{OpCode::Push, 1},
+                                  {OpCode::Push, 2.5f},
+                                  {OpCode::Add},
+                                  {OpCode::Push, (int64_t)3},
+                                  {OpCode::Subtract},
+                                  {OpCode::Pop}};
+    RegisterProgram program(instructions);
+
+    auto threeAddressInstructions = program.GetThreeAddressInstructions();
+    REQUIRE(threeAddressInstructions.size() == 2);
+    CHECK(threeAddressInstructions[0].evaluate ==
+          SpecializeAdd(ArgumentType::i32, ArgumentType::f32));
+    CHECK(threeAddressInstructions[1].evaluate ==
+          SpecializeSubtract(ArgumentType::f32, ArgumentType::i64));
+  }
+
+  SUBCASE("Operations on values from before the program use the value stack") {
+    Instruction instructions[] = {{OpCode::Push, 1}, {OpCode::Add}};
+    RegisterProgram program(instructions);
+
+    auto threeAddressInstructions = program.GetThreeAddressInstructions();
+    REQUIRE(threeAddressInstructions.size() == 2);
+    CHECK(threeAddressInstructions[0].opCode == RegisterOpCode::Store);
+    CHECK(threeAddressInstructions[1].opCode == RegisterOpCode::Call);
+    CHECK(threeAddressInstructions[1].instruction == OpCode::Add);
+  }
+
+  SUBCASE("Operands with no result are popped") {
+    Instruction instructions[] = {{OpCode::Push, 1},
+                                  {OpCode::Push, true},
+                                  {OpCode::Push, 2},
+                                  {OpCode::Add}};
+    RegisterProgram program(instructions);
+    CHECK(program.GetThreeAddressInstructions().size() == 1);
+
+    auto stackSize = StackSize();
+    program.Execute();
+    CHECK(StackSize() == stackSize + 1);
+    CHECK(Pop().i32() == 1);
+  }
+
+  SUBCASE("Values left on the stack are stored") {
+    Instruction instructions[] = {
+        {OpCode::Push, 1}, {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    RegisterProgram program(instructions);
+
+    auto threeAddressInstructions = program.GetThreeAddressInstructions();
+    REQUIRE(threeAddressInstructions.size() == 3);
+    CHECK(threeAddressInstructions[1].opCode == RegisterOpCode::Store);
+    CHECK(threeAddressInstructions[1].left == 0);
+    CHECK(threeAddressInstructions[2].opCode == RegisterOpCode::Store);
+    CHECK(threeAddressInstructions[2].left ==
+          threeAddressInstructions[0].destination);
+
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+    CHECK(Pop().i32() == 1);
+  }
+
+  SUBCASE("Results match the instruction processor") {
+    auto instructions = GenerateRandomProgram(1000);
+    VerifyMatchesProcess(instructions, [](span<Instruction> instructions) {
+      RegisterProgram(instructions).Execute();
+    });
+  }
+
+  SUBCASE("Values pushed before the program are loaded") {
+    Instruction instructions[] = {{OpCode::Push, 3},
+                                  {OpCode::Subtract},
+                                  {OpCode::Push, 2.5},
+                                  {OpCode::Add},
+                                  {OpCode::Add}};
+    Push(10);
+    Push((int64_t)20);
+    Process(instructions);
+    auto expected = Pop();
+
+    Push(10);
+    Push((int64_t)20);
+    RegisterProgram program(instructions);
+    program.Execute();
+    CHECK(Pop() == expected);
+  }
+
+  SUBCASE("Values pushed before the program can be popped") {
+    auto stackSize = StackSize();
+    Push(1);
+    Push(2);
+    Instruction instructions[] = {{OpCode::Pop}, {OpCode::Pop}};
+    RegisterProgram program(instructions);
+    program.Execute();
+    CHECK(StackSize() == stackSize);
+  }
+
+  SUBCASE("Instructions without an evaluate function use the value stack") {
+    auto metadata = GetInstructionMetadata(OpCode::Nop);
+    MockInstructionCalled = false;
+    RegisterInstruction(OpCode::Nop, {.execute =
+                                          [] {
+                                            MockInstructionCalled = true;
+                                            Push(Pop().i32() * 2);
+                                          },
+                                      .name = "Nop"});
+
+    Instruction instructions[] = {
+        {OpCode::Push, 1}, {OpCode::Push, 2}, {OpCode::Nop}, {OpCode::Add}};
+    RegisterProgram program(instructions);
+    program.Execute();
+    CHECK(MockInstructionCalled);
+    CHECK(Pop().i32() == 5);
+
+    RegisterInstruction(OpCode::Nop, metadata);
+  }
+
+  SUBCASE("An instruction that is not specialized may have no result") {
+    auto metadata = GetInstructionMetadata(OpCode::Nop);
+    RegisterInstruction(OpCode::Nop, {.execute = MultiplyI32,
+                                      .name = "Nop",
+                                      .evaluate = EvaluateMultiplyI32});
+
+    Instruction instructions[] = {{OpCode::Push, 2},   {OpCode::Push, 3},
+                                  {OpCode::Nop},       {OpCode::Push, 1},
+                                  {OpCode::Push, 2.5}, {OpCode::Nop},
+                                  {OpCode::Push, 4},   {OpCode::Nop}};
+    VerifyMatchesProcess(instructions, [](span<Instruction> instructions) {
+      RegisterProgram(instructions).Execute();
+    });
+
+    auto stackSize = StackSize();
+    RegisterProgram(instructions).Execute();
+    REQUIRE(StackSize() == stackSize + 1);
+    CHECK(Pop().i32() == 24);
+
+    RegisterInstruction(OpCode::Nop, metadata);
+  }
+
+  SUBCASE("An unexpected opcode is an error") {
+    auto stackSize = StackSize();
+    Instruction instructions[] = {{OpCode::Push, 1}, {(OpCode)42}};
+    RegisterProgram program(instructions);
+    CHECK_THROWS_AS(program.Execute(), logic_error);
+    CHECK(StackSize() == stackSize + 1);
+    CHECK(Pop().i32() == 1);
+  }
+
+  SUBCASE("An instruction registered after translating is executed") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    RegisterProgram program(instructions);
+
+    MockInstructionCalled = false;
+    RegisterInstruction(OpCode::Add,
+                        {.execute = [] { MockInstructionCalled = true; },
+                         .name = "Add"});
+    program.Execute();
+    CHECK(MockInstructionCalled);
+    CHECK(Pop().i32() == 3);
+    CHECK(Pop().i32() == 2);
+
+    RegisterInstruction(OpCode::Add, GetAddMetadata());
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+  }
+}
+
+TEST_CASE("Verify register program performance") {
+  auto instructions = GenerateRandomProgram(100000);
+
+  DecodedProgram decodedProgram(instructions);
+  RegisterProgram registerProgram(instructions);
+
+  auto stackSize = StackSize();
+  auto clearStack = [stackSize] {
+    while (StackSize() > stackSize)
+      Pop();
+  };
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(instructions.size());
+
+  b.run("Execute a decoded program", [&] {
+    decodedProgram.Execute();
+    clearStack();
+  });
+
+  b.run("Execute a register program", [&] {
+    registerProgram.Execute();
+    clearStack();
+  });
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+using std::span;
+#include <vector>
+using std::vector;
+
+#include "Bytecode.hpp"
+
+enum class RegisterOpCode {
+  // destination = evaluate(left, right)
+  Evaluate,
+
+  // Pushes left on to the value stack.
+  Store,
+
+  // Pops the top of the value stack and drops it.
+  Drop,
+
+  // Executes a registered instruction on the value stack.
+  Call,
+
+  // Throws, as the opcode cannot be executed.
+  Unexpected
+};
+
+// Each three-address instruction names its operands by their index in the
+// register file. The first registers hold the constants the program pushes.
+struct ThreeAddressInstruction {
+  RegisterOpCode opCode;
+  uint32_t destination;
+  uint32_t left;
+  uint32_t right;
+  OpCode instruction;
+  EvaluateInstructionFunc evaluate;
+};
+
+class RegisterProgram {
+public:
+  RegisterProgram(span<Instruction> instructions);
+
+  void Execute();
+
+  span<const ThreeAddressInstruction> GetThreeAddressInstructions() const;
+  size_t GetNumberOfRegisters() const;
+
+private:
+  span<Instruction> m_instructions;
+  uint32_t m_registryVersion;
+  vector<ThreeAddressInstruction> m_threeAddressInstructions;
+  vector<Argument> m_registers;
+
+  void Translate();
+};
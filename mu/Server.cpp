@@ -0,0 +1,661 @@
+#include "Configuration.hpp"
+
+#include <algorithm>
+using std::max;
+#include <cerrno>
+#include <cstring>
+using std::memcpy;
+using std::strcpy;
+using std::strerror;
+using std::strlen;
+#include <exception>
+using std::exception;
+#include <mutex>
+using std::lock_guard;
+using std::unique_lock;
+#include <span>
+using std::span;
+#include <thread>
+using std::thread;
+#include <utility>
+using std::move;
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+using fmt::format;
+
+#include "Loader.hpp"
+#include "Program.hpp"
+#include "Server.hpp"
+#include "ValueStack.hpp"
+
+// == Server ==
+//
+// Starting a process costs far more than executing a small program, so a
+// server stays running and executes the programs its clients send over a Unix
+// domain socket.
+//
+// The thread that calls Serve waits for requests on every connection with
+// poll. Its sockets do not block, so it reads whatever has arrived of each
+// request in to a buffer for the connection, and only hands a connection to a
+// worker once its whole request is there. The worker executes the request,
+// writes the response, and hands the connection back. A connection only holds a
+// worker while its request executes, so a few workers serve any number of
+// connections, and a client that sends part of a request holds none of them.
+// Each worker keeps its VM context, so its value stack is already allocated for
+// the next request.
+
+const size_t ServerMessageHeaderSize = 4;
+
+// A worker waits this long for a client to make room for its response.
+const int ServerWriteTimeoutMilliseconds = 5000;
+
+static bool ReadBytes(int socket, char* data, size_t size) {
+  while (size > 0) {
+    auto count = read(socket, data, size);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      return false;
+    data += count;
+    size -= count;
+  }
+  return true;
+}
+
+// The sockets of the server do not block, so this waits for room to write,
+// but gives up on a client that stops reading.
+static bool WriteBytes(int socket, const char* data, size_t size) {
+  while (size > 0) {
+    auto count = send(socket, data, size, MSG_NOSIGNAL);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      pollfd polled = {socket, POLLOUT, 0};
+      auto ready = poll(&polled, 1, ServerWriteTimeoutMilliseconds);
+      if (ready > 0 || (ready < 0 && errno == EINTR))
+        continue;
+      return false;
+    }
+    if (count <= 0)
+      return false;
+    data += count;
+    size -= count;
+  }
+  return true;
+}
+
+static size_t GetMessageSize(const char* header) {
+  auto bytes = (const unsigned char*)header;
+  return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (size_t)bytes[3] << 24;
+}
+
+static bool HasWholeMessage(const string& received) {
+  return received.size() >= ServerMessageHeaderSize &&
+         received.size() - ServerMessageHeaderSize >=
+             GetMessageSize(received.data());
+}
+
+// Reads what has arrived on a socket that does not block, until the received
+// bytes hold a whole message. Returns false when the connection is closed or
+// the message is too big.
+static bool ReceiveAvailableBytes(int socket, string& received) {
+  char buffer[64 * 1024];
+  while (!HasWholeMessage(received)) {
+    if (received.size() >= ServerMessageHeaderSize &&
+        GetMessageSize(received.data()) > MaximumServerMessageSize)
+      return false;
+
+    auto count = read(socket, buffer, sizeof(buffer));
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return true;
+    if (count <= 0)
+      return false;
+    received.append(buffer, count);
+  }
+  return true;
+}
+
+bool ReadServerMessage(int socket, string& message) {
+  char header[ServerMessageHeaderSize];
+  if (!ReadBytes(socket, header, sizeof(header)))
+    return false;
+
+  auto size = GetMessageSize(header);
+  if (size > MaximumServerMessageSize)
+    return false;
+
+  message.resize(size);
+  return ReadBytes(socket, message.data(), size);
+}
+
+bool WriteServerMessage(int socket, string_view message) {
+  if (message.size() > MaximumServerMessageSize)
+    return false;
+
+  auto size = message.size();
+  unsigned char header[ServerMessageHeaderSize] = {
+      (unsigned char)size, (unsigned char)(size >> 8),
+      (unsigned char)(size >> 16), (unsigned char)(size >> 24)};
+  return WriteBytes(socket, (const char*)header, sizeof(header)) &&
+         WriteBytes(socket, message.data(), message.size());
+}
+
+static bool TryGetSocketAddress(const char* socketPath, sockaddr_un& address) {
+  address = {};
+  address.sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(address.sun_path))
+    return false;
+  strcpy(address.sun_path, socketPath);
+  return true;
+}
+
+int ConnectToServer(const char* socketPath) {
+  sockaddr_un address;
+  if (!TryGetSocketAddress(socketPath, address))
+    return -1;
+
+  auto connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (connection == -1)
+    return -1;
+  if (connect(connection, (sockaddr*)&address, sizeof(address)) != 0) {
+    close(connection);
+    return -1;
+  }
+  return connection;
+}
+
+Server::Server(const char* socketPath, Engine engine, size_t numberOfThreads)
+    : m_socketPath(socketPath), m_engine(engine),
+      m_numberOfThreads(numberOfThreads), m_listenSocket(-1),
+      m_wakeReadPipe(-1), m_wakeWritePipe(-1), m_stopping(false),
+      m_numberOfRequests(0), m_closed(false) {
+  if (m_numberOfThreads == 0)
+    m_numberOfThreads = max(thread::hardware_concurrency(), 1u);
+
+  sockaddr_un address;
+  if (!TryGetSocketAddress(socketPath, address)) {
+    m_errorMessage = format("The socket path '{}' is too long.", socketPath);
+    return;
+  }
+
+  // A socket left behind by a server that did not exit cleanly is replaced,
+  // but a socket that a server is listening on, or any other file, is not.
+  struct stat st;
+  if (lstat(socketPath, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    auto connection = ConnectToServer(socketPath);
+    if (connection != -1) {
+      close(connection);
+      m_errorMessage =
+          format("A server is already listening on '{}'.", socketPath);
+      return;
+    }
+    unlink(socketPath);
+  }
+
+  int wakePipe[2];
+  if (pipe2(wakePipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+    m_errorMessage = format("Cannot create a pipe: {}.", strerror(errno));
+    return;
+  }
+  m_wakeReadPipe = wakePipe[0];
+  m_wakeWritePipe = wakePipe[1];
+
+  m_listenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (m_listenSocket == -1 ||
+      bind(m_listenSocket, (sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(m_listenSocket, SOMAXCONN) != 0) {
+    m_errorMessage =
+        format("Cannot listen on '{}': {}.", socketPath, strerror(errno));
+    if (m_listenSocket != -1)
+      close(m_listenSocket);
+    m_listenSocket = -1;
+  }
+}
+
+Server::~Server() {
+  if (m_listenSocket != -1) {
+    close(m_listenSocket);
+    unlink(m_socketPath.c_str());
+  }
+  if (m_wakeReadPipe != -1)
+    close(m_wakeReadPipe);
+  if (m_wakeWritePipe != -1)
+    close(m_wakeWritePipe);
+}
+
+bool Server::IsListening() const { return m_listenSocket != -1; }
+
+const string& Server::GetErrorMessage() const { return m_errorMessage; }
+
+void Server::Serve() {
+  if (!IsListening())
+    return;
+
+  vector<thread> workers;
+  for (size_t i = 0; i < m_numberOfThreads; i++)
+    workers.emplace_back([this] { ServeRequests(); });
+
+  vector<Connection> waitingConnections;
+  vector<Connection> polledConnections;
+  vector<pollfd> polled;
+  while (!m_stopping) {
+    // A client may have sent its next request with the last one.
+    vector<Connection> idleConnections;
+    {
+      lock_guard<mutex> guard(m_idleLock);
+      idleConnections.swap(m_idleConnections);
+    }
+    for (auto& connection : idleConnections)
+      HandOff(move(connection), waitingConnections);
+
+    polled.clear();
+    polled.push_back({m_wakeReadPipe, POLLIN, 0});
+    polled.push_back({m_listenSocket, POLLIN, 0});
+    for (auto& connection : waitingConnections)
+      polled.push_back({connection.socket, POLLIN, 0});
+    if (poll(polled.data(), polled.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (polled[0].revents != 0) {
+      char buffer[64];
+      while (read(m_wakeReadPipe, buffer, sizeof(buffer)) > 0) {
+      }
+    }
+
+    // A connection that was closed is readable too, so it is found out here.
+    polledConnections.clear();
+    polledConnections.swap(waitingConnections);
+    for (size_t i = 2; i < polled.size(); i++) {
+      auto& connection = polledConnections[i - 2];
+      if (polled[i].revents != 0 &&
+          !ReceiveAvailableBytes(connection.socket, connection.received)) {
+        close(connection.socket);
+        continue;
+      }
+      HandOff(move(connection), waitingConnections);
+    }
+
+    if (polled[1].revents & POLLIN) {
+      auto connection = accept4(m_listenSocket, nullptr, nullptr,
+                                SOCK_CLOEXEC | SOCK_NONBLOCK);
+      if (connection != -1)
+        waitingConnections.push_back({connection, ""});
+    }
+  }
+
+  {
+    lock_guard<mutex> guard(m_readyLock);
+    m_closed = true;
+  }
+  m_readyCondition.notify_all();
+  for (auto& worker : workers)
+    worker.join();
+
+  for (auto& connection : waitingConnections)
+    close(connection.socket);
+  for (auto& connection : m_idleConnections)
+    close(connection.socket);
+  m_idleConnections.clear();
+}
+
+// Gives a connection whose whole request has arrived to a worker, or leaves it
+// to wait for the rest.
+void Server::HandOff(Connection connection,
+                     vector<Connection>& waitingConnections) {
+  if (!HasWholeMessage(connection.received)) {
+    waitingConnections.push_back(move(connection));
+    return;
+  }
+
+  lock_guard<mutex> guard(m_readyLock);
+  m_readyConnections.push_back(move(connection));
+  m_readyCondition.notify_one();
+}
+
+void Server::Stop() {
+  m_stopping = true;
+  Wake();
+}
+
+size_t Server::GetNumberOfRequests() const { return m_numberOfRequests; }
+
+void Server::ServeRequests() {
+  VmContext context;
+  for (;;) {
+    Connection connection;
+    {
+      unique_lock<mutex> lock(m_readyLock);
+      m_readyCondition.wait(
+          lock, [this] { return m_closed || !m_readyConnections.empty(); });
+      if (m_readyConnections.empty())
+        return;
+      connection = move(m_readyConnections.front());
+      m_readyConnections.pop_front();
+    }
+
+    if (!ServeRequest(connection)) {
+      close(connection.socket);
+      continue;
+    }
+
+    lock_guard<mutex> guard(m_idleLock);
+    m_idleConnections.push_back(move(connection));
+    Wake();
+  }
+}
+
+// The whole request has arrived, so this only blocks to write the response.
+bool Server::ServeRequest(Connection& connection) {
+  auto size = GetMessageSize(connection.received.data());
+  auto request = connection.received.substr(ServerMessageHeaderSize, size);
+  connection.received.erase(0, ServerMessageHeaderSize + size);
+
+  m_numberOfRequests++;
+  return WriteServerMessage(connection.socket, Respond(request));
+}
+
+string Server::Respond(const string& request) {
+  string response(1, (char)ServerStatus::Error);
+  try {
+    span<const byte> bytes((const byte*)request.data(), request.size());
+    auto program = Loader::IsMuBytecode(bytes)
+                       ? Program::Load(bytes)
+                       : Program::Parse(request);
+    if (!program.Execute(m_engine)) {
+      response += program.GetErrorMessage();
+      return response;
+    }
+
+    response[0] = (char)ServerStatus::Ok;
+    for (auto& result : program.GetResults())
+      response += format("{}\n", result);
+  } catch (const exception& e) {
+    response.resize(1);
+    response += e.what();
+  }
+  return response;
+}
+
+// This only writes to the pipe, so signal handlers can call it.
+void Server::Wake() {
+  char wake = 0;
+  [[maybe_unused]] auto count = write(m_wakeWritePipe, &wake, 1);
+}
+
+// These send requests over a connection to a test server.
+static string SendRequest(int connection, string_view request) {
+  string response;
+  REQUIRE(WriteServerMessage(connection, request));
+  REQUIRE(ReadServerMessage(connection, response));
+  return response;
+}
+
+static string OkResponse(string_view results) {
+  return string(1, (char)ServerStatus::Ok) + string(results);
+}
+
+static string ErrorResponse(string_view message) {
+  return string(1, (char)ServerStatus::Error) + string(message);
+}
+
+TEST_CASE("Verify server behavior") {
+  const char* socketPath = "test.sock";
+
+  SUBCASE("Executes μtext and bytecode requests") {
+    Server server(socketPath, Engine::Verified, 2);
+    REQUIRE(server.IsListening());
+    thread serving([&] { server.Serve(); });
+
+    auto connection = ConnectToServer(socketPath);
+    REQUIRE(connection != -1);
+    CHECK(SendRequest(connection, "Push i32:5\nPush i32:6\nAdd\n") ==
+          OkResponse("11 (i32)\n"));
+
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Subtract}};
+    auto magic = Loader::MuMagicHeader;
+    string bytecode((const char*)&magic, sizeof(magic));
+    bytecode.append((const char*)instructions, sizeof(instructions));
+    CHECK(SendRequest(connection, bytecode) == OkResponse("-1 (i32)\n"));
+
+    CHECK(SendRequest(connection, "Push i32:1\nPush c:a\n") ==
+          OkResponse("1 (i32)\na (char)\n"));
+    close(connection);
+
+    server.Stop();
+    serving.join();
+    CHECK(server.GetNumberOfRequests() == 3);
+  }
+
+  SUBCASE("Executes compressed bytecode requests") {
+    Server server(socketPath, Engine::Verified, 1);
+    thread serving([&] { server.Serve(); });
+
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Subtract}};
+    auto connection = ConnectToServer(socketPath);
+    REQUIRE(connection != -1);
+    auto bytecode = WriteBytecode(instructions, BytecodeFormat::Compressed);
+    CHECK(SendRequest(connection, bytecode) == OkResponse("-1 (i32)\n"));
+    close(connection);
+
+    server.Stop();
+    serving.join();
+  }
+
+  SUBCASE("Checks analyzed bytecode requests against their analysis") {
+    Server server(socketPath, Engine::Verified, 1);
+    thread serving([&] { server.Serve(); });
+
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Subtract}};
+    auto connection = ConnectToServer(socketPath);
+    REQUIRE(connection != -1);
+    auto bytecode = WriteBytecode(instructions, BytecodeFormat::Analyzed);
+    CHECK(SendRequest(connection, bytecode) == OkResponse("-1 (i32)\n"));
+
+    uint64_t maximumStackDepth = 1;
+    memcpy(bytecode.data() + bytecode.size() - sizeof(AnalyzedFooter) +
+               offsetof(AnalyzedFooter, maximumStackDepth),
+           &maximumStackDepth, sizeof(maximumStackDepth));
+    CHECK(SendRequest(connection, bytecode) ==
+          ErrorResponse(
+              "Instruction 1 does not match the analysis of the program."));
+    close(connection);
+
+    server.Stop();
+    serving.join();
+  }
+
+  SUBCASE("Responds with an error for a program that is not valid") {
+    Server server(socketPath, Engine::Verified, 1);
+    thread serving([&] { server.Serve(); });
+
+    auto connection = ConnectToServer(socketPath);
+    REQUIRE(connection != -1);
+    CHECK(SendRequest(connection, "Push i32:1\nAdd\n") ==
+          ErrorResponse("Instruction 1 pops from an empty stack."));
+    CHECK(SendRequest(connection, "Push\n")[0] == (char)ServerStatus::Error);
+    const char withNull[] = "Push i32:1\0Push i32:2\n";
+    string_view request(withNull, sizeof(withNull) - 1);
+    CHECK(SendRequest(connection, request)[0] == (char)ServerStatus::Error);
+    CHECK(SendRequest(connection, "Push i32:7\n") == OkResponse("7 (i32)\n"));
+    close(connection);
+
+    server.Stop();
+    serving.join();
+  }
+
+  SUBCASE("Serves more connections than it has workers") {
+    Server server(socketPath, Engine::Verified, 2);
+    thread serving([&] { server.Serve(); });
+
+    // The idle connection does not hold a worker.
+    auto idleConnection = ConnectToServer(socketPath);
+    REQUIRE(idleConnection != -1);
+
+    const int numberOfClients = 8;
+    const int numberOfRequests = 50;
+    vector<int> numberOfCorrectResponses(numberOfClients);
+    vector<thread> clients;
+    for (auto client = 0; client < numberOfClients; client++) {
+      clients.emplace_back([&, client] {
+        auto connection = ConnectToServer(socketPath);
+        for (auto i = 0; i < numberOfRequests && connection != -1; i++) {
+          string response;
+          WriteServerMessage(connection,
+                             format("Push i32:{}\nPush i32:{}\nAdd\n", client,
+                                    i));
+          if (ReadServerMessage(connection, response) &&
+              response == OkResponse(format("{} (i32)\n", client + i)))
+            numberOfCorrectResponses[client]++;
+        }
+        close(connection);
+      });
+    }
+    for (auto& client : clients)
+      client.join();
+
+    for (auto count : numberOfCorrectResponses)
+      CHECK(count == numberOfRequests);
+    close(idleConnection);
+
+    server.Stop();
+    serving.join();
+    CHECK(server.GetNumberOfRequests() == numberOfClients * numberOfRequests);
+  }
+
+  SUBCASE("A partial request does not hold a worker") {
+    Server server(socketPath, Engine::Verified, 1);
+    thread serving([&] { server.Serve(); });
+
+    string request = "Push i32:3\n";
+    auto partialConnection = ConnectToServer(socketPath);
+    REQUIRE(partialConnection != -1);
+    unsigned char header[] = {(unsigned char)request.size(), 0, 0, 0};
+    REQUIRE(write(partialConnection, header, sizeof(header)) == sizeof(header));
+    REQUIRE(write(partialConnection, request.data(), 4) == 4);
+
+    // The other client gives up instead of waiting forever.
+    auto connection = ConnectToServer(socketPath);
+    REQUIRE(connection != -1);
+    timeval timeout = {5, 0};
+    setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    CHECK(SendRequest(connection, "Push i32:7\n") == OkResponse("7 (i32)\n"));
+    close(connection);
+
+    auto rest = request.size() - 4;
+    REQUIRE(write(partialConnection, request.data() + 4, rest) ==
+            (ssize_t)rest);
+    string response;
+    REQUIRE(ReadServerMessage(partialConnection, response));
+    CHECK(response == OkResponse("3 (i32)\n"));
+    close(partialConnection);
+
+    server.Stop();
+    serving.join();
+    CHECK(server.GetNumberOfRequests() == 2);
+  }
+
+  SUBCASE("A request that is too big closes the connection") {
+    Server server(socketPath, Engine::Verified, 1);
+    thread serving([&] { server.Serve(); });
+
+    auto connection = ConnectToServer(socketPath);
+    REQUIRE(connection != -1);
+    unsigned char header[] = {0xFF, 0xFF, 0xFF, 0xFF};
+    REQUIRE(write(connection, header, sizeof(header)) == sizeof(header));
+    string response;
+    CHECK_FALSE(ReadServerMessage(connection, response));
+    close(connection);
+
+    server.Stop();
+    serving.join();
+  }
+
+  SUBCASE("The socket is removed when the server is destroyed") {
+    {
+      Server server(socketPath);
+      REQUIRE(server.IsListening());
+    }
+    CHECK(ConnectToServer(socketPath) == -1);
+    struct stat st;
+    CHECK(lstat(socketPath, &st) != 0);
+  }
+
+  SUBCASE("A socket that no server is listening on is replaced") {
+    auto stale = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    REQUIRE(TryGetSocketAddress(socketPath, address));
+    REQUIRE(bind(stale, (sockaddr*)&address, sizeof(address)) == 0);
+    close(stale);
+
+    Server server(socketPath);
+    CHECK(server.IsListening());
+  }
+
+  SUBCASE("Only one server listens on a socket") {
+    Server server(socketPath);
+    REQUIRE(server.IsListening());
+
+    Server other(socketPath);
+    CHECK_FALSE(other.IsListening());
+    CHECK(other.GetErrorMessage() ==
+          "A server is already listening on 'test.sock'.");
+  }
+
+  SUBCASE("A socket path that is too long is an error") {
+    string socketPath(200, 'a');
+    Server server(socketPath.c_str());
+    CHECK_FALSE(server.IsListening());
+    CHECK(server.GetErrorMessage() ==
+          format("The socket path '{}' is too long.", socketPath));
+  }
+
+  SUBCASE("A client cannot connect without a server") {
+    CHECK(ConnectToServer("no_server.sock") == -1);
+  }
+}
+
+TEST_CASE("Verify server performance") {
+  const char* socketPath = "test.sock";
+  Server server(socketPath, Engine::Verified, 1);
+  REQUIRE(server.IsListening());
+  thread serving([&] { server.Serve(); });
+
+  auto connection = ConnectToServer(socketPath);
+  REQUIRE(connection != -1);
+  string mutext = "Push i32:5\nPush i32:6\nAdd\n";
+  string response;
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true);
+
+  b.run("Parse and execute in this process", [&] {
+    auto program = Program::Parse(mutext.c_str());
+    program.Execute();
+    ankerl::nanobench::doNotOptimizeAway(program.GetResults().size());
+  });
+
+  b.run("Round trip to the server", [&] {
+    WriteServerMessage(connection, mutext);
+    ReadServerMessage(connection, response);
+  });
+
+  close(connection);
+  server.Stop();
+  serving.join();
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+using std::atomic;
+#include <condition_variable>
+using std::condition_variable;
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+using std::deque;
+#include <mutex>
+using std::mutex;
+#include <string>
+using std::string;
+#include <string_view>
+using std::string_view;
+#include <vector>
+using std::vector;
+
+#include "InstructionProcessor.hpp"
+
+// == Protocol ==
+//
+// Each message is a 32-bit little-endian size followed by that many bytes. A
+// request holds one program, either μ bytecode (which starts with the magic
+// header) or μtext. The response starts with a status byte. The rest of it is
+// the results, one per line from the bottom of the stack up, or the error
+// message.
+enum class ServerStatus : uint8_t { Ok, Error };
+
+const size_t MaximumServerMessageSize = 64 * 1024 * 1024;
+
+// These return false when the connection is closed or the message is too big.
+bool ReadServerMessage(int socket, string& message);
+bool WriteServerMessage(int socket, string_view message);
+
+// Returns a connected socket, or -1 if there is no server at the path.
+int ConnectToServer(const char* socketPath);
+
+class Server {
+public:
+  // Zero threads means one for each core.
+  Server(const char* socketPath, Engine engine = Engine::Verified,
+         size_t numberOfThreads = 0);
+  ~Server();
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  // A server that is not listening has an error message that says why.
+  bool IsListening() const;
+  const string& GetErrorMessage() const;
+
+  // Serves requests until Stop is called. The calling thread waits for
+  // connections, and the worker threads execute the requests.
+  void Serve();
+
+  // Stop can be called from any thread, or from a signal handler.
+  void Stop();
+
+  size_t GetNumberOfRequests() const;
+
+private:
+  string m_socketPath;
+  Engine m_engine;
+  size_t m_numberOfThreads;
+  int m_listenSocket;
+  int m_wakeReadPipe;
+  int m_wakeWritePipe;
+  string m_errorMessage;
+  atomic<bool> m_stopping;
+  atomic<size_t> m_numberOfRequests;
+
+  // A connection and the bytes that have arrived on it, which start with its
+  // next request.
+  struct Connection {
+    int socket;
+    string received;
+  };
+
+  // Connections whose whole request has arrived, for the workers.
+  mutex m_readyLock;
+  condition_variable m_readyCondition;
+  deque<Connection> m_readyConnections;
+  bool m_closed;
+
+  // Connections the workers are done with, for the calling thread to wait on.
+  mutex m_idleLock;
+  vector<Connection> m_idleConnections;
+
+  void ServeRequests();
+  bool ServeRequest(Connection& connection);
+  void HandOff(Connection connection, vector<Connection>& waitingConnections);
+  string Respond(const string& request);
+  void Wake();
+};
@@ -0,0 +1,358 @@
+#include "Configuration.hpp"
+
+#include <algorithm>
+using std::min;
+#include <condition_variable>
+using std::condition_variable;
+#include <deque>
+using std::deque;
+#include <exception>
+using std::exception;
+#include <mutex>
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+#include <thread>
+using std::thread;
+#include <utility>
+using std::move;
+#include <vector>
+using std::vector;
+
+#include <fmt/core.h>
+using fmt::format;
+
+#include "Loader.hpp"
+#include "Mutext/Parser.hpp"
+#include "StreamingExecutor.hpp"
+#include "ValueStack.hpp"
+#include "VerifiedProgram.hpp"
+
+// == Streaming Executor ==
+//
+// Generated μtext programs can be far bigger than memory. The streaming
+// executor never holds the whole program. A parser thread reads the μtext a
+// chunk at a time and hands batches of instructions to the executing thread
+// through a bounded queue, so parsing overlaps execution, and the memory used
+// does not depend on the size of the input.
+//
+// Each batch is verified before it executes, continuing from the types of the
+// values the batches before it left on the stack, so a bad instruction is
+// reported with the same index as when the whole program is verified. The
+// instructions before it have already executed by then. A batch only verifies,
+// moves and updates the types of the values it pops from below its own, so it
+// takes as long on a deep stack as on an empty one.
+//
+// A bytecode file that is bigger than memory is executed the same way, a batch
+// at a time from each window the loader maps.
+
+namespace {
+// The parser thread waits while the queue is full. The executing thread closes
+// it to stop the parser early.
+class BatchQueue {
+public:
+  explicit BatchQueue(size_t capacity) : m_capacity(capacity), m_done(false) {}
+
+  bool Push(vector<Instruction> batch) {
+    unique_lock<mutex> lock(m_lock);
+    m_notFull.wait(lock,
+                   [this] { return m_done || m_batches.size() < m_capacity; });
+    if (m_done)
+      return false;
+    m_batches.push_back(move(batch));
+    m_notEmpty.notify_one();
+    return true;
+  }
+
+  bool Pop(vector<Instruction>& batch) {
+    unique_lock<mutex> lock(m_lock);
+    m_notEmpty.wait(lock, [this] { return m_done || !m_batches.empty(); });
+    if (m_batches.empty())
+      return false;
+    batch = move(m_batches.front());
+    m_batches.pop_front();
+    m_notFull.notify_one();
+    return true;
+  }
+
+  // Pop returns the batches that are left, then returns false.
+  void Close() {
+    lock_guard<mutex> guard(m_lock);
+    m_done = true;
+    m_notEmpty.notify_all();
+    m_notFull.notify_all();
+  }
+
+private:
+  size_t m_capacity;
+  mutex m_lock;
+  condition_variable m_notEmpty;
+  condition_variable m_notFull;
+  deque<vector<Instruction>> m_batches;
+  bool m_done;
+};
+} // namespace
+
+StreamingExecutor::StreamingExecutor(Engine engine, size_t batchSize,
+                                     size_t queueCapacity)
+    : m_engine(engine), m_batchSize(batchSize), m_queueCapacity(queueCapacity),
+      m_numberOfInstructions(0) {}
+
+bool StreamingExecutor::Execute(FILE* mutext) {
+  m_errorMessage.clear();
+  m_numberOfInstructions = 0;
+  ClearValueStack();
+
+  BatchQueue queue(m_queueCapacity);
+  string parseErrorMessage;
+  thread parser([&] {
+    try {
+      ParseMutextStream(mutext, m_batchSize, [&](vector<Instruction> batch) {
+        return queue.Push(move(batch));
+      });
+    } catch (const exception& e) {
+      parseErrorMessage = e.what();
+    }
+    queue.Close();
+  });
+
+  vector<ArgumentType> stackTypes;
+  vector<Instruction> batch;
+  try {
+    while (queue.Pop(batch)) {
+      if (!ExecuteBatch(batch, stackTypes))
+        break;
+    }
+  } catch (const exception& e) {
+    m_errorMessage = e.what();
+  }
+
+  queue.Close();
+  parser.join();
+
+  if (m_errorMessage.empty())
+    m_errorMessage = parseErrorMessage;
+  if (!m_errorMessage.empty()) {
+    ClearValueStack();
+    return false;
+  }
+  return true;
+}
+
+bool StreamingExecutor::Execute(Loader& loader) {
+  m_errorMessage.clear();
+  m_numberOfInstructions = 0;
+  ClearValueStack();
+
+  vector<ArgumentType> stackTypes;
+  try {
+    auto executed = loader.ForEachWindow([&](span<Instruction> window) {
+      for (size_t first = 0; first < window.size(); first += m_batchSize) {
+        auto size = min(m_batchSize, window.size() - first);
+        if (!ExecuteBatch(window.subspan(first, size), stackTypes))
+          return false;
+      }
+      return true;
+    });
+    if (!executed && m_errorMessage.empty())
+      m_errorMessage = loader.GetErrorMessage();
+  } catch (const exception& e) {
+    m_errorMessage = e.what();
+  }
+
+  if (!m_errorMessage.empty()) {
+    ClearValueStack();
+    return false;
+  }
+  return true;
+}
+
+bool StreamingExecutor::ExecuteBatch(span<Instruction> batch,
+                                     vector<ArgumentType>& stackTypes) {
+  VerifiedProgram program(batch, stackTypes, m_numberOfInstructions);
+  if (!program.IsVerified()) {
+    m_errorMessage = program.GetErrorMessage();
+    return false;
+  }
+
+  if (m_engine == Engine::Verified)
+    program.Execute();
+  else
+    Process(batch, m_engine);
+  // Only the types of the values the batch replaced change.
+  auto resultTypes = program.GetResultTypes();
+  stackTypes.resize(stackTypes.size() - program.GetNumberOfInputs());
+  stackTypes.insert(stackTypes.end(), resultTypes.begin(), resultTypes.end());
+  m_numberOfInstructions += batch.size();
+  return true;
+}
+
+const string& StreamingExecutor::GetErrorMessage() const {
+  return m_errorMessage;
+}
+
+size_t StreamingExecutor::GetNumberOfInstructions() const {
+  return m_numberOfInstructions;
+}
+
+// Writes the μtext to a temporary file, ready to stream.
+static FILE* CreateStream(const string& mutext) {
+  auto file = tmpfile();
+  fwrite(mutext.data(), 1, mutext.size(), file);
+  rewind(file);
+  return file;
+}
+
+TEST_CASE("Verify streaming executor behavior") {
+  SUBCASE("Values are carried from one batch to the next") {
+    auto file = CreateStream("Push i32:1\nPush i32:2\nPush f64:0.5\nPop\n"
+                             "Add\nPush i32:4\nSubtract\nPush c:a\n");
+    for (auto engine : {Engine::Loop, Engine::DirectThreaded, Engine::TailCall,
+                        Engine::Jit, Engine::Register, Engine::Verified}) {
+      rewind(file);
+      StreamingExecutor executor(engine, 3, 1);
+      REQUIRE(executor.Execute(file));
+      CHECK(executor.GetNumberOfInstructions() == 8);
+      REQUIRE(StackSize() == 2);
+      CHECK(Pop().c() == 'a');
+      CHECK(Pop().i32() == -1);
+    }
+    fclose(file);
+  }
+
+  SUBCASE("A stack that keeps growing is carried through every batch") {
+    string mutext;
+    for (auto i = 0; i < 1000; i++)
+      mutext += format("Push i32:{}\n", i);
+    mutext += "Add\nSubtract\n";
+    auto file = CreateStream(mutext);
+    for (auto engine : {Engine::DirectThreaded, Engine::Verified}) {
+      rewind(file);
+      StreamingExecutor executor(engine, 7, 1);
+      REQUIRE(executor.Execute(file));
+      REQUIRE(StackSize() == 998);
+      CHECK(Pop().i32() == 997 - (998 + 999));
+      CHECK(Pop().i32() == 996);
+      ClearValueStack();
+    }
+    fclose(file);
+  }
+
+  SUBCASE("A bad instruction is reported with its index in the stream") {
+    auto file = CreateStream("Push i32:1\nPush i32:2\nAdd\nPop\nPop\n"
+                             "Push i32:3\n");
+    StreamingExecutor executor(Engine::Verified, 2, 1);
+    CHECK_FALSE(executor.Execute(file));
+    CHECK(executor.GetErrorMessage() ==
+          "Instruction 4 pops from an empty stack.");
+    CHECK(executor.GetNumberOfInstructions() == 4);
+    CHECK(StackSize() == 0);
+    fclose(file);
+  }
+
+  SUBCASE("The parser stops early when a batch is not valid") {
+    string mutext = "Add\n";
+    for (auto i = 0; i < 100000; i++)
+      mutext += "Push i32:1\nPop\n";
+    auto file = CreateStream(mutext);
+    StreamingExecutor executor(Engine::Verified, 16, 2);
+    CHECK_FALSE(executor.Execute(file));
+    CHECK(executor.GetErrorMessage() ==
+          "Instruction 0 pops from an empty stack.");
+    CHECK(ftell(file) < (long)mutext.size());
+    fclose(file);
+  }
+
+  SUBCASE("A line that cannot be parsed is an error") {
+    auto file = CreateStream("Push i32:1\nPush\n");
+    StreamingExecutor executor;
+    CHECK_FALSE(executor.Execute(file));
+    CHECK_FALSE(executor.GetErrorMessage().empty());
+    CHECK(StackSize() == 0);
+    fclose(file);
+  }
+
+  SUBCASE("A bytecode file is executed a window at a time") {
+    vector<Instruction> instructions;
+    for (auto i = 0; i < 1000; i++) {
+      instructions.push_back({OpCode::Push, i});
+      instructions.push_back({OpCode::Add});
+    }
+    instructions.insert(instructions.begin(), {OpCode::Push, 0});
+    TestMuFile testFile("test.mu", instructions);
+
+    MemoryMapOptions options;
+    for (auto windowSize : {size_t(0), 300 * sizeof(Instruction)}) {
+      options.windowSize = windowSize;
+      Loader loader("test.mu", options);
+      StreamingExecutor executor(Engine::Verified, 7, 1);
+      REQUIRE(executor.Execute(loader));
+      CHECK(executor.GetNumberOfInstructions() == instructions.size());
+      REQUIRE(StackSize() == 1);
+      CHECK(Pop().i32() == 499500);
+    }
+  }
+
+  SUBCASE("A bad instruction in a bytecode window is reported with its index") {
+    Instruction instructions[] = {{OpCode::Push, 1}, {OpCode::Pop},
+                                  {OpCode::Push, 2}, {OpCode::Pop},
+                                  {OpCode::Pop},     {OpCode::Push, 3}};
+    TestMuFile testFile("test.mu", instructions);
+
+    MemoryMapOptions options;
+    options.windowSize = 2 * sizeof(Instruction);
+    Loader loader("test.mu", options);
+    StreamingExecutor executor;
+    CHECK_FALSE(executor.Execute(loader));
+    CHECK(executor.GetErrorMessage() ==
+          "Instruction 4 pops from an empty stack.");
+    CHECK(StackSize() == 0);
+  }
+
+  SUBCASE("Executing an empty stream leaves the stack empty") {
+    Push(42);
+    auto file = CreateStream("");
+    StreamingExecutor executor;
+    CHECK(executor.Execute(file));
+    CHECK(executor.GetNumberOfInstructions() == 0);
+    CHECK(StackSize() == 0);
+    fclose(file);
+  }
+}
+
+TEST_CASE("Verify streaming executor performance") {
+  string mutext;
+  for (auto i = 0; i < 250000; i++)
+    mutext += "Push i32:43\nPush i32:42\nAdd\nPop\n";
+  auto file = CreateStream(mutext);
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(1000000);
+
+  b.run("Parse the whole file, then execute it", [&] {
+    rewind(file);
+    string contents(mutext.size(), '\0');
+    fread(contents.data(), 1, contents.size(), file);
+    auto instructions = ParseMutext(contents.c_str());
+    VerifiedProgram(instructions).Execute();
+  });
+
+  StreamingExecutor executor;
+  b.run("Stream the file", [&] {
+    rewind(file);
+    executor.Execute(file);
+  });
+
+  // Each batch takes as long as the first, however deep the stack below it.
+  string growing;
+  for (auto i = 0; i < 1000000; i++)
+    growing += "Push i32:1\n";
+  auto growingFile = CreateStream(growing);
+  b.run("Stream a file whose stack keeps growing", [&] {
+    rewind(growingFile);
+    executor.Execute(growingFile);
+  });
+
+  fclose(file);
+  fclose(growingFile);
+}
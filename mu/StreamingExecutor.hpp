@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+using std::FILE;
+#include <span>
+using std::span;
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+
+#include "InstructionProcessor.hpp"
+#include "Loader.hpp"
+
+class StreamingExecutor {
+public:
+  // The parser gets at most queueCapacity batches of batchSize instructions
+  // ahead of execution.
+  explicit StreamingExecutor(Engine engine = Engine::Verified,
+                             size_t batchSize = 4096,
+                             size_t queueCapacity = 4);
+
+  // Parses and executes the μtext from a file, a pipe or stdin, starting from
+  // an empty value stack on the calling thread. The results are left on the
+  // value stack, as they are after Process. Returns false if the μtext cannot
+  // be read or is not valid, and then the value stack is empty.
+  bool Execute(FILE* mutext);
+
+  // Executes the bytecode a window at a time, and batchSize instructions at a
+  // time from each window, in the same way.
+  bool Execute(Loader& loader);
+
+  const string& GetErrorMessage() const;
+
+  // The number of instructions the last execution executed.
+  size_t GetNumberOfInstructions() const;
+
+private:
+  Engine m_engine;
+  size_t m_batchSize;
+  size_t m_queueCapacity;
+  string m_errorMessage;
+  size_t m_numberOfInstructions;
+
+  // Verifies the batch, continuing from the types on the stack, and executes
+  // it. Returns false if the batch is not valid.
+  bool ExecuteBatch(span<Instruction> batch, vector<ArgumentType>& stackTypes);
+};
@@ -0,0 +1,316 @@
+#include "Configuration.hpp"
+
+#include <stdexcept>
+using std::logic_error;
+#include <vector>
+using std::vector;
+
+#include <fmt/core.h>
+using fmt::format;
+
+#include "InstructionProcessor.hpp"
+#include "Interpreter/Interpreter.hpp"
+#include "TailCallInterpreter.hpp"
+#include "ValueStack.hpp"
+
+// == Tail Call Interpreter ==
+//
+// Each handler executes one instruction, then tail calls the handler for the
+// next one. The current instruction, the end of the program, the top of the
+// value stack, in both its values and its types, and the end of its storage are
+// passed as arguments, so they stay in registers from one handler to the next,
+// and each handler is compiled on its own, with none of the register pressure
+// of one large dispatch function.
+//
+// The handlers write values directly to the storage of the value stack. Only a
+// push checks for room, and only the slow path and registered instructions
+// sync the size of the value stack with the top the handlers pass along.
+//
+// The tail calls must be guaranteed, or a long program would overflow the
+// machine stack. Where the compiler has no musttail attribute, each handler
+// returns the state for the next instruction to a loop that calls it instead.
+
+#if defined(__has_cpp_attribute)
+#if __has_cpp_attribute(clang::musttail)
+#define MU_MUSTTAIL [[clang::musttail]]
+#elif __has_cpp_attribute(gnu::musttail)
+#define MU_MUSTTAIL [[gnu::musttail]]
+#endif
+#endif
+
+// Only the handlers that grow the value stack change the end of its storage,
+// so the state returned to the loop leaves it out. The types of the values on
+// the stack are found again from the top of its values.
+struct TailCallState {
+  const Instruction* instruction;
+  uint64_t* top;
+};
+
+typedef TailCallState (*TailCallHandler)(const Instruction* instruction,
+                                         const Instruction* end, uint64_t* top,
+                                         uint8_t* types, uint64_t* limit);
+
+static TailCallState Dispatch(const Instruction* instruction,
+                              const Instruction* end, uint64_t* top,
+                              uint8_t* types, uint64_t* limit);
+
+#if defined(MU_MUSTTAIL)
+#define NEXT(instruction, top, types, limit)                                   \
+  MU_MUSTTAIL return Dispatch(instruction, end, top, types, limit)
+#else
+#define MU_MUSTTAIL
+#define NEXT(instruction, top, types, limit)                                   \
+  return TailCallState { instruction, top }
+#endif
+
+struct StackRegisters {
+  uint64_t* top;
+  uint8_t* types;
+  uint64_t* limit;
+};
+
+static StackRegisters LoadStack() {
+  auto values = valueStack.valueData();
+  return {values + valueStack.size(), valueStack.typeData() + valueStack.size(),
+          values + valueStack.capacity()};
+}
+
+static void StoreStack(uint64_t* top) {
+  valueStack.resize((int)(top - valueStack.valueData()));
+}
+
+static StackRegisters GrowStack(uint64_t* top) {
+  StoreStack(top);
+  valueStack.grow();
+  return LoadStack();
+}
+
+static TailCallState PushHandler(const Instruction* instruction,
+                                 const Instruction* end, uint64_t* top,
+                                 uint8_t* types, uint64_t* limit) {
+  if (top == limit) [[unlikely]] {
+    auto stack = GrowStack(top);
+    top = stack.top;
+    types = stack.types;
+    limit = stack.limit;
+  }
+
+  *top++ = instruction->argument.Bits();
+  *types++ = (uint8_t)instruction->argument.Type();
+  NEXT(instruction + 1, top, types, limit);
+}
+
+static TailCallState PopHandler(const Instruction* instruction,
+                                const Instruction* end, uint64_t* top,
+                                uint8_t* types, uint64_t* limit) {
+  assert(top > valueStack.valueData());
+  top--;
+  types--;
+  NEXT(instruction + 1, top, types, limit);
+}
+
+template <EvaluateInstructionFunc evaluate>
+static TailCallState BinaryOperationHandler(const Instruction* instruction,
+                                            const Instruction* end,
+                                            uint64_t* top, uint8_t* types,
+                                            uint64_t* limit) {
+  assert(top - valueStack.valueData() >= 2);
+
+  auto result =
+      evaluate(Argument::FromBits((ArgumentType)types[-2], top[-2]),
+               Argument::FromBits((ArgumentType)types[-1], top[-1]));
+  top -= 2;
+  types -= 2;
+  if (result.Type() != ArgumentType::None) {
+    *top++ = result.Bits();
+    *types++ = (uint8_t)result.Type();
+  }
+  NEXT(instruction + 1, top, types, limit);
+}
+
+static void ExecuteRegisteredInstruction(OpCode opCode) {
+  if (!HasInstruction(opCode))
+    throw logic_error(format("Unexpected opcode: {}", (int)opCode));
+  ExecuteInstruction(opCode);
+}
+
+// Registered instructions operate on the value stack, so it is synced before
+// they execute, and the registers are loaded from it again afterwards.
+static TailCallState RegisteredHandler(const Instruction* instruction,
+                                       const Instruction* end, uint64_t* top,
+                                       uint8_t* types, uint64_t* limit) {
+  StoreStack(top);
+  ExecuteRegisteredInstruction(instruction->opCode);
+  auto stack = LoadStack();
+  NEXT(instruction + 1, stack.top, stack.types, stack.limit);
+}
+
+// As with the direct-threaded engine, the built-in instructions are executed
+// directly, and any other opcode goes through the instruction registry.
+static const TailCallHandler handlers[NumberOfOpCodes + 1] = {
+    RegisteredHandler,
+    PushHandler,
+    PopHandler,
+    BinaryOperationHandler<EvaluateAdd>,
+    BinaryOperationHandler<EvaluateSubtract>,
+    RegisteredHandler};
+
+static TailCallState Dispatch(const Instruction* instruction,
+                              const Instruction* end, uint64_t* top,
+                              uint8_t* types, uint64_t* limit) {
+  if (instruction == end)
+    return {instruction, top};
+
+  auto index = (size_t)instruction->opCode;
+  MU_MUSTTAIL return handlers[index < NumberOfOpCodes ? index
+                                                      : NumberOfOpCodes](
+      instruction, end, top, types, limit);
+}
+
+// The handler table calls the built-in Add and Subtract directly. If another
+// instruction is registered in place of either, which is checked once for each
+// call, every instruction but a push or a pop goes through the registry.
+static void ProcessRegistered(span<Instruction> instructions) {
+  for (auto& instruction : instructions) {
+    if (instruction.opCode == OpCode::Push)
+      Push(instruction.argument);
+    else if (instruction.opCode == OpCode::Pop)
+      Pop();
+    else
+      ExecuteRegisteredInstruction(instruction.opCode);
+  }
+}
+
+void ProcessTailCall(span<Instruction> instructions) {
+  if (GetInstructionMetadata(OpCode::Add).execute != Add ||
+      GetInstructionMetadata(OpCode::Subtract).execute != Subtract)
+    return ProcessRegistered(instructions);
+
+  auto end = instructions.data() + instructions.size();
+  auto stack = LoadStack();
+
+  // With guaranteed tail calls, the first dispatch only returns at the end of
+  // the program.
+  TailCallState state = {instructions.data(), stack.top};
+  do {
+    auto values = valueStack.valueData();
+    auto types = valueStack.typeData() + (state.top - values);
+    auto limit = values + valueStack.capacity();
+    state = Dispatch(state.instruction, end, state.top, types, limit);
+  } while (state.instruction != end);
+
+  StoreStack(state.top);
+}
+
+#undef NEXT
+#undef MU_MUSTTAIL
+
+TEST_CASE("Verify tail call interpreter behavior") {
+  SUBCASE("Push two values and add") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    ProcessTailCall(instructions);
+    CHECK(Pop().i32() == 5);
+  }
+
+  SUBCASE("Operate on values pushed before the program") {
+    Instruction instructions[] = {{OpCode::Push, 2.5}, {OpCode::Subtract}};
+    Push(4);
+    ProcessTailCall(instructions);
+    CHECK(Pop() == Argument(1.5));
+  }
+
+  SUBCASE("The value stack grows as values are pushed") {
+    auto stackSize = StackSize();
+    vector<Instruction> instructions(valueStack.capacity() * 3,
+                                     {OpCode::Push, 7});
+    ProcessTailCall(instructions);
+    CHECK(StackSize() == stackSize + (int)instructions.size());
+    while (StackSize() > stackSize)
+      CHECK(Pop().i32() == 7);
+  }
+
+  SUBCASE("A long program does not overflow the machine stack") {
+    auto stackSize = StackSize();
+    vector<Instruction> instructions;
+    for (auto i = 0; i < 250000; i++) {
+      instructions.push_back({OpCode::Push, 1});
+      instructions.push_back({OpCode::Pop});
+    }
+    ProcessTailCall(instructions);
+    CHECK(StackSize() == stackSize);
+  }
+
+  SUBCASE("Registered instructions operate on the value stack") {
+    auto metadata = GetInstructionMetadata(OpCode::Nop);
+    RegisterInstruction(OpCode::Nop, {.execute = [] {
+                                        for (auto i = 0; i < 100; i++)
+                                          Push(i);
+                                      },
+                                      .name = "Nop"});
+
+    Instruction instructions[] = {
+        {OpCode::Push, 1}, {OpCode::Nop}, {OpCode::Push, 2}, {OpCode::Add}};
+    ProcessTailCall(instructions);
+    CHECK(Pop().i32() == 101);
+    for (auto i = 98; i >= 0; i--)
+      CHECK(Pop().i32() == i);
+    CHECK(Pop().i32() == 1);
+
+    RegisterInstruction(OpCode::Nop, metadata);
+  }
+
+  SUBCASE("A registered instruction replaces a built-in one") {
+    auto metadata = GetInstructionMetadata(OpCode::Subtract);
+    RegisterInstruction(OpCode::Subtract, {.execute = [] {
+                                             Pop();
+                                             Pop();
+                                             Push(42);
+                                           },
+                                           .name = "Subtract"});
+
+    Instruction instructions[] = {{OpCode::Push, 5}, {OpCode::Push, 3},
+                                  {OpCode::Subtract}, {OpCode::Push, 1},
+                                  {OpCode::Add}};
+    ProcessTailCall(instructions);
+    CHECK(Pop().i32() == 43);
+
+    RegisterInstruction(OpCode::Subtract, metadata);
+  }
+
+  SUBCASE("An unexpected opcode leaves the values before it on the stack") {
+    auto stackSize = StackSize();
+    Instruction instructions[] = {{OpCode::Push, 1}, {(OpCode)42}};
+    CHECK_THROWS_AS(ProcessTailCall(instructions), logic_error);
+    CHECK(StackSize() == stackSize + 1);
+    CHECK(Pop().i32() == 1);
+  }
+
+  SUBCASE("Verify that a generated program matches the instruction processor") {
+    auto instructions = GenerateRandomProgram(10000);
+    VerifyMatchesProcess(instructions, ProcessTailCall);
+  }
+}
+
+TEST_CASE("Verify tail call interpreter performance") {
+  auto instructions = GenerateRandomProgram(100000);
+  auto stackSize = StackSize();
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(instructions.size());
+
+  b.run("Process with the loop engine", [&] {
+    Process(instructions, Engine::Loop);
+    valueStack.resize(stackSize);
+  });
+
+  b.run("Process with the direct-threaded engine", [&] {
+    Process(instructions, Engine::DirectThreaded);
+    valueStack.resize(stackSize);
+  });
+
+  b.run("Process with the tail call engine", [&] {
+    ProcessTailCall(instructions);
+    valueStack.resize(stackSize);
+  });
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <span>
+using std::span;
+
+#include "Bytecode.hpp"
+
+// Executes the instructions with handlers that each tail call the handler for
+// the next instruction. Without guaranteed tail calls, each handler returns to
+// a loop that calls the next one instead.
+void ProcessTailCall(span<Instruction> instructions);
+
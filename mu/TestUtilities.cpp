@@ -2,13 +2,17 @@
 
 #include <cstdio>
 #include <cstring>
+#include <random>
+using std::mt19937;
 
 #include <fmt/core.h>
 using fmt::format;
 
 #include "TestUtilities.hpp"
 
+#include "InstructionProcessor.hpp"
 #include "Loader.hpp"
+#include "ValueStack.hpp"
 
 // == TestFile ==
 //
@@ -65,6 +69,80 @@ void VerifyInstructions(span<Instruction> expected, span<Instruction> actual) {
   }
 }
 
+// This helper function is used to verify that an engine leaves the same values
+// on the stack as the instruction processor.
+void VerifyMatchesProcess(span<Instruction> instructions,
+                          function<void(span<Instruction>)> execute) {
+  auto stackSize = StackSize();
+  Process(instructions);
+  vector<Argument> expected;
+  while (StackSize() > stackSize)
+    expected.push_back(Pop());
+
+  execute(instructions);
+  vector<Argument> actual;
+  while (StackSize() > stackSize)
+    actual.push_back(Pop());
+
+  REQUIRE(actual.size() == expected.size());
+  for (size_t i = 0; i < expected.size(); ++i)
+    CHECK(actual[i] == expected[i]);
+}
+
+// This helper function is used to generate programs that exercise every
+// combination of the arithmetic types. The random numbers are seeded, so a test
+// that fails always fails the same way.
+vector<Instruction> GenerateRandomProgram(size_t size) {
+  const Argument constants[] = {42, (int64_t)43, 44.5f, 45.5};
+
+  mt19937 random(42);
+  vector<Instruction> instructions;
+  auto depth = 0;
+  while (instructions.size() < size) {
+    auto choice = random() % 8;
+    if (depth < 2 || choice < 3) {
+      instructions.push_back({OpCode::Push, constants[random() % 4]});
+      depth++;
+    } else if (choice < 5) {
+      instructions.push_back({OpCode::Add});
+      depth--;
+    } else if (choice < 7) {
+      instructions.push_back({OpCode::Subtract});
+      depth--;
+    } else {
+      instructions.push_back({OpCode::Pop});
+      depth--;
+    }
+  }
+  return instructions;
+}
+
+string GenerateArithmeticMutext(size_t repetitions) {
+  string mutext;
+  for (size_t i = 0; i < repetitions; i++)
+    mutext += format("Push i32:{}\nPush f64:{}.5\nAdd\nPop\n", i, i);
+  return mutext;
+}
+
+string WriteBytecode(span<const Instruction> instructions,
+                     BytecodeFormat format) {
+  auto file = tmpfile();
+  BytecodeWriter writer(file, format);
+  writer.Write(instructions);
+  writer.Finish();
+
+  string bytecode(ftell(file), '\0');
+  rewind(file);
+  REQUIRE(fread(bytecode.data(), 1, bytecode.size(), file) == bytecode.size());
+  fclose(file);
+  return bytecode;
+}
+
+bool MockInstructionCalled = false;
+void MockInstruction() { MockInstructionCalled = true; }
+InstructionMetadata MockInstructionMetadata = {.execute = MockInstruction,
+                                               .name = "MockInstruction"};
+
 // This helper function is used to display a given instuction as a string in the
 // test output.
 doctest::String toString(const Instruction& instruction) {
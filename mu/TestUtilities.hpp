@@ -4,9 +4,16 @@
 
 #include <cstddef>
 using std::byte;
+#include <functional>
+using std::function;
 #include <span>
 using std::span;
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
 
+#include "Assembler.hpp"
 #include "Bytecode.hpp"
 
 class TestFile {
@@ -34,4 +41,29 @@ private:
 
 void VerifyInstructions(span<Instruction> expected, span<Instruction> actual);
 
+// Executes the instructions with the instruction processor and with the given
+// function, and checks that both leave the same values on the stack.
+void VerifyMatchesProcess(span<Instruction> instructions,
+                          function<void(span<Instruction>)> execute);
+
+// Generates a program of random arithmetic on constants of every arithmetic
+// type, which leaves a few values on the stack. Each call generates the same
+// program for the same size.
+vector<Instruction> GenerateRandomProgram(size_t size);
+
+// Generates μtext that pushes an i32 and an f64, adds them and pops the sum,
+// the given number of times, with different values each time. The parser and
+// assembler benchmarks use it.
+string GenerateArithmeticMutext(size_t repetitions);
+
+// Writes the instructions as .mu bytecode in the given format, for tests that
+// load it from memory.
+string WriteBytecode(span<const Instruction> instructions,
+                     BytecodeFormat format = BytecodeFormat::Plain);
+
+// A registered instruction that only records that it was called.
+extern bool MockInstructionCalled;
+void MockInstruction();
+extern InstructionMetadata MockInstructionMetadata;
+
 doctest::String toString(const Instruction& value);
@@ -0,0 +1,138 @@
+#include "Configuration.hpp"
+
+#include <memory>
+using std::make_unique;
+#include <vector>
+using std::vector;
+
+#include "InstructionProcessor.hpp"
+#include "TieredProgram.hpp"
+#include "ValueStack.hpp"
+
+// == Tiered Program ==
+//
+// Compiling a program costs far more than executing it once, so a tiered
+// program starts out in the interpreter, as a decoded program. Each execution
+// is counted, and once the count reaches the compile threshold the program is
+// compiled by the JIT, which executes it from then on. Programs that only run a
+// few times never pay for compilation.
+//
+// On platforms without a JIT the program stays in the interpreter. So does a
+// program the JIT could not compile, rather than paying to compile it again on
+// every execution.
+
+TieredProgram::TieredProgram(span<Instruction> instructions,
+                             TieringOptions options)
+    : m_instructions(instructions), m_options(options), m_executionCount(0),
+      m_decodedProgram(instructions), m_compileFailed(false) {}
+
+void TieredProgram::Execute() {
+  m_executionCount++;
+
+  if (m_jitProgram != nullptr) {
+    m_jitProgram->Execute();
+    return;
+  }
+
+  m_decodedProgram.Execute();
+
+  if (m_executionCount >= m_options.compileThreshold && IsJitAvailable() &&
+      !m_compileFailed) {
+    auto jitProgram = make_unique<JitProgram>(m_instructions);
+    if (jitProgram->IsCompiled())
+      m_jitProgram = std::move(jitProgram);
+    else
+      m_compileFailed = true;
+  }
+}
+
+Tier TieredProgram::GetTier() const {
+  return m_jitProgram != nullptr ? Tier::Jit : Tier::Interpreter;
+}
+
+uint32_t TieredProgram::GetExecutionCount() const { return m_executionCount; }
+
+TEST_CASE("Verify tiered program behavior") {
+  SUBCASE("A program starts in the interpreter") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    TieredProgram program(instructions, {.compileThreshold = 2});
+    CHECK(program.GetTier() == Tier::Interpreter);
+
+    program.Execute();
+    CHECK(program.GetTier() == Tier::Interpreter);
+    CHECK(Pop().i32() == 5);
+  }
+
+  SUBCASE("A program moves to the JIT at the compile threshold") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    TieredProgram program(instructions, {.compileThreshold = 2});
+    program.Execute();
+    program.Execute();
+    CHECK(program.GetExecutionCount() == 2);
+    CHECK(program.GetTier() ==
+          (IsJitAvailable() ? Tier::Jit : Tier::Interpreter));
+
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+    CHECK(Pop().i32() == 5);
+    CHECK(Pop().i32() == 5);
+  }
+
+  SUBCASE("Each tier produces the same results") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2},       {OpCode::Push, (int64_t)-3},
+        {OpCode::Add},           {OpCode::Push, 0.1f},
+        {OpCode::Subtract},      {OpCode::Push, 7},
+        {OpCode::Push, 1e100},   {OpCode::Pop},
+        {OpCode::Add}};
+    TieredProgram program(instructions, {.compileThreshold = 1});
+
+    program.Execute();
+    auto interpreted = Pop();
+    program.Execute();
+    auto compiled = Pop();
+
+    CHECK(compiled == interpreted);
+  }
+}
+
+TEST_CASE("Verify tiered program performance") {
+  vector<Instruction> instructions = {{OpCode::Push, 0}};
+  for (auto i = 0; i < 1000; i++) {
+    instructions.push_back({OpCode::Push, 43});
+    instructions.push_back({OpCode::Push, 42});
+    instructions.push_back({OpCode::Add});
+    instructions.push_back({OpCode::Push, 41});
+    instructions.push_back({OpCode::Subtract});
+    instructions.push_back({OpCode::Add});
+  }
+
+  DecodedProgram decodedProgram(instructions);
+  TieredProgram tieredProgram(instructions);
+
+  // Measure the tiered program once it has reached its last tier.
+  for (auto i = 0u; i < TieringOptions().compileThreshold; i++) {
+    tieredProgram.Execute();
+    Pop();
+  }
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(instructions.size());
+
+  b.run("Execute a decoded program", [&] {
+    decodedProgram.Execute();
+    Pop();
+  });
+
+  b.run("Execute a tiered program", [&] {
+    tieredProgram.Execute();
+    Pop();
+  });
+
+  b.run("Compile a JIT program", [&] {
+    JitProgram jitProgram(instructions);
+    ankerl::nanobench::doNotOptimizeAway(jitProgram);
+  });
+}
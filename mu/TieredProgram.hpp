@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+using std::unique_ptr;
+#include <span>
+using std::span;
+
+#include "Bytecode.hpp"
+#include "DecodedProgram.hpp"
+#include "Jit/JitProgram.hpp"
+
+enum class Tier { Interpreter, Jit };
+
+struct TieringOptions {
+  // The number of times the program executes in the interpreter before it is
+  // compiled.
+  uint32_t compileThreshold = 100;
+};
+
+class TieredProgram {
+public:
+  TieredProgram(span<Instruction> instructions, TieringOptions options = {});
+
+  void Execute();
+
+  Tier GetTier() const;
+  uint32_t GetExecutionCount() const;
+
+private:
+  span<Instruction> m_instructions;
+  TieringOptions m_options;
+  uint32_t m_executionCount;
+  DecodedProgram m_decodedProgram;
+  unique_ptr<JitProgram> m_jitProgram;
+  bool m_compileFailed;
+};
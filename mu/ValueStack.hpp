@@ -1,26 +1,39 @@
 #pragma once
 
+#include <cassert>
+#include <cstdint>
 #include <cstdlib>
-using std::malloc;
+using std::free;
 using std::realloc;
+#include <limits>
+using std::numeric_limits;
+#include <new>
+using std::bad_alloc;
 
 #include "Bytecode.hpp"
 
+// The stack is constant initialized and allocates its entries on the first
+// push, so each thread can have its own stack without any cost to set it up.
+//
+// The types of the entries are kept apart from their values, one byte each, and
+// the values are the eight bytes of an argument without its type (see
+// Argument::Bits). So an entry takes nine bytes instead of the sixteen of an
+// argument, a deep stack takes about half of the cache, and the types of the
+// operands of an instruction are next to each other, where they can be tested
+// at once.
 struct Stack {
 public:
-  Stack() : currentIndex(-1), reservedNumberOfEntries(20) {
-    values = (Argument*)malloc(reservedNumberOfEntries * sizeof(Argument));
-  }
+  constexpr Stack()
+      : types(nullptr), values(nullptr), currentIndex(-1),
+        reservedNumberOfEntries(0) {}
 
-  constexpr void push(Argument value) {
+  void push(Argument value) {
+    if (currentIndex + 1 >= reservedNumberOfEntries)
+      grow();
     currentIndex++;
-    if (currentIndex >= reservedNumberOfEntries) {
-      reservedNumberOfEntries *= 2;
-      values = (Argument*)realloc(values,
-                                  reservedNumberOfEntries * sizeof(Argument));
-    }
     assert(currentIndex < reservedNumberOfEntries);
-    values[currentIndex] = value;
+    types[currentIndex] = (uint8_t)value.Type();
+    values[currentIndex] = value.Bits();
   }
 
   constexpr void pop() {
@@ -28,24 +41,104 @@ public:
     currentIndex--;
   }
 
-  constexpr Argument top() { return values[currentIndex]; }
+  Argument top() { return peek(0); }
+
+  Argument peek(int depth) {
+    assert(depth <= currentIndex);
+    auto index = currentIndex - depth;
+    return Argument::FromBits((ArgumentType)types[index], values[index]);
+  }
 
   constexpr int size() { return currentIndex + 1; }
 
+  // Engines that keep the top of the stack in a register work on the entries
+  // directly, then resize the stack to match when they are done. The type and
+  // the value of an entry have the same index in each.
+  constexpr uint8_t* typeData() { return types; }
+  constexpr uint64_t* valueData() { return values; }
+
+  constexpr int capacity() { return reservedNumberOfEntries; }
+
+  // Throws bad_alloc if the entries cannot be allocated. The capacity only
+  // changes once both arrays have grown, so a stack that cannot grow keeps its
+  // entries.
+  void reserve(int numberOfEntries) {
+    if (numberOfEntries <= reservedNumberOfEntries)
+      return;
+    auto newTypes = (uint8_t*)realloc(types, numberOfEntries);
+    if (newTypes == nullptr)
+      throw bad_alloc();
+    types = newTypes;
+    auto newValues = (uint64_t*)realloc(
+        values, (size_t)numberOfEntries * sizeof(uint64_t));
+    if (newValues == nullptr)
+      throw bad_alloc();
+    values = newValues;
+    reservedNumberOfEntries = numberOfEntries;
+  }
+
+  void grow() {
+    auto maximumNumberOfEntries = numeric_limits<int>::max();
+    if (reservedNumberOfEntries == maximumNumberOfEntries)
+      throw bad_alloc();
+    if (reservedNumberOfEntries == 0)
+      reserve(20);
+    else if (reservedNumberOfEntries > maximumNumberOfEntries / 2)
+      reserve(maximumNumberOfEntries);
+    else
+      reserve(reservedNumberOfEntries * 2);
+  }
+
+  constexpr void resize(int size) {
+    assert(size >= 0 && size <= reservedNumberOfEntries);
+    currentIndex = size - 1;
+  }
+
+  // Frees the entries. The stack is empty afterwards, and can still be used.
+  void release() {
+    free(types);
+    free(values);
+    types = nullptr;
+    values = nullptr;
+    currentIndex = -1;
+    reservedNumberOfEntries = 0;
+  }
+
 private:
-  Argument* values;
+  uint8_t* types;
+  uint64_t* values;
   int currentIndex;
   int reservedNumberOfEntries;
 };
 
-extern Stack valueStack;
+// Each thread has its own value stack, so threads can execute programs at the
+// same time (see WorkStealingPool.hpp).
+extern thread_local constinit Stack valueStack;
 
-constexpr inline void Push(Argument value) { valueStack.push(value); }
+inline void ClearValueStack() { valueStack.resize(0); }
+
+// A VM context gives the thread that creates it an empty value stack, and frees
+// the value stack when the context is destroyed. Threads that execute programs
+// for a while and then exit use one, so their value stacks are not leaked.
+class VmContext {
+public:
+  VmContext() { ClearValueStack(); }
+  ~VmContext() { valueStack.release(); }
 
-constexpr inline Argument Pop() {
+  VmContext(const VmContext&) = delete;
+  VmContext& operator=(const VmContext&) = delete;
+};
+
+inline void Push(Argument value) { valueStack.push(value); }
+
+inline Argument Pop() {
   auto value = valueStack.top();
   valueStack.pop();
   return value;
 }
 
+// Returns the value `depth` entries below the top of the stack without removing
+// it, so Peek(0) is the top of the stack.
+inline Argument Peek(int depth) { return valueStack.peek(depth); }
+
 constexpr inline int StackSize() { return valueStack.size(); }
@@ -0,0 +1,683 @@
+#include "Configuration.hpp"
+
+#include <algorithm>
+using std::max;
+#include <array>
+using std::array;
+#include <thread>
+using std::thread;
+#include <utility>
+using std::move;
+#include <stdexcept>
+using std::logic_error;
+
+#include <fmt/core.h>
+using fmt::format;
+
+#include "DecodedProgram.hpp"
+#include "InstructionProcessor.hpp"
+#include "Interpreter/Interpreter.hpp"
+#include "ValueStack.hpp"
+#include "VerifiedProgram.hpp"
+#include "WorkStealingPool.hpp"
+
+// == Verified Program ==
+//
+// The value stack checks that it has room on every push and that it is not
+// empty on every pop, and each instruction checks the types of its operands.
+// A bad program only fails when execution reaches the bad instruction.
+//
+// The verifier does all of that once, before the program executes. It follows
+// the depth and the type of each value stack slot through the program, and
+// rejects a program that:
+//
+// * Pops from an empty stack. The program must not depend on values that were
+//   on the stack before it started.
+// * Uses an opcode that has no instruction.
+// * Uses an instruction without an evaluate function, since the verifier cannot
+//   know how it changes the stack.
+// * Applies an operation to types it has no result for.
+//
+// A verified program executes on its own stack, preallocated to the exact
+// maximum depth the verifier found, without any of those checks. Each
+// operation uses the evaluate function for the types of its operands. When the
+// program is done, the values left on its stack are pushed on to the value
+// stack, so it holds the same values as it would after the instruction
+// processor.
+//
+// A program that continues from values already on the stack is given their
+// types. It only follows the values it pops from below its own, its inputs, so
+// verifying it takes no longer however deep the stack is, and it only moves
+// its inputs to its own stack before it executes. Streamed μtext executes this
+// way, one batch of instructions at a time.
+//
+// The program refers to the instructions it was verified from, so they must
+// outlive it. If an instruction is registered after verifying, the program is
+// verified again before it next executes.
+//
+// What the verifier finds is the program's analysis: its maximum stack depth,
+// the operand types of each instruction, and where the stack is empty. An
+// analyzed .mu file stores it, and a program loaded from one is checked
+// against it rather than analyzed. The check still follows every stack slot,
+// since a file that is wrong must not make the VM read outside its stack, but
+// it writes nothing for each instruction, and the blocks between the places
+// the stack is empty are checked in parallel.
+
+static string GetTypeName(ArgumentType type) {
+  switch (type) {
+  case ArgumentType::i32:
+    return "i32";
+  case ArgumentType::i64:
+    return "i64";
+  case ArgumentType::f32:
+    return "f32";
+  case ArgumentType::f64:
+    return "f64";
+  case ArgumentType::b:
+    return "bool";
+  case ArgumentType::c:
+    return "char";
+  default:
+    return "empty";
+  }
+}
+
+// An analysis of a smaller program is checked on one thread, as starting the
+// threads would take longer than checking it.
+static const size_t ParallelCheckSize = 1024 * 1024;
+
+namespace {
+struct Specialization {
+  EvaluateInstructionFunc evaluate;
+  ArgumentType resultType;
+};
+
+typedef array<array<Specialization, 256>, NumberOfOpCodes> SpecializationTable;
+} // namespace
+
+// Each thread keeps the specialization of every instruction for every pair of
+// operand types, indexed by the packed operand types, so neither verifying nor
+// executing looks them up in the registry. They are found again when an
+// instruction is registered.
+static const SpecializationTable& GetSpecializations() {
+  thread_local SpecializationTable specializations;
+  thread_local bool found = false;
+  thread_local uint32_t registryVersion;
+  if (found && registryVersion == GetInstructionRegistryVersion())
+    return specializations;
+
+  for (size_t opCode = 0; opCode < NumberOfOpCodes; opCode++) {
+    for (size_t left = 1; left < NumberOfArgumentTypes; left++) {
+      for (size_t right = 1; right < NumberOfArgumentTypes; right++) {
+        auto leftType = (ArgumentType)left;
+        auto rightType = (ArgumentType)right;
+        auto& specialization =
+            specializations[opCode][PackOperandTypes(leftType, rightType)];
+        specialization.resultType = ArgumentType::None;
+        specialization.evaluate = SpecializeInstruction(
+            (OpCode)opCode, leftType, rightType, specialization.resultType);
+      }
+    }
+  }
+  found = true;
+  registryVersion = GetInstructionRegistryVersion();
+  return specializations;
+}
+
+VerifiedProgram::VerifiedProgram(span<Instruction> instructions)
+    : VerifiedProgram(instructions, {}, 0) {}
+
+VerifiedProgram::VerifiedProgram(span<Instruction> instructions,
+                                 span<const ArgumentType> stackTypes,
+                                 size_t firstIndex)
+    : m_instructions(instructions), m_stackTypes(stackTypes),
+      m_firstIndex(firstIndex), m_analysis(nullptr) {
+  Verify();
+}
+
+VerifiedProgram::VerifiedProgram(span<Instruction> instructions,
+                                 const ProgramAnalysis& analysis)
+    : m_instructions(instructions), m_firstIndex(0), m_analysis(&analysis) {
+  Verify();
+}
+
+bool VerifiedProgram::IsVerified() const {
+  return m_errorCondition == ErrorCondition::NoError;
+}
+
+string VerifiedProgram::GetErrorMessage() const {
+  auto index = m_firstIndex + m_errorIndex;
+  if (m_errorCondition == ErrorCondition::StackUnderflow)
+    return format("Instruction {} pops from an empty stack.", index);
+  if (m_errorCondition == ErrorCondition::UnexpectedOpCode)
+    return format("Instruction {} has an unexpected opcode: {}.", index,
+                  (int)m_instructions[m_errorIndex].opCode);
+  if (m_errorCondition == ErrorCondition::UnknownStackEffect)
+    return format("Instruction {} ({}) cannot be verified, as its effect on "
+                  "the stack is unknown.",
+                  index, m_instructions[m_errorIndex].opCode);
+  if (m_errorCondition == ErrorCondition::InvalidOperandTypes)
+    return format("Instruction {} ({}) has no result for {} and {} operands.",
+                  index, m_instructions[m_errorIndex].opCode,
+                  GetTypeName(m_errorTypes[0]), GetTypeName(m_errorTypes[1]));
+  if (m_errorCondition == ErrorCondition::AnalysisMismatch)
+    return format("Instruction {} does not match the analysis of the program.",
+                  index);
+  return "";
+}
+
+size_t VerifiedProgram::GetMaximumStackDepth() const {
+  return m_maximumStackDepth;
+}
+
+size_t VerifiedProgram::GetNumberOfInputs() const { return m_numberOfInputs; }
+
+span<const ArgumentType> VerifiedProgram::GetResultTypes() const {
+  return m_resultTypes;
+}
+
+span<const uint8_t> VerifiedProgram::GetOperandTypes() const {
+  if (m_analysis != nullptr)
+    return m_analysis->operandTypes;
+  return m_operandTypes;
+}
+
+void VerifiedProgram::Execute() {
+  if (m_registryVersion != GetInstructionRegistryVersion())
+    Verify();
+
+  if (!IsVerified())
+    throw logic_error(GetErrorMessage());
+
+  auto stack = m_stack.data();
+  auto top = stack + m_numberOfInputs;
+  for (auto value = top; value != stack;)
+    *--value = Pop();
+
+  auto& specializations = GetSpecializations();
+  auto operandTypes = GetOperandTypes().data();
+  for (size_t i = 0; i < m_instructions.size(); i++) {
+    auto& instruction = m_instructions[i];
+    switch (instruction.opCode) {
+    case OpCode::Push:
+      *top++ = instruction.argument;
+      break;
+    case OpCode::Pop:
+      top--;
+      break;
+    default:
+      top[-2] = specializations[(size_t)instruction.opCode][operandTypes[i]]
+                    .evaluate(top[-2], top[-1]);
+      top--;
+      break;
+    }
+  }
+
+  for (auto value = stack; value != top; value++)
+    Push(*value);
+}
+
+void VerifiedProgram::Verify() {
+  m_registryVersion = GetInstructionRegistryVersion();
+  m_operandTypes.clear();
+  m_stack.clear();
+  m_resultTypes.clear();
+  m_errorCondition = ErrorCondition::NoError;
+  if (m_analysis != nullptr)
+    return CheckAnalysis();
+
+  Verification verification;
+  m_operandTypes.reserve(m_instructions.size());
+  VerifyRange(0, m_instructions.size(), verification);
+  if (verification.errorCondition != ErrorCondition::NoError)
+    return Fail(verification);
+
+  m_maximumStackDepth = verification.maximumStackDepth;
+  m_numberOfInputs = verification.numberOfInputs;
+  m_stack.resize(m_maximumStackDepth);
+  m_resultTypes = move(verification.types);
+}
+
+// Each block starts with an empty stack, so the blocks of a large program are
+// checked on all of the cores. An error is reported from the first block that
+// has one, so it is the same error as checking the blocks in order finds.
+void VerifiedProgram::CheckAnalysis() {
+  auto boundaries = m_analysis->blockBoundaries;
+  auto numberOfInstructions = m_instructions.size();
+  m_maximumStackDepth = 0;
+  m_numberOfInputs = 0;
+  Verification mismatch;
+  mismatch.errorCondition = ErrorCondition::AnalysisMismatch;
+  if (m_analysis->operandTypes.size() != numberOfInstructions)
+    return Fail(mismatch);
+  for (size_t i = 0; i < boundaries.size(); i++) {
+    auto previous = i == 0 ? 0 : boundaries[i - 1];
+    if (boundaries[i] <= previous || boundaries[i] >= numberOfInstructions)
+      return Fail(mismatch);
+  }
+
+  auto numberOfBlocks = boundaries.size() + 1;
+  vector<Verification> blocks(numberOfBlocks);
+  auto checkBlock = [&](size_t block) {
+    auto begin = block == 0 ? 0 : boundaries[block - 1];
+    auto end = block + 1 == numberOfBlocks ? numberOfInstructions
+                                           : boundaries[block];
+    auto& verification = blocks[block];
+    VerifyRange(begin, end, verification);
+    if (verification.errorCondition == ErrorCondition::NoError &&
+        block + 1 != numberOfBlocks && !verification.types.empty()) {
+      verification.errorCondition = ErrorCondition::AnalysisMismatch;
+      verification.errorIndex = end;
+    }
+  };
+
+  if (numberOfBlocks > 1 && numberOfInstructions >= ParallelCheckSize &&
+      thread::hardware_concurrency() > 1) {
+    WorkStealingPool().Run(numberOfBlocks, checkBlock);
+  } else {
+    for (size_t block = 0; block < numberOfBlocks; block++) {
+      checkBlock(block);
+      if (blocks[block].errorCondition != ErrorCondition::NoError)
+        break;
+    }
+  }
+
+  for (auto& verification : blocks) {
+    if (verification.errorCondition != ErrorCondition::NoError)
+      return Fail(verification);
+    m_maximumStackDepth =
+        max(m_maximumStackDepth, verification.maximumStackDepth);
+  }
+  m_stack.resize(m_maximumStackDepth);
+  m_resultTypes = move(blocks.back().types);
+}
+
+// Follows the depth and the type of each stack slot through the instructions.
+// Without an analysis, it records the operand types of each instruction, and
+// with one, it checks them.
+//
+// A value popped from below the types followed so far is the next input, taken
+// from the top of the stack types the program continues from. Every depth seen
+// before it was one deeper, since the input was under it.
+void VerifiedProgram::VerifyRange(size_t begin, size_t end,
+                                  Verification& verification) {
+  auto& specializations = GetSpecializations();
+  auto& types = verification.types;
+  auto fail = [&](ErrorCondition condition, size_t index) {
+    verification.errorCondition = condition;
+    verification.errorIndex = index;
+  };
+  auto available = [&] {
+    return types.size() + m_stackTypes.size() - verification.numberOfInputs;
+  };
+  auto pop = [&] {
+    if (!types.empty()) {
+      auto type = types.back();
+      types.pop_back();
+      return type;
+    }
+    verification.numberOfInputs++;
+    verification.maximumStackDepth++;
+    return m_stackTypes[m_stackTypes.size() - verification.numberOfInputs];
+  };
+
+  for (size_t i = begin; i < end; i++) {
+    auto& instruction = m_instructions[i];
+    auto opCode = instruction.opCode;
+    uint8_t operandTypes = 0;
+    if (opCode == OpCode::Push) {
+      types.push_back(instruction.argument.Type());
+      verification.maximumStackDepth =
+          max(verification.maximumStackDepth, types.size());
+    } else if (opCode == OpCode::Pop) {
+      if (available() == 0)
+        return fail(ErrorCondition::StackUnderflow, i);
+      pop();
+    } else {
+      if (!HasInstruction(opCode))
+        return fail(ErrorCondition::UnexpectedOpCode, i);
+      if (GetInstructionMetadata(opCode).evaluate == nullptr)
+        return fail(ErrorCondition::UnknownStackEffect, i);
+      if (available() < 2)
+        return fail(ErrorCondition::StackUnderflow, i);
+
+      auto right = pop();
+      auto left = pop();
+
+      operandTypes = PackOperandTypes(left, right);
+      auto& specialization = specializations[(size_t)opCode][operandTypes];
+      if ((size_t)left >= NumberOfArgumentTypes ||
+          (size_t)right >= NumberOfArgumentTypes ||
+          specialization.evaluate == nullptr) {
+        verification.errorTypes[0] = left;
+        verification.errorTypes[1] = right;
+        return fail(ErrorCondition::InvalidOperandTypes, i);
+      }
+      types.push_back(specialization.resultType);
+    }
+
+    if (m_analysis == nullptr)
+      m_operandTypes.push_back(operandTypes);
+    else if (m_analysis->operandTypes[i] != operandTypes ||
+             types.size() > m_analysis->maximumStackDepth)
+      return fail(ErrorCondition::AnalysisMismatch, i);
+  }
+}
+
+void VerifiedProgram::Fail(const Verification& verification) {
+  m_errorCondition = verification.errorCondition;
+  m_errorIndex = verification.errorIndex;
+  m_errorTypes[0] = verification.errorTypes[0];
+  m_errorTypes[1] = verification.errorTypes[1];
+  m_operandTypes.clear();
+}
+
+TEST_CASE("Verify verified program behavior") {
+  SUBCASE("Push two values and add") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    VerifiedProgram program(instructions);
+    REQUIRE(program.IsVerified());
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+  }
+
+  SUBCASE("Push three values, pop one and subtract") {
+    Instruction instructions[] = {{OpCode::Push, 2},
+                                  {OpCode::Push, 3},
+                                  {OpCode::Push, 8},
+                                  {OpCode::Pop},
+                                  {OpCode::Subtract}};
+    VerifiedProgram program(instructions);
+    REQUIRE(program.IsVerified());
+    program.Execute();
+    CHECK(Pop().i32() == -1);
+  }
+
+  SUBCASE("A program can be executed more than once") {
+    Instruction instructions[] = {
+        {OpCode::Push, 40}, {OpCode::Push, 2}, {OpCode::Add}};
+    VerifiedProgram program(instructions);
+    program.Execute();
+    program.Execute();
+    CHECK(Pop().i32() == 42);
+    CHECK(Pop().i32() == 42);
+  }
+
+  SUBCASE("Values left on the stack are pushed in order") {
+    Instruction instructions[] = {{OpCode::Push, 1},
+                                  {OpCode::Push, 2.5},
+                                  {OpCode::Push, (int64_t)3},
+                                  {OpCode::Push, 4.5f},
+                                  {OpCode::Subtract}};
+    VerifiedProgram program(instructions);
+    program.Execute();
+    CHECK(Pop() == Argument(-1.5f));
+    CHECK(Pop() == Argument(2.5));
+    CHECK(Pop() == Argument(1));
+  }
+
+  SUBCASE("The maximum stack depth is exact") {
+    Instruction instructions[] = {{OpCode::Push, 1}, {OpCode::Push, 2},
+                                  {OpCode::Add},     {OpCode::Push, 3},
+                                  {OpCode::Push, 4}, {OpCode::Push, 5},
+                                  {OpCode::Pop},     {OpCode::Subtract}};
+    VerifiedProgram program(instructions);
+    CHECK(program.GetMaximumStackDepth() == 4);
+  }
+
+  SUBCASE("An empty program is verified") {
+    auto stackSize = StackSize();
+    VerifiedProgram program(span<Instruction>{});
+    CHECK(program.IsVerified());
+    CHECK(program.GetMaximumStackDepth() == 0);
+    program.Execute();
+    CHECK(StackSize() == stackSize);
+  }
+
+  SUBCASE("Popping from an empty stack is rejected") {
+    Instruction instructions[] = {
+        {OpCode::Push, 1}, {OpCode::Pop}, {OpCode::Pop}};
+    VerifiedProgram program(instructions);
+    CHECK_FALSE(program.IsVerified());
+    CHECK(program.GetErrorMessage() ==
+          "Instruction 2 pops from an empty stack.");
+  }
+
+  SUBCASE("An operation without enough operands is rejected") {
+    Instruction instructions[] = {{OpCode::Push, 1}, {OpCode::Add}};
+    VerifiedProgram program(instructions);
+    CHECK_FALSE(program.IsVerified());
+    CHECK(program.GetErrorMessage() ==
+          "Instruction 1 pops from an empty stack.");
+  }
+
+  SUBCASE("An unexpected opcode is rejected") {
+    Instruction instructions[] = {{OpCode::Push, 1}, {(OpCode)42}};
+    VerifiedProgram program(instructions);
+    CHECK_FALSE(program.IsVerified());
+    CHECK(program.GetErrorMessage() ==
+          "Instruction 1 has an unexpected opcode: 42.");
+  }
+
+  SUBCASE("Operands without a result are rejected") {
+    Instruction instructions[] = {
+        {OpCode::Push, 1}, {OpCode::Push, true}, {OpCode::Subtract}};
+    VerifiedProgram program(instructions);
+    CHECK_FALSE(program.IsVerified());
+    CHECK(program.GetErrorMessage() ==
+          "Instruction 2 (Subtract) has no result for i32 and bool operands.");
+  }
+
+  SUBCASE("Result types are followed through the program") {
+    Instruction instructions[] = {{OpCode::Push, 1},   {OpCode::Push, 2.5f},
+                                  {OpCode::Add},       {OpCode::Push, 'a'},
+                                  {OpCode::Subtract}};
+    VerifiedProgram program(instructions);
+    CHECK(program.GetErrorMessage() ==
+          "Instruction 4 (Subtract) has no result for f32 and char operands.");
+  }
+
+  SUBCASE("An instruction without an evaluate function is rejected") {
+    auto metadata = GetInstructionMetadata(OpCode::Nop);
+    RegisterInstruction(OpCode::Nop, {.execute = [] {}, .name = "Nop"});
+
+    Instruction instructions[] = {{OpCode::Nop}};
+    VerifiedProgram program(instructions);
+    CHECK(program.GetErrorMessage() ==
+          "Instruction 0 (Nop) cannot be verified, as its effect on the stack "
+          "is unknown.");
+
+    RegisterInstruction(OpCode::Nop, metadata);
+  }
+
+  SUBCASE("Executing a program that is not verified is an error") {
+    auto stackSize = StackSize();
+    Instruction instructions[] = {{OpCode::Push, 1}, {(OpCode)42}};
+    VerifiedProgram program(instructions);
+    CHECK_THROWS_AS(program.Execute(), logic_error);
+    CHECK(StackSize() == stackSize);
+  }
+
+  SUBCASE("A program is verified again after an instruction is registered") {
+    Instruction instructions[] = {
+        {OpCode::Push, 2}, {OpCode::Push, 3}, {OpCode::Add}};
+    VerifiedProgram program(instructions);
+
+    RegisterInstruction(OpCode::Add, {.execute = [] {}, .name = "Add"});
+    CHECK_THROWS_AS(program.Execute(), logic_error);
+
+    RegisterInstruction(OpCode::Add, GetAddMetadata());
+    program.Execute();
+    CHECK(Pop().i32() == 5);
+  }
+
+  SUBCASE("A program continues from the values an earlier one left") {
+    auto stackSize = StackSize();
+    Instruction first[] = {{OpCode::Push, 2}, {OpCode::Push, 3.5}};
+    VerifiedProgram firstProgram(first);
+    REQUIRE(firstProgram.IsVerified());
+    REQUIRE(firstProgram.GetResultTypes().size() == 2);
+    CHECK(firstProgram.GetResultTypes()[1] == ArgumentType::f64);
+    firstProgram.Execute();
+
+    Instruction second[] = {{OpCode::Push, 1.0}, {OpCode::Add}, {OpCode::Pop}};
+    VerifiedProgram secondProgram(second, firstProgram.GetResultTypes(), 2);
+    REQUIRE(secondProgram.IsVerified());
+    CHECK(secondProgram.GetNumberOfInputs() == 1);
+    CHECK(secondProgram.GetMaximumStackDepth() == 2);
+    CHECK(secondProgram.GetResultTypes().empty());
+    secondProgram.Execute();
+    CHECK(StackSize() == stackSize + 1);
+    CHECK(Pop().i32() == 2);
+
+    Instruction third[] = {{OpCode::Pop}, {OpCode::Pop}};
+    ArgumentType stackTypes[] = {ArgumentType::i32};
+    VerifiedProgram thirdProgram(third, stackTypes, 10);
+    CHECK(thirdProgram.GetErrorMessage() ==
+          "Instruction 11 pops from an empty stack.");
+  }
+
+  SUBCASE("A program only follows the values it takes from below its own") {
+    vector<ArgumentType> stackTypes(100000, ArgumentType::i32);
+    stackTypes.back() = ArgumentType::f64;
+    Instruction instructions[] = {{OpCode::Push, 1},  {OpCode::Push, 2},
+                                  {OpCode::Pop},      {OpCode::Add},
+                                  {OpCode::Subtract}, {OpCode::Push, 'a'}};
+    VerifiedProgram program(instructions, stackTypes, 0);
+    REQUIRE(program.IsVerified());
+    CHECK(program.GetNumberOfInputs() == 2);
+    CHECK(program.GetMaximumStackDepth() == 4);
+    auto resultTypes = program.GetResultTypes();
+    REQUIRE(resultTypes.size() == 2);
+    CHECK(resultTypes[0] == ArgumentType::f64);
+    CHECK(resultTypes[1] == ArgumentType::c);
+
+    auto stackSize = StackSize();
+    Push(7);
+    Push(0.5);
+    program.Execute();
+    CHECK(StackSize() == stackSize + 2);
+    CHECK(Pop().c() == 'a');
+    CHECK(Pop() == Argument(5.5));
+  }
+
+  SUBCASE("A program is checked against its analysis") {
+    Instruction instructions[] = {{OpCode::Push, 1}, {OpCode::Push, 2.5f},
+                                  {OpCode::Add},     {OpCode::Pop},
+                                  {OpCode::Push, 3}, {OpCode::Push, 4},
+                                  {OpCode::Subtract}};
+    VerifiedProgram analyzed(instructions);
+    REQUIRE(analyzed.IsVerified());
+    auto operandTypes = analyzed.GetOperandTypes();
+    REQUIRE(operandTypes.size() == 7);
+    CHECK(operandTypes[2] ==
+          PackOperandTypes(ArgumentType::i32, ArgumentType::f32));
+    CHECK(operandTypes[0] == 0);
+
+    uint64_t boundaries[] = {4};
+    ProgramAnalysis analysis;
+    analysis.maximumStackDepth = analyzed.GetMaximumStackDepth();
+    analysis.operandTypes = operandTypes;
+    analysis.blockBoundaries = boundaries;
+    VerifiedProgram program(instructions, analysis);
+    REQUIRE(program.IsVerified());
+    CHECK(program.GetMaximumStackDepth() == 2);
+    program.Execute();
+    CHECK(Pop().i32() == -1);
+  }
+
+  SUBCASE("An analysis that does not match the program is rejected") {
+    Instruction instructions[] = {{OpCode::Push, 1},
+                                  {OpCode::Push, 2},
+                                  {OpCode::Add},
+                                  {OpCode::Push, 3},
+                                  {OpCode::Subtract}};
+    uint8_t operandTypes[] = {
+        0, 0, PackOperandTypes(ArgumentType::i32, ArgumentType::i32), 0,
+        PackOperandTypes(ArgumentType::i32, ArgumentType::i32)};
+    ProgramAnalysis analysis;
+    analysis.maximumStackDepth = 2;
+    analysis.operandTypes = operandTypes;
+    CHECK(VerifiedProgram(instructions, analysis).IsVerified());
+
+    operandTypes[4] = PackOperandTypes(ArgumentType::f64, ArgumentType::i32);
+    VerifiedProgram wrongTypes(instructions, analysis);
+    CHECK(wrongTypes.GetErrorMessage() ==
+          "Instruction 4 does not match the analysis of the program.");
+    operandTypes[4] = operandTypes[2];
+
+    analysis.maximumStackDepth = 1;
+    CHECK_FALSE(VerifiedProgram(instructions, analysis).IsVerified());
+    analysis.maximumStackDepth = 2;
+
+    // The stack is not empty before instruction 3.
+    uint64_t boundaries[] = {3};
+    analysis.blockBoundaries = boundaries;
+    VerifiedProgram wrongBoundary(instructions, analysis);
+    CHECK(wrongBoundary.GetErrorMessage() ==
+          "Instruction 3 does not match the analysis of the program.");
+
+    analysis.blockBoundaries = {};
+    analysis.operandTypes = span(operandTypes).first(4);
+    CHECK_FALSE(VerifiedProgram(instructions, analysis).IsVerified());
+  }
+
+  SUBCASE("The blocks of a large analyzed program are checked in parallel") {
+    vector<Instruction> instructions;
+    vector<uint64_t> boundaries;
+    for (size_t i = 0; i < ParallelCheckSize / 2; i++) {
+      if (i % 1000 == 0 && i != 0)
+        boundaries.push_back(instructions.size());
+      instructions.push_back({OpCode::Push, 1});
+      instructions.push_back({OpCode::Pop});
+    }
+    instructions.push_back({OpCode::Pop});
+
+    vector<uint8_t> operandTypes(instructions.size());
+    ProgramAnalysis analysis;
+    analysis.maximumStackDepth = 1;
+    analysis.operandTypes = operandTypes;
+    analysis.blockBoundaries = boundaries;
+    VerifiedProgram program(instructions, analysis);
+    CHECK(program.GetErrorMessage() ==
+          format("Instruction {} pops from an empty stack.",
+                 ParallelCheckSize));
+  }
+}
+
+TEST_CASE("Verify verified program performance") {
+  vector<Instruction> instructions;
+  for (auto i = 0; i < 1000; i++) {
+    instructions.push_back({OpCode::Push, 43});
+    instructions.push_back({OpCode::Push, 42});
+    instructions.push_back({OpCode::Add});
+    instructions.push_back({OpCode::Pop});
+  }
+
+  DecodedProgram decodedProgram(instructions);
+  VerifiedProgram verifiedProgram(instructions);
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName()).relative(true).batch(instructions.size());
+
+  b.run("Process with the direct-threaded engine",
+        [&] { Process(instructions, Engine::DirectThreaded); });
+
+  b.run("Execute a decoded program", [&] { decodedProgram.Execute(); });
+
+  b.run("Execute a verified program", [&] { verifiedProgram.Execute(); });
+
+  b.run("Verify a program", [&] {
+    VerifiedProgram program(instructions);
+    ankerl::nanobench::doNotOptimizeAway(program);
+  });
+
+  ProgramAnalysis analysis;
+  analysis.maximumStackDepth = verifiedProgram.GetMaximumStackDepth();
+  analysis.operandTypes = verifiedProgram.GetOperandTypes();
+  b.run("Check a program against its analysis", [&] {
+    VerifiedProgram program(instructions, analysis);
+    ankerl::nanobench::doNotOptimizeAway(program);
+  });
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+using std::span;
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+
+#include "Bytecode.hpp"
+
+// The results of verifying a program. An analyzed .mu file carries them, so a
+// program that is loaded from one is only checked against them.
+struct ProgramAnalysis {
+  size_t maximumStackDepth = 0;
+
+  // For each instruction, the types of the operands of a binary operation,
+  // packed by PackOperandTypes, or zero for any other instruction.
+  span<const uint8_t> operandTypes;
+
+  // The instructions the stack is empty before, in order. The program can be
+  // split at each of them and the blocks checked independently.
+  span<const uint64_t> blockBoundaries;
+};
+
+class VerifiedProgram {
+public:
+  VerifiedProgram(span<Instruction> instructions);
+
+  // A program can continue from the values an earlier one left on the stack,
+  // given their types from the bottom of the stack up. Only the values the
+  // program pops are looked at, and the types must outlive the program, as the
+  // instructions do. The error messages count instructions from firstIndex.
+  VerifiedProgram(span<Instruction> instructions,
+                  span<const ArgumentType> stackTypes, size_t firstIndex);
+
+  // The program is checked against the analysis instead of being analyzed,
+  // which allocates nothing for each instruction. The analysis must outlive
+  // the program, as the instructions do.
+  VerifiedProgram(span<Instruction> instructions,
+                  const ProgramAnalysis& analysis);
+
+  bool IsVerified() const;
+  string GetErrorMessage() const;
+
+  // The maximum depth of the program's own stack, counting the values it takes
+  // from the stack it continues from.
+  size_t GetMaximumStackDepth() const;
+
+  // The number of values the program takes from the top of the stack it
+  // continues from, which is zero for a program that starts from an empty one.
+  size_t GetNumberOfInputs() const;
+
+  // The types of the values the program leaves on the stack in place of its
+  // inputs, from the bottom of the stack up.
+  span<const ArgumentType> GetResultTypes() const;
+
+  // The operand types of each instruction, as a ProgramAnalysis has them.
+  span<const uint8_t> GetOperandTypes() const;
+
+  // The program must be verified before it executes.
+  void Execute();
+
+private:
+  span<Instruction> m_instructions;
+  span<const ArgumentType> m_stackTypes;
+  size_t m_firstIndex;
+  const ProgramAnalysis* m_analysis;
+  vector<ArgumentType> m_resultTypes;
+  uint32_t m_registryVersion;
+  vector<uint8_t> m_operandTypes;
+  vector<Argument> m_stack;
+  size_t m_maximumStackDepth;
+  size_t m_numberOfInputs;
+
+  enum class ErrorCondition {
+    NoError,
+    StackUnderflow,
+    UnexpectedOpCode,
+    UnknownStackEffect,
+    InvalidOperandTypes,
+    AnalysisMismatch
+  };
+  ErrorCondition m_errorCondition;
+  size_t m_errorIndex;
+  ArgumentType m_errorTypes[2];
+
+  // The state of verifying a range of the instructions. The types are of the
+  // values above the inputs taken so far.
+  struct Verification {
+    vector<ArgumentType> types;
+    size_t numberOfInputs = 0;
+    size_t maximumStackDepth = 0;
+    ErrorCondition errorCondition = ErrorCondition::NoError;
+    size_t errorIndex = 0;
+    ArgumentType errorTypes[2] = {};
+  };
+
+  void Verify();
+  void CheckAnalysis();
+  void VerifyRange(size_t begin, size_t end, Verification& verification);
+  void Fail(const Verification& verification);
+};
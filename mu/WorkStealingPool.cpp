@@ -0,0 +1,225 @@
+#include "Configuration.hpp"
+
+#include <algorithm>
+using std::max;
+#include <chrono>
+using std::chrono::milliseconds;
+#include <deque>
+using std::deque;
+#include <exception>
+using std::current_exception;
+using std::exception_ptr;
+using std::rethrow_exception;
+#include <mutex>
+using std::lock_guard;
+using std::mutex;
+#include <stdexcept>
+using std::logic_error;
+#include <thread>
+using std::thread;
+using std::this_thread::sleep_for;
+#include <vector>
+using std::vector;
+
+#include "InstructionProcessor.hpp"
+#include "Interpreter/Interpreter.hpp"
+#include "ValueStack.hpp"
+#include "WorkStealingPool.hpp"
+
+// == Work Stealing Pool ==
+//
+// The value stack is the whole state of the VM, and each thread has its own,
+// so programs on different threads execute independently. The pool runs a batch
+// of jobs, such as one program per file, on all of the cores.
+//
+// The jobs are split into one contiguous range for each thread up front. Each
+// thread takes jobs from the front of its own range, so it runs them in order
+// with no contention. A thread that runs out of jobs steals from the back of
+// the range of another thread, so threads that get short jobs help the ones
+// that get long jobs, and all of them finish at about the same time.
+//
+// No jobs are added during a run, so a thread that finds no jobs in any range
+// is done.
+
+namespace {
+struct WorkQueue {
+  mutex lock;
+  deque<size_t> jobs;
+
+  bool TryTakeFront(size_t& job) {
+    lock_guard<mutex> guard(lock);
+    if (jobs.empty())
+      return false;
+    job = jobs.front();
+    jobs.pop_front();
+    return true;
+  }
+
+  bool TryTakeBack(size_t& job) {
+    lock_guard<mutex> guard(lock);
+    if (jobs.empty())
+      return false;
+    job = jobs.back();
+    jobs.pop_back();
+    return true;
+  }
+};
+} // namespace
+
+WorkStealingPool::WorkStealingPool(size_t numberOfThreads)
+    : m_numberOfThreads(numberOfThreads), m_numberOfStolenJobs(0) {
+  if (m_numberOfThreads == 0)
+    m_numberOfThreads = max(thread::hardware_concurrency(), 1u);
+}
+
+size_t WorkStealingPool::GetNumberOfThreads() const {
+  return m_numberOfThreads;
+}
+
+void WorkStealingPool::Run(size_t numberOfJobs,
+                           const function<void(size_t)>& job) {
+  m_numberOfStolenJobs = 0;
+
+  vector<WorkQueue> queues(m_numberOfThreads);
+  for (size_t i = 0; i < m_numberOfThreads; i++) {
+    auto begin = numberOfJobs * i / m_numberOfThreads;
+    auto end = numberOfJobs * (i + 1) / m_numberOfThreads;
+    for (auto j = begin; j < end; j++)
+      queues[i].jobs.push_back(j);
+  }
+
+  mutex exceptionLock;
+  exception_ptr firstException;
+
+  auto work = [&](size_t self) {
+    VmContext context;
+    for (;;) {
+      size_t next;
+      if (!queues[self].TryTakeFront(next)) {
+        auto stolen = false;
+        for (size_t i = 1; i < m_numberOfThreads && !stolen; i++)
+          stolen = queues[(self + i) % m_numberOfThreads].TryTakeBack(next);
+        if (!stolen)
+          return;
+        m_numberOfStolenJobs++;
+      }
+
+      try {
+        job(next);
+      } catch (...) {
+        lock_guard<mutex> guard(exceptionLock);
+        if (!firstException)
+          firstException = current_exception();
+      }
+    }
+  };
+
+  vector<thread> threads;
+  for (size_t i = 0; i < m_numberOfThreads; i++)
+    threads.emplace_back(work, i);
+  for (auto& thread : threads)
+    thread.join();
+
+  if (firstException)
+    rethrow_exception(firstException);
+}
+
+size_t WorkStealingPool::GetNumberOfStolenJobs() const {
+  return m_numberOfStolenJobs;
+}
+
+TEST_CASE("Verify work stealing pool behavior") {
+  SUBCASE("Every job runs once") {
+    WorkStealingPool pool(4);
+    vector<atomic<int>> runs(1000);
+    pool.Run(runs.size(), [&](size_t job) { runs[job]++; });
+    for (auto& count : runs)
+      CHECK(count == 1);
+  }
+
+  SUBCASE("Zero threads means one for each core") {
+    WorkStealingPool pool;
+    CHECK(pool.GetNumberOfThreads() >= 1);
+  }
+
+  SUBCASE("Running no jobs does nothing") {
+    WorkStealingPool pool(2);
+    pool.Run(0, [](size_t) { FAIL("No job should run"); });
+    CHECK(pool.GetNumberOfStolenJobs() == 0);
+  }
+
+  SUBCASE("Jobs are stolen from a thread that is busy") {
+    // The first job waits until every other job is done, so the thread that
+    // takes it cannot run the rest of its range itself.
+    WorkStealingPool pool(4);
+    const size_t numberOfJobs = 100;
+    atomic<size_t> done = 0;
+    pool.Run(numberOfJobs, [&](size_t job) {
+      if (job == 0) {
+        while (done < numberOfJobs - 1)
+          sleep_for(milliseconds(1));
+      }
+      done++;
+    });
+    CHECK(done == numberOfJobs);
+    CHECK(pool.GetNumberOfStolenJobs() > 0);
+  }
+
+  SUBCASE("Each job executes a program on the value stack of its thread") {
+    WorkStealingPool pool(4);
+    vector<int32_t> results(200);
+    pool.Run(results.size(), [&](size_t job) {
+      Instruction instructions[] = {{OpCode::Push, (int32_t)job},
+                                    {OpCode::Push, 1000},
+                                    {OpCode::Add},
+                                    {OpCode::Push, 1},
+                                    {OpCode::Subtract}};
+      Process(instructions, Engine::DirectThreaded);
+      results[job] = Pop().i32();
+    });
+    for (size_t job = 0; job < results.size(); job++)
+      CHECK(results[job] == (int32_t)job + 999);
+  }
+
+  SUBCASE("The first exception is rethrown after every job runs") {
+    WorkStealingPool pool(3);
+    atomic<int> runs = 0;
+    CHECK_THROWS_AS(pool.Run(30,
+                             [&](size_t job) {
+                               runs++;
+                               if (job % 10 == 5)
+                                 throw logic_error("Job failed");
+                             }),
+                    logic_error);
+    CHECK(runs == 30);
+  }
+}
+
+TEST_CASE("Verify work stealing pool performance") {
+  vector<Instruction> instructions;
+  for (auto i = 0; i < 10000; i++) {
+    instructions.push_back({OpCode::Push, 43});
+    instructions.push_back({OpCode::Push, 42});
+    instructions.push_back({OpCode::Add});
+    instructions.push_back({OpCode::Pop});
+  }
+  const size_t numberOfPrograms = 64;
+
+  ankerl::nanobench::Bench b;
+  b.title(GetCurrentTestName())
+      .relative(true)
+      .batch(numberOfPrograms * instructions.size());
+
+  b.run("Process the programs on this thread", [&] {
+    for (size_t i = 0; i < numberOfPrograms; i++)
+      Process(instructions, Engine::DirectThreaded);
+  });
+
+  WorkStealingPool pool;
+  b.run(format("Process the programs on {} threads", pool.GetNumberOfThreads()),
+        [&] {
+          pool.Run(numberOfPrograms, [&](size_t) {
+            Process(instructions, Engine::DirectThreaded);
+          });
+        });
+}
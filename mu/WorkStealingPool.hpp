@@ -0,0 +1,28 @@
+#pragma once
+
+#include <atomic>
+using std::atomic;
+#include <cstddef>
+#include <functional>
+using std::function;
+
+class WorkStealingPool {
+public:
+  // Zero threads means one for each core.
+  explicit WorkStealingPool(size_t numberOfThreads = 0);
+
+  size_t GetNumberOfThreads() const;
+
+  // Calls job once for each index from zero to numberOfJobs - 1, spread across
+  // the threads, and returns when every job is done. Each thread has its own VM
+  // context, so each job can execute a program. If a job throws, the other jobs
+  // still run, and the first exception is rethrown.
+  void Run(size_t numberOfJobs, const function<void(size_t)>& job);
+
+  // The number of jobs the last run moved from one thread to another.
+  size_t GetNumberOfStolenJobs() const;
+
+private:
+  size_t m_numberOfThreads;
+  atomic<size_t> m_numberOfStolenJobs;
+};
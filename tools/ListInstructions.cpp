@@ -0,0 +1,21 @@
+#include <fmt/core.h>
+using fmt::print;
+
+#include "mu/Bytecode.hpp"
+
+// == List Instructions ==
+//
+// Prints the opcode and the name of each instruction in the instruction
+// registry, one to a line. The superinstruction generator (see
+// generate_superinstructions.py) only fuses the instructions listed here, so it
+// follows the registry rather than the source of the OpCode enumeration. This
+// is built from the registry and the instructions it holds, none of which need
+// the generated superinstructions.
+int main() {
+  for (size_t opCode = 0; opCode < NumberOfOpCodes; opCode++) {
+    auto name = GetInstructionName((OpCode)opCode);
+    if (!name.empty())
+      print("{} {}\n", opCode, name);
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Generates the superinstruction table for decoded μ programs.
+
+The table is derived from a corpus of μtext workloads. Each workload is profiled
+for the frequency of every opcode pair and opcode triple, and the sequences that
+make up a large enough share of the corpus become superinstructions. Only
+instructions in the instruction registry are considered, as listed by the
+mu_instructions tool (tools/ListInstructions.cpp), so a new instruction gets
+fused forms as soon as it is registered and shows up in the corpus.
+
+Usage: generate_superinstructions.py <mu_instructions> <output.hpp>
+           <file.mut>...
+"""
+
+import collections
+import os
+import subprocess
+import sys
+
+# A sequence must make up at least this share of the pairs or triples in the
+# corpus to become a superinstruction.
+MINIMUM_SHARE = 0.05
+
+# The most superinstructions of each length to generate.
+MAXIMUM_PER_LENGTH = 8
+
+SEQUENCE_LENGTHS = (3, 2)
+
+
+def read_registered_opcodes(list_instructions_path):
+    """Maps the name of each registered instruction to its opcode."""
+    result = subprocess.run([list_instructions_path], capture_output=True,
+                            text=True, check=False)
+    if result.returncode != 0:
+        sys.exit(f"error: {list_instructions_path} failed: {result.stderr}")
+    opcodes = {}
+    for line in result.stdout.splitlines():
+        opcode, name = line.split()
+        opcodes[name] = int(opcode)
+    return opcodes
+
+
+def read_mnemonics(mutext_path):
+    with open(mutext_path, encoding="utf-8") as mutext:
+        return [line.split()[0] for line in mutext if line.strip()]
+
+
+def count_sequences(corpus_paths, opcodes, length):
+    counts = collections.Counter()
+    for path in corpus_paths:
+        mnemonics = read_mnemonics(path)
+        for start in range(len(mnemonics) - length + 1):
+            sequence = tuple(mnemonics[start:start + length])
+            if all(mnemonic in opcodes for mnemonic in sequence):
+                counts[sequence] += 1
+    return counts
+
+
+def select_superinstructions(counts):
+    total = sum(counts.values())
+    selected = []
+    for sequence, count in counts.most_common():
+        if len(selected) == MAXIMUM_PER_LENGTH or count < total * MINIMUM_SHARE:
+            break
+        selected.append((sequence, count, count / total))
+    return selected
+
+
+def write_header(output_path, corpus_paths, opcodes, superinstructions):
+    lines = [
+        "// Generated by tools/generate_superinstructions.py. Do not edit.",
+        "//",
+        f"// Profiled {len(corpus_paths)} workloads:",
+    ]
+    lines += [f"//   {os.path.basename(path)}" for path in sorted(corpus_paths)]
+    lines += ["//", "// Superinstruction (count, share of sequences of its length):"]
+    lines += [
+        f"//   {' '.join(sequence)} ({count}, {share:.1%})"
+        for sequence, count, share in superinstructions
+    ]
+    lines += ["", "#pragma once", "", "#define SUPERINSTRUCTIONS(X) \\"]
+    lines += [
+        "  X(" + ", ".join(f"(OpCode){opcodes[name]}" for name in sequence)
+        + f") /* {' '.join(sequence)} */ \\"
+        for sequence, _, _ in superinstructions
+    ]
+    lines += [""]
+
+    contents = "\n".join(lines) + "\n"
+    # Only touch the output when it changes, so unchanged profiles do not cause
+    # a rebuild.
+    if os.path.exists(output_path):
+        with open(output_path, encoding="utf-8") as existing:
+            if existing.read() == contents:
+                return
+    os.makedirs(os.path.dirname(output_path), exist_ok=True)
+    with open(output_path, "w", encoding="utf-8") as output:
+        output.write(contents)
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+
+    opcodes = read_registered_opcodes(sys.argv[1])
+    corpus_paths = sys.argv[3:]
+
+    superinstructions = []
+    for length in SEQUENCE_LENGTHS:
+        counts = count_sequences(corpus_paths, opcodes, length)
+        superinstructions += select_superinstructions(counts)
+
+    write_header(sys.argv[2], corpus_paths, opcodes, superinstructions)
+
+
+if __name__ == "__main__":
+    main()